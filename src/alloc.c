@@ -0,0 +1,326 @@
+#include "alloc.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define ALLOC_COUNT(counter) InterlockedIncrement64((volatile LONG64*)&(counter))
+#define ALLOC_LOAD(counter) InterlockedOr64((volatile LONG64*)&(counter), 0)
+#else
+#define ALLOC_COUNT(counter) __atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+#define ALLOC_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#endif
+
+static void* alloc_default_malloc(void *ctx, size_t size) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void* alloc_default_realloc(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+static void alloc_default_free(void *ctx, void *ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+static alloc_hooks_t g_alloc_hooks = { alloc_default_malloc, alloc_default_realloc, alloc_default_free, NULL };
+static alloc_counters_t g_alloc_counters;
+
+void alloc_set_hooks(const alloc_hooks_t *hooks) {
+    if (hooks) {
+        g_alloc_hooks = *hooks;
+    } else {
+        g_alloc_hooks.malloc_fn = alloc_default_malloc;
+        g_alloc_hooks.realloc_fn = alloc_default_realloc;
+        g_alloc_hooks.free_fn = alloc_default_free;
+        g_alloc_hooks.ctx = NULL;
+    }
+}
+
+void* alloc_malloc(size_t size) {
+    ALLOC_COUNT(g_alloc_counters.allocs);
+    return g_alloc_hooks.malloc_fn(g_alloc_hooks.ctx, size);
+}
+
+void* alloc_calloc(size_t count, size_t size) {
+    if (size && count > (size_t)-1 / size) {
+        return NULL;
+    }
+    void *ptr = alloc_malloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void* alloc_realloc(void *ptr, size_t size) {
+    ALLOC_COUNT(g_alloc_counters.reallocs);
+    return g_alloc_hooks.realloc_fn(g_alloc_hooks.ctx, ptr, size);
+}
+
+void alloc_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    ALLOC_COUNT(g_alloc_counters.frees);
+    g_alloc_hooks.free_fn(g_alloc_hooks.ctx, ptr);
+}
+
+// Over-allocate through the hooks and keep the original pointer just below
+// the aligned address, so any allocator can back aligned buffers
+void* alloc_aligned(size_t size, size_t alignment) {
+    char *raw = (char*)alloc_malloc(size + alignment + sizeof(void*));
+    if (!raw) {
+        return NULL;
+    }
+    uintptr_t addr = ((uintptr_t)(raw + sizeof(void*)) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    ((void**)addr)[-1] = raw;
+    return (void*)addr;
+}
+
+void alloc_free_aligned(void *ptr) {
+    if (ptr) {
+        alloc_free(((void**)ptr)[-1]);
+    }
+}
+
+void alloc_get_counters(alloc_counters_t *counters) {
+    counters->allocs = ALLOC_LOAD(g_alloc_counters.allocs);
+    counters->reallocs = ALLOC_LOAD(g_alloc_counters.reallocs);
+    counters->frees = ALLOC_LOAD(g_alloc_counters.frees);
+}
+
+void alloc_print_counters(const alloc_counters_t *counters, FILE *stream) {
+    fprintf(stream, "allocator: %llu allocations, %llu reallocations, %llu frees\n",
+            counters->allocs, counters->reallocs, counters->frees);
+}
+
+void arena_init(arena_t *arena, size_t block_size) {
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size;
+}
+
+// Make room for 'size' more bytes, starting a new block if needed
+static int arena_reserve(arena_t *arena, size_t size) {
+    if (arena->block_count > 0 && arena->used + size <= arena->block_size) {
+        return 0;
+    }
+    if (arena->block_count == arena->block_capacity) {
+        size_t capacity = arena->block_capacity ? arena->block_capacity * 2 : 16;
+        char **blocks = (char**)alloc_realloc(arena->blocks, capacity * sizeof(char*));
+        if (!blocks) {
+            return -1;
+        }
+        arena->blocks = blocks;
+        arena->block_capacity = capacity;
+    }
+    size_t block_size = size > arena->block_size ? size : arena->block_size;
+    char *block = (char*)alloc_malloc(block_size);
+    if (!block) {
+        return -1;
+    }
+    arena->blocks[arena->block_count++] = block;
+    arena->used = 0;
+    arena->bytes += block_size;
+    return 0;
+}
+
+void* arena_alloc(arena_t *arena, size_t size) {
+    // Round up so the next allocation stays aligned too
+    const size_t align = sizeof(void*) > sizeof(double) ? sizeof(void*) : sizeof(double);
+    size = (size + align - 1) & ~(align - 1);
+    if (arena_reserve(arena, size) != 0) {
+        return NULL;
+    }
+    char *ptr = arena->blocks[arena->block_count - 1] + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+void* arena_alloc_at(arena_t *arena, size_t size, uint64_t *offset) {
+    if (arena_reserve(arena, size) != 0) {
+        return NULL;
+    }
+    *offset = ((uint64_t)(arena->block_count - 1) << 32) | arena->used;
+    char *ptr = arena->blocks[arena->block_count - 1] + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+void* arena_at(const arena_t *arena, uint64_t offset) {
+    return arena->blocks[offset >> 32] + (offset & 0xffffffffu);
+}
+
+char* arena_strdup(arena_t *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char*)arena_alloc(arena, len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+void arena_free(arena_t *arena) {
+    for (size_t i = 0; i < arena->block_count; i++) {
+        alloc_free(arena->blocks[i]);
+    }
+    alloc_free(arena->blocks);
+    size_t block_size = arena->block_size;
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size;
+}
+
+// Size classes start at one page and then come four to each doubling, so a
+// buffer is at most a quarter larger than asked for
+#define BUFFER_POOL_MIN_SHIFT 12
+#define BUFFER_POOL_STEPS 4
+#define BUFFER_POOL_CLASSES (1 + 40 * BUFFER_POOL_STEPS)
+
+struct buffer_pool {
+    platform_mutex_t lock;
+    void *free_lists[BUFFER_POOL_CLASSES];     // Linked through the buffers' first bytes
+    size_t retained;                            // Bytes on the free lists
+    size_t outstanding;                         // Bytes acquired and not yet released
+    size_t retain_limit;
+};
+
+// Class that holds 'size' bytes, and the size of its buffers.
+// Returns BUFFER_POOL_CLASSES if 'size' is larger than every class.
+static unsigned buffer_pool_class(size_t size, size_t *class_size) {
+    size_t base = (size_t)1 << BUFFER_POOL_MIN_SHIFT;
+    if (size <= base) {
+        *class_size = base;
+        return 0;
+    }
+    unsigned k = 1;
+    while (k < BUFFER_POOL_CLASSES) {
+        size_t step = base / BUFFER_POOL_STEPS;
+        for (unsigned i = 1; i <= BUFFER_POOL_STEPS; i++, k++) {
+            if (base + i * step >= size) {
+                *class_size = base + i * step;
+                return k;
+            }
+        }
+        if (base > (size_t)-1 / 2) {
+            break;
+        }
+        base *= 2;
+    }
+    return BUFFER_POOL_CLASSES;
+}
+
+// Size of the buffers of class 'k'
+static void buffer_pool_class_size_at(unsigned k, size_t *class_size) {
+    size_t base = (size_t)1 << BUFFER_POOL_MIN_SHIFT;
+    if (k > 0) {
+        base <<= (k - 1) / BUFFER_POOL_STEPS;
+        base += (base / BUFFER_POOL_STEPS) * ((k - 1) % BUFFER_POOL_STEPS + 1);
+    }
+    *class_size = base;
+}
+
+buffer_pool_t* buffer_pool_create(size_t retain_limit) {
+    buffer_pool_t *pool = (buffer_pool_t*)alloc_calloc(1, sizeof(buffer_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    platform_mutex_init(&pool->lock);
+    pool->retain_limit = retain_limit;
+    return pool;
+}
+
+void* buffer_pool_acquire(buffer_pool_t *pool, size_t size, size_t *capacity) {
+    size_t class_size;
+    unsigned k = buffer_pool_class(size, &class_size);
+    if (k == BUFFER_POOL_CLASSES) {
+        return NULL; // Beyond the largest class
+    }
+
+    platform_mutex_lock(&pool->lock);
+    void *buffer = pool->free_lists[k];
+    void *trimmed = NULL;
+    if (buffer) {
+        pool->free_lists[k] = *(void**)buffer;
+        pool->retained -= class_size;
+    } else {
+        // A new buffer is needed. Give back kept buffers of other sizes,
+        // largest first, so the pool as a whole stays within its limit.
+        for (unsigned j = BUFFER_POOL_CLASSES; j-- > 0 && pool->retained > 0 &&
+             pool->retained + pool->outstanding + class_size > pool->retain_limit; ) {
+            if (!pool->free_lists[j]) {
+                continue;
+            }
+            size_t victim_size;
+            buffer_pool_class_size_at(j, &victim_size);
+            while (pool->free_lists[j] && pool->retained + pool->outstanding + class_size > pool->retain_limit) {
+                void *victim = pool->free_lists[j];
+                pool->free_lists[j] = *(void**)victim;
+                pool->retained -= victim_size;
+                *(void**)victim = trimmed;
+                trimmed = victim;
+            }
+        }
+    }
+    pool->outstanding += class_size;
+    platform_mutex_unlock(&pool->lock);
+
+    while (trimmed) {
+        void *next = *(void**)trimmed;
+        alloc_free_aligned(trimmed);
+        trimmed = next;
+    }
+    if (!buffer) {
+        buffer = alloc_aligned(class_size, BUFFER_POOL_ALIGNMENT);
+        if (!buffer) {
+            platform_mutex_lock(&pool->lock);
+            pool->outstanding -= class_size;
+            platform_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+    }
+    *capacity = class_size;
+    return buffer;
+}
+
+size_t buffer_pool_capacity(size_t size) {
+    size_t class_size;
+    return buffer_pool_class(size, &class_size) == BUFFER_POOL_CLASSES ? 0 : class_size;
+}
+
+void buffer_pool_release(buffer_pool_t *pool, void *buffer, size_t capacity) {
+    if (!buffer) {
+        return;
+    }
+    size_t class_size;
+    unsigned k = buffer_pool_class(capacity, &class_size);
+    platform_mutex_lock(&pool->lock);
+    pool->outstanding -= capacity;
+    if (pool->retained + pool->outstanding + capacity <= pool->retain_limit) {
+        *(void**)buffer = pool->free_lists[k];
+        pool->free_lists[k] = buffer;
+        pool->retained += capacity;
+        buffer = NULL;
+    }
+    platform_mutex_unlock(&pool->lock);
+    alloc_free_aligned(buffer); // Over the limit: really free it
+}
+
+void buffer_pool_destroy(buffer_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+    for (unsigned k = 0; k < BUFFER_POOL_CLASSES; k++) {
+        void *buffer = pool->free_lists[k];
+        while (buffer) {
+            void *next = *(void**)buffer;
+            alloc_free_aligned(buffer);
+            buffer = next;
+        }
+    }
+    platform_mutex_destroy(&pool->lock);
+    alloc_free(pool);
+}
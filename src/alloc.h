@@ -0,0 +1,107 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Allocator used for everything the library allocates. Embedders can install
+// their own before the first call into the library; by default the C
+// library's malloc, realloc and free are used.
+typedef struct {
+    void* (*malloc_fn)(void *ctx, size_t size);
+    void* (*realloc_fn)(void *ctx, void *ptr, size_t size);
+    void  (*free_fn)(void *ctx, void *ptr);
+    void *ctx;
+} alloc_hooks_t;
+
+// Install 'hooks', or the default allocator if NULL. Not thread-safe; call
+// it while nothing is allocated through the old hooks any more.
+void alloc_set_hooks(const alloc_hooks_t *hooks);
+
+void* alloc_malloc(size_t size);
+void* alloc_calloc(size_t count, size_t size);
+void* alloc_realloc(void *ptr, size_t size);
+void alloc_free(void *ptr);
+
+// Allocate 'size' bytes aligned to 'alignment' (a power of two).
+// Free with alloc_free_aligned.
+void* alloc_aligned(size_t size, size_t alignment);
+void alloc_free_aligned(void *ptr);
+
+// Running totals of calls into the allocator, for checking that a hot path
+// does not allocate once it has warmed up.
+typedef struct {
+    unsigned long long allocs;      // malloc, calloc and aligned allocations
+    unsigned long long reallocs;
+    unsigned long long frees;
+} alloc_counters_t;
+
+void alloc_get_counters(alloc_counters_t *counters);
+
+// Print 'counters' as a one-line report.
+void alloc_print_counters(const alloc_counters_t *counters, FILE *stream);
+
+// Bump allocator for metadata that lives as long as a run. Memory comes in
+// blocks that never move and is only given back all at once by arena_free.
+// Allocations larger than a block get a block of their own.
+typedef struct {
+    char **blocks;
+    size_t block_count;
+    size_t block_capacity;
+    size_t block_size;
+    size_t used;                // Bytes used in the last block
+    size_t bytes;               // Bytes allocated for all blocks
+} arena_t;
+
+// Start an empty arena with blocks of 'block_size' bytes.
+void arena_init(arena_t *arena, size_t block_size);
+
+// Allocate 'size' bytes aligned for any type. Returns NULL when out of memory.
+void* arena_alloc(arena_t *arena, size_t size);
+
+// Allocate 'size' bytes with no alignment and also return their position as
+// an offset (block number in the upper 32 bits) for arena_at.
+void* arena_alloc_at(arena_t *arena, size_t size, uint64_t *offset);
+
+// Address of an offset returned by arena_alloc_at.
+void* arena_at(const arena_t *arena, uint64_t offset);
+
+// Copy a string into the arena. Returns NULL when out of memory.
+char* arena_strdup(arena_t *arena, const char *str);
+
+// Free every block.
+void arena_free(arena_t *arena);
+
+// Alignment of buffers handed out by a buffer pool.
+#define BUFFER_POOL_ALIGNMENT 4096
+
+// Thread-safe pool of aligned I/O buffers. Requests are rounded up to a size
+// class (one page, then four classes to each doubling); a released buffer
+// goes back on the free list of its class and is handed out again instead of
+// allocating a new one.
+typedef struct buffer_pool buffer_pool_t;
+
+// Create a pool that keeps released buffers for reuse while they and the
+// buffers in use add up to no more than 'retain_limit' bytes. Kept buffers of
+// other sizes are freed to make room before a new one is allocated.
+// Returns NULL on failure.
+buffer_pool_t* buffer_pool_create(size_t retain_limit);
+
+// Get a buffer of at least 'size' bytes. Its real size is stored in
+// '*capacity' and must be passed back to buffer_pool_release.
+// Returns NULL when out of memory.
+void* buffer_pool_acquire(buffer_pool_t *pool, size_t size, size_t *capacity);
+
+// Size of the buffer buffer_pool_acquire hands out for 'size' bytes, or 0 if
+// 'size' is too large for any pool buffer.
+size_t buffer_pool_capacity(size_t size);
+
+// Give a buffer back. NULL is ignored.
+void buffer_pool_release(buffer_pool_t *pool, void *buffer, size_t capacity);
+
+// Free the pool and every buffer it holds. Buffers still acquired must have
+// been released.
+void buffer_pool_destroy(buffer_pool_t *pool);
+
+#endif // ALLOC_H
@@ -0,0 +1,430 @@
+#include "batch_read.h"
+#include "platform.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef MAKEFSDATA_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Submission and completion rings shared with the kernel
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+} batch_ring_t;
+
+// Operations are tagged with the file slot and the step they belong to
+#define BATCH_OP_OPEN  0
+#define BATCH_OP_STATX 1
+#define BATCH_OP_READ  2
+#define BATCH_OP_CLOSE 3
+#define BATCH_TAG(slot, op) (((unsigned long long)(slot) << 2) | (op))
+
+// Largest single read request; anything beyond is finished with pread
+#define BATCH_READ_MAX_LEN (1u << 30)
+#endif
+
+// Per-file state, reused from batch to batch
+typedef struct {
+    batch_file_t file;
+    size_t capacity;
+#ifdef MAKEFSDATA_HAVE_IO_URING
+    int fd;
+    int open_res;
+    int statx_res;
+    struct statx stx;
+#endif
+} batch_slot_t;
+
+struct batch_reader {
+    size_t window;
+    size_t count;
+    batch_slot_t *slots;
+    int use_io_uring;
+#ifdef MAKEFSDATA_HAVE_IO_URING
+    batch_ring_t ring;
+#endif
+};
+
+// Make sure the slot buffer can hold 'size' bytes
+static int batch_slot_reserve(batch_slot_t *slot, size_t size) {
+    if (size <= slot->capacity && slot->file.data) {
+        return 0;
+    }
+    size_t capacity = size ? size : 1;
+    unsigned char *data = (unsigned char*)alloc_realloc(slot->file.data, capacity);
+    if (!data) {
+        return -1;
+    }
+    slot->file.data = data;
+    slot->capacity = capacity;
+    return 0;
+}
+
+// Synchronous path: read each file to the end with stdio
+static void batch_read_sync(batch_slot_t *slot, const char *path) {
+    slot->file.size = 0;
+    slot->file.error = 0;
+
+    platform_file_handle fh = platform_fopen(path, "rb");
+    if (!fh) {
+        slot->file.error = -1;
+        return;
+    }
+
+    for (;;) {
+        if (slot->file.size == slot->capacity || !slot->file.data) {
+            if (batch_slot_reserve(slot, slot->capacity ? slot->capacity * 2 : 4096) != 0) {
+                slot->file.error = -1;
+                break;
+            }
+        }
+        size_t n = platform_fread(slot->file.data + slot->file.size, 1, slot->capacity - slot->file.size, fh);
+        slot->file.size += n;
+        if (n == 0) {
+            if (ferror(fh)) {
+                slot->file.error = -1;
+            }
+            break;
+        }
+    }
+    platform_fclose(fh);
+}
+
+#ifdef MAKEFSDATA_HAVE_IO_URING
+
+static int batch_ring_setup(batch_ring_t *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return -1; // ENOSYS, EPERM under seccomp, ...
+    }
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len) {
+            ring->sq_len = ring->cq_len;
+        }
+        ring->cq_len = ring->sq_len;
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            munmap(ring->sq_ptr, ring->sq_len);
+            close(fd);
+            return -1;
+        }
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ptr != ring->sq_ptr) {
+            munmap(ring->cq_ptr, ring->cq_len);
+        }
+        munmap(ring->sq_ptr, ring->sq_len);
+        close(fd);
+        return -1;
+    }
+
+    char *sq = (char*)ring->sq_ptr;
+    char *cq = (char*)ring->cq_ptr;
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void batch_ring_teardown(batch_ring_t *ring) {
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+// Queue an operation. Each step submits and drains the whole ring, and the
+// ring has room for two operations per slot, so it never fills up.
+static struct io_uring_sqe* batch_ring_sqe(batch_ring_t *ring, unsigned char opcode, unsigned long long user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// Submit 'submit' queued operations and hand each completion to the slots.
+// The kernel may take only some of them per call; it then returns without
+// waiting, and the rest are submitted on the next call.
+// Returns 0 on success, nonzero if io_uring_enter itself failed.
+static int batch_ring_run(batch_reader_t *br, unsigned submit) {
+    batch_ring_t *ring = &br->ring;
+    unsigned submitted = 0;
+    unsigned done = 0;
+
+    while (done < submit) {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, submit - submitted, submit - done, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN) {
+            return -1;
+        }
+        if (ret > 0) {
+            submitted += (unsigned)ret;
+        }
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, done++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            batch_slot_t *slot = &br->slots[cqe->user_data >> 2];
+            switch (cqe->user_data & 3) {
+            case BATCH_OP_OPEN:
+                slot->open_res = cqe->res;
+                slot->fd = cqe->res >= 0 ? cqe->res : -1;
+                break;
+            case BATCH_OP_STATX:
+                slot->statx_res = cqe->res;
+                break;
+            case BATCH_OP_READ:
+                if (cqe->res < 0) {
+                    slot->file.error = -1;
+                } else {
+                    slot->file.size = (size_t)cqe->res;
+                }
+                break;
+            case BATCH_OP_CLOSE:
+                slot->fd = -1;
+                break;
+            default:
+                break;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Close what the batch still has open, before giving up on io_uring for it
+static int batch_read_abandon(batch_reader_t *br) {
+    for (size_t k = 0; k < br->count; k++) {
+        if (br->slots[k].fd >= 0) {
+            close(br->slots[k].fd);
+            br->slots[k].fd = -1;
+        }
+    }
+    return -1;
+}
+
+// io_uring path: one batch each of opens+statx, reads, and closes.
+// Returns 0 on success, nonzero if io_uring cannot be used for this batch.
+static int batch_read_uring(batch_reader_t *br, const file_info_t *files, const size_t *indices) {
+    batch_ring_t *ring = &br->ring;
+    unsigned queued = 0;
+
+    for (size_t k = 0; k < br->count; k++) {
+        batch_slot_t *slot = &br->slots[k];
+        const char *path = files[indices[k]].path;
+        slot->fd = -1;
+        slot->open_res = 0;
+        slot->statx_res = 0;
+
+        struct io_uring_sqe *sqe = batch_ring_sqe(ring, IORING_OP_OPENAT, BATCH_TAG(k, BATCH_OP_OPEN));
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long long)(uintptr_t)path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+        sqe = batch_ring_sqe(ring, IORING_OP_STATX, BATCH_TAG(k, BATCH_OP_STATX));
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long long)(uintptr_t)path;
+        sqe->len = STATX_SIZE;
+        sqe->addr2 = (unsigned long long)(uintptr_t)&slot->stx;
+        queued += 2;
+    }
+    if (batch_ring_run(br, queued) != 0) {
+        return batch_read_abandon(br);
+    }
+
+    // Kernels without these opcodes answer -EINVAL; use the synchronous path then
+    for (size_t k = 0; k < br->count; k++) {
+        if (br->slots[k].open_res == -EINVAL || br->slots[k].statx_res == -EINVAL) {
+            return batch_read_abandon(br);
+        }
+    }
+
+    queued = 0;
+    for (size_t k = 0; k < br->count; k++) {
+        batch_slot_t *slot = &br->slots[k];
+        if (slot->fd < 0 || slot->statx_res < 0) {
+            slot->file.error = -1;
+            continue;
+        }
+        if (batch_slot_reserve(slot, (size_t)slot->stx.stx_size) != 0) {
+            slot->file.error = -1;
+            continue;
+        }
+        if (slot->stx.stx_size == 0) {
+            continue;
+        }
+        struct io_uring_sqe *sqe = batch_ring_sqe(ring, IORING_OP_READ, BATCH_TAG(k, BATCH_OP_READ));
+        sqe->fd = slot->fd;
+        sqe->addr = (unsigned long long)(uintptr_t)slot->file.data;
+        sqe->len = slot->stx.stx_size > BATCH_READ_MAX_LEN ? BATCH_READ_MAX_LEN : (unsigned)slot->stx.stx_size;
+        sqe->off = 0;
+        queued++;
+    }
+    if (batch_ring_run(br, queued) != 0) {
+        return batch_read_abandon(br);
+    }
+
+    queued = 0;
+    for (size_t k = 0; k < br->count; k++) {
+        batch_slot_t *slot = &br->slots[k];
+        if (slot->fd < 0) {
+            continue;
+        }
+        // A short read means the file changed under us; finish it synchronously
+        while (!slot->file.error && slot->file.size < (size_t)slot->stx.stx_size) {
+            ssize_t n = pread(slot->fd, slot->file.data + slot->file.size,
+                              (size_t)slot->stx.stx_size - slot->file.size, (off_t)slot->file.size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            slot->file.size += (size_t)n;
+        }
+        struct io_uring_sqe *sqe = batch_ring_sqe(ring, IORING_OP_CLOSE, BATCH_TAG(k, BATCH_OP_CLOSE));
+        sqe->fd = slot->fd;
+        queued++;
+    }
+    // Each completed close clears its fd, so only the rest are closed here
+    if (batch_ring_run(br, queued) != 0) {
+        return batch_read_abandon(br);
+    }
+    return 0;
+}
+
+#endif // MAKEFSDATA_HAVE_IO_URING
+
+batch_reader_t* batch_reader_create(size_t window, int use_io_uring) {
+    batch_reader_t *br = (batch_reader_t*)alloc_malloc(sizeof(batch_reader_t));
+    if (!br) {
+        return NULL;
+    }
+    memset(br, 0, sizeof(*br));
+    br->window = window ? window : BATCH_READ_WINDOW;
+    br->slots = (batch_slot_t*)alloc_calloc(br->window, sizeof(batch_slot_t));
+    if (!br->slots) {
+        alloc_free(br);
+        return NULL;
+    }
+
+#ifdef MAKEFSDATA_HAVE_IO_URING
+    // Fall back to the synchronous path if the kernel refuses io_uring
+    if (use_io_uring && batch_ring_setup(&br->ring, (unsigned)br->window * 2) == 0) {
+        br->use_io_uring = 1;
+    }
+#else
+    (void)use_io_uring;
+#endif
+    return br;
+}
+
+int batch_reader_uses_io_uring(const batch_reader_t *br) {
+    return br->use_io_uring;
+}
+
+int batch_reader_read(batch_reader_t *br, const file_info_t *files, const size_t *indices, size_t count) {
+    if (!br || !files || (!indices && count) || count > br->window) {
+        return -1;
+    }
+    br->count = count;
+    for (size_t k = 0; k < count; k++) {
+        br->slots[k].file.index = indices[k];
+        br->slots[k].file.size = 0;
+        br->slots[k].file.error = 0;
+    }
+
+#ifdef MAKEFSDATA_HAVE_IO_URING
+    if (br->use_io_uring) {
+        if (batch_read_uring(br, files, indices) == 0) {
+            return 0;
+        }
+        // io_uring is not usable here after all; stay synchronous from now on
+        batch_ring_teardown(&br->ring);
+        br->use_io_uring = 0;
+        for (size_t k = 0; k < count; k++) {
+            br->slots[k].file.size = 0;
+            br->slots[k].file.error = 0;
+        }
+    }
+#endif
+
+    for (size_t k = 0; k < count; k++) {
+        batch_read_sync(&br->slots[k], files[indices[k]].path);
+    }
+    return 0;
+}
+
+const batch_file_t* batch_reader_file(const batch_reader_t *br, size_t k) {
+    return &br->slots[k].file;
+}
+
+void batch_reader_destroy(batch_reader_t *br) {
+    if (!br) {
+        return;
+    }
+#ifdef MAKEFSDATA_HAVE_IO_URING
+    if (br->use_io_uring) {
+        batch_ring_teardown(&br->ring);
+    }
+#endif
+    for (size_t k = 0; k < br->window; k++) {
+        alloc_free(br->slots[k].file.data);
+    }
+    alloc_free(br->slots);
+    alloc_free(br);
+}
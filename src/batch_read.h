@@ -0,0 +1,44 @@
+#ifndef BATCH_READ_H
+#define BATCH_READ_H
+
+#include <stddef.h>
+#include "file_list.h"
+
+// Number of files loaded per batch.
+#define BATCH_READ_WINDOW 64
+
+// One loaded file. 'data' belongs to the reader and stays valid until the
+// next batch_reader_read call.
+typedef struct {
+    size_t index;           // Index of the entry in 'files'
+    unsigned char *data;
+    size_t size;
+    int error;              // 0 on success, nonzero if the file could not be read
+} batch_file_t;
+
+// Reads small files a window at a time. On Linux builds with io_uring, the
+// opens, statx calls, reads and closes of a window are each submitted as one
+// batch. Otherwise, or if io_uring is unavailable at runtime, files are read
+// one after another with stdio.
+typedef struct batch_reader batch_reader_t;
+
+// Create a reader for up to 'window' files per batch (0 selects
+// BATCH_READ_WINDOW). If 'use_io_uring' is zero the synchronous path is used.
+// Returns NULL on failure.
+batch_reader_t* batch_reader_create(size_t window, int use_io_uring);
+
+// Returns nonzero if the reader is currently using io_uring.
+int batch_reader_uses_io_uring(const batch_reader_t *br);
+
+// Load the entries of 'files' named by 'indices' (at most the window size).
+// Returns 0 if the batch was processed; per-file failures are reported in
+// each batch_file_t. Returns nonzero on invalid arguments or out of memory.
+int batch_reader_read(batch_reader_t *br, const file_info_t *files, const size_t *indices, size_t count);
+
+// The k-th file of the last batch, in the order of 'indices'.
+const batch_file_t* batch_reader_file(const batch_reader_t *br, size_t k);
+
+// Free the reader and its buffers.
+void batch_reader_destroy(batch_reader_t *br);
+
+#endif // BATCH_READ_H
@@ -0,0 +1,213 @@
+#include "chksum.h"
+#include "alloc.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHKSUM_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// The kernels add little-endian 32-bit words into 64-bit lanes. Since
+// 2^16 = 1 in one's complement arithmetic, folding that total gives the sum
+// of the little-endian 16-bit words, which is the byte-swapped sum of the
+// big-endian words. An odd last byte is then the low byte of its word.
+typedef uint64_t (*chksum_fn)(const unsigned char *data, size_t len);
+
+// Add the bytes after the last whole 8-byte word
+static uint64_t chksum_tail(const unsigned char *data, size_t len) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 2 <= len; i += 2) {
+        sum += (uint64_t)data[i] | (uint64_t)data[i + 1] << 8;
+    }
+    if (i < len) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static uint64_t chksum_scalar(const unsigned char *data, size_t len) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint32_t w[2];
+        memcpy(w, data + i, 8);
+        sum += (uint64_t)w[0] + w[1];
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // Words were loaded big-endian; fold and swap them to match the tail
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    sum = (uint64_t)(((sum & 0xFF) << 8) | (sum >> 8));
+#endif
+    return sum + chksum_tail(data + i, len - i);
+}
+
+#ifdef CHKSUM_HAVE_X86_KERNELS
+
+__attribute__((target("sse2")))
+static uint64_t chksum_sse2(const unsigned char *data, size_t len) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i b = zero;
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i w = _mm_loadu_si128((const __m128i*)(data + i + 16));
+        a = _mm_add_epi64(a, _mm_add_epi64(_mm_unpacklo_epi32(v, zero), _mm_unpackhi_epi32(v, zero)));
+        b = _mm_add_epi64(b, _mm_add_epi64(_mm_unpacklo_epi32(w, zero), _mm_unpackhi_epi32(w, zero)));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(a, b));
+    return lanes[0] + lanes[1] + chksum_scalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t chksum_avx2(const unsigned char *data, size_t len) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a = zero;
+    __m256i b = zero;
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        __m256i w = _mm256_loadu_si256((const __m256i*)(data + i + 32));
+        a = _mm256_add_epi64(a, _mm256_add_epi64(_mm256_unpacklo_epi32(v, zero), _mm256_unpackhi_epi32(v, zero)));
+        b = _mm256_add_epi64(b, _mm256_add_epi64(_mm256_unpacklo_epi32(w, zero), _mm256_unpackhi_epi32(w, zero)));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(a, b));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + chksum_sse2(data + i, len - i);
+}
+
+#endif // CHKSUM_HAVE_X86_KERNELS
+
+static chksum_kernel_t g_kernel = CHKSUM_KERNEL_SCALAR;
+static chksum_fn g_chksum = chksum_scalar;
+
+int chksum_kernel_supported(chksum_kernel_t kernel) {
+    switch (kernel) {
+    case CHKSUM_KERNEL_AUTO:
+    case CHKSUM_KERNEL_SCALAR:
+        return 1;
+#ifdef CHKSUM_HAVE_X86_KERNELS
+    case CHKSUM_KERNEL_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case CHKSUM_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+int chksum_set_kernel(chksum_kernel_t kernel) {
+    if (kernel == CHKSUM_KERNEL_AUTO) {
+        kernel = CHKSUM_KERNEL_SCALAR;
+        for (int k = CHKSUM_KERNEL_AVX2; k > CHKSUM_KERNEL_SCALAR; k--) {
+            if (chksum_kernel_supported((chksum_kernel_t)k)) {
+                kernel = (chksum_kernel_t)k;
+                break;
+            }
+        }
+    }
+    if (!chksum_kernel_supported(kernel)) {
+        return -1;
+    }
+
+    switch (kernel) {
+#ifdef CHKSUM_HAVE_X86_KERNELS
+    case CHKSUM_KERNEL_SSE2:
+        g_chksum = chksum_sse2;
+        break;
+    case CHKSUM_KERNEL_AVX2:
+        g_chksum = chksum_avx2;
+        break;
+#endif
+    default:
+        g_chksum = chksum_scalar;
+        break;
+    }
+    g_kernel = kernel;
+    return 0;
+}
+
+chksum_kernel_t chksum_get_kernel(void) {
+    return g_kernel;
+}
+
+const char* chksum_kernel_name(chksum_kernel_t kernel) {
+    switch (kernel) {
+    case CHKSUM_KERNEL_AUTO:   return "auto";
+    case CHKSUM_KERNEL_SCALAR: return "scalar";
+    case CHKSUM_KERNEL_SSE2:   return "sse2";
+    case CHKSUM_KERNEL_AVX2:   return "avx2";
+    default:                   return "unknown";
+    }
+}
+
+static uint16_t chksum_swap(uint16_t v) {
+    return (uint16_t)((v << 8) | (v >> 8));
+}
+
+static uint16_t chksum_fold(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+uint16_t chksum_sum(const void *data, size_t len) {
+    return chksum_swap(chksum_fold(g_chksum((const unsigned char*)data, len)));
+}
+
+uint16_t chksum_combine(uint16_t a, uint16_t b, size_t offset) {
+    // A piece starting at an odd offset has its bytes in the other halves
+    return chksum_fold((uint64_t)a + (offset % 2 ? chksum_swap(b) : b));
+}
+
+void chksum_segments_init(chksum_segments_t *s, size_t mss) {
+    memset(s, 0, sizeof(*s));
+    s->mss = mss;
+}
+
+// Store the sum of the current segment and start the next one
+static int chksum_segments_close(chksum_segments_t *s) {
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity ? s->capacity * 2 : 16;
+        uint16_t *sums = (uint16_t*)alloc_realloc(s->sums, capacity * sizeof(uint16_t));
+        if (!sums) {
+            return -1;
+        }
+        s->sums = sums;
+        s->capacity = capacity;
+    }
+    s->sums[s->count++] = s->sum;
+    s->sum = 0;
+    s->used = 0;
+    return 0;
+}
+
+int chksum_segments_add(chksum_segments_t *s, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    while (len > 0) {
+        size_t n = s->mss - s->used < len ? s->mss - s->used : len;
+        s->sum = chksum_combine(s->sum, chksum_sum(p, n), s->used);
+        s->used += n;
+        p += n;
+        len -= n;
+        if (s->used == s->mss && chksum_segments_close(s) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int chksum_segments_finish(chksum_segments_t *s) {
+    return s->used > 0 ? chksum_segments_close(s) : 0;
+}
+
+void chksum_segments_free(chksum_segments_t *s) {
+    alloc_free(s->sums);
+    memset(s, 0, sizeof(*s));
+}
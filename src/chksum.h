@@ -0,0 +1,63 @@
+#ifndef CHKSUM_H
+#define CHKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Internet checksum (RFC 1071) kernels. Vector kernels are only built for
+// x86 with GCC/Clang, like the hex encoders.
+typedef enum {
+    CHKSUM_KERNEL_AUTO = 0,     // Best kernel supported by this CPU
+    CHKSUM_KERNEL_SCALAR,       // 8 bytes per step, works everywhere
+    CHKSUM_KERNEL_SSE2,         // 32 bytes per step
+    CHKSUM_KERNEL_AVX2,         // 64 bytes per step
+} chksum_kernel_t;
+
+// Returns nonzero if 'kernel' is built in and supported by this CPU.
+int chksum_kernel_supported(chksum_kernel_t kernel);
+
+// Select the kernel used by chksum_sum(). CHKSUM_KERNEL_AUTO picks the best
+// one. Not thread-safe; call before starting any workers.
+// Returns 0 on success, nonzero if the kernel is not supported.
+int chksum_set_kernel(chksum_kernel_t kernel);
+
+// Returns the kernel currently in use.
+chksum_kernel_t chksum_get_kernel(void);
+
+// Returns a printable name for 'kernel'.
+const char* chksum_kernel_name(chksum_kernel_t kernel);
+
+// One's complement sum of 'len' bytes taken as big-endian 16-bit words, an
+// odd last byte padded with a zero, folded to 16 bits. Not inverted, so it
+// is what a TCP stack adds for the payload.
+uint16_t chksum_sum(const void *data, size_t len);
+
+// Sum of two pieces of one run of bytes, where 'b' starts 'offset' bytes
+// after 'a' did.
+uint16_t chksum_combine(uint16_t a, uint16_t b, size_t offset);
+
+// Sums of consecutive segments of 'mss' bytes (the last one may be shorter)
+// of bytes that arrive in pieces of any size.
+typedef struct {
+    size_t mss;
+    size_t used;            // Bytes in the current segment so far
+    uint16_t sum;           // Of the current segment
+    uint16_t *sums;         // One per finished segment
+    size_t count;
+    size_t capacity;
+} chksum_segments_t;
+
+// Start with no bytes. 'mss' must be at least 1.
+void chksum_segments_init(chksum_segments_t *s, size_t mss);
+
+// Add the next 'len' bytes. Returns nonzero if out of memory.
+int chksum_segments_add(chksum_segments_t *s, const void *data, size_t len);
+
+// Close the last segment if it holds any bytes. Returns nonzero if out of
+// memory. s->sums then has s->count entries.
+int chksum_segments_finish(chksum_segments_t *s);
+
+// Free the sums.
+void chksum_segments_free(chksum_segments_t *s);
+
+#endif // CHKSUM_H
@@ -1,5 +1,6 @@
 #include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // Print usage instructions
@@ -7,15 +8,70 @@ static void print_usage(const char *program_name) {
     printf("Usage: %s [options]\n", program_name);
     printf("Options:\n");
     printf(" --input <dir>     Specify the input directory of web files.\n");
-    printf(" --output <file>   Specify the output file for fsdata (e.g., fsdata.c).\n");
+    printf(" --output <file>   Specify the output file for fsdata (e.g., fsdata.c), or -\n");
+    printf("                   to write it to stdout (stream writer only).\n");
     printf(" --recursive       Recurse into subdirectories.\n");
+    printf(" --io <backend>    Input backend: auto, stdio, read or mmap (default: auto).\n");
+    printf(" --jobs <n>        Number of scan and conversion threads (default: one per CPU core).\n");
+    printf(" --max-memory <n>  Memory budget for conversion buffers, in bytes or with a\n");
+    printf("                   K, M or G suffix (default: 512M). Larger files are streamed.\n");
+    printf(" --keep-alive      Bake HTTP/1.1 headers that keep the connection open into\n");
+    printf("                   the files, instead of HTTP/1.0 with Connection: close.\n");
+    printf(" --precalc-chksum  Precalculate the TCP checksum of every segment of each\n");
+    printf("                   response, for HTTPD_PRECALCULATED_CHECKSUM.\n");
+    printf(" --mss <n>         Segment size for --precalc-chksum (default: 1460).\n");
+    printf(" --gzip            Serve files gzip compressed where that saves space. A file\n");
+    printf("                   with a .gz next to it is served as that file instead.\n");
+    printf(" --gzip-min-saving <percent>\n");
+    printf("                   Share of a file --gzip has to save to keep it compressed\n");
+    printf("                   (default: 5).\n");
+    printf(" --writer <mode>   stream: write the output in order as files are found (default).\n");
+    printf("                   positional: lay out the output file up front and write\n");
+    printf("                   all files into it in parallel.\n");
+    printf("                   null: convert but discard the output, for timing.\n");
+    printf(" --no-prefetch     Do not ask the OS to read upcoming files ahead, or to drop\n");
+    printf("                   files read cold from the page cache afterwards.\n");
+    printf(" --stats           Print per-stage pipeline statistics to stderr.\n");
     printf(" --help            Show this help message and exit.\n"); 
 }
 
+// Match a backend name against the names platform.c reports
+static bool parse_input_strategy(const char *name, platform_input_strategy *strategy) {
+    for (int s = PLATFORM_INPUT_AUTO; s <= PLATFORM_INPUT_MMAP; s++) {
+        if (strcmp(name, platform_input_strategy_name((platform_input_strategy)s)) == 0) {
+            *strategy = (platform_input_strategy)s;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parse a byte count with an optional K, M or G suffix (powers of 1024)
+static bool parse_size(const char *text, size_t *size) {
+    char *end = NULL;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text || text[0] == '-') {
+        return false;
+    }
+    unsigned shift = 0;
+    switch (*end) {
+    case 'K': case 'k': shift = 10; end++; break;
+    case 'M': case 'm': shift = 20; end++; break;
+    case 'G': case 'g': shift = 30; end++; break;
+    default: break;
+    }
+    if (*end != '\0' || value == 0 || value > ((unsigned long long)(size_t)-1 >> shift)) {
+        return false;
+    }
+    *size = (size_t)(value << shift);
+    return true;
+}
+
 // Simple custom argument parser
 bool parse_args(int argc, char **argv, config_t *config) {
     // Set defautls
     memset(config, 0, sizeof(*config));
+    config->gzip_min_saving = -1;
     // You can set default paths or leave them empty for mandatory argument
 
     for (int i = 1; i < argc; i++) {
@@ -38,6 +94,91 @@ bool parse_args(int argc, char **argv, config_t *config) {
             i++; // Skip next argument since it's consumed by --output
         } else if (strcmp(argv[i], "--recursive") == 0) {
             config->recursive = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            config->stats = true;
+        } else if (strcmp(argv[i], "--keep-alive") == 0) {
+            config->keep_alive = true;
+        } else if (strcmp(argv[i], "--precalc-chksum") == 0) {
+            config->precalc_chksum = true;
+        } else if (strcmp(argv[i], "--mss") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --mss requires a number argument.\n");
+                return false;
+            }
+            char *end = NULL;
+            unsigned long mss = strtoul(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end != '\0' || argv[i + 1][0] == '-' || mss == 0 || mss > 65535) {
+                fprintf(stderr, "Error: --mss must be a number between 1 and 65535.\n");
+                return false;
+            }
+            config->mss = (size_t)mss;
+            i++; // Skip next argument since it's consumed by --mss
+        } else if (strcmp(argv[i], "--gzip") == 0) {
+            config->gzip = true;
+        } else if (strcmp(argv[i], "--gzip-min-saving") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --gzip-min-saving requires a number argument.\n");
+                return false;
+            }
+            char *end = NULL;
+            unsigned long saving = strtoul(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end != '\0' || argv[i + 1][0] == '-' || saving > 99) {
+                fprintf(stderr, "Error: --gzip-min-saving must be a number between 0 and 99.\n");
+                return false;
+            }
+            config->gzip_min_saving = (int)saving;
+            i++; // Skip next argument since it's consumed by --gzip-min-saving
+        } else if (strcmp(argv[i], "--no-prefetch") == 0) {
+            config->no_prefetch = true;
+        } else if (strcmp(argv[i], "--io") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --io requires a backend argument.\n");
+                return false;
+            }
+            if (!parse_input_strategy(argv[i + 1], &config->input_strategy)) {
+                fprintf(stderr, "Error: unknown --io backend: %s\n", argv[i + 1]);
+                return false;
+            }
+            i++; // Skip next argument since it's consumed by --io
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --jobs requires a number argument.\n");
+                return false;
+            }
+            char *end = NULL;
+            unsigned long jobs = strtoul(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end != '\0' || jobs == 0 || jobs > 1024) {
+                fprintf(stderr, "Error: --jobs must be a number between 1 and 1024.\n");
+                return false;
+            }
+            config->jobs = (unsigned)jobs;
+            i++; // Skip next argument since it's consumed by --jobs
+        } else if (strcmp(argv[i], "--max-memory") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --max-memory requires a size argument.\n");
+                return false;
+            }
+            if (!parse_size(argv[i + 1], &config->max_memory)) {
+                fprintf(stderr, "Error: --max-memory must be a positive size such as 268435456, 256M or 1G.\n");
+                return false;
+            }
+            i++; // Skip next argument since it's consumed by --max-memory
+        } else if (strcmp(argv[i], "--writer") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --writer requires a mode argument.\n");
+                return false;
+            }
+            if (strcmp(argv[i + 1], "stream") == 0) {
+                config->writer = CONFIG_WRITER_STREAM;
+            } else if (strcmp(argv[i + 1], "positional") == 0) {
+                config->writer = CONFIG_WRITER_POSITIONAL;
+            } else if (strcmp(argv[i + 1], "null") == 0) {
+                config->writer = CONFIG_WRITER_NULL;
+            } else {
+                fprintf(stderr, "Error: unknown --writer mode: %s\n", argv[i + 1]);
+                return false;
+            }
+            i++; // Skip next argument since it's consumed by --writer
         } else {
             fprintf(stderr, "Unknown option: %s\n", argv[i]);
             return false;
@@ -53,6 +194,18 @@ bool parse_args(int argc, char **argv, config_t *config) {
         fprintf(stderr, "Error: --output <file> is required.\n");
         return false;
     }
+    if (config->mss != 0 && !config->precalc_chksum) {
+        fprintf(stderr, "Error: --mss only applies with --precalc-chksum.\n");
+        return false;
+    }
+    if (config->gzip_min_saving >= 0 && !config->gzip) {
+        fprintf(stderr, "Error: --gzip-min-saving only applies with --gzip.\n");
+        return false;
+    }
+    if (strcmp(config->output_file, "-") == 0 && config->writer == CONFIG_WRITER_POSITIONAL) {
+        fprintf(stderr, "Error: --writer positional needs an output file, not stdout.\n");
+        return false;
+    }
 
     return true;
 }
@@ -2,11 +2,30 @@
 #define CONFIG_H
 
 #include <stdbool.h>
+#include "platform.h"
+
+// Where the converted arrays go
+typedef enum {
+    CONFIG_WRITER_STREAM = 0,   // To the output file (or stdout) in order, while the scan runs
+    CONFIG_WRITER_POSITIONAL,   // To the output file, laid out up front and written in parallel
+    CONFIG_WRITER_NULL,         // Nowhere, to time conversion without output I/O
+} config_writer_t;
 
 typedef struct {
     char input_dir[256];
     char output_file[256];
     bool recursive;
+    platform_input_strategy input_strategy;
+    unsigned jobs;          // Worker threads, 0 = one per CPU core
+    size_t max_memory;      // Conversion memory budget in bytes, 0 = default
+    config_writer_t writer;
+    bool keep_alive;        // HTTP/1.1 headers with persistent connections
+    bool precalc_chksum;    // Emit per-segment TCP checksums
+    size_t mss;             // Checksum segment size in bytes, 0 = default
+    bool gzip;              // Serve files gzip compressed where that pays
+    int gzip_min_saving;    // Percent compression has to save, -1 = default
+    bool no_prefetch;       // Do not read ahead across files or drop them from the page cache
+    bool stats;             // Print per-stage pipeline counters to stderr
     bool show_help;
 } config_t;
 
@@ -1,9 +1,14 @@
 #include "convert.h"
 #include "platform.h"
+#include "alloc.h"
+#include "encode.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Rows of hex text assembled per sink_write call
+#define CONVERT_WRITE_ROWS 512
+
 unsigned char* convert_read_file_contents(const char *path, size_t *size_out) {
     // Open file in binary mode
     platform_file_handle fh = platform_fopen(path, "rb");
@@ -11,22 +16,15 @@ unsigned char* convert_read_file_contents(const char *path, size_t *size_out) {
         return NULL; // Caller can handle error
     }
 
-    // Determine file size
-    if (platform_fseek(fh, 0, SEEK_END) != 0) {
-        platform_fclose(fh);
-        return NULL;
-    }
-    long size = platform_ftell(fh);
-    if (size < 0) {
+    // Determine file size without seeking; it must also fit in memory
+    platform_off_t size = 0;
+    if (platform_file_size(fh, &size) != 0 || size < 0 || (unsigned long long)size > (unsigned long long)SIZE_MAX) {
         platform_fclose(fh);
         return NULL;
     }
 
-    // Move back to start
-    platform_fseek(fh, 0, SEEK_SET);
-
     // Allocate buffer
-    unsigned char *buffer = (unsigned char*)malloc((size_t)size);
+    unsigned char *buffer = (unsigned char*)alloc_malloc((size_t)size);
     if (!buffer) {
         platform_fclose(fh);
         return NULL;
@@ -36,7 +34,7 @@ unsigned char* convert_read_file_contents(const char *path, size_t *size_out) {
     platform_fclose(fh);
 
     if (read_count != (size_t)size) {
-        free(buffer);
+        alloc_free(buffer);
         return NULL;
     }
 
@@ -44,14 +42,307 @@ unsigned char* convert_read_file_contents(const char *path, size_t *size_out) {
     return buffer;
 }
 
-void convert_write_c_array(const char *var_name, const unsigned char *data, size_t size, platform_file_handle out) {
-    fprintf(out, "static const unsigned char %s[] = {\n", var_name);
+#define CONVERT_HEADER_PREFIX "static const unsigned char "
+#define CONVERT_HEADER_SUFFIX "[] = {\n"
+#define CONVERT_FOOTER "\n};\n\n"
+
+static void convert_write_header(const char *var_name, output_sink_t *out) {
+    sink_write(out, CONVERT_HEADER_PREFIX, strlen(CONVERT_HEADER_PREFIX));
+    sink_write(out, var_name, strlen(var_name));
+    sink_write(out, CONVERT_HEADER_SUFFIX, strlen(CONVERT_HEADER_SUFFIX));
+}
+
+size_t convert_format_header(char *dst, const char *var_name) {
+    size_t len = 0;
+    memcpy(dst + len, CONVERT_HEADER_PREFIX, strlen(CONVERT_HEADER_PREFIX));
+    len += strlen(CONVERT_HEADER_PREFIX);
+    memcpy(dst + len, var_name, strlen(var_name));
+    len += strlen(var_name);
+    memcpy(dst + len, CONVERT_HEADER_SUFFIX, strlen(CONVERT_HEADER_SUFFIX));
+    len += strlen(CONVERT_HEADER_SUFFIX);
+    return len;
+}
+
+size_t convert_format_footer(char *dst) {
+    memcpy(dst, CONVERT_FOOTER, strlen(CONVERT_FOOTER));
+    return strlen(CONVERT_FOOTER);
+}
+
+static void convert_write_footer(output_sink_t *out) {
+    sink_write(out, CONVERT_FOOTER, strlen(CONVERT_FOOTER));
+}
+
+// Encode 'size' bytes that start at array offset 'pos' and write them out.
+static void convert_write_body(const unsigned char *data, size_t size, size_t pos, output_sink_t *out) {
+    // Encode whole rows into a local buffer and hand them to the sink in large writes
+    char text[CONVERT_WRITE_ROWS * ENCODE_ROW_CHARS];
+    for (size_t done = 0; done < size; ) {
+        size_t chunk = size - done;
+        if (chunk > CONVERT_WRITE_ROWS * ENCODE_BYTES_PER_ROW) {
+            chunk = CONVERT_WRITE_ROWS * ENCODE_BYTES_PER_ROW;
+        }
+        size_t len = encode_hex(text, data + done, chunk, pos + done);
+        sink_write(out, text, len);
+        done += chunk;
+    }
+}
+
+// Completion counter for one round of chunk tasks
+typedef struct {
+    platform_mutex_t lock;
+    platform_cond_t done;
+    size_t pending;
+} convert_latch_t;
+
+typedef struct {
+    const unsigned char *src;
+    size_t len;
+    size_t pos;             // Array offset of src[0]
+    char *dst;              // Precomputed place of this chunk's text
+    convert_latch_t *latch;
+} convert_chunk_t;
+
+struct convert_parallel {
+    thread_pool_t *pool;
+    size_t max_chunks;
+    convert_chunk_t *chunks;
+    char *text;
+    convert_latch_t latch;
+};
+
+static void convert_chunk_task(void *arg, unsigned worker) {
+    (void)worker;
+    convert_chunk_t *chunk = (convert_chunk_t*)arg;
+    encode_hex(chunk->dst, chunk->src, chunk->len, chunk->pos);
+
+    platform_mutex_lock(&chunk->latch->lock);
+    if (--chunk->latch->pending == 0) {
+        platform_cond_broadcast(&chunk->latch->done);
+    }
+    platform_mutex_unlock(&chunk->latch->lock);
+}
+
+convert_parallel_t* convert_parallel_create(thread_pool_t *pool, size_t max_chunks) {
+    convert_parallel_t *cp = (convert_parallel_t*)alloc_calloc(1, sizeof(convert_parallel_t));
+    if (!cp) {
+        return NULL;
+    }
+    cp->pool = pool;
+    cp->max_chunks = max_chunks ? max_chunks : 1;
+    cp->chunks = (convert_chunk_t*)alloc_malloc(cp->max_chunks * sizeof(convert_chunk_t));
+    cp->text = (char*)alloc_malloc(encode_hex_size(0, cp->max_chunks * CONVERT_PARALLEL_CHUNK) + ENCODE_ROW_CHARS);
+    if (!cp->chunks || !cp->text) {
+        alloc_free(cp->chunks);
+        alloc_free(cp->text);
+        alloc_free(cp);
+        return NULL;
+    }
+    platform_mutex_init(&cp->latch.lock);
+    platform_cond_init(&cp->latch.done);
+    return cp;
+}
+
+void convert_parallel_destroy(convert_parallel_t *cp) {
+    if (!cp) {
+        return;
+    }
+    platform_cond_destroy(&cp->latch.done);
+    platform_mutex_destroy(&cp->latch.lock);
+    alloc_free(cp->chunks);
+    alloc_free(cp->text);
+    alloc_free(cp);
+}
+
+// Encode 'size' bytes that start at array offset 'pos' on the pool and write
+// them out, one round of up to max_chunks chunks at a time.
+static void convert_write_body_parallel(convert_parallel_t *cp, const unsigned char *data, size_t size, size_t pos, output_sink_t *out) {
+    size_t base = pos;
+    size_t end = pos + size;
+    while (pos < end) {
+        // Chunk boundaries sit on absolute row boundaries
+        size_t n = 0;
+        size_t text_len = 0;
+        size_t start = pos;
+        while (start < end && n < cp->max_chunks) {
+            size_t stop = (start / ENCODE_BYTES_PER_ROW) * ENCODE_BYTES_PER_ROW + CONVERT_PARALLEL_CHUNK;
+            if (stop > end) {
+                stop = end;
+            }
+            convert_chunk_t *chunk = &cp->chunks[n++];
+            chunk->src = data + (start - base);
+            chunk->len = stop - start;
+            chunk->pos = start;
+            chunk->dst = cp->text + text_len;
+            chunk->latch = &cp->latch;
+            text_len += encode_hex_size(start, stop - start);
+            start = stop;
+        }
+
+        if (n == 1) {
+            encode_hex(cp->chunks[0].dst, cp->chunks[0].src, cp->chunks[0].len, cp->chunks[0].pos);
+        } else {
+            cp->latch.pending = n;
+            for (size_t k = 0; k < n; k++) {
+                if (thread_pool_submit(cp->pool, convert_chunk_task, &cp->chunks[k]) != 0) {
+                    convert_chunk_task(&cp->chunks[k], 0); // Could not queue it, run it here
+                }
+            }
+            platform_mutex_lock(&cp->latch.lock);
+            while (cp->latch.pending > 0) {
+                platform_cond_wait(&cp->latch.done, &cp->latch.lock);
+            }
+            platform_mutex_unlock(&cp->latch.lock);
+        }
+
+        sink_write(out, cp->text, text_len);
+        pos = start;
+    }
+}
+
+// Array offset of the file's first byte
+static size_t convert_prefix_len(const convert_prefix_t *prefix) {
+    return prefix ? prefix->len : 0;
+}
+
+// Open 'path' for a streaming writer, which must match the prefix's size
+static int convert_stream_open(platform_input *in, const char *path, const convert_prefix_t *prefix) {
+    if (platform_input_open(in, path) != 0) {
+        return -1;
+    }
+    if (prefix && platform_input_size(in) != prefix->size) {
+        platform_input_close(in);
+        return -1;
+    }
+    return 0;
+}
+
+void convert_write_c_array(const char *var_name, const convert_prefix_t *prefix, const unsigned char *data, size_t size, output_sink_t *out) {
+    convert_write_header(var_name, out);
+    if (prefix) {
+        convert_write_body(prefix->data, prefix->len, 0, out);
+    }
+    convert_write_body(data, size, convert_prefix_len(prefix), out);
+    convert_write_footer(out);
+}
+
+int convert_stream_c_array(const char *var_name, const convert_prefix_t *prefix, const char *path, platform_input *in, output_sink_t *out) {
+    platform_input *own = NULL;
+    if (!in) {
+        own = platform_input_create(PLATFORM_INPUT_AUTO, CONVERT_STREAM_BLOCK_SIZE);
+        if (!own) {
+            return -1;
+        }
+        in = own;
+    }
+
+    if (convert_stream_open(in, path, prefix) != 0) {
+        platform_input_destroy(own);
+        return -1;
+    }
 
-    for (size_t i = 0; i < size; i++) {
-        fprintf(out, "0x%02X,", data[i]);
-        if ((i + 1) % 16 == 0) {
-            fprintf(out, "\n");
+    convert_write_header(var_name, out);
+    if (prefix) {
+        convert_write_body(prefix->data, prefix->len, 0, out);
+    }
+
+    int result = 0;
+    size_t pos = convert_prefix_len(prefix);
+    for (;;) {
+        const unsigned char *block;
+        size_t n;
+        if (platform_input_next(in, &block, &n) != 0) {
+            result = 1;
+            break;
+        }
+        if (n == 0) {
+            break;
         }
+        convert_write_body(block, n, pos, out);
+        pos += n;
     }
-    fprintf(out, "\n};\n\n");
+    if (prefix && pos != prefix->len + prefix->size) {
+        result = 1; // The file changed while it was read
+    }
+
+    // Close the array even on a read error so the output stays valid C
+    convert_write_footer(out);
+
+    platform_input_close(in);
+    platform_input_destroy(own);
+    return result;
+}
+
+void convert_var_name(char *var_name, size_t len, size_t index) {
+#ifdef _WIN32
+    snprintf(var_name, len, "file_%llu", (unsigned long long)index);
+#else
+    snprintf(var_name, len, "file_%zu", index);
+#endif
+}
+
+size_t convert_header_size(const char *var_name) {
+    return strlen(CONVERT_HEADER_PREFIX) + strlen(var_name) + strlen(CONVERT_HEADER_SUFFIX);
+}
+
+size_t convert_footer_size(void) {
+    return strlen(CONVERT_FOOTER);
+}
+
+size_t convert_c_array_size(const char *var_name, size_t size) {
+    return convert_header_size(var_name) + encode_hex_size(0, size) + convert_footer_size();
+}
+
+size_t convert_format_c_array(char *dst, const char *var_name, const convert_prefix_t *prefix, const unsigned char *data, size_t size) {
+    size_t len = convert_format_header(dst, var_name);
+    if (prefix) {
+        len += encode_hex(dst + len, prefix->data, prefix->len, 0);
+    }
+    len += encode_hex(dst + len, data, size, convert_prefix_len(prefix));
+    memcpy(dst + len, CONVERT_FOOTER, strlen(CONVERT_FOOTER));
+    return len + strlen(CONVERT_FOOTER);
+}
+
+void convert_write_c_array_parallel(const char *var_name, const convert_prefix_t *prefix, const unsigned char *data, size_t size, convert_parallel_t *cp, output_sink_t *out) {
+    convert_write_header(var_name, out);
+    if (prefix) {
+        convert_write_body(prefix->data, prefix->len, 0, out);
+    }
+    convert_write_body_parallel(cp, data, size, convert_prefix_len(prefix), out);
+    convert_write_footer(out);
+}
+
+int convert_stream_c_array_parallel(const char *var_name, const convert_prefix_t *prefix, const char *path, platform_input *in, convert_parallel_t *cp, output_sink_t *out) {
+    if (convert_stream_open(in, path, prefix) != 0) {
+        return -1;
+    }
+
+    convert_write_header(var_name, out);
+    if (prefix) {
+        convert_write_body(prefix->data, prefix->len, 0, out);
+    }
+
+    int result = 0;
+    size_t pos = convert_prefix_len(prefix);
+    for (;;) {
+        const unsigned char *block;
+        size_t n;
+        if (platform_input_next(in, &block, &n) != 0) {
+            result = 1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        convert_write_body_parallel(cp, block, n, pos, out);
+        pos += n;
+    }
+    if (prefix && pos != prefix->len + prefix->size) {
+        result = 1; // The file changed while it was read
+    }
+
+    // Close the array even on a read error so the output stays valid C
+    convert_write_footer(out);
+
+    platform_input_close(in);
+    return result;
 }
@@ -4,16 +4,91 @@
 #include <stddef.h>
 #include <stdio.h>
 #include "platform.h"
+#include "thread_pool.h"
+#include "sink.h"
 
 // Reads the entire file at 'path' into a newly allocated buffer.
 // Returns pointer to the buffer, and writes its size into *size_out.
-// Caller must free the returned buffer.
+// Caller must free the returned buffer with alloc_free.
 unsigned char* convert_read_file_contents(const char *path, size_t *size_out);
 
-// Writes the file's data as a static const unsigned char array into a given output stream.
+// Bytes an array starts with ahead of the file's contents, such as the name
+// and HTTP header of an lwIP fsdata entry. 'len' is a multiple of
+// ENCODE_BYTES_PER_ROW, so the contents start on a row of their own and are
+// encoded exactly as without a prefix. An array of a prefix and 'size' bytes
+// is convert_c_array_size(var_name, len + size) characters long.
+// Functions taking a prefix accept NULL for none.
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t size;        // File size the prefix was made for; streaming fails on any other
+} convert_prefix_t;
+
+// Writes the file's data as a static const unsigned char array into a given output sink.
 // var_name: The C identifier to use for the array variable.
-void convert_write_c_array(const char *var_name, const unsigned char *data, size_t size, platform_file_handle out);
+void convert_write_c_array(const char *var_name, const convert_prefix_t *prefix, const unsigned char *data, size_t size, output_sink_t *out);
+
+// Size of the blocks convert_stream_c_array reads at a time.
+#define CONVERT_STREAM_BLOCK_SIZE PLATFORM_INPUT_BLOCK_SIZE
+
+// Same output as convert_read_file_contents + convert_write_c_array, but reads
+// the file at 'path' block by block through 'in' and encodes each block
+// straight into 'out', so memory use does not depend on the file size.
+// 'in' is reused across calls to avoid reallocating its buffer; pass NULL to
+// use a temporary reader with PLATFORM_INPUT_AUTO.
+// Returns 0 on success, -1 if the file cannot be opened or is not the size
+// 'prefix' was made for (nothing is written), or 1 if a read fails or the
+// file changes part way (the array is closed early, so the output holds a
+// truncated array).
+int convert_stream_c_array(const char *var_name, const convert_prefix_t *prefix, const char *path, platform_input *in, output_sink_t *out);
+
+
+// Writes the C identifier used for the file at 'index' ("file_<index>").
+void convert_var_name(char *var_name, size_t len, size_t index);
+
+// Exact number of characters convert_write_c_array produces for an array
+// named 'var_name' holding 'size' bytes.
+size_t convert_c_array_size(const char *var_name, size_t size);
+
+// The array text is the header, encode_hex() of the data, and the footer.
+// These write the header and footer into 'dst' without a terminator and
+// return their length, for writers that place the parts themselves.
+size_t convert_format_header(char *dst, const char *var_name);
+size_t convert_format_footer(char *dst);
+size_t convert_header_size(const char *var_name);
+size_t convert_footer_size(void);
+
+// Formats the same text as convert_write_c_array into 'dst', which must hold
+// convert_c_array_size(var_name, size) characters (counting the prefix's
+// bytes in 'size'). No terminator is added.
+// Returns the number of characters written.
+size_t convert_format_c_array(char *dst, const char *var_name, const convert_prefix_t *prefix, const unsigned char *data, size_t size);
+
+// Input bytes encoded per task by the parallel writers. A multiple of the
+// 16-byte row, so every chunk but the last ends on a row boundary.
+#define CONVERT_PARALLEL_CHUNK (256 * 1024)
+
+// Chunk table and text buffer the parallel writers encode into, for up to
+// 'max_chunks' chunks at a time on the threads of 'pool'. Made once and used
+// for every file of a run, from one thread at a time.
+typedef struct convert_parallel convert_parallel_t;
+
+// Returns NULL when out of memory.
+convert_parallel_t* convert_parallel_create(thread_pool_t *pool, size_t max_chunks);
+
+// NULL is ignored.
+void convert_parallel_destroy(convert_parallel_t *cp);
 
+// Same output as convert_write_c_array, but the array body is split into
+// row-aligned chunks that are encoded on the threads of the pool. Each
+// chunk's output size is known in advance, so chunks are encoded straight
+// into their final place in one buffer. Must not be called from a task of
+// the pool.
+void convert_write_c_array_parallel(const char *var_name, const convert_prefix_t *prefix, const unsigned char *data, size_t size, convert_parallel_t *cp, output_sink_t *out);
 
+// Same as convert_stream_c_array, but each block read through 'in' is
+// encoded in parallel as in convert_write_c_array_parallel. Use a reader
+// whose block size is max_chunks chunks, or the mmap backend.
+int convert_stream_c_array_parallel(const char *var_name, const convert_prefix_t *prefix, const char *path, platform_input *in, convert_parallel_t *cp, output_sink_t *out);
 
 #endif // CONVERT_H
@@ -0,0 +1,790 @@
+#include "deflate.h"
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Matches reach this far back
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_HASH_SIZE (1u << DEFLATE_HASH_BITS)
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+// Search effort, as zlib's level 6
+#define DEFLATE_MAX_CHAIN 128       // Candidates tried per position
+#define DEFLATE_GOOD_MATCH 8        // Try a quarter as many after a match this long
+#define DEFLATE_LAZY_MATCH 16       // Take a match this long without looking one byte on
+#define DEFLATE_NICE_MATCH 128      // Stop searching at a match this long
+#define DEFLATE_TOO_FAR 4096        // Three-byte matches further back cost more than literals
+
+// Tokens per block; each block gets codes fitted to its own symbols
+#define DEFLATE_BLOCK_TOKENS 16384
+
+#define DEFLATE_LITLEN_CODES 288
+#define DEFLATE_DIST_CODES 30
+#define DEFLATE_CLEN_CODES 19
+#define DEFLATE_END_OF_BLOCK 256
+#define DEFLATE_MAX_BITS 15
+#define DEFLATE_MAX_CLEN_BITS 7
+#define DEFLATE_MAX_STORED 65535
+
+static const uint16_t deflate_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t deflate_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t deflate_dist_base[DEFLATE_DIST_CODES] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t deflate_dist_extra[DEFLATE_DIST_CODES] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+// Order the code length code lengths are sent in
+static const uint8_t deflate_clen_order[DEFLATE_CLEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+static const uint32_t deflate_crc_table[256] = {
+    0x00000000u, 0x77073096u, 0xee0e612cu, 0x990951bau, 0x076dc419u, 0x706af48fu,
+    0xe963a535u, 0x9e6495a3u, 0x0edb8832u, 0x79dcb8a4u, 0xe0d5e91eu, 0x97d2d988u,
+    0x09b64c2bu, 0x7eb17cbdu, 0xe7b82d07u, 0x90bf1d91u, 0x1db71064u, 0x6ab020f2u,
+    0xf3b97148u, 0x84be41deu, 0x1adad47du, 0x6ddde4ebu, 0xf4d4b551u, 0x83d385c7u,
+    0x136c9856u, 0x646ba8c0u, 0xfd62f97au, 0x8a65c9ecu, 0x14015c4fu, 0x63066cd9u,
+    0xfa0f3d63u, 0x8d080df5u, 0x3b6e20c8u, 0x4c69105eu, 0xd56041e4u, 0xa2677172u,
+    0x3c03e4d1u, 0x4b04d447u, 0xd20d85fdu, 0xa50ab56bu, 0x35b5a8fau, 0x42b2986cu,
+    0xdbbbc9d6u, 0xacbcf940u, 0x32d86ce3u, 0x45df5c75u, 0xdcd60dcfu, 0xabd13d59u,
+    0x26d930acu, 0x51de003au, 0xc8d75180u, 0xbfd06116u, 0x21b4f4b5u, 0x56b3c423u,
+    0xcfba9599u, 0xb8bda50fu, 0x2802b89eu, 0x5f058808u, 0xc60cd9b2u, 0xb10be924u,
+    0x2f6f7c87u, 0x58684c11u, 0xc1611dabu, 0xb6662d3du, 0x76dc4190u, 0x01db7106u,
+    0x98d220bcu, 0xefd5102au, 0x71b18589u, 0x06b6b51fu, 0x9fbfe4a5u, 0xe8b8d433u,
+    0x7807c9a2u, 0x0f00f934u, 0x9609a88eu, 0xe10e9818u, 0x7f6a0dbbu, 0x086d3d2du,
+    0x91646c97u, 0xe6635c01u, 0x6b6b51f4u, 0x1c6c6162u, 0x856530d8u, 0xf262004eu,
+    0x6c0695edu, 0x1b01a57bu, 0x8208f4c1u, 0xf50fc457u, 0x65b0d9c6u, 0x12b7e950u,
+    0x8bbeb8eau, 0xfcb9887cu, 0x62dd1ddfu, 0x15da2d49u, 0x8cd37cf3u, 0xfbd44c65u,
+    0x4db26158u, 0x3ab551ceu, 0xa3bc0074u, 0xd4bb30e2u, 0x4adfa541u, 0x3dd895d7u,
+    0xa4d1c46du, 0xd3d6f4fbu, 0x4369e96au, 0x346ed9fcu, 0xad678846u, 0xda60b8d0u,
+    0x44042d73u, 0x33031de5u, 0xaa0a4c5fu, 0xdd0d7cc9u, 0x5005713cu, 0x270241aau,
+    0xbe0b1010u, 0xc90c2086u, 0x5768b525u, 0x206f85b3u, 0xb966d409u, 0xce61e49fu,
+    0x5edef90eu, 0x29d9c998u, 0xb0d09822u, 0xc7d7a8b4u, 0x59b33d17u, 0x2eb40d81u,
+    0xb7bd5c3bu, 0xc0ba6cadu, 0xedb88320u, 0x9abfb3b6u, 0x03b6e20cu, 0x74b1d29au,
+    0xead54739u, 0x9dd277afu, 0x04db2615u, 0x73dc1683u, 0xe3630b12u, 0x94643b84u,
+    0x0d6d6a3eu, 0x7a6a5aa8u, 0xe40ecf0bu, 0x9309ff9du, 0x0a00ae27u, 0x7d079eb1u,
+    0xf00f9344u, 0x8708a3d2u, 0x1e01f268u, 0x6906c2feu, 0xf762575du, 0x806567cbu,
+    0x196c3671u, 0x6e6b06e7u, 0xfed41b76u, 0x89d32be0u, 0x10da7a5au, 0x67dd4accu,
+    0xf9b9df6fu, 0x8ebeeff9u, 0x17b7be43u, 0x60b08ed5u, 0xd6d6a3e8u, 0xa1d1937eu,
+    0x38d8c2c4u, 0x4fdff252u, 0xd1bb67f1u, 0xa6bc5767u, 0x3fb506ddu, 0x48b2364bu,
+    0xd80d2bdau, 0xaf0a1b4cu, 0x36034af6u, 0x41047a60u, 0xdf60efc3u, 0xa867df55u,
+    0x316e8eefu, 0x4669be79u, 0xcb61b38cu, 0xbc66831au, 0x256fd2a0u, 0x5268e236u,
+    0xcc0c7795u, 0xbb0b4703u, 0x220216b9u, 0x5505262fu, 0xc5ba3bbeu, 0xb2bd0b28u,
+    0x2bb45a92u, 0x5cb36a04u, 0xc2d7ffa7u, 0xb5d0cf31u, 0x2cd99e8bu, 0x5bdeae1du,
+    0x9b64c2b0u, 0xec63f226u, 0x756aa39cu, 0x026d930au, 0x9c0906a9u, 0xeb0e363fu,
+    0x72076785u, 0x05005713u, 0x95bf4a82u, 0xe2b87a14u, 0x7bb12baeu, 0x0cb61b38u,
+    0x92d28e9bu, 0xe5d5be0du, 0x7cdcefb7u, 0x0bdbdf21u, 0x86d3d2d4u, 0xf1d4e242u,
+    0x68ddb3f8u, 0x1fda836eu, 0x81be16cdu, 0xf6b9265bu, 0x6fb077e1u, 0x18b74777u,
+    0x88085ae6u, 0xff0f6a70u, 0x66063bcau, 0x11010b5cu, 0x8f659effu, 0xf862ae69u,
+    0x616bffd3u, 0x166ccf45u, 0xa00ae278u, 0xd70dd2eeu, 0x4e048354u, 0x3903b3c2u,
+    0xa7672661u, 0xd06016f7u, 0x4969474du, 0x3e6e77dbu, 0xaed16a4au, 0xd9d65adcu,
+    0x40df0b66u, 0x37d83bf0u, 0xa9bcae53u, 0xdebb9ec5u, 0x47b2cf7fu, 0x30b5ffe9u,
+    0xbdbdf21cu, 0xcabac28au, 0x53b39330u, 0x24b4a3a6u, 0xbad03605u, 0xcdd70693u,
+    0x54de5729u, 0x23d967bfu, 0xb3667a2eu, 0xc4614ab8u, 0x5d681b02u, 0x2a6f2b94u,
+    0xb40bbe37u, 0xc30c8ea1u, 0x5a05df1bu, 0x2d02ef8du,
+};
+
+uint32_t deflate_crc32(uint32_t crc, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = deflate_crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Output bits, lowest first, as DEFLATE packs them
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t capacity;
+    uint64_t bits;          // Not yet in 'buf'
+    unsigned count;         // Bits in 'bits', always below 32 between calls
+} deflate_out_t;
+
+// Make room for 'n' more bytes, plus whatever is pending in 'bits'
+static int deflate_reserve(deflate_out_t *o, size_t n) {
+    size_t needed = o->len + n + 8;
+    if (needed <= o->capacity) {
+        return 0;
+    }
+    size_t capacity = o->capacity * 2 > needed ? o->capacity * 2 : needed;
+    unsigned char *buf = (unsigned char*)alloc_realloc(o->buf, capacity);
+    if (!buf) {
+        return -1;
+    }
+    o->buf = buf;
+    o->capacity = capacity;
+    return 0;
+}
+
+static void deflate_put_bits(deflate_out_t *o, uint32_t value, unsigned n) {
+    o->bits |= (uint64_t)value << o->count;
+    o->count += n;
+    if (o->count >= 32) {
+        o->buf[o->len++] = (unsigned char)o->bits;
+        o->buf[o->len++] = (unsigned char)(o->bits >> 8);
+        o->buf[o->len++] = (unsigned char)(o->bits >> 16);
+        o->buf[o->len++] = (unsigned char)(o->bits >> 24);
+        o->bits >>= 32;
+        o->count -= 32;
+    }
+}
+
+// Pad to a whole byte and write out the pending bits
+static void deflate_align(deflate_out_t *o) {
+    while (o->count > 0) {
+        o->buf[o->len++] = (unsigned char)o->bits;
+        o->bits >>= 8;
+        o->count = o->count > 8 ? o->count - 8 : 0;
+    }
+    o->bits = 0;
+}
+
+static void deflate_put_bytes(deflate_out_t *o, const void *data, size_t len) {
+    memcpy(o->buf + o->len, data, len);
+    o->len += len;
+}
+
+static void deflate_put_u32le(deflate_out_t *o, uint32_t v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    deflate_put_bytes(o, b, sizeof(b));
+}
+
+typedef struct {
+    uint32_t weight;
+    uint16_t sym;
+} deflate_leaf_t;
+
+static int deflate_leaf_cmp(const void *a, const void *b) {
+    const deflate_leaf_t *x = (const deflate_leaf_t*)a;
+    const deflate_leaf_t *y = (const deflate_leaf_t*)b;
+    if (x->weight != y->weight) {
+        return x->weight < y->weight ? -1 : 1;
+    }
+    return x->sym < y->sym ? -1 : x->sym > y->sym;
+}
+
+// Huffman code lengths for the 'n' symbols counted in 'freq', none longer
+// than 'limit'; unused symbols get 0. At least two symbols get a code, so
+// the code is always complete. Should a code come out too long, the counts
+// are flattened and it is built again.
+static void deflate_huffman_lengths(const uint32_t *freq, unsigned n, unsigned limit, uint8_t *lengths) {
+    deflate_leaf_t leaves[DEFLATE_LITLEN_CODES];
+    uint32_t weight[2 * DEFLATE_LITLEN_CODES];
+    uint16_t parent[2 * DEFLATE_LITLEN_CODES];
+    uint8_t depth[2 * DEFLATE_LITLEN_CODES];
+
+    memset(lengths, 0, n);
+    unsigned m = 0;
+    for (unsigned s = 0; s < n; s++) {
+        if (freq[s]) {
+            leaves[m++].sym = (uint16_t)s;
+        }
+    }
+    for (unsigned s = 0; m < 2; s++) {
+        if (!freq[s]) {
+            leaves[m++].sym = (uint16_t)s;
+        }
+    }
+
+    for (unsigned shift = 0;; shift++) {
+        for (unsigned k = 0; k < m; k++) {
+            uint32_t f = freq[leaves[k].sym];
+            leaves[k].weight = (f >> shift) | 1;
+        }
+        qsort(leaves, m, sizeof(deflate_leaf_t), deflate_leaf_cmp);
+
+        // Two queues: the sorted leaves, and the merged nodes, which come
+        // out in order of weight too
+        for (unsigned k = 0; k < m; k++) {
+            weight[k] = leaves[k].weight;
+        }
+        unsigned next_leaf = 0;
+        unsigned next_node = m;
+        for (unsigned k = m; k < 2 * m - 1; k++) {
+            unsigned pick[2];
+            for (unsigned t = 0; t < 2; t++) {
+                if (next_leaf < m && (next_node >= k || weight[next_leaf] <= weight[next_node])) {
+                    pick[t] = next_leaf++;
+                } else {
+                    pick[t] = next_node++;
+                }
+            }
+            weight[k] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = (uint16_t)k;
+            parent[pick[1]] = (uint16_t)k;
+        }
+
+        // Parents come after their children, so depths fill in from the root
+        unsigned longest = 0;
+        depth[2 * m - 2] = 0;
+        for (unsigned k = 2 * m - 2; k-- > 0; ) {
+            depth[k] = (uint8_t)(depth[parent[k]] + 1);
+            if (k < m && depth[k] > longest) {
+                longest = depth[k];
+            }
+        }
+        if (longest <= limit) {
+            for (unsigned k = 0; k < m; k++) {
+                lengths[leaves[k].sym] = depth[k];
+            }
+            return;
+        }
+    }
+}
+
+// Canonical codes for 'lengths', bit-reversed to be sent lowest bit first
+static void deflate_huffman_codes(const uint8_t *lengths, unsigned n, uint16_t *codes) {
+    unsigned count[DEFLATE_MAX_BITS + 1] = { 0 };
+    unsigned next[DEFLATE_MAX_BITS + 1];
+    for (unsigned s = 0; s < n; s++) {
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+    unsigned code = 0;
+    for (unsigned bits = 1; bits <= DEFLATE_MAX_BITS; bits++) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (unsigned s = 0; s < n; s++) {
+        unsigned len = lengths[s];
+        if (len == 0) {
+            codes[s] = 0;
+            continue;
+        }
+        unsigned c = next[len]++;
+        unsigned r = 0;
+        for (unsigned b = 0; b < len; b++) {
+            r = (r << 1) | ((c >> b) & 1);
+        }
+        codes[s] = (uint16_t)r;
+    }
+}
+
+static unsigned deflate_dist_code(unsigned dist) {
+    unsigned x = dist - 1;
+    if (x < 4) {
+        return x;
+    }
+    unsigned bits = 2;
+    while ((x >> (bits + 1)) != 0) {
+        bits++;
+    }
+    return 2 * bits + ((x >> (bits - 1)) & 1);
+}
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t *head;               // Latest position + 1 with each hash, 0 for none
+    size_t *prev;               // Previous position + 1 with the same hash, by position in the window
+    uint16_t *lits;             // Literal byte or match length of each token
+    uint16_t *dists;            // Match distance, 0 for a literal
+    size_t count;
+    uint32_t lit_freq[DEFLATE_LITLEN_CODES];
+    uint32_t dist_freq[DEFLATE_DIST_CODES];
+    uint8_t len_code[DEFLATE_MAX_MATCH + 1];
+    uint8_t fixed_lit_len[DEFLATE_LITLEN_CODES];
+    uint16_t fixed_lit_code[DEFLATE_LITLEN_CODES];
+    uint8_t fixed_dist_len[DEFLATE_DIST_CODES];
+    uint16_t fixed_dist_code[DEFLATE_DIST_CODES];
+    deflate_out_t out;
+} deflate_t;
+
+static int deflate_init(deflate_t *s, const unsigned char *data, size_t size) {
+    memset(s, 0, sizeof(*s));
+    s->data = data;
+    s->size = size;
+    s->head = (size_t*)alloc_calloc(DEFLATE_HASH_SIZE, sizeof(size_t));
+    s->prev = (size_t*)alloc_malloc(DEFLATE_WINDOW * sizeof(size_t));
+    s->lits = (uint16_t*)alloc_malloc(DEFLATE_BLOCK_TOKENS * sizeof(uint16_t));
+    s->dists = (uint16_t*)alloc_malloc(DEFLATE_BLOCK_TOKENS * sizeof(uint16_t));
+    if (!s->head || !s->prev || !s->lits || !s->dists) {
+        return -1;
+    }
+    for (unsigned c = 0; c < 28; c++) {
+        for (unsigned len = deflate_len_base[c]; len < deflate_len_base[c] + (1u << deflate_len_extra[c]); len++) {
+            s->len_code[len] = (uint8_t)c;
+        }
+    }
+    s->len_code[DEFLATE_MAX_MATCH] = 28;
+    for (unsigned sym = 0; sym < DEFLATE_LITLEN_CODES; sym++) {
+        s->fixed_lit_len[sym] = sym < 144 ? 8 : sym < 256 ? 9 : sym < 280 ? 7 : 8;
+    }
+    memset(s->fixed_dist_len, 5, sizeof(s->fixed_dist_len));
+    deflate_huffman_codes(s->fixed_lit_len, DEFLATE_LITLEN_CODES, s->fixed_lit_code);
+    deflate_huffman_codes(s->fixed_dist_len, DEFLATE_DIST_CODES, s->fixed_dist_code);
+    return 0;
+}
+
+static void deflate_free(deflate_t *s) {
+    alloc_free(s->head);
+    alloc_free(s->prev);
+    alloc_free(s->lits);
+    alloc_free(s->dists);
+    alloc_free(s->out.buf);
+}
+
+static void deflate_literal(deflate_t *s, unsigned char c) {
+    s->lits[s->count] = c;
+    s->dists[s->count++] = 0;
+    s->lit_freq[c]++;
+}
+
+static void deflate_match(deflate_t *s, unsigned len, unsigned dist) {
+    s->lits[s->count] = (uint16_t)len;
+    s->dists[s->count++] = (uint16_t)dist;
+    s->lit_freq[DEFLATE_END_OF_BLOCK + 1 + s->len_code[len]]++;
+    s->dist_freq[deflate_dist_code(dist)]++;
+}
+
+// Bits the tokens take with the given code lengths, extra bits included
+static size_t deflate_token_bits(const deflate_t *s, const uint8_t *lit_len, const uint8_t *dist_len) {
+    size_t bits = 0;
+    for (unsigned sym = 0; sym < DEFLATE_LITLEN_CODES; sym++) {
+        bits += (size_t)s->lit_freq[sym] * lit_len[sym];
+        if (sym > DEFLATE_END_OF_BLOCK && sym - DEFLATE_END_OF_BLOCK - 1 < 29) {
+            bits += (size_t)s->lit_freq[sym] * deflate_len_extra[sym - DEFLATE_END_OF_BLOCK - 1];
+        }
+    }
+    for (unsigned c = 0; c < DEFLATE_DIST_CODES; c++) {
+        bits += (size_t)s->dist_freq[c] * (dist_len[c] + deflate_dist_extra[c]);
+    }
+    return bits;
+}
+
+static void deflate_put_tokens(deflate_t *s, const uint16_t *lit_code, const uint8_t *lit_len,
+                               const uint16_t *dist_code, const uint8_t *dist_len) {
+    deflate_out_t *o = &s->out;
+    for (size_t t = 0; t < s->count; t++) {
+        unsigned v = s->lits[t];
+        unsigned dist = s->dists[t];
+        if (dist == 0) {
+            deflate_put_bits(o, lit_code[v], lit_len[v]);
+            continue;
+        }
+        unsigned lc = s->len_code[v];
+        unsigned sym = DEFLATE_END_OF_BLOCK + 1 + lc;
+        deflate_put_bits(o, lit_code[sym], lit_len[sym]);
+        if (deflate_len_extra[lc]) {
+            deflate_put_bits(o, v - deflate_len_base[lc], deflate_len_extra[lc]);
+        }
+        unsigned dc = deflate_dist_code(dist);
+        deflate_put_bits(o, dist_code[dc], dist_len[dc]);
+        if (deflate_dist_extra[dc]) {
+            deflate_put_bits(o, dist - deflate_dist_base[dc], deflate_dist_extra[dc]);
+        }
+    }
+    deflate_put_bits(o, lit_code[DEFLATE_END_OF_BLOCK], lit_len[DEFLATE_END_OF_BLOCK]);
+}
+
+// Write the tokens recorded for input [begin, end) as one block, in
+// whichever form is shortest, and start a new block
+static int deflate_write_block(deflate_t *s, size_t begin, size_t end, int final) {
+    s->lit_freq[DEFLATE_END_OF_BLOCK] = 1;
+
+    // Dynamic codes, and the code lengths run-length coded
+    uint8_t lit_len[DEFLATE_LITLEN_CODES];
+    uint8_t dist_len[DEFLATE_DIST_CODES];
+    deflate_huffman_lengths(s->lit_freq, 286, DEFLATE_MAX_BITS, lit_len);
+    lit_len[286] = lit_len[287] = 0;
+    deflate_huffman_lengths(s->dist_freq, DEFLATE_DIST_CODES, DEFLATE_MAX_BITS, dist_len);
+    unsigned hlit = 286;
+    while (hlit > 257 && lit_len[hlit - 1] == 0) {
+        hlit--;
+    }
+    unsigned hdist = DEFLATE_DIST_CODES;
+    while (hdist > 1 && dist_len[hdist - 1] == 0) {
+        hdist--;
+    }
+    uint8_t seq[286 + DEFLATE_DIST_CODES];
+    memcpy(seq, lit_len, hlit);
+    memcpy(seq + hlit, dist_len, hdist);
+    size_t total = hlit + hdist;
+    uint8_t rle_sym[286 + DEFLATE_DIST_CODES];
+    uint8_t rle_extra[286 + DEFLATE_DIST_CODES];
+    size_t rle_count = 0;
+    uint32_t clen_freq[DEFLATE_CLEN_CODES] = { 0 };
+    for (size_t i = 0; i < total; ) {
+        unsigned v = seq[i];
+        size_t run = 1;
+        while (i + run < total && seq[i + run] == v) {
+            run++;
+        }
+        unsigned sym = v;
+        size_t used = 1;
+        if (v == 0 && run >= 3) {
+            used = run > 138 ? 138 : run;
+            sym = used >= 11 ? 18 : 17;
+            rle_extra[rle_count] = (uint8_t)(used - (used >= 11 ? 11 : 3));
+        } else if (v != 0 && run >= 3 && i > 0 && seq[i - 1] == v) {
+            used = run > 6 ? 6 : run;
+            sym = 16;
+            rle_extra[rle_count] = (uint8_t)(used - 3);
+        }
+        rle_sym[rle_count++] = (uint8_t)sym;
+        clen_freq[sym]++;
+        i += used;
+    }
+    uint8_t clen_len[DEFLATE_CLEN_CODES];
+    uint16_t clen_code[DEFLATE_CLEN_CODES];
+    deflate_huffman_lengths(clen_freq, DEFLATE_CLEN_CODES, DEFLATE_MAX_CLEN_BITS, clen_len);
+    deflate_huffman_codes(clen_len, DEFLATE_CLEN_CODES, clen_code);
+    unsigned hclen = DEFLATE_CLEN_CODES;
+    while (hclen > 4 && clen_len[deflate_clen_order[hclen - 1]] == 0) {
+        hclen--;
+    }
+
+    size_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * (size_t)hclen + deflate_token_bits(s, lit_len, dist_len);
+    for (unsigned sym = 0; sym < DEFLATE_CLEN_CODES; sym++) {
+        dynamic_bits += (size_t)clen_freq[sym] * clen_len[sym];
+    }
+    dynamic_bits += (size_t)clen_freq[16] * 2 + (size_t)clen_freq[17] * 3 + (size_t)clen_freq[18] * 7;
+    size_t fixed_bits = 3 + deflate_token_bits(s, s->fixed_lit_len, s->fixed_dist_len);
+    size_t stored_chunks = end - begin ? (end - begin + DEFLATE_MAX_STORED - 1) / DEFLATE_MAX_STORED : 1;
+    size_t stored_bits = (end - begin) * 8 + stored_chunks * 48;
+
+    int result;
+    if (stored_bits <= dynamic_bits && stored_bits <= fixed_bits) {
+        result = deflate_reserve(&s->out, stored_bits / 8 + 1);
+        for (size_t pos = begin; result == 0; ) {
+            size_t n = end - pos > DEFLATE_MAX_STORED ? DEFLATE_MAX_STORED : end - pos;
+            deflate_put_bits(&s->out, final && pos + n == end, 1);
+            deflate_put_bits(&s->out, 0, 2);
+            deflate_align(&s->out);
+            unsigned char lens[4] = { (unsigned char)n, (unsigned char)(n >> 8),
+                                      (unsigned char)~n, (unsigned char)(~n >> 8) };
+            deflate_put_bytes(&s->out, lens, sizeof(lens));
+            deflate_put_bytes(&s->out, s->data + pos, n);
+            pos += n;
+            if (pos == end) {
+                break;
+            }
+        }
+    } else if (fixed_bits <= dynamic_bits) {
+        result = deflate_reserve(&s->out, fixed_bits / 8 + 1);
+        if (result == 0) {
+            deflate_put_bits(&s->out, final ? 1 : 0, 1);
+            deflate_put_bits(&s->out, 1, 2);
+            deflate_put_tokens(s, s->fixed_lit_code, s->fixed_lit_len, s->fixed_dist_code, s->fixed_dist_len);
+        }
+    } else {
+        result = deflate_reserve(&s->out, dynamic_bits / 8 + 1);
+        if (result == 0) {
+            uint16_t lit_code[DEFLATE_LITLEN_CODES];
+            uint16_t dist_code[DEFLATE_DIST_CODES];
+            deflate_huffman_codes(lit_len, DEFLATE_LITLEN_CODES, lit_code);
+            deflate_huffman_codes(dist_len, DEFLATE_DIST_CODES, dist_code);
+            deflate_put_bits(&s->out, final ? 1 : 0, 1);
+            deflate_put_bits(&s->out, 2, 2);
+            deflate_put_bits(&s->out, hlit - 257, 5);
+            deflate_put_bits(&s->out, hdist - 1, 5);
+            deflate_put_bits(&s->out, hclen - 4, 4);
+            for (unsigned k = 0; k < hclen; k++) {
+                deflate_put_bits(&s->out, clen_len[deflate_clen_order[k]], 3);
+            }
+            for (size_t k = 0; k < rle_count; k++) {
+                unsigned sym = rle_sym[k];
+                deflate_put_bits(&s->out, clen_code[sym], clen_len[sym]);
+                if (sym >= 16) {
+                    deflate_put_bits(&s->out, rle_extra[k], sym == 16 ? 2 : sym == 17 ? 3 : 7);
+                }
+            }
+            deflate_put_tokens(s, lit_code, lit_len, dist_code, dist_len);
+        }
+    }
+
+    s->count = 0;
+    memset(s->lit_freq, 0, sizeof(s->lit_freq));
+    memset(s->dist_freq, 0, sizeof(s->dist_freq));
+    return result;
+}
+
+static uint32_t deflate_hash(const unsigned char *p) {
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+    return (v * 0x9E3779B1u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// Add 'pos' to its hash chain. Returns the chain it was put in front of.
+static size_t deflate_insert(deflate_t *s, size_t pos) {
+    if (pos + DEFLATE_MIN_MATCH > s->size) {
+        return 0;
+    }
+    uint32_t h = deflate_hash(s->data + pos);
+    size_t chain = s->head[h];
+    s->prev[pos & (DEFLATE_WINDOW - 1)] = chain;
+    s->head[h] = pos + 1;
+    return chain;
+}
+
+// Number of equal bytes at 'a' and 'b', up to 'limit'
+static size_t deflate_match_len(const unsigned char *a, const unsigned char *b, size_t limit) {
+    size_t n = 0;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; n + 8 <= limit; n += 8) {
+        uint64_t x;
+        uint64_t y;
+        memcpy(&x, a + n, 8);
+        memcpy(&y, b + n, 8);
+        if (x != y) {
+            return n + ((unsigned)__builtin_ctzll(x ^ y) >> 3);
+        }
+    }
+#endif
+    while (n < limit && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+// Longest match for 'pos' along 'chain', at most 'limit' bytes long. Only
+// matches longer than 'best' count; returns the length found, or 'best'.
+static size_t deflate_longest(const deflate_t *s, size_t pos, size_t chain, size_t limit, size_t best, size_t *dist) {
+    const unsigned char *p = s->data + pos;
+    unsigned tries = best >= DEFLATE_GOOD_MATCH ? DEFLATE_MAX_CHAIN / 4 : DEFLATE_MAX_CHAIN;
+    while (chain != 0 && tries-- > 0) {
+        size_t cand = chain - 1;
+        if (cand >= pos || pos - cand > DEFLATE_WINDOW) {
+            break;
+        }
+        const unsigned char *q = s->data + cand;
+        if (q[best] == p[best] && q[0] == p[0] && q[1] == p[1]) {
+            size_t len = deflate_match_len(p, q, limit);
+            if (len > best) {
+                best = len;
+                *dist = pos - cand;
+                if (len >= limit || len >= DEFLATE_NICE_MATCH) {
+                    break;
+                }
+            }
+        }
+        size_t next = s->prev[cand & (DEFLATE_WINDOW - 1)];
+        if (next >= chain) {
+            break; // The slot was reused by a later position
+        }
+        chain = next;
+    }
+    return best;
+}
+
+// Compress input [begin, end) into blocks, the last one marked final if
+// 'final' is set. Matches may reach back before 'begin' as far as positions
+// have been inserted.
+static int deflate_compress(deflate_t *s, size_t begin, size_t end, int final) {
+    size_t block_start = begin;
+    size_t pos = begin;
+    int pending = 0;                // A token for pos - 1 is still to be chosen
+    size_t prev_len = 0;            // Match at pos - 1, if at least DEFLATE_MIN_MATCH
+    size_t prev_dist = 0;
+    while (pos < end) {
+        size_t chain = deflate_insert(s, pos);
+        size_t limit = end - pos > DEFLATE_MAX_MATCH ? DEFLATE_MAX_MATCH : end - pos;
+        size_t len = 0;
+        size_t dist = 0;
+        size_t shortest = prev_len >= DEFLATE_MIN_MATCH ? prev_len : DEFLATE_MIN_MATCH - 1;
+        if (chain != 0 && shortest < limit && prev_len < DEFLATE_LAZY_MATCH) {
+            len = deflate_longest(s, pos, chain, limit, shortest, &dist);
+            if (len == shortest || (len == DEFLATE_MIN_MATCH && dist > DEFLATE_TOO_FAR)) {
+                len = 0;
+            }
+        }
+
+        if (pending && prev_len >= DEFLATE_MIN_MATCH && len <= prev_len) {
+            // The match at pos - 1 is at least as long as the one here
+            deflate_match(s, (unsigned)prev_len, (unsigned)prev_dist);
+            size_t stop = pos - 1 + prev_len;
+            for (pos++; pos < stop; pos++) {
+                deflate_insert(s, pos);
+            }
+            pending = 0;
+            prev_len = 0;
+        } else {
+            if (pending) {
+                deflate_literal(s, s->data[pos - 1]);
+            }
+            pending = 1;
+            prev_len = len;
+            prev_dist = dist;
+            pos++;
+        }
+
+        if (s->count == DEFLATE_BLOCK_TOKENS) {
+            size_t covered = pending ? pos - 1 : pos;
+            if (deflate_write_block(s, block_start, covered, 0) != 0) {
+                return -1;
+            }
+            block_start = covered;
+        }
+    }
+    if (pending) {
+        if (prev_len >= DEFLATE_MIN_MATCH) {
+            deflate_match(s, (unsigned)prev_len, (unsigned)prev_dist);
+        } else {
+            deflate_literal(s, s->data[pos - 1]);
+        }
+    }
+    return deflate_write_block(s, block_start, end, final);
+}
+
+// No name or time stamp, so the output only depends on the input
+static const unsigned char deflate_gzip_header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+
+int deflate_gzip(const unsigned char *data, size_t size, unsigned char **out, size_t *out_len) {
+    deflate_t s;
+    // Most web assets shrink to a third or less
+    if (deflate_init(&s, data, size) != 0 || deflate_reserve(&s.out, size / 3 + 64) != 0) {
+        deflate_free(&s);
+        return -1;
+    }
+    deflate_put_bytes(&s.out, deflate_gzip_header, sizeof(deflate_gzip_header));
+    if (deflate_compress(&s, 0, size, 1) != 0 || deflate_reserve(&s.out, 8) != 0) {
+        deflate_free(&s);
+        return -1;
+    }
+    deflate_align(&s.out);
+    deflate_put_u32le(&s.out, deflate_crc32(0, data, size));
+    deflate_put_u32le(&s.out, (uint32_t)size);
+
+    *out = s.out.buf;
+    *out_len = s.out.len;
+    s.out.buf = NULL;
+    deflate_free(&s);
+    return 0;
+}
+
+// a * b modulo the CRC polynomial, both bit-reflected as the CRC is. 'a'
+// must not be 0.
+static uint32_t deflate_crc_multiply(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                return p;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ 0xEDB88320u : b >> 1;
+    }
+}
+
+uint32_t deflate_crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    // crc1 moves on by x^(8 * len2), built from repeated squares of x^8
+    uint32_t power = 1u << 31;      // x^0
+    uint32_t square = 1u << 23;     // x^8
+    for (uint64_t n = len2; n != 0; n >>= 1) {
+        if (n & 1) {
+            power = deflate_crc_multiply(square, power);
+        }
+        square = deflate_crc_multiply(square, square);
+    }
+    return deflate_crc_multiply(power, crc1) ^ crc2;
+}
+
+size_t deflate_chunk_count(size_t size) {
+    return size <= DEFLATE_CHUNK_SIZE ? 1 : (size + DEFLATE_CHUNK_SIZE - 1) / DEFLATE_CHUNK_SIZE;
+}
+
+// Compress input [begin, end) of 'data' as one chunk, with the window before
+// 'begin' as its dictionary. 'data' need only hold what is from 'begin'
+// back one window.
+static int deflate_chunk_range(const unsigned char *data, size_t begin, size_t end, int final, deflate_chunk_t *chunk) {
+    deflate_t s;
+    memset(chunk, 0, sizeof(*chunk));
+    if (deflate_init(&s, data, end) != 0 || deflate_reserve(&s.out, (end - begin) / 3 + 64) != 0) {
+        deflate_free(&s);
+        return -1;
+    }
+    // The window before the chunk is its dictionary
+    for (size_t pos = begin > DEFLATE_WINDOW ? begin - DEFLATE_WINDOW : 0; pos < begin; pos++) {
+        deflate_insert(&s, pos);
+    }
+    if (deflate_compress(&s, begin, end, final) != 0 || deflate_reserve(&s.out, 8) != 0) {
+        deflate_free(&s);
+        return -1;
+    }
+    if (!final) {
+        // An empty stored block brings the chunk to a byte boundary
+        static const unsigned char empty[4] = { 0, 0, 0xff, 0xff };
+        deflate_put_bits(&s.out, 0, 3);
+        deflate_align(&s.out);
+        deflate_put_bytes(&s.out, empty, sizeof(empty));
+    }
+    deflate_align(&s.out);
+
+    chunk->data = s.out.buf;
+    chunk->len = s.out.len;
+    chunk->crc = deflate_crc32(0, data + begin, end - begin);
+    s.out.buf = NULL;
+    deflate_free(&s);
+    return 0;
+}
+
+int deflate_chunk(const unsigned char *data, size_t size, size_t index, deflate_chunk_t *chunk) {
+    size_t begin = index * DEFLATE_CHUNK_SIZE;
+    size_t end = size - begin > DEFLATE_CHUNK_SIZE ? begin + DEFLATE_CHUNK_SIZE : size;
+    return deflate_chunk_range(data, begin, end, end == size, chunk);
+}
+
+size_t deflate_chunk_window(size_t size, size_t index, size_t *offset) {
+    size_t begin = index * DEFLATE_CHUNK_SIZE;
+    size_t end = size - begin > DEFLATE_CHUNK_SIZE ? begin + DEFLATE_CHUNK_SIZE : size;
+    *offset = begin > DEFLATE_WINDOW ? begin - DEFLATE_WINDOW : 0;
+    return end - *offset;
+}
+
+int deflate_chunk_from(const unsigned char *window, size_t size, size_t index, deflate_chunk_t *chunk) {
+    size_t offset;
+    size_t len = deflate_chunk_window(size, index, &offset);
+    // Chunks start on a multiple of the window, so positions in the window
+    // hash and chain exactly as they do in the whole input
+    size_t begin = index * DEFLATE_CHUNK_SIZE - offset;
+    return deflate_chunk_range(window, begin, len, offset + len == size, chunk);
+}
+
+size_t deflate_memory(size_t size) {
+    // The output starts at a third of the input and doubles as it grows, so
+    // it may end up near twice the worst case of stored blocks
+    size_t tables = DEFLATE_HASH_SIZE * sizeof(size_t) + DEFLATE_WINDOW * sizeof(size_t) +
+                    2 * DEFLATE_BLOCK_TOKENS * sizeof(uint16_t);
+    return tables + 2 * (size + size / 8192 + 128);
+}
+
+int deflate_join(const deflate_chunk_t *chunks, size_t count, size_t size, unsigned char **out, size_t *out_len) {
+    deflate_out_t o;
+    memset(&o, 0, sizeof(o));
+    size_t len = sizeof(deflate_gzip_header) + 8;
+    for (size_t i = 0; i < count; i++) {
+        len += chunks[i].len;
+    }
+    if (deflate_reserve(&o, len) != 0) {
+        return -1;
+    }
+    deflate_put_bytes(&o, deflate_gzip_header, sizeof(deflate_gzip_header));
+    uint32_t crc = 0;
+    size_t remaining = size;
+    for (size_t i = 0; i < count; i++) {
+        size_t covered = remaining > DEFLATE_CHUNK_SIZE ? DEFLATE_CHUNK_SIZE : remaining;
+        deflate_put_bytes(&o, chunks[i].data, chunks[i].len);
+        crc = deflate_crc32_combine(crc, chunks[i].crc, covered);
+        remaining -= covered;
+    }
+    deflate_put_u32le(&o, crc);
+    deflate_put_u32le(&o, (uint32_t)size);
+    *out = o.buf;
+    *out_len = o.len;
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// DEFLATE (RFC 1951) in a gzip wrapper (RFC 1952), with no outside library.
+// Matches are found with hash chains over a 32 KiB window and lazy
+// evaluation, about what zlib does at level 6. Each block is written with
+// dynamic or fixed Huffman codes or stored, whichever is shortest.
+//
+// Large inputs can also be compressed in chunks on separate threads, the way
+// pigz does: each chunk starts with the 32 KiB before it as its dictionary
+// and ends on a byte boundary, so the chunks join into one gzip member that
+// loses little against compressing the input in one go.
+
+// CRC-32 as gzip uses it, continuing from 'crc' (0 for the first piece)
+uint32_t deflate_crc32(uint32_t crc, const void *data, size_t len);
+
+// Compress 'size' bytes into one gzip member in a newly allocated buffer.
+// On success stores it in *out and its length in *out_len and returns 0;
+// the caller must alloc_free the buffer. Returns nonzero if out of memory.
+int deflate_gzip(const unsigned char *data, size_t size, unsigned char **out, size_t *out_len);
+
+// CRC-32 of two pieces joined, from the CRC of each and the second's length
+uint32_t deflate_crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+// Input bytes per chunk of deflate_chunk
+#define DEFLATE_CHUNK_SIZE (256 * 1024)
+
+// One chunk of the input compressed on its own
+typedef struct {
+    unsigned char *data;    // DEFLATE blocks ending on a byte boundary
+    size_t len;
+    uint32_t crc;           // CRC-32 of the input the chunk covers
+} deflate_chunk_t;
+
+// Number of chunks 'size' bytes are compressed in, at least 1
+size_t deflate_chunk_count(size_t size);
+
+// Compress chunk 'index' of the input into 'chunk'. Chunks are independent
+// and may be compressed in any order and on any thread. Returns nonzero if
+// out of memory.
+int deflate_chunk(const unsigned char *data, size_t size, size_t index, deflate_chunk_t *chunk);
+
+// Part of the input chunk 'index' of 'size' bytes reads: the chunk and the
+// window before it. Stores where it starts in *offset and returns its length.
+size_t deflate_chunk_window(size_t size, size_t index, size_t *offset);
+
+// Same as deflate_chunk, given only the part of the input that
+// deflate_chunk_window names, so a large input need not be held whole.
+int deflate_chunk_from(const unsigned char *window, size_t size, size_t index, deflate_chunk_t *chunk);
+
+// Most memory deflate_gzip or deflate_chunk allocates for 'size' input bytes,
+// tables and output together
+size_t deflate_memory(size_t size);
+
+// Join all 'count' chunks of 'size' input bytes into one gzip member, like
+// deflate_gzip. The chunks are left to the caller to alloc_free.
+int deflate_join(const deflate_chunk_t *chunks, size_t count, size_t size, unsigned char **out, size_t *out_len);
+
+#endif // DEFLATE_H
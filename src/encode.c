@@ -0,0 +1,270 @@
+#include "encode.h"
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ENCODE_HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#define HEX_DIGIT(n) ((n) < 10 ? '0' + (n) : 'A' + (n) - 10)
+#define HEX_ENTRY(n) { '0', 'x', HEX_DIGIT((n) >> 4), HEX_DIGIT((n) & 0xF), ',' }
+#define HEX_ROW(h) \
+    HEX_ENTRY((h) * 16 + 0),  HEX_ENTRY((h) * 16 + 1),  HEX_ENTRY((h) * 16 + 2),  HEX_ENTRY((h) * 16 + 3), \
+    HEX_ENTRY((h) * 16 + 4),  HEX_ENTRY((h) * 16 + 5),  HEX_ENTRY((h) * 16 + 6),  HEX_ENTRY((h) * 16 + 7), \
+    HEX_ENTRY((h) * 16 + 8),  HEX_ENTRY((h) * 16 + 9),  HEX_ENTRY((h) * 16 + 10), HEX_ENTRY((h) * 16 + 11), \
+    HEX_ENTRY((h) * 16 + 12), HEX_ENTRY((h) * 16 + 13), HEX_ENTRY((h) * 16 + 14), HEX_ENTRY((h) * 16 + 15)
+
+// "0xNN," for every byte value, so encoding is a table lookup and a copy.
+static const char g_hex_table[256][ENCODE_CHARS_PER_BYTE] = {
+    HEX_ROW(0),  HEX_ROW(1),  HEX_ROW(2),  HEX_ROW(3),
+    HEX_ROW(4),  HEX_ROW(5),  HEX_ROW(6),  HEX_ROW(7),
+    HEX_ROW(8),  HEX_ROW(9),  HEX_ROW(10), HEX_ROW(11),
+    HEX_ROW(12), HEX_ROW(13), HEX_ROW(14), HEX_ROW(15)
+};
+
+size_t encode_hex_size(size_t pos, size_t len) {
+    size_t breaks = (pos + len) / ENCODE_BYTES_PER_ROW - pos / ENCODE_BYTES_PER_ROW;
+    return len * ENCODE_CHARS_PER_BYTE + breaks;
+}
+
+typedef void (*encode_rows_fn)(char *dst, const unsigned char *src, size_t rows);
+
+// Encode 'rows' full rows of 16 bytes, each followed by its newline.
+static void encode_rows_scalar(char *dst, const unsigned char *src, size_t rows) {
+    for (size_t r = 0; r < rows; r++) {
+        for (int i = 0; i < ENCODE_BYTES_PER_ROW; i++) {
+            memcpy(dst + i * ENCODE_CHARS_PER_BYTE, g_hex_table[src[i]], ENCODE_CHARS_PER_BYTE);
+        }
+        dst[ENCODE_ROW_CHARS - 1] = '\n';
+        dst += ENCODE_ROW_CHARS;
+        src += ENCODE_BYTES_PER_ROW;
+    }
+}
+
+#ifdef ENCODE_HAVE_X86_KERNELS
+
+// Shuffle tables, indexed by output position. Each "0xNN," is built from the
+// high nibble digit of byte p/5 at offset 2, the low nibble digit at offset 3,
+// and constant characters elsewhere. 0x80 makes pshufb emit a zero byte.
+#define SEQ16(F, b) \
+    F((b) + 0),  F((b) + 1),  F((b) + 2),  F((b) + 3),  F((b) + 4),  F((b) + 5),  F((b) + 6),  F((b) + 7), \
+    F((b) + 8),  F((b) + 9),  F((b) + 10), F((b) + 11), F((b) + 12), F((b) + 13), F((b) + 14), F((b) + 15)
+#define SEQ_ROW(F) SEQ16(F, 0), SEQ16(F, 16), SEQ16(F, 32), SEQ16(F, 48), SEQ16(F, 64)
+
+#define ROW_HI_IDX(p) ((p) % 5 == 2 ? (p) / 5 : 0x80)
+#define ROW_LO_IDX(p) ((p) % 5 == 3 ? (p) / 5 : 0x80)
+#define ROW_TEMPLATE(p) ((p) % 5 == 0 ? '0' : (p) % 5 == 1 ? 'x' : (p) % 5 == 4 ? ',' : 0)
+
+static const unsigned char g_row_hi_idx[80] = { SEQ_ROW(ROW_HI_IDX) };
+static const unsigned char g_row_lo_idx[80] = { SEQ_ROW(ROW_LO_IDX) };
+static const unsigned char g_row_template[80] = { SEQ_ROW(ROW_TEMPLATE) };
+
+// Four rows (324 characters) for the AVX-512 kernel, padded to six vectors.
+// Indices below 64 select from the high digits, 64 and up from the low digits.
+#define QUAD_Q(p) ((p) % ENCODE_ROW_CHARS)
+#define QUAD_BYTE(p) ((p) / ENCODE_ROW_CHARS * 16 + QUAD_Q(p) / 5)
+#define QUAD_IDX(p) ((p) >= 4 * ENCODE_ROW_CHARS || QUAD_Q(p) == 80 ? 0 : \
+                     QUAD_Q(p) % 5 == 2 ? QUAD_BYTE(p) : \
+                     QUAD_Q(p) % 5 == 3 ? 64 + QUAD_BYTE(p) : 0)
+#define QUAD_TEMPLATE(p) ((p) >= 4 * ENCODE_ROW_CHARS ? 0 : QUAD_Q(p) == 80 ? '\n' : \
+                          ROW_TEMPLATE(QUAD_Q(p)))
+#define SEQ_QUAD(F) \
+    SEQ16(F, 0),   SEQ16(F, 16),  SEQ16(F, 32),  SEQ16(F, 48),  SEQ16(F, 64),  SEQ16(F, 80), \
+    SEQ16(F, 96),  SEQ16(F, 112), SEQ16(F, 128), SEQ16(F, 144), SEQ16(F, 160), SEQ16(F, 176), \
+    SEQ16(F, 192), SEQ16(F, 208), SEQ16(F, 224), SEQ16(F, 240), SEQ16(F, 256), SEQ16(F, 272), \
+    SEQ16(F, 288), SEQ16(F, 304), SEQ16(F, 320), SEQ16(F, 336), SEQ16(F, 352), SEQ16(F, 368)
+
+static const unsigned char g_quad_idx[384] = { SEQ_QUAD(QUAD_IDX) };
+static const unsigned char g_quad_template[384] = { SEQ_QUAD(QUAD_TEMPLATE) };
+
+__attribute__((target("ssse3")))
+static void encode_rows_ssse3(char *dst, const unsigned char *src, size_t rows) {
+    const __m128i digits = _mm_loadu_si128((const __m128i*)"0123456789ABCDEF");
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    for (size_t r = 0; r < rows; r++) {
+        __m128i v = _mm_loadu_si128((const __m128i*)src);
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, nibble));
+
+        for (int k = 0; k < 80; k += 16) {
+            __m128i out = _mm_loadu_si128((const __m128i*)(g_row_template + k));
+            out = _mm_or_si128(out, _mm_shuffle_epi8(hi, _mm_loadu_si128((const __m128i*)(g_row_hi_idx + k))));
+            out = _mm_or_si128(out, _mm_shuffle_epi8(lo, _mm_loadu_si128((const __m128i*)(g_row_lo_idx + k))));
+            _mm_storeu_si128((__m128i*)(dst + k), out);
+        }
+        dst[ENCODE_ROW_CHARS - 1] = '\n';
+        dst += ENCODE_ROW_CHARS;
+        src += ENCODE_BYTES_PER_ROW;
+    }
+}
+
+// Write one row whose digits are duplicated in both 128-bit lanes of hi/lo.
+__attribute__((target("avx2")))
+static inline void encode_row_avx2(char *dst, __m256i hi, __m256i lo) {
+    for (int k = 0; k < 64; k += 32) {
+        __m256i out = _mm256_loadu_si256((const __m256i*)(g_row_template + k));
+        out = _mm256_or_si256(out, _mm256_shuffle_epi8(hi, _mm256_loadu_si256((const __m256i*)(g_row_hi_idx + k))));
+        out = _mm256_or_si256(out, _mm256_shuffle_epi8(lo, _mm256_loadu_si256((const __m256i*)(g_row_lo_idx + k))));
+        _mm256_storeu_si256((__m256i*)(dst + k), out);
+    }
+    __m128i out = _mm_loadu_si128((const __m128i*)(g_row_template + 64));
+    out = _mm_or_si128(out, _mm_shuffle_epi8(_mm256_castsi256_si128(hi), _mm_loadu_si128((const __m128i*)(g_row_hi_idx + 64))));
+    out = _mm_or_si128(out, _mm_shuffle_epi8(_mm256_castsi256_si128(lo), _mm_loadu_si128((const __m128i*)(g_row_lo_idx + 64))));
+    _mm_storeu_si128((__m128i*)(dst + 64), out);
+    dst[ENCODE_ROW_CHARS - 1] = '\n';
+}
+
+__attribute__((target("avx2")))
+static void encode_rows_avx2(char *dst, const unsigned char *src, size_t rows) {
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)"0123456789ABCDEF"));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    for (; rows >= 2; rows -= 2) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)src);
+        __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(v, nibble));
+
+        // pshufb works within 128-bit lanes, so give each row both lanes
+        encode_row_avx2(dst, _mm256_permute2x128_si256(hi, hi, 0x00), _mm256_permute2x128_si256(lo, lo, 0x00));
+        encode_row_avx2(dst + ENCODE_ROW_CHARS, _mm256_permute2x128_si256(hi, hi, 0x11), _mm256_permute2x128_si256(lo, lo, 0x11));
+        dst += 2 * ENCODE_ROW_CHARS;
+        src += 2 * ENCODE_BYTES_PER_ROW;
+    }
+    if (rows) {
+        encode_rows_ssse3(dst, src, rows);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void encode_rows_avx512(char *dst, const unsigned char *src, size_t rows) {
+    const __m512i digits = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)"0123456789ABCDEF"));
+    const __m512i nibble = _mm512_set1_epi8(0x0F);
+
+    for (; rows >= 4; rows -= 4) {
+        __m512i v = _mm512_loadu_si512((const void*)src);
+        __m512i hi = _mm512_shuffle_epi8(digits, _mm512_and_si512(_mm512_srli_epi16(v, 4), nibble));
+        __m512i lo = _mm512_shuffle_epi8(digits, _mm512_and_si512(v, nibble));
+
+        for (int k = 0; k < 384; k += 64) {
+            __m512i tmpl = _mm512_loadu_si512((const void*)(g_quad_template + k));
+            __m512i idx = _mm512_loadu_si512((const void*)(g_quad_idx + k));
+            __m512i digit = _mm512_permutex2var_epi8(hi, idx, lo);
+            __m512i out = _mm512_mask_blend_epi8(_mm512_test_epi8_mask(tmpl, tmpl), digit, tmpl);
+            if (k + 64 <= 4 * ENCODE_ROW_CHARS) {
+                _mm512_storeu_si512((void*)(dst + k), out);
+            } else {
+                _mm512_mask_storeu_epi8(dst + k, ((__mmask64)1 << (4 * ENCODE_ROW_CHARS - k)) - 1, out);
+            }
+        }
+        dst += 4 * ENCODE_ROW_CHARS;
+        src += 4 * ENCODE_BYTES_PER_ROW;
+    }
+    if (rows) {
+        encode_rows_avx2(dst, src, rows);
+    }
+}
+
+#endif // ENCODE_HAVE_X86_KERNELS
+
+static encode_kernel_t g_kernel = ENCODE_KERNEL_SCALAR;
+static encode_rows_fn g_encode_rows = encode_rows_scalar;
+
+int encode_kernel_supported(encode_kernel_t kernel) {
+    switch (kernel) {
+    case ENCODE_KERNEL_AUTO:
+    case ENCODE_KERNEL_SCALAR:
+        return 1;
+#ifdef ENCODE_HAVE_X86_KERNELS
+    case ENCODE_KERNEL_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case ENCODE_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ENCODE_KERNEL_AVX512:
+        return __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vbmi");
+#endif
+    default:
+        return 0;
+    }
+}
+
+int encode_set_kernel(encode_kernel_t kernel) {
+    if (kernel == ENCODE_KERNEL_AUTO) {
+        kernel = ENCODE_KERNEL_SCALAR;
+        for (int k = ENCODE_KERNEL_AVX512; k > ENCODE_KERNEL_SCALAR; k--) {
+            if (encode_kernel_supported((encode_kernel_t)k)) {
+                kernel = (encode_kernel_t)k;
+                break;
+            }
+        }
+    }
+    if (!encode_kernel_supported(kernel)) {
+        return -1;
+    }
+
+    switch (kernel) {
+#ifdef ENCODE_HAVE_X86_KERNELS
+    case ENCODE_KERNEL_SSSE3:
+        g_encode_rows = encode_rows_ssse3;
+        break;
+    case ENCODE_KERNEL_AVX2:
+        g_encode_rows = encode_rows_avx2;
+        break;
+    case ENCODE_KERNEL_AVX512:
+        g_encode_rows = encode_rows_avx512;
+        break;
+#endif
+    default:
+        g_encode_rows = encode_rows_scalar;
+        break;
+    }
+    g_kernel = kernel;
+    return 0;
+}
+
+encode_kernel_t encode_get_kernel(void) {
+    return g_kernel;
+}
+
+const char* encode_kernel_name(encode_kernel_t kernel) {
+    switch (kernel) {
+    case ENCODE_KERNEL_AUTO:   return "auto";
+    case ENCODE_KERNEL_SCALAR: return "scalar";
+    case ENCODE_KERNEL_SSSE3:  return "ssse3";
+    case ENCODE_KERNEL_AVX2:   return "avx2";
+    case ENCODE_KERNEL_AVX512: return "avx512";
+    default:                   return "unknown";
+    }
+}
+
+size_t encode_hex(char *dst, const unsigned char *src, size_t len, size_t pos) {
+    char *p = dst;
+    size_t i = 0;
+
+    // Leading bytes up to the next row boundary
+    while (i < len && (pos + i) % ENCODE_BYTES_PER_ROW != 0) {
+        memcpy(p, g_hex_table[src[i]], ENCODE_CHARS_PER_BYTE);
+        p += ENCODE_CHARS_PER_BYTE;
+        i++;
+        if ((pos + i) % ENCODE_BYTES_PER_ROW == 0) {
+            *p++ = '\n';
+        }
+    }
+
+    // Whole rows
+    size_t rows = (len - i) / ENCODE_BYTES_PER_ROW;
+    if (rows) {
+        g_encode_rows(p, src + i, rows);
+        p += rows * ENCODE_ROW_CHARS;
+        i += rows * ENCODE_BYTES_PER_ROW;
+    }
+
+    // Trailing partial row
+    while (i < len) {
+        memcpy(p, g_hex_table[src[i]], ENCODE_CHARS_PER_BYTE);
+        p += ENCODE_CHARS_PER_BYTE;
+        i++;
+    }
+
+    return (size_t)(p - dst);
+}
@@ -0,0 +1,47 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+
+// Layout of the array body emitted by convert_write_c_array:
+// every byte becomes "0xNN," and a newline follows every 16th byte.
+#define ENCODE_BYTES_PER_ROW 16
+#define ENCODE_CHARS_PER_BYTE 5
+#define ENCODE_ROW_CHARS (ENCODE_BYTES_PER_ROW * ENCODE_CHARS_PER_BYTE + 1)
+
+// Row encoding kernels. Vector kernels are only built for x86 with GCC/Clang
+// and are only selectable when the running CPU supports them.
+typedef enum {
+    ENCODE_KERNEL_AUTO = 0,     // Best kernel supported by this CPU
+    ENCODE_KERNEL_SCALAR,       // Lookup table, works everywhere
+    ENCODE_KERNEL_SSSE3,        // 16 bytes per step
+    ENCODE_KERNEL_AVX2,         // 32 bytes per step
+    ENCODE_KERNEL_AVX512,       // 64 bytes per step, needs AVX-512 BW + VBMI
+} encode_kernel_t;
+
+// Returns nonzero if 'kernel' is built in and supported by this CPU.
+int encode_kernel_supported(encode_kernel_t kernel);
+
+// Select the kernel used by encode_hex(). ENCODE_KERNEL_AUTO picks the best one.
+// Call once at startup, before any encoding threads are running.
+// Returns 0 on success, nonzero if the kernel is not supported.
+int encode_set_kernel(encode_kernel_t kernel);
+
+// Returns the kernel currently in use.
+encode_kernel_t encode_get_kernel(void);
+
+// Returns a printable name for 'kernel'.
+const char* encode_kernel_name(encode_kernel_t kernel);
+
+// Number of characters encode_hex() writes for 'len' bytes that start at
+// byte offset 'pos' within the array.
+size_t encode_hex_size(size_t pos, size_t len);
+
+// Encodes 'len' bytes of 'src' as hex text into 'dst'.
+// 'pos' is the offset of src[0] within the whole array, so that row breaks
+// land in the same place no matter how the input is split into blocks.
+// 'dst' must hold at least encode_hex_size(pos, len) characters.
+// Returns the number of characters written (no null terminator is added).
+size_t encode_hex(char *dst, const unsigned char *src, size_t len, size_t pos);
+
+#endif // ENCODE_H
@@ -2,23 +2,251 @@
 #include <stdlib.h>
 #include <string.h>
 
+size_t file_info_size(file_info_t *info) {
+    if (info->size == PLATFORM_SIZE_UNKNOWN) {
+        size_t size = 0;
+        if (platform_stat_size(info->path, &size) != 0) {
+            size = 0;
+        }
+        info->size = size;
+    }
+    return info->size;
+}
+
 void file_list_init(file_list_t *list) {
-    list->count = 0;
-    list->capacity = 10;
-    list->files = (file_info_t*)malloc(list->capacity * sizeof(file_info_t));
+    memset(list, 0, sizeof(*list));
+    list->offsets = (uint64_t*)alloc_malloc(FILE_LIST_INITIAL_CAPACITY * sizeof(uint64_t));
+    list->sizes = (size_t*)alloc_malloc(FILE_LIST_INITIAL_CAPACITY * sizeof(size_t));
+    list->flags = (unsigned char*)alloc_malloc(FILE_LIST_INITIAL_CAPACITY);
+    if (list->offsets && list->sizes && list->flags) {
+        list->capacity = FILE_LIST_INITIAL_CAPACITY;
+    }
+    // Otherwise the first append tries again
+    arena_init(&list->paths, FILE_LIST_BLOCK_SIZE);
 }
 
-void file_list_append(file_list_t *list, const file_info_t *info) {
-    if (list->count == list->capacity) {
-        list->capacity *= 2;
-        list->files = (file_info_t*)realloc(list->files, list->capacity * sizeof(file_info_t));
+void file_list_init_front_coded(file_list_t *list) {
+    file_list_init(list);
+    list->front_coded = 1;
+}
+
+// Front-coded records are a varint prefix length followed by the rest of the
+// path and a terminator
+static size_t file_list_varint_size(size_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
     }
-    list->files[list->count++] = *info;
+    return n;
+}
+
+static int file_list_append_front_coded(file_list_t *list, const char *path, size_t len) {
+    size_t shared = 0;
+    if (list->count % FILE_LIST_RESTART_INTERVAL != 0) {
+        size_t limit = len < list->last_len ? len : list->last_len;
+        while (shared < limit && path[shared] == list->last_path[shared]) {
+            shared++;
+        }
+    }
+    if (len + 1 > list->last_capacity) {
+        char *last = (char*)alloc_realloc(list->last_path, (len + 1) * 2);
+        if (!last) {
+            return -1;
+        }
+        list->last_path = last;
+        list->last_capacity = (len + 1) * 2;
+    }
+
+    uint64_t offset;
+    size_t header = file_list_varint_size(shared);
+    unsigned char *dst = (unsigned char*)arena_alloc_at(&list->paths, header + len - shared + 1, &offset);
+    if (!dst) {
+        return -1;
+    }
+    size_t value = shared;
+    while (value >= 0x80) {
+        *dst++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *dst++ = (unsigned char)value;
+    memcpy(dst, path + shared, len - shared + 1);
+    list->offsets[list->count] = offset;
+
+    memcpy(list->last_path, path, len + 1);
+    list->last_len = len;
+    return 0;
+}
+
+// Grow every column to hold at least one more entry. A column that was
+// grown before another failed is just larger than it needs to be.
+static int file_list_grow(file_list_t *list) {
+    size_t capacity = list->capacity ? list->capacity * 2 : FILE_LIST_INITIAL_CAPACITY;
+    uint64_t *offsets = (uint64_t*)alloc_realloc(list->offsets, capacity * sizeof(uint64_t));
+    if (!offsets) {
+        return -1;
+    }
+    list->offsets = offsets;
+    size_t *sizes = (size_t*)alloc_realloc(list->sizes, capacity * sizeof(size_t));
+    if (!sizes) {
+        return -1;
+    }
+    list->sizes = sizes;
+    unsigned char *flags = (unsigned char*)alloc_realloc(list->flags, capacity);
+    if (!flags) {
+        return -1;
+    }
+    list->flags = flags;
+    list->capacity = capacity;
+    return 0;
+}
+
+int file_list_append(file_list_t *list, const file_info_t *info) {
+    if (list->count == list->capacity && file_list_grow(list) != 0) {
+        return -1;
+    }
+    size_t len = strlen(info->path);
+    if (list->front_coded) {
+        if (file_list_append_front_coded(list, info->path, len) != 0) {
+            return -1;
+        }
+    } else {
+        char *dst = (char*)arena_alloc_at(&list->paths, len + 1, &list->offsets[list->count]);
+        if (!dst) {
+            return -1;
+        }
+        memcpy(dst, info->path, len + 1);
+    }
+    list->sizes[list->count] = info->size;
+    list->flags[list->count] = info->is_dir ? FILE_LIST_FLAG_DIR : 0;
+    list->count++;
+    return 0;
+}
+
+void file_list_get(const file_list_t *list, size_t index, file_info_t *info) {
+    info->path = file_list_path(list, index);
+    info->size = list->sizes[index];
+    info->is_dir = file_list_is_dir(list, index);
+}
+
+const char* file_list_path(const file_list_t *list, size_t index) {
+    if (list->front_coded) {
+        return NULL;
+    }
+    return (const char*)arena_at(&list->paths, list->offsets[index]);
+}
+
+size_t file_list_copy_path(const file_list_t *list, size_t index, char *buf, size_t buf_len) {
+    if (!list->front_coded) {
+        const char *path = file_list_path(list, index);
+        size_t len = strlen(path);
+        if (buf_len > 0) {
+            size_t n = len < buf_len - 1 ? len : buf_len - 1;
+            memcpy(buf, path, n);
+            buf[n] = '\0';
+        }
+        return len;
+    }
+
+    // Rebuild the path from the last entry that was stored in full. Only
+    // the first buf_len - 1 characters are kept, but all lengths are tracked.
+    size_t len = 0;
+    for (size_t i = index - index % FILE_LIST_RESTART_INTERVAL; i <= index; i++) {
+        const unsigned char *src = (const unsigned char*)arena_at(&list->paths, list->offsets[i]);
+        size_t shared = 0;
+        unsigned shift = 0;
+        while (*src & 0x80) {
+            shared |= (size_t)(*src++ & 0x7f) << shift;
+            shift += 7;
+        }
+        shared |= (size_t)*src++ << shift;
+
+        size_t rest = strlen((const char*)src);
+        if (buf_len > 0 && shared < buf_len - 1) {
+            size_t n = rest < buf_len - 1 - shared ? rest : buf_len - 1 - shared;
+            memcpy(buf + shared, src, n);
+        }
+        len = shared + rest;
+    }
+    if (buf_len > 0) {
+        buf[len < buf_len - 1 ? len : buf_len - 1] = '\0';
+    }
+    return len;
+}
+
+size_t file_list_size(const file_list_t *list, size_t index) {
+    return list->sizes[index];
+}
+
+void file_list_set_size(file_list_t *list, size_t index, size_t size) {
+    list->sizes[index] = size;
+}
+
+int file_list_is_dir(const file_list_t *list, size_t index) {
+    return (list->flags[index] & FILE_LIST_FLAG_DIR) != 0;
+}
+
+size_t file_list_memory(const file_list_t *list) {
+    size_t per_entry = sizeof(uint64_t) + sizeof(size_t) + 1;
+    return list->capacity * per_entry + list->paths.block_capacity * sizeof(char*) + list->paths.bytes + list->last_capacity;
 }
 
 void file_list_free(file_list_t *list) {
-    free(list->files);
-    list->files = NULL;
-    list->count = 0;
-    list->capacity = 0;
+    arena_free(&list->paths);
+    alloc_free(list->offsets);
+    alloc_free(list->sizes);
+    alloc_free(list->flags);
+    alloc_free(list->last_path);
+    memset(list, 0, sizeof(*list));
+}
+
+void file_feed_init(file_feed_t *feed, file_list_t *list) {
+    feed->list = list;
+    feed->done = 0;
+    feed->error = 0;
+    platform_mutex_init(&feed->lock);
+    platform_cond_init(&feed->grown);
+}
+
+int file_feed_append(file_feed_t *feed, const file_info_t *info) {
+    platform_mutex_lock(&feed->lock);
+    int result = file_list_append(feed->list, info);
+    platform_cond_broadcast(&feed->grown);
+    platform_mutex_unlock(&feed->lock);
+    return result;
+}
+
+void file_feed_finish(file_feed_t *feed, int error) {
+    platform_mutex_lock(&feed->lock);
+    feed->done = 1;
+    feed->error = error;
+    platform_cond_broadcast(&feed->grown);
+    platform_mutex_unlock(&feed->lock);
+}
+
+int file_feed_get(file_feed_t *feed, size_t index, file_info_t *info) {
+    int result = 0;
+    platform_mutex_lock(&feed->lock);
+    while (index >= feed->list->count && !feed->done) {
+        platform_cond_wait(&feed->grown, &feed->lock);
+    }
+    if (index < feed->list->count) {
+        file_list_get(feed->list, index, info);
+    } else {
+        result = -1;
+    }
+    platform_mutex_unlock(&feed->lock);
+    return result;
+}
+
+int file_feed_error(file_feed_t *feed) {
+    platform_mutex_lock(&feed->lock);
+    int error = feed->error;
+    platform_mutex_unlock(&feed->lock);
+    return error;
+}
+
+void file_feed_destroy(file_feed_t *feed) {
+    platform_cond_destroy(&feed->grown);
+    platform_mutex_destroy(&feed->lock);
 }
@@ -2,26 +2,128 @@
 #define FILE_LIST_H
 
 #include <stddef.h>
+#include "platform.h"
+#include "alloc.h"
 
+#include <stdint.h>
+
+// One file, as passed to file_list_append and handed out by file_list_get.
 typedef struct {
-    char path[512];
-    size_t size;
+    const char *path;   // Owned by the list once appended
+    size_t size;        // PLATFORM_SIZE_UNKNOWN until looked up, see file_info_size
     int is_dir;
 } file_info_t;
 
+// Entries a new list has room for before its columns grow
+#define FILE_LIST_INITIAL_CAPACITY 10
+
+// Bytes per block of the path arena. Longer paths get a block of their own.
+#define FILE_LIST_BLOCK_SIZE (64 * 1024)
+
+// With front coding, every this many entries one is stored in full, so a
+// path is never more than this many steps from one that can be read as is.
+#define FILE_LIST_RESTART_INTERVAL 16
+
+// Entry flags
+#define FILE_LIST_FLAG_DIR 0x01
+
+// A list of files kept compact for very large trees. Paths are copied into
+// a bump arena of fixed blocks that never move, and each entry is just the
+// offset of its path plus its size and flags, kept in separate columns.
+// Offsets put the block number in the upper 32 bits.
+//
+// Optionally (file_list_init_front_coded) a path is stored as the length of
+// the prefix it shares with the previous path plus the rest, which saves the
+// repeated directory part of sibling files. Such paths have to be read with
+// file_list_copy_path.
 typedef struct {
-    file_info_t *files;
     size_t count;
     size_t capacity;
+    uint64_t *offsets;          // Path of each entry in the arena
+    size_t *sizes;
+    unsigned char *flags;
+
+    arena_t paths;              // Blocks of FILE_LIST_BLOCK_SIZE bytes
+
+    int front_coded;
+    char *last_path;            // Previous path, while front coding
+    size_t last_len;
+    size_t last_capacity;
 } file_list_t;
 
+// Returns the size of the file, looking it up and storing it in 'info' the
+// first time if the scan did not provide it. Returns 0 if the file cannot be
+// stat'ed; reading it will then fail and report the error.
+size_t file_info_size(file_info_t *info);
+
 // Initialize the file list
 void file_list_init(file_list_t *list);
 
-// Append a file_info_t entry to the list
-void file_list_append(file_list_t *list, const file_info_t *info);
+// Initialize the file list with front-coded paths
+void file_list_init_front_coded(file_list_t *list);
+
+// Append a file_info_t entry to the list. The path is copied, so the caller
+// may reuse its buffer; the copy stays valid until file_list_free.
+// Returns 0 on success, nonzero if out of memory, leaving the list as it was.
+int file_list_append(file_list_t *list, const file_info_t *info);
+
+// Fill 'info' with entry 'index'. The path points into the list's arena and
+// stays valid until file_list_free. Not for front-coded lists, whose entries
+// get a NULL path; use file_list_copy_path for those.
+void file_list_get(const file_list_t *list, size_t index, file_info_t *info);
+
+// Path of entry 'index', or NULL for a front-coded list
+const char* file_list_path(const file_list_t *list, size_t index);
+
+// Copy the path of entry 'index' into 'buf', truncating it to 'buf_len' - 1
+// characters. Works for every list. Returns the full length of the path.
+size_t file_list_copy_path(const file_list_t *list, size_t index, char *buf, size_t buf_len);
+
+// Size of entry 'index' as appended, or as set by file_list_set_size
+size_t file_list_size(const file_list_t *list, size_t index);
+
+// Record the size of entry 'index', once it has been looked up
+void file_list_set_size(file_list_t *list, size_t index, size_t size);
+
+// Returns nonzero if entry 'index' is a directory
+int file_list_is_dir(const file_list_t *list, size_t index);
+
+// Bytes held by the list: columns plus path arena
+size_t file_list_memory(const file_list_t *list);
 
 // Free the list resources
 void file_list_free(file_list_t *list);
 
+// A file list filled by one thread while others read it, so that files can
+// be converted while the scan is still running. Entries are read by copy,
+// since appending may move the underlying array.
+typedef struct {
+    file_list_t *list;
+    platform_mutex_t lock;
+    platform_cond_t grown;      // Signalled on append and on finish
+    int done;                   // No more entries will be appended
+    int error;                  // Result passed to file_feed_finish
+} file_feed_t;
+
+// Start a feed over 'list', which must stay alive until the feed is destroyed.
+// Readers get pointers into the list's arena, so it cannot be front coded.
+void file_feed_init(file_feed_t *feed, file_list_t *list);
+
+// Append an entry and wake any waiting readers. Returns nonzero if out of
+// memory, like file_list_append.
+int file_feed_append(file_feed_t *feed, const file_info_t *info);
+
+// Mark the feed complete. 'error' is the producer's result (0 on success).
+void file_feed_finish(file_feed_t *feed, int error);
+
+// Copy entry 'index' into 'info', waiting until it has been appended.
+// Returns 0 on success, nonzero if the feed finished without reaching 'index'.
+int file_feed_get(file_feed_t *feed, size_t index, file_info_t *info);
+
+// The producer's result; only meaningful once the feed has finished
+int file_feed_error(file_feed_t *feed);
+
+// Release the feed's locks (the list itself is left alone)
+void file_feed_destroy(file_feed_t *feed);
+
 #endif  // FILE_LIST_H
@@ -0,0 +1,931 @@
+#include "generate.h"
+#include "convert.h"
+#include "encode.h"
+#include "perfect_hash.h"
+#include "chksum.h"
+#include "deflate.h"
+#include "thread_pool.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One array in the output
+typedef struct {
+    size_t index;           // Entry in the list, which names the array
+    const char *name;       // URL the httpd looks it up by
+    size_t data_offset;     // Where the header starts in the array
+    unsigned flags;         // GENERATE_FLAG_*
+    const uint16_t *chksums;    // Of each segment of the response, with precalc_chksum
+    size_t chksum_count;
+    size_t response_len;        // Header and contents
+} generate_entry_t;
+
+#define GENERATE_FLAG_PERSISTENT 0x01
+
+// lwIP counts the checksums of a file in a u16_t
+#define GENERATE_MAX_CHKSUMS 65535
+
+// Bytes per block of the arena holding the names
+#define GENERATE_NAME_BLOCK_SIZE (64 * 1024)
+
+// Header line of files served compressed
+#define GENERATE_GZIP_HEADER "Content-Encoding: gzip\r\n"
+
+// Contents of an entry held in memory, with gzip
+typedef struct {
+    unsigned char *data;    // gzip data, or NULL to convert the file as it is
+    size_t size;
+} generate_source_t;
+
+struct generator {
+    generate_options_t options;
+    pipeline_hooks_t hooks;
+    generate_entry_t *entries;
+    arena_t names;              // And checksums
+    platform_input *input;      // Reads files again for their checksums
+    generate_source_t *sources; // By entry, once generate_compress has run
+    size_t source_count;
+    size_t count;
+    size_t capacity;
+    int error;              // An entry could not be recorded
+};
+
+// Content types by extension, as the lwIP makefsdata tool sends them
+static const struct {
+    const char *ext;
+    const char *type;
+} generate_content_types[] = {
+    { "html", "text/html" },
+    { "htm", "text/html" },
+    { "shtml", "text/html" },
+    { "shtm", "text/html" },
+    { "ssi", "text/html" },
+    { "css", "text/css" },
+    { "js", "application/javascript" },
+    { "json", "application/json" },
+    { "xml", "text/xml" },
+    { "xsl", "text/xml" },
+    { "txt", "text/plain" },
+    { "svg", "image/svg+xml" },
+    { "png", "image/png" },
+    { "gif", "image/gif" },
+    { "jpg", "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "bmp", "image/bmp" },
+    { "ico", "image/x-icon" },
+    { "pdf", "application/pdf" },
+    { "woff", "font/woff" },
+    { "woff2", "font/woff2" },
+    { "wasm", "application/wasm" },
+    { "class", "application/octet-stream" },
+    { "swf", "application/x-shockwave-flash" },
+};
+
+// Server Side Include files are filled in by the httpd, so their length is
+// not known here and the connection has to close after them
+static const char *generate_ssi_exts[] = { "shtml", "shtm", "ssi" };
+
+static int generate_ext_equal(const char *a, const char *b) {
+    for (; *a && *b; a++, b++) {
+        char c = *a >= 'A' && *a <= 'Z' ? (char)(*a - 'A' + 'a') : *a;
+        if (c != *b) {
+            return 0;
+        }
+    }
+    return *a == *b;
+}
+
+// Extension of the last path component, or "" if it has none
+static const char* generate_ext(const char *name) {
+    const char *slash = strrchr(name, '/');
+    const char *dot = strrchr(slash ? slash : name, '.');
+    return dot ? dot + 1 : "";
+}
+
+static const char* generate_content_type(const char *ext) {
+    for (size_t i = 0; i < sizeof(generate_content_types) / sizeof(generate_content_types[0]); i++) {
+        if (generate_ext_equal(ext, generate_content_types[i].ext)) {
+            return generate_content_types[i].type;
+        }
+    }
+    return "text/plain";
+}
+
+static int generate_is_ssi(const char *ext) {
+    for (size_t i = 0; i < sizeof(generate_ssi_exts) / sizeof(generate_ssi_exts[0]); i++) {
+        if (generate_ext_equal(ext, generate_ssi_exts[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Status line for the file: the httpd serves /404.html and friends for errors
+static const char* generate_status(const char *name) {
+    if (strncmp(name, "/404.", 5) == 0) {
+        return "404 File not found";
+    }
+    if (strncmp(name, "/400.", 5) == 0) {
+        return "400 Bad Request";
+    }
+    if (strncmp(name, "/501.", 5) == 0) {
+        return "501 Not Implemented";
+    }
+    return "200 OK";
+}
+
+// Write the name the httpd looks 'path' up by into 'dst', which holds 'cap'
+// bytes. Returns its length, or 0 if it does not fit.
+static size_t generate_name(const generator_t *gen, const char *path, char *dst, size_t cap) {
+    const char *rel = path;
+    size_t dir_len = strlen(gen->options.input_dir);
+    if (strncmp(path, gen->options.input_dir, dir_len) == 0) {
+        rel = path + dir_len;
+    }
+    while (*rel == '/' || *rel == PLATFORM_PATH_SEP) {
+        rel++;
+    }
+    size_t len = strlen(rel) + 1;
+    if (len + 1 > cap) {
+        return 0;
+    }
+    dst[0] = '/';
+    for (size_t i = 1; i < len; i++) {
+        dst[i] = rel[i - 1] == PLATFORM_PATH_SEP ? '/' : rel[i - 1];
+    }
+    dst[len] = '\0';
+    return len;
+}
+
+// Build the prefix and report whether the header lets the connection persist.
+// 'gzip' marks contents that are gzip data.
+static size_t generate_build(const generator_t *gen, const char *path, size_t size, int gzip, unsigned char *dst,
+                             size_t *data_offset, unsigned *flags) {
+    char name[PIPELINE_PREFIX_MAX];
+    size_t name_len = generate_name(gen, path, name, sizeof(name));
+    if (name_len == 0) {
+        return 0;
+    }
+    const char *ext = generate_ext(name);
+    int ssi = generate_is_ssi(ext);
+    int keep_alive = gen->options.keep_alive && !ssi;
+
+    char header[512];
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.%c %s\r\nContent-Type: %s\r\n",
+                              gen->options.keep_alive ? '1' : '0', generate_status(name), generate_content_type(ext));
+    if (gzip) {
+        header_len += snprintf(header + header_len, sizeof(header) - (size_t)header_len, GENERATE_GZIP_HEADER);
+    }
+    if (!ssi) {
+        header_len += snprintf(header + header_len, sizeof(header) - (size_t)header_len,
+                               "Content-Length: %llu\r\n", (unsigned long long)size);
+    }
+    header_len += snprintf(header + header_len, sizeof(header) - (size_t)header_len,
+                           "Connection: %s\r\n\r\n", keep_alive ? "keep-alive" : "close");
+
+    // The name and its NUL, padded so that name plus header fill whole rows
+    size_t padded = name_len + 1;
+    size_t total = padded + (size_t)header_len;
+    padded += (ENCODE_BYTES_PER_ROW - total % ENCODE_BYTES_PER_ROW) % ENCODE_BYTES_PER_ROW;
+    total = padded + (size_t)header_len;
+    if (total > PIPELINE_PREFIX_MAX) {
+        return 0;
+    }
+    memset(dst, 0, padded);
+    memcpy(dst, name, name_len);
+    memcpy(dst + padded, header, (size_t)header_len);
+    if (data_offset) {
+        *data_offset = padded;
+    }
+    if (flags) {
+        *flags = keep_alive ? GENERATE_FLAG_PERSISTENT : 0;
+    }
+    return total;
+}
+
+size_t generate_prefix(const generator_t *gen, const char *path, size_t size, unsigned char *dst, size_t *data_offset) {
+    return generate_build(gen, path, size, 0, dst, data_offset, NULL);
+}
+
+// Compressed contents of entry 'index', or NULL
+static const generate_source_t* generate_source(const generator_t *gen, size_t index) {
+    if (index >= gen->source_count || !gen->sources[index].data) {
+        return NULL;
+    }
+    return &gen->sources[index];
+}
+
+static size_t generate_prefix_hook(void *ctx, size_t index, const char *path, size_t size, unsigned char *dst) {
+    const generator_t *gen = (const generator_t*)ctx;
+    return generate_build(gen, path, size, generate_source(gen, index) != NULL, dst, NULL, NULL);
+}
+
+static const unsigned char* generate_contents_hook(void *ctx, size_t index, const char *path, size_t *size) {
+    (void)path;
+    const generate_source_t *src = generate_source((const generator_t*)ctx, index);
+    if (!src) {
+        return NULL;
+    }
+    *size = src->size;
+    return src->data;
+}
+
+// Sum each segment of the header in 'prefix' and the contents, which are
+// 'held' in memory or else read from the file again
+static int generate_checksum(generator_t *gen, generate_entry_t *e, const unsigned char *prefix, size_t prefix_len,
+                             const char *path, const unsigned char *held, size_t size) {
+    if (!held && platform_input_open(gen->input, path) != 0) {
+        fprintf(stderr, "Failed to checksum file: %s\n", path);
+        return -1;
+    }
+    chksum_segments_t segments;
+    chksum_segments_init(&segments, gen->options.mss);
+    int result = chksum_segments_add(&segments, prefix + e->data_offset, prefix_len - e->data_offset);
+    size_t done = 0;
+    if (held) {
+        if (result == 0) {
+            result = chksum_segments_add(&segments, held, size);
+            done = size;
+        }
+    } else if (platform_input_size(gen->input) != size) {
+        result = -1; // The contents have to be the ones just written
+    }
+    while (result == 0 && !held) {
+        const unsigned char *block;
+        size_t n;
+        if (platform_input_next(gen->input, &block, &n) != 0) {
+            result = -1;
+        } else if (n == 0) {
+            break;
+        } else {
+            result = chksum_segments_add(&segments, block, n);
+            done += n;
+        }
+    }
+    if (!held) {
+        platform_input_close(gen->input);
+    }
+    if (result == 0 && (done != size || chksum_segments_finish(&segments) != 0)) {
+        result = -1;
+    }
+    if (result != 0) {
+        fprintf(stderr, "Failed to checksum file: %s\n", path);
+    } else if (segments.count > GENERATE_MAX_CHKSUMS) {
+        fprintf(stderr, "Too many segments to checksum in %s; use a larger --mss\n", path);
+        result = -1;
+    } else {
+        uint16_t *chksums = (uint16_t*)arena_alloc(&gen->names, segments.count * sizeof(uint16_t));
+        if (chksums) {
+            memcpy(chksums, segments.sums, segments.count * sizeof(uint16_t));
+            e->chksums = chksums;
+            e->chksum_count = segments.count;
+        } else {
+            result = -1;
+        }
+    }
+    chksum_segments_free(&segments);
+    return result;
+}
+
+static void generate_written_hook(void *ctx, size_t index, const char *path, size_t size) {
+    generator_t *gen = (generator_t*)ctx;
+    if (gen->count == gen->capacity) {
+        size_t capacity = gen->capacity ? gen->capacity * 2 : 64;
+        generate_entry_t *entries = (generate_entry_t*)alloc_realloc(gen->entries, capacity * sizeof(generate_entry_t));
+        if (!entries) {
+            gen->error = 1;
+            return;
+        }
+        gen->entries = entries;
+        gen->capacity = capacity;
+    }
+    // Only the name, offset and flags are kept; the prefix is already written
+    unsigned char prefix[PIPELINE_PREFIX_MAX];
+    char name[PIPELINE_PREFIX_MAX];
+    generate_entry_t *e = &gen->entries[gen->count];
+    const generate_source_t *src = generate_source(gen, index);
+    size_t prefix_len = generate_build(gen, path, size, src != NULL, prefix, &e->data_offset, &e->flags);
+    if (prefix_len == 0 || generate_name(gen, path, name, sizeof(name)) == 0 ||
+        !(e->name = arena_strdup(&gen->names, name))) {
+        gen->error = 1;
+        return;
+    }
+    e->chksums = NULL;
+    e->chksum_count = 0;
+    e->response_len = prefix_len - e->data_offset + size;
+    if (gen->input && generate_checksum(gen, e, prefix, prefix_len, path, src ? src->data : NULL, size) != 0) {
+        gen->error = 1;
+        return;
+    }
+    e->index = index;
+    gen->count++;
+}
+
+generator_t* generate_create(const generate_options_t *options) {
+    generator_t *gen = (generator_t*)alloc_calloc(1, sizeof(generator_t));
+    if (!gen) {
+        return NULL;
+    }
+    gen->options = *options;
+    if (gen->options.mss == 0) {
+        gen->options.mss = GENERATE_DEFAULT_MSS;
+    }
+    if (gen->options.gzip_min_saving < 0) {
+        gen->options.gzip_min_saving = GENERATE_DEFAULT_GZIP_SAVING;
+    }
+    arena_init(&gen->names, GENERATE_NAME_BLOCK_SIZE);
+    if (gen->options.precalc_chksum) {
+        gen->input = platform_input_create(PLATFORM_INPUT_AUTO, CONVERT_STREAM_BLOCK_SIZE);
+        if (!gen->input) {
+            alloc_free(gen);
+            return NULL;
+        }
+    }
+    gen->hooks.contents = generate_contents_hook;
+    gen->hooks.prefix = generate_prefix_hook;
+    gen->hooks.written = generate_written_hook;
+    gen->hooks.ctx = gen;
+    return gen;
+}
+
+const pipeline_hooks_t* generate_hooks(generator_t *gen) {
+    return &gen->hooks;
+}
+
+size_t generate_file_count(const generator_t *gen) {
+    return gen->count;
+}
+
+// State shared by the tasks of one generate_compress. Work is admitted
+// against the memory limit the way the pipeline admits files: results kept
+// for the pipeline count for good, and a task's input, compressor and output
+// while it runs. Something is always admitted when nothing is running.
+typedef struct {
+    generator_t *gen;
+    platform_mutex_t lock;
+    platform_cond_t finished;   // Signalled as tasks finish
+    size_t limit;
+    size_t held;                // Results kept for the pipeline
+    size_t inflight;            // Running tasks, and chunks waiting to be joined
+    size_t running;
+} generate_run_t;
+
+// One file of generate_compress
+typedef struct {
+    generate_run_t *run;
+    size_t index;           // Entry in the served list
+    const char *path;       // File read: the entry's own, or its ".gz" sibling
+    int sibling;
+    int error;              // GENERATE_COMPRESS_*
+    size_t size;            // As looked up before compressing
+    size_t cost;            // Bytes admitted for a task that reads the whole file
+    deflate_chunk_t *chunks;    // Of a file compressed in chunks
+    size_t chunk_count;
+    size_t chunks_left;     // Not compressed yet, under the run's lock
+} generate_task_t;
+
+// One chunk of a large file, read and compressed on whichever thread is free
+typedef struct {
+    generate_task_t *task;
+    size_t index;
+    size_t cost;
+} generate_chunk_t;
+
+#define GENERATE_COMPRESS_OK 0
+#define GENERATE_COMPRESS_NO_MEMORY 1
+#define GENERATE_COMPRESS_UNREADABLE 2     // Only an error for a sibling
+#define GENERATE_COMPRESS_NOT_GZIP 3
+
+// Whether 'compressed' bytes and the longer header save enough over 'size'
+static int generate_gzip_pays(const generator_t *gen, size_t size, size_t compressed) {
+    size_t served = compressed + strlen(GENERATE_GZIP_HEADER);
+    return served < size &&
+           (unsigned long long)(size - served) * 100 > (unsigned long long)size * (unsigned)gen->options.gzip_min_saving;
+}
+
+// Serve 'compressed' for the task's file if it pays, else drop it. Returns
+// the bytes kept.
+static size_t generate_compressed(generate_task_t *t, size_t size, unsigned char *compressed, size_t compressed_len) {
+    generate_source_t *src = &t->run->gen->sources[t->index];
+    if (generate_gzip_pays(t->run->gen, size, compressed_len)) {
+        src->data = compressed;
+        src->size = compressed_len;
+        return compressed_len;
+    }
+    alloc_free(compressed);
+    return 0;
+}
+
+// Wait until 'cost' more bytes fit in the limit, or nothing is running, and
+// take them
+static void generate_admit(generate_run_t *run, size_t cost) {
+    platform_mutex_lock(&run->lock);
+    while (run->running > 0 && run->held + run->inflight + cost > run->limit) {
+        platform_cond_wait(&run->finished, &run->lock);
+    }
+    run->inflight += cost;
+    run->running++;
+    platform_mutex_unlock(&run->lock);
+}
+
+// A task admitted for 'cost' is done, and keeps 'kept' bytes for the pipeline
+static void generate_finish(generate_run_t *run, size_t cost, size_t kept) {
+    platform_mutex_lock(&run->lock);
+    run->inflight -= cost;
+    run->held += kept;
+    run->running--;
+    platform_cond_broadcast(&run->finished);
+    platform_mutex_unlock(&run->lock);
+}
+
+static void generate_compress_task(void *arg, unsigned worker) {
+    (void)worker;
+    generate_task_t *t = (generate_task_t*)arg;
+    generate_source_t *src = &t->run->gen->sources[t->index];
+    size_t kept = 0;
+    size_t size = 0;
+    unsigned char *data = convert_read_file_contents(t->path, &size);
+    if (!data) {
+        t->error = GENERATE_COMPRESS_UNREADABLE;
+    } else if (t->sibling) {
+        // Served as it is, so it has to be a gzip member
+        if (size < 18 || data[0] != 0x1f || data[1] != 0x8b) {
+            t->error = GENERATE_COMPRESS_NOT_GZIP;
+            alloc_free(data);
+        } else {
+            src->data = data;
+            src->size = size;
+            kept = size;
+        }
+    } else {
+        unsigned char *compressed;
+        size_t compressed_len;
+        if (deflate_gzip(data, size, &compressed, &compressed_len) != 0) {
+            t->error = GENERATE_COMPRESS_NO_MEMORY;
+        } else {
+            kept = generate_compressed(t, size, compressed, compressed_len);
+        }
+        alloc_free(data);
+    }
+    generate_finish(t->run, t->cost, kept);
+}
+
+// Read 'len' bytes at 'offset' of 'path', which must still be 'size' bytes
+static int generate_read_range(const char *path, size_t size, size_t offset, unsigned char *dst, size_t len) {
+    platform_file_handle fh = platform_fopen(path, "rb");
+    if (!fh) {
+        return -1;
+    }
+    platform_off_t file_size;
+    int result = platform_file_size(fh, &file_size) == 0 && (unsigned long long)file_size == size &&
+                 platform_fseek(fh, (platform_off_t)offset, SEEK_SET) == 0 &&
+                 platform_fread(dst, 1, len, fh) == len ? 0 : -1;
+    platform_fclose(fh);
+    return result;
+}
+
+// Join the chunks of a large file into one gzip member and free them.
+// Returns the bytes kept.
+static size_t generate_join(generate_task_t *t) {
+    size_t kept = 0;
+    unsigned char *compressed;
+    size_t compressed_len;
+    if (t->error == GENERATE_COMPRESS_OK) {
+        if (deflate_join(t->chunks, t->chunk_count, t->size, &compressed, &compressed_len) != 0) {
+            t->error = GENERATE_COMPRESS_NO_MEMORY;
+        } else {
+            kept = generate_compressed(t, t->size, compressed, compressed_len);
+        }
+    }
+    for (size_t i = 0; i < t->chunk_count; i++) {
+        alloc_free(t->chunks[i].data);
+    }
+    alloc_free(t->chunks);
+    t->chunks = NULL;
+    return kept;
+}
+
+// Only the part of the file the chunk needs is read. Its output waits in
+// memory for the other chunks, and whichever chunk finishes last joins them.
+static void generate_chunk_task(void *arg, unsigned worker) {
+    (void)worker;
+    generate_chunk_t *c = (generate_chunk_t*)arg;
+    generate_task_t *t = c->task;
+    generate_run_t *run = t->run;
+    deflate_chunk_t *chunk = &t->chunks[c->index];
+    size_t offset;
+    size_t len = deflate_chunk_window(t->size, c->index, &offset);
+    unsigned char *window = (unsigned char*)alloc_malloc(len);
+    int error = GENERATE_COMPRESS_OK;
+    if (!window) {
+        error = GENERATE_COMPRESS_NO_MEMORY;
+    } else if (generate_read_range(t->path, t->size, offset, window, len) != 0) {
+        error = GENERATE_COMPRESS_UNREADABLE; // Left for the pipeline to read as it is
+    } else if (deflate_chunk_from(window, t->size, c->index, chunk) != 0) {
+        error = GENERATE_COMPRESS_NO_MEMORY;
+    }
+    alloc_free(window);
+
+    platform_mutex_lock(&run->lock);
+    if (error != GENERATE_COMPRESS_OK && t->error != GENERATE_COMPRESS_UNREADABLE) {
+        t->error = error;
+    }
+    run->inflight -= c->cost;
+    run->inflight += chunk->len;
+    int last = --t->chunks_left == 0;
+    if (!last) {
+        run->running--;
+        platform_cond_broadcast(&run->finished);
+    }
+    platform_mutex_unlock(&run->lock);
+    if (!last) {
+        return;
+    }
+
+    size_t waiting = 0;
+    for (size_t i = 0; i < t->chunk_count; i++) {
+        waiting += t->chunks[i].len;
+    }
+    size_t kept = generate_join(t);
+    generate_finish(run, waiting, kept);
+}
+
+// Run fn(arg) on the pool, or here if there is none
+static void generate_run(thread_pool_t *pool, thread_pool_task_fn fn, void *arg) {
+    if (!pool || thread_pool_submit(pool, fn, arg) != 0) {
+        fn(arg, 0);
+    }
+}
+
+typedef struct {
+    const char *path;
+    size_t index;
+} generate_path_t;
+
+static int generate_path_cmp(const void *a, const void *b) {
+    return strcmp(((const generate_path_t*)a)->path, ((const generate_path_t*)b)->path);
+}
+
+// Whether the task's file is compressed in chunks
+static int generate_is_chunked(const generate_task_t *t) {
+    return !t->sibling && t->size != PLATFORM_SIZE_UNKNOWN && t->size > DEFLATE_CHUNK_SIZE;
+}
+
+int generate_compress(generator_t *gen, const file_list_t *list, const pipeline_options_t *options, file_list_t *served) {
+    size_t count = list->count;
+    generate_path_t *sorted = (generate_path_t*)alloc_malloc((count ? count : 1) * sizeof(generate_path_t));
+    size_t *sibling = (size_t*)alloc_malloc((count ? count : 1) * sizeof(size_t));
+    unsigned char *taken = (unsigned char*)alloc_calloc(count ? count : 1, 1);
+    generate_task_t *tasks = (generate_task_t*)alloc_calloc(count ? count : 1, sizeof(generate_task_t));
+    gen->sources = (generate_source_t*)alloc_calloc(count ? count : 1, sizeof(generate_source_t));
+    if (!sorted || !sibling || !taken || !tasks || !gen->sources) {
+        alloc_free(sorted);
+        alloc_free(sibling);
+        alloc_free(taken);
+        alloc_free(tasks);
+        fprintf(stderr, "Failed to allocate compression buffers\n");
+        return -1;
+    }
+
+    // Pair each "x.gz" with an "x" in the list
+    for (size_t i = 0; i < count; i++) {
+        sorted[i].path = file_list_path(list, i);
+        sorted[i].index = i;
+        sibling[i] = SIZE_MAX;
+    }
+    qsort(sorted, count, sizeof(generate_path_t), generate_path_cmp);
+    char base[MAX_PATH_LENGTH];
+    for (size_t i = 0; i < count; i++) {
+        const char *path = file_list_path(list, i);
+        size_t len = strlen(path);
+        if (len <= 3 || len - 3 >= sizeof(base) || strcmp(path + len - 3, ".gz") != 0) {
+            continue;
+        }
+        memcpy(base, path, len - 3);
+        base[len - 3] = '\0';
+        generate_path_t key = { base, 0 };
+        const generate_path_t *found = (const generate_path_t*)bsearch(&key, sorted, count, sizeof(generate_path_t),
+                                                                         generate_path_cmp);
+        if (found && !generate_is_ssi(generate_ext(base))) {
+            sibling[found->index] = i;
+            taken[i] = 1;
+        }
+    }
+
+    generate_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.gen = gen;
+    run.limit = options->memory_limit ? options->memory_limit : PIPELINE_DEFAULT_MEMORY_LIMIT;
+
+    // Sizes are looked up here, since they decide how each file is compressed
+    size_t task_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (taken[i]) {
+            continue;
+        }
+        file_info_t info;
+        file_list_get(list, i, &info);
+        size_t index = served->count;
+        if (file_list_append(served, &info) != 0) {
+            alloc_free(sorted);
+            alloc_free(sibling);
+            alloc_free(taken);
+            alloc_free(tasks);
+            fprintf(stderr, "Failed to allocate compression buffers\n");
+            return -1;
+        }
+        if (sibling[i] != SIZE_MAX || !generate_is_ssi(generate_ext(info.path))) {
+            generate_task_t *t = &tasks[task_count++];
+            t->run = &run;
+            t->index = index;
+            t->sibling = sibling[i] != SIZE_MAX;
+            t->path = t->sibling ? file_list_path(list, sibling[i]) : file_list_path(list, i);
+            if (!t->sibling) {
+                t->size = file_info_size(&info);
+            } else if (platform_stat_size(t->path, &t->size) != 0) {
+                t->size = 0; // Fails again when it is read
+            }
+            // A sibling is kept as it is read; other files need a compressor
+            t->cost = t->sibling ? t->size : t->size + deflate_memory(t->size);
+        }
+    }
+    gen->source_count = served->count;
+
+    // Files over a chunk are compressed in chunks, so that one large file
+    // keeps every thread busy. Whether a file is chunked depends on its size
+    // alone, so the output is the same for any number of jobs.
+    size_t large_count = 0;
+    size_t chunk_total = 0;
+    for (size_t k = 0; k < task_count; k++) {
+        generate_task_t *t = &tasks[k];
+        if (!generate_is_chunked(t)) {
+            continue;
+        }
+        t->chunk_count = deflate_chunk_count(t->size);
+        t->chunks_left = t->chunk_count;
+        t->chunks = (deflate_chunk_t*)alloc_calloc(t->chunk_count, sizeof(deflate_chunk_t));
+        if (!t->chunks) {
+            t->error = GENERATE_COMPRESS_NO_MEMORY;
+            continue;
+        }
+        large_count++;
+        chunk_total += t->chunk_count;
+    }
+    generate_chunk_t *chunks = (generate_chunk_t*)alloc_malloc((chunk_total ? chunk_total : 1) * sizeof(generate_chunk_t));
+    if (!chunks) {
+        for (size_t k = 0; k < task_count; k++) {
+            if (tasks[k].chunks) {
+                alloc_free(tasks[k].chunks);
+                tasks[k].chunks = NULL;
+                tasks[k].error = GENERATE_COMPRESS_NO_MEMORY;
+            }
+        }
+    }
+
+    platform_mutex_init(&run.lock);
+    platform_cond_init(&run.finished);
+    unsigned jobs = options->jobs;
+    thread_pool_t *pool = jobs > 1 && (task_count > 1 || large_count > 0) ? thread_pool_create(jobs) : NULL;
+
+    // Queue the chunks ahead of the small files, which fill in around them
+    size_t chunk_count = 0;
+    for (size_t k = 0; chunks && k < task_count; k++) {
+        for (size_t i = 0; tasks[k].chunks && i < tasks[k].chunk_count; i++) {
+            generate_chunk_t *c = &chunks[chunk_count++];
+            size_t offset;
+            size_t len = deflate_chunk_window(tasks[k].size, i, &offset);
+            c->task = &tasks[k];
+            c->index = i;
+            c->cost = len + deflate_memory(len);
+            generate_admit(&run, c->cost);
+            generate_run(pool, generate_chunk_task, c);
+        }
+    }
+    for (size_t k = 0; k < task_count; k++) {
+        generate_task_t *t = &tasks[k];
+        if (!generate_is_chunked(t)) {
+            generate_admit(&run, t->cost);
+            generate_run(pool, generate_compress_task, t);
+        }
+    }
+    thread_pool_destroy(pool);
+    alloc_free(chunks);
+    platform_cond_destroy(&run.finished);
+    platform_mutex_destroy(&run.lock);
+
+    // Report in list order, whatever order the tasks ran in
+    int result = 0;
+    for (size_t k = 0; k < task_count; k++) {
+        const generate_task_t *t = &tasks[k];
+        if (t->error == GENERATE_COMPRESS_NO_MEMORY) {
+            fprintf(stderr, "Failed to compress file: %s\n", t->path);
+            result = -1;
+        } else if (t->error == GENERATE_COMPRESS_NOT_GZIP) {
+            fprintf(stderr, "Not a gzip file: %s\n", t->path);
+            result = -1;
+        } else if (t->error == GENERATE_COMPRESS_UNREADABLE && t->sibling) {
+            fprintf(stderr, "Failed to read file: %s\n", t->path);
+            result = -1;
+        } else if (gen->sources[t->index].data) {
+            file_list_set_size(served, t->index, gen->sources[t->index].size);
+        }
+    }
+    // The results are held until the pipeline has converted them, so they
+    // have to fit in the limit on their own
+    if (result == 0 && run.held > run.limit) {
+        fprintf(stderr, "Compressed files need %zu bytes, over the memory limit of %zu bytes\n", run.held, run.limit);
+        result = -1;
+    }
+
+    alloc_free(sorted);
+    alloc_free(sibling);
+    alloc_free(taken);
+    alloc_free(tasks);
+    return result;
+}
+
+// fs_lookup in the output repeats perfect_hash_key and perfect_hash_slot
+static const char generate_lookup_code[] =
+    "const struct fsdata_file *fs_lookup(const char *name);\n"
+    "\n"
+    "static u32_t fs_hash_mix(u32_t h)\n"
+    "{\n"
+    "  h ^= h >> 16;\n"
+    "  h = (u32_t)(h * 0x85ebca6bUL);\n"
+    "  h ^= h >> 13;\n"
+    "  h = (u32_t)(h * 0xc2b2ae35UL);\n"
+    "  h ^= h >> 16;\n"
+    "  return h;\n"
+    "}\n"
+    "\n"
+    "/* The file named 'name', or NULL: one hash of the name and one compare */\n"
+    "const struct fsdata_file *fs_lookup(const char *name)\n"
+    "{\n"
+    "  const unsigned char *p = (const unsigned char *)name;\n"
+    "  const struct fsdata_file *f;\n"
+    "  u32_t h = FS_HASH_SALT ^ 0x811c9dc5UL;\n"
+    "  s32_t d;\n"
+    "  while (*p) {\n"
+    "    h = (u32_t)((h ^ *p++) * 0x01000193UL);\n"
+    "  }\n"
+    "  h = fs_hash_mix(h);\n"
+    "  d = fs_hash_displace[h % FS_HASH_BUCKETS];\n"
+    "  f = fs_hash_files[d < 0 ? (u32_t)(-(d + 1)) : fs_hash_mix(h ^ (u32_t)d) % FS_NUMFILES];\n"
+    "  return strcmp(name, (const char *)f->name) == 0 ? f : NULL;\n"
+    "}\n";
+
+// Write the perfect hash over the names written and fs_lookup
+static int generate_write_lookup(generator_t *gen, output_sink_t *out) {
+    char text[256];
+    int len;
+    if (gen->count == 0) {
+        static const char empty[] =
+            "const struct fsdata_file *fs_lookup(const char *name);\n"
+            "\n"
+            "const struct fsdata_file *fs_lookup(const char *name)\n"
+            "{\n"
+            "  LWIP_UNUSED_ARG(name);\n"
+            "  return NULL;\n"
+            "}\n";
+        sink_write(out, empty, sizeof(empty) - 1);
+        return 0;
+    }
+
+    const char **names = (const char**)alloc_malloc(gen->count * sizeof(const char*));
+    if (!names) {
+        return -1;
+    }
+    for (size_t i = 0; i < gen->count; i++) {
+        names[i] = gen->entries[i].name;
+    }
+    perfect_hash_t ph;
+    int result = perfect_hash_build(&ph, names, gen->count);
+    alloc_free(names);
+    if (result != 0) {
+        return -1;
+    }
+
+    // Displacements and free slots mostly fit in 16 bits
+    int wide = 0;
+    for (size_t b = 0; b < ph.buckets; b++) {
+        if (ph.displace[b] < INT16_MIN || ph.displace[b] > INT16_MAX) {
+            wide = 1;
+        }
+    }
+    len = snprintf(text, sizeof(text),
+                   "#define FS_HASH_SALT 0x%08lxUL\n"
+                   "#define FS_HASH_BUCKETS %llu\n\n"
+                   "static const %s fs_hash_displace[FS_HASH_BUCKETS] = {\n",
+                   (unsigned long)ph.salt, (unsigned long long)ph.buckets, wide ? "s32_t" : "s16_t");
+    sink_write(out, text, (size_t)len);
+    for (size_t b = 0; b < ph.buckets; b++) {
+        len = snprintf(text, sizeof(text), "%ld,%s", (long)ph.displace[b], (b + 1) % 16 == 0 ? "\n" : "");
+        sink_write(out, text, (size_t)len);
+    }
+    static const char files[] = "\n};\n\nstatic const struct fsdata_file *const fs_hash_files[FS_NUMFILES] = {\n";
+    sink_write(out, files, sizeof(files) - 1);
+    char var_name[64];
+    for (size_t s = 0; s < ph.count; s++) {
+        convert_var_name(var_name, sizeof(var_name), gen->entries[ph.slots[s]].index);
+        len = snprintf(text, sizeof(text), "fsdata_%s,\n", var_name);
+        sink_write(out, text, (size_t)len);
+    }
+    static const char end[] = "};\n\n";
+    sink_write(out, end, sizeof(end) - 1);
+    sink_write(out, generate_lookup_code, sizeof(generate_lookup_code) - 1);
+    perfect_hash_free(&ph);
+    return 0;
+}
+
+// Write the fsdata_chksum table of one file. The sums are stored as the
+// device's u16_t would hold the big-endian sum, as lwIP's checksum routines
+// produce it.
+static void generate_write_chksums(const generator_t *gen, const generate_entry_t *e, const char *var_name,
+                                   output_sink_t *out) {
+    char text[128];
+    int len = snprintf(text, sizeof(text),
+                       "#if HTTPD_PRECALCULATED_CHECKSUM\n"
+                       "const struct fsdata_chksum chksums_%s[] = {\n", var_name);
+    sink_write(out, text, (size_t)len);
+    for (size_t k = 0, offset = 0; k < e->chksum_count; k++, offset += gen->options.mss) {
+        size_t seg_len = e->response_len - offset < gen->options.mss ? e->response_len - offset : gen->options.mss;
+        len = snprintf(text, sizeof(text), "{%llu, PP_HTONS(0x%04x), %llu},\n",
+                       (unsigned long long)offset, (unsigned)e->chksums[k], (unsigned long long)seg_len);
+        sink_write(out, text, (size_t)len);
+    }
+    static const char end[] = "};\n#endif /* HTTPD_PRECALCULATED_CHECKSUM */\n\n";
+    sink_write(out, end, sizeof(end) - 1);
+}
+
+int generate_write_table(generator_t *gen, output_sink_t *out) {
+    static const char preamble[] =
+        "#include \"lwip/apps/fs.h\"\n"
+        "#include \"lwip/def.h\"\n"
+        "#include <string.h>\n"
+        "\n"
+        "#define file_NULL (struct fsdata_file *) NULL\n"
+        "\n"
+        "#ifndef FS_FILE_FLAGS_HEADER_INCLUDED\n"
+        "#define FS_FILE_FLAGS_HEADER_INCLUDED 1\n"
+        "#endif\n"
+        "#ifndef FS_FILE_FLAGS_HEADER_PERSISTENT\n"
+        "#define FS_FILE_FLAGS_HEADER_PERSISTENT 0\n"
+        "#endif\n"
+        "\n";
+    sink_write(out, preamble, sizeof(preamble) - 1);
+
+    char var_name[64];
+    char prev[80];
+    char text[512];
+    strcpy(prev, "file_NULL");
+    for (size_t i = 0; i < gen->count; i++) {
+        const generate_entry_t *e = &gen->entries[i];
+        convert_var_name(var_name, sizeof(var_name), e->index);
+        if (e->chksums) {
+            generate_write_chksums(gen, e, var_name, out);
+        }
+        int len = snprintf(text, sizeof(text),
+                           "const struct fsdata_file fsdata_%s[] = { {\n"
+                           "%s,\n"
+                           "%s,\n"
+                           "%s + %llu,\n"
+                           "sizeof(%s) - %llu,\n"
+                           "FS_FILE_FLAGS_HEADER_INCLUDED%s,\n",
+                           var_name, prev, var_name, var_name, (unsigned long long)e->data_offset,
+                           var_name, (unsigned long long)e->data_offset,
+                           (e->flags & GENERATE_FLAG_PERSISTENT) ? " | FS_FILE_FLAGS_HEADER_PERSISTENT" : "");
+        sink_write(out, text, (size_t)len);
+        if (e->chksums) {
+            len = snprintf(text, sizeof(text),
+                           "#if HTTPD_PRECALCULATED_CHECKSUM\n"
+                           "%llu, chksums_%s,\n"
+                           "#endif /* HTTPD_PRECALCULATED_CHECKSUM */\n",
+                           (unsigned long long)e->chksum_count, var_name);
+            sink_write(out, text, (size_t)len);
+        }
+        static const char close[] = "} };\n\n";
+        sink_write(out, close, sizeof(close) - 1);
+        snprintf(prev, sizeof(prev), "fsdata_%s", var_name);
+    }
+
+    int len = snprintf(text, sizeof(text), "#define FS_ROOT %s\n#define FS_NUMFILES %llu\n\n", prev,
+                       (unsigned long long)gen->count);
+    sink_write(out, text, (size_t)len);
+    int result = generate_write_lookup(gen, out);
+    return result != 0 || gen->error || sink_flush(out) != 0 ? -1 : 0;
+}
+
+void generate_destroy(generator_t *gen) {
+    if (!gen) {
+        return;
+    }
+    alloc_free(gen->entries);
+    arena_free(&gen->names);
+    platform_input_destroy(gen->input);
+    for (size_t i = 0; i < gen->source_count; i++) {
+        alloc_free(gen->sources[i].data);
+    }
+    alloc_free(gen->sources);
+    alloc_free(gen);
+}
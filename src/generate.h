@@ -0,0 +1,89 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "pipeline.h"
+#include "sink.h"
+
+typedef struct {
+    const char *input_dir;      // File names are made relative to this
+    bool keep_alive;            // HTTP/1.1 headers that keep the connection open
+    bool precalc_chksum;        // Emit fsdata_chksum tables for HTTPD_PRECALCULATED_CHECKSUM
+    size_t mss;                 // Segment size for the checksums, 0 = GENERATE_DEFAULT_MSS
+    bool gzip;                  // Serve files gzip compressed where that pays, see generate_compress
+    int gzip_min_saving;        // Percent a file has to shrink by, -1 = GENERATE_DEFAULT_GZIP_SAVING
+} generate_options_t;
+
+// Default TCP segment size the checksums are computed for
+#define GENERATE_DEFAULT_MSS 1460
+
+// Default share of a file that compression has to save for it to be served
+// compressed, in percent
+#define GENERATE_DEFAULT_GZIP_SAVING 5
+
+// Turns the converted arrays into an lwIP fsdata.c.
+//
+// Each array starts with the file's name as the httpd looks it up ("/" and
+// the path below the input directory), then the whole HTTP response header
+// (status line, Content-Type, Content-Length and Connection), so the device
+// sends it as is. The name is padded with NULs so the header starts a row of
+// its own and the name plus header is a whole number of rows; see
+// convert_prefix_t. After the arrays, generate_write_table writes the
+// fsdata_file list linking them, with FS_ROOT and FS_NUMFILES, and
+// fs_lookup(), which finds a file by name through a minimal perfect hash
+// built over the names (see perfect_hash.h) instead of walking the list.
+//
+// With precalc_chksum, each file's response (header and contents) is split
+// into segments of 'mss' bytes, and the one's complement sum of each is
+// written to an fsdata_chksum table, so the device does not checksum static
+// content. The contents are read again for this once the array is written.
+//
+// With gzip, generate_compress decides up front which files are served
+// compressed; their arrays then hold the gzip data and their header says
+// Content-Encoding: gzip.
+typedef struct generator generator_t;
+
+// Returns NULL on failure. 'options' is copied; input_dir must stay valid.
+generator_t* generate_create(const generate_options_t *options);
+
+// Hooks that give every array its name and header and record the files
+// written, to pass in pipeline_options_t.
+const pipeline_hooks_t* generate_hooks(generator_t *gen);
+
+// Store the name and header of the file at 'path' holding 'size' bytes in
+// 'dst' (PIPELINE_PREFIX_MAX bytes). Returns their length, or 0 if the name
+// is too long. *data_offset is set to the offset of the header.
+size_t generate_prefix(const generator_t *gen, const char *path, size_t size, unsigned char *dst, size_t *data_offset);
+
+// Compress the files in 'list' on options->jobs threads, and fill 'served'
+// (an initialized, empty list) with the files to convert, in the same order.
+// A file with a ".gz" sibling in the list is served as the sibling's
+// contents, which must be gzip data, and the sibling gets no entry of its
+// own. Other files are compressed, and kept compressed if that saves more
+// than gzip_min_saving percent, counting the longer header. Files over
+// DEFLATE_CHUNK_SIZE are compressed in chunks spread over the threads, each
+// reading only its part of the file. SSI files are left alone, since the
+// httpd fills them in. The compressed files are held in memory until the
+// generator is destroyed, and the generator's hooks hand them to the
+// pipeline in place of the files. Files that cannot be read are left for the
+// pipeline to report.
+//
+// Work is started only while the files being compressed and the results
+// kept so far fit in options->memory_limit, or when nothing else runs.
+// Returns 0 on success, nonzero if out of memory, a sibling is not gzip, or
+// the kept results alone do not fit in the memory limit.
+int generate_compress(generator_t *gen, const file_list_t *list, const pipeline_options_t *options, file_list_t *served);
+
+// Write the fsdata_file entries for the arrays written so far, in order,
+// and fs_lookup over their names. Returns 0 on success, nonzero if the sink
+// failed, out of memory, or two files have the same name.
+int generate_write_table(generator_t *gen, output_sink_t *out);
+
+// Number of files recorded so far
+size_t generate_file_count(const generator_t *gen);
+
+// NULL is ignored.
+void generate_destroy(generator_t *gen);
+
+#endif // GENERATE_H
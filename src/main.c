@@ -1,10 +1,17 @@
 #include "makefsdata_portable.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "config.h"
 #include "file_list.h"
 #include "scan.h"
 #include "convert.h"
+#include "encode.h"
+#include "chksum.h"
+#include "pipeline.h"
+#include "alloc.h"
+#include "sink.h"
+#include "generate.h"
 
 extern bool parse_args(int argc, char **argv, config_t *config);
 extern void print_help_message(const char *program_name);
@@ -22,41 +29,123 @@ int main (int argc, char **argv) {
         return EXIT_SUCCESS;
     }
 
+    // Pick the fastest hex encoding and checksum kernels this CPU supports
+    encode_set_kernel(ENCODE_KERNEL_AUTO);
+    chksum_set_kernel(CHKSUM_KERNEL_AUTO);
+
+    generate_options_t generate_options;
+    memset(&generate_options, 0, sizeof(generate_options));
+    generate_options.input_dir = config.input_dir;
+    generate_options.keep_alive = config.keep_alive;
+    generate_options.precalc_chksum = config.precalc_chksum;
+    generate_options.mss = config.mss;
+    generate_options.gzip = config.gzip;
+    generate_options.gzip_min_saving = config.gzip_min_saving;
+    generator_t *gen = generate_create(&generate_options);
+    if (!gen) {
+        fprintf(stderr, "Failed to set up output\n");
+        return EXIT_FAILURE;
+    }
+
     file_list_t list;
     file_list_init(&list);
 
-    if (scan_directory(config.input_dir, &config, &list) != 0) {
-        fprintf(stderr, "Failed to scan directory: %s\n", config.input_dir);
+    // Scan in the background so conversion starts with the first file found
+    file_feed_t feed;
+    file_feed_init(&feed, &list);
+    scan_job_t *scan = scan_start(config.input_dir, &config, &feed);
+    if (!scan) {
+        fprintf(stderr, "Failed to start scanning: %s\n", config.input_dir);
+        file_feed_destroy(&feed);
         file_list_free(&list);
+        generate_destroy(gen);
         return EXIT_FAILURE;
     }
 
-    for (size_t i = 0; i < list.count; i++) {
-        file_info_t *finfo = &list.files[i];
-
-        // Read file contents
-        size_t file_size;
-        unsigned char *data = convert_read_file_contents(finfo->path, &file_size);
-        if (!data) {
-            fprintf(stderr, "Failed to read file: %s\n", finfo->path);
-            continue; // Skip this file
+    pipeline_stats_t stats;
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = config.jobs ? config.jobs : platform_cpu_count();
+    options.input_strategy = config.input_strategy;
+    options.memory_limit = config.max_memory;
+    options.prefetch = !config.no_prefetch;
+    options.hooks = generate_hooks(gen);
+    options.stats = config.stats ? &stats : NULL;
+    int converted = 0;
+    output_sink_t *out = NULL;
+    if (config.writer == CONFIG_WRITER_STREAM && strcmp(config.output_file, "-") == 0) {
+        // Gift pages to the pipe when piped into another tool
+        out = sink_pipe_create(fileno(stdout));
+        if (!out) {
+            out = sink_fd_create(fileno(stdout), SINK_BUFFER_SIZE);
         }
+    } else if (config.writer == CONFIG_WRITER_STREAM) {
+        out = sink_file_create(config.output_file, 0);
+    } else if (config.writer == CONFIG_WRITER_NULL) {
+        out = sink_null_create();
+    }
+    if (out && !config.gzip) {
+        converted = pipeline_run_feed(&feed, &options, out);
+    } else if (!out && config.writer != CONFIG_WRITER_POSITIONAL) {
+        fprintf(stderr, "Failed to create output file: %s\n", config.output_file);
+        converted = -1;
+    }
+    scan_stats_t scan_stats;
+    int scanned = scan_wait(scan, &scan_stats);
+    file_feed_destroy(&feed);
 
-        // Generate a variable name from the file index
-        char var_name[64];
-#ifdef _WIN32
-        snprintf(var_name, sizeof(var_name), "file_%llu", i);
-#else
-        snprintf(var_name, sizeof(var_name), "file_%zu", i);
-#endif
-
-        // Until Generate.c is implemented, we will write the array to stdout for now
-        convert_write_c_array(var_name, data, file_size, stdout);
+    // Which files are served compressed is settled before any is converted,
+    // so with --gzip conversion waits for the whole scan
+    file_list_t served;
+    file_list_init(&served);
+    const file_list_t *convert_list = &list;
+    if (config.gzip && scanned == 0 && converted == 0) {
+        converted = generate_compress(gen, &list, &options, &served);
+        convert_list = &served;
+        if (out && converted == 0) {
+            converted = pipeline_run(&served, &options, out);
+        }
+    }
 
-        free(data);
+    // The positional writer lays out the whole output, so it needs every file.
+    // The fsdata_file table then goes after the arrays it wrote.
+    if (config.writer == CONFIG_WRITER_POSITIONAL && scanned == 0 && converted == 0) {
+        converted = pipeline_write_file(convert_list, &options, config.output_file);
+        if (converted == 0) {
+            out = sink_file_append(config.output_file, 0);
+            if (!out) {
+                fprintf(stderr, "Failed to write output file: %s\n", config.output_file);
+                converted = -1;
+            }
+        }
+    }
+    if (out && converted == 0 && scanned == 0 && generate_write_table(gen, out) != 0) {
+        fprintf(stderr, "Failed to write output file: %s\n", config.output_file);
+        converted = -1;
+    }
+    if (out && sink_close(out) != 0 && converted == 0) {
+        fprintf(stderr, "Failed to write output file: %s\n", config.output_file);
+        converted = -1;
     }
+    generate_destroy(gen);
+    file_list_free(&served);
 
-    // TODO: Generate fsdata.c with generate.c
+    if (scanned != 0) {
+        fprintf(stderr, "Failed to scan directory: %s\n", config.input_dir);
+        file_list_free(&list);
+        return EXIT_FAILURE;
+    }
+    if (converted != 0) {
+        file_list_free(&list);
+        return EXIT_FAILURE;
+    }
+    if (config.stats) {
+        scan_print_stats(&scan_stats, stderr);
+        pipeline_print_stats(&stats, stderr);
+        alloc_counters_t counters;
+        alloc_get_counters(&counters);
+        alloc_print_counters(&counters, stderr);
+    }
 
     file_list_free(&list);
     return EXIT_SUCCESS;
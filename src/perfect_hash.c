@@ -0,0 +1,192 @@
+#include "perfect_hash.h"
+#include "alloc.h"
+#include <string.h>
+
+// Scratch space for one build
+typedef struct {
+    uint32_t *hashes;       // Of each key
+    size_t *members;        // Keys grouped by bucket
+    size_t *starts;         // First member of each bucket, plus an end marker
+    size_t *order;          // Buckets holding keys, largest first
+    size_t used;            // Entries in 'order'
+    unsigned char *taken;   // Slots in use
+    size_t *placed;         // Slots of the bucket being placed
+} perfect_hash_work_t;
+
+uint32_t perfect_hash_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// FNV-1a over the bytes, then mixed so the low bits spread well
+uint32_t perfect_hash_key(uint32_t salt, const char *key) {
+    uint32_t h = salt ^ 0x811c9dc5u;
+    for (const unsigned char *p = (const unsigned char*)key; *p; p++) {
+        h = (h ^ *p) * 0x01000193u;
+    }
+    return perfect_hash_mix(h);
+}
+
+static size_t perfect_hash_displaced(const perfect_hash_t *ph, uint32_t h, uint32_t d) {
+    return perfect_hash_mix(h ^ d) % ph->count;
+}
+
+// Group the keys by bucket and sort the buckets by size. Returns nonzero if
+// two keys in a bucket have the same hash, so no displacement can part them.
+static int perfect_hash_group(perfect_hash_t *ph, perfect_hash_work_t *w) {
+    memset(w->starts, 0, (ph->buckets + 1) * sizeof(size_t));
+    for (size_t i = 0; i < ph->count; i++) {
+        w->starts[w->hashes[i] % ph->buckets + 1]++;
+    }
+    size_t largest = 0;
+    for (size_t b = 0; b < ph->buckets; b++) {
+        if (w->starts[b + 1] > largest) {
+            largest = w->starts[b + 1];
+        }
+        w->starts[b + 1] += w->starts[b];
+    }
+    // Fill each bucket from its end; starts[b + 1] then holds the start of b
+    for (size_t i = ph->count; i-- > 0; ) {
+        size_t b = w->hashes[i] % ph->buckets;
+        w->members[--w->starts[b + 1]] = i;
+    }
+    for (size_t b = 0; b < ph->buckets; b++) {
+        w->starts[b] = w->starts[b + 1];
+    }
+    w->starts[ph->buckets] = ph->count;
+    for (size_t b = 0; b < ph->buckets; b++) {
+        for (size_t x = w->starts[b]; x < w->starts[b + 1]; x++) {
+            for (size_t y = x + 1; y < w->starts[b + 1]; y++) {
+                if (w->hashes[w->members[x]] == w->hashes[w->members[y]]) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Largest buckets first, while most slots are free
+    w->used = 0;
+    for (size_t size = largest; size > 0; size--) {
+        for (size_t b = 0; b < ph->buckets; b++) {
+            if (w->starts[b + 1] - w->starts[b] == size) {
+                w->order[w->used++] = b;
+            }
+        }
+    }
+    return 0;
+}
+
+// Find a displacement for every bucket. Returns nonzero if a bucket could
+// not be placed.
+static int perfect_hash_place(perfect_hash_t *ph, perfect_hash_work_t *w) {
+    memset(w->taken, 0, ph->count);
+    memset(ph->displace, 0, ph->buckets * sizeof(int32_t)); // Empty buckets keep 0
+    size_t free_slot = 0;
+    for (size_t k = 0; k < w->used; k++) {
+        size_t b = w->order[k];
+        size_t first = w->starts[b];
+        size_t size = w->starts[b + 1] - first;
+        if (size == 1) {
+            // No hash needed, just a free slot
+            while (w->taken[free_slot]) {
+                free_slot++;
+            }
+            w->taken[free_slot] = 1;
+            ph->slots[free_slot] = w->members[first];
+            ph->displace[b] = -(int32_t)free_slot - 1;
+            continue;
+        }
+
+        uint32_t d = 0;
+        for (; d < PERFECT_HASH_MAX_TRIES; d++) {
+            size_t n = 0;
+            for (; n < size; n++) {
+                size_t slot = perfect_hash_displaced(ph, w->hashes[w->members[first + n]], d);
+                if (w->taken[slot]) {
+                    break;
+                }
+                w->taken[slot] = 1;
+                w->placed[n] = slot;
+            }
+            if (n == size) {
+                break;
+            }
+            while (n-- > 0) {
+                w->taken[w->placed[n]] = 0;
+            }
+        }
+        if (d == PERFECT_HASH_MAX_TRIES) {
+            return -1;
+        }
+        for (size_t n = 0; n < size; n++) {
+            ph->slots[w->placed[n]] = w->members[first + n];
+        }
+        ph->displace[b] = (int32_t)d;
+    }
+    return 0;
+}
+
+int perfect_hash_build(perfect_hash_t *ph, const char *const *keys, size_t count) {
+    memset(ph, 0, sizeof(*ph));
+    if (count == 0) {
+        return 0;
+    }
+    if (count > (size_t)INT32_MAX) {
+        return -1;
+    }
+    ph->count = count;
+    ph->buckets = (count + PERFECT_HASH_KEYS_PER_BUCKET - 1) / PERFECT_HASH_KEYS_PER_BUCKET;
+    ph->displace = (int32_t*)alloc_malloc(ph->buckets * sizeof(int32_t));
+    ph->slots = (size_t*)alloc_malloc(count * sizeof(size_t));
+
+    perfect_hash_work_t w;
+    w.hashes = (uint32_t*)alloc_malloc(count * sizeof(uint32_t));
+    w.members = (size_t*)alloc_malloc(count * sizeof(size_t));
+    w.starts = (size_t*)alloc_malloc((ph->buckets + 1) * sizeof(size_t));
+    w.order = (size_t*)alloc_malloc(ph->buckets * sizeof(size_t));
+    w.taken = (unsigned char*)alloc_malloc(count);
+    w.placed = (size_t*)alloc_malloc(count * sizeof(size_t));
+
+    int result = -1;
+    if (ph->displace && ph->slots && w.hashes && w.members && w.starts && w.order && w.taken && w.placed) {
+        for (uint32_t s = 0; s < PERFECT_HASH_MAX_SALTS && result != 0; s++) {
+            ph->salt = s * 0x9e3779b9u;
+            for (size_t i = 0; i < count; i++) {
+                w.hashes[i] = perfect_hash_key(ph->salt, keys[i]);
+            }
+            if (perfect_hash_group(ph, &w) == 0 && perfect_hash_place(ph, &w) == 0) {
+                result = 0;
+            }
+        }
+    }
+
+    alloc_free(w.hashes);
+    alloc_free(w.members);
+    alloc_free(w.starts);
+    alloc_free(w.order);
+    alloc_free(w.taken);
+    alloc_free(w.placed);
+    if (result != 0) {
+        perfect_hash_free(ph);
+    }
+    return result;
+}
+
+size_t perfect_hash_slot(const perfect_hash_t *ph, const char *key) {
+    if (ph->count == 0) {
+        return 0;
+    }
+    uint32_t h = perfect_hash_key(ph->salt, key);
+    int32_t d = ph->displace[h % ph->buckets];
+    return d < 0 ? (size_t)(-(d + 1)) : perfect_hash_displaced(ph, h, (uint32_t)d);
+}
+
+void perfect_hash_free(perfect_hash_t *ph) {
+    alloc_free(ph->displace);
+    alloc_free(ph->slots);
+    memset(ph, 0, sizeof(*ph));
+}
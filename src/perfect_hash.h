@@ -0,0 +1,51 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Average keys per bucket. Fewer buckets make a smaller table but take
+// longer to build.
+#define PERFECT_HASH_KEYS_PER_BUCKET 2
+
+// Displacements tried for one bucket before starting over with a new salt
+#define PERFECT_HASH_MAX_TRIES (1u << 20)
+
+// Salts tried before giving up
+#define PERFECT_HASH_MAX_SALTS 64
+
+// A minimal perfect hash over a set of distinct strings, built by hash and
+// displace (CHD): each key is hashed once, the hash picks a bucket, and the
+// bucket's displacement moves its keys to slots no other bucket uses. Every
+// key gets its own slot in 0..count-1, so a lookup is one hash and one
+// compare with the key stored in its slot.
+//
+// A displacement d >= 0 puts a key with hash h in slot
+// perfect_hash_mix(h ^ d) % count. Buckets holding a single key are placed
+// last, straight into a free slot s, which is stored as -s - 1.
+typedef struct {
+    uint32_t salt;          // Seed of the key hash
+    size_t count;           // Keys, and slots
+    size_t buckets;
+    int32_t *displace;      // One per bucket
+    size_t *slots;          // Index of the key in each slot
+} perfect_hash_t;
+
+// Build 'ph' over 'keys'. Returns 0 on success, nonzero if out of memory or
+// no hash was found (duplicate keys). An empty set is allowed.
+int perfect_hash_build(perfect_hash_t *ph, const char *const *keys, size_t count);
+
+// Hash of a key, the same function as the generated fs_lookup
+uint32_t perfect_hash_key(uint32_t salt, const char *key);
+
+// Final mixing step of the key hash, also used to displace keys
+uint32_t perfect_hash_mix(uint32_t h);
+
+// Slot 'key' would be in. A key that is not in the set also gets a slot;
+// compare it with the key stored there to reject it.
+size_t perfect_hash_slot(const perfect_hash_t *ph, const char *key);
+
+// Free the tables. The keys belong to the caller.
+void perfect_hash_free(perfect_hash_t *ph);
+
+#endif // PERFECT_HASH_H
@@ -0,0 +1,1071 @@
+#include "pipeline.h"
+#include "convert.h"
+#include "batch_read.h"
+#include "thread_pool.h"
+#include "alloc.h"
+#include "encode.h"
+#include "prefetch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double pipeline_seconds(unsigned long long start, unsigned long long end) {
+    return (double)(end - start) / 1e9;
+}
+
+// Stop the prefetcher, if any, and add its counters to 'stats'
+static void pipeline_prefetch_finish(prefetcher_t *pf, pipeline_stats_t *stats) {
+    if (!pf) {
+        return;
+    }
+    prefetch_stats_t ps;
+    prefetcher_destroy(pf, &ps);
+    stats->prefetched_files = ps.advised;
+    stats->dropped_files = ps.dropped;
+    stats->prefetch_depth = ps.max_depth;
+}
+
+// Buffers for streaming a file encoded 'chunks' chunks at a time. One chunk
+// is encoded on the writer alone, with no text buffer.
+static size_t pipeline_stream_memory(size_t chunks) {
+    size_t block = chunks * CONVERT_PARALLEL_CHUNK;
+    return chunks <= 1 ? block : block + encode_hex_size(0, block) + ENCODE_ROW_CHARS;
+}
+
+// Chunks a streamed file is encoded in at once: two per thread, or fewer so
+// the fixed buffers stay within 'memory_limit'
+static size_t pipeline_stream_chunks(unsigned threads, size_t memory_limit) {
+    size_t limit = memory_limit ? memory_limit : PIPELINE_DEFAULT_MEMORY_LIMIT;
+    size_t chunks = threads <= 1 ? 1 : (size_t)threads * 2;
+    while (chunks > 1 && CONVERT_STREAM_BLOCK_SIZE + pipeline_stream_memory(chunks) > limit) {
+        chunks--;
+    }
+    return chunks;
+}
+
+size_t pipeline_fixed_memory(unsigned threads, size_t memory_limit) {
+    if (threads <= 1) {
+        return CONVERT_STREAM_BLOCK_SIZE;
+    }
+    return CONVERT_STREAM_BLOCK_SIZE + pipeline_stream_memory(pipeline_stream_chunks(threads, memory_limit));
+}
+
+size_t pipeline_min_memory(unsigned threads) {
+    return threads <= 1 ? CONVERT_STREAM_BLOCK_SIZE : CONVERT_STREAM_BLOCK_SIZE + pipeline_stream_memory(1);
+}
+
+// Part of the memory limit left for files once the fixed buffers are counted
+static size_t pipeline_file_budget(size_t memory_limit, unsigned threads) {
+    size_t fixed = pipeline_fixed_memory(threads, memory_limit);
+    return memory_limit > fixed ? memory_limit - fixed : 0;
+}
+
+// Refuse a memory limit the fixed buffers do not fit in
+static int pipeline_check_memory(const pipeline_options_t *options) {
+    size_t least = pipeline_min_memory(options->jobs);
+    if (options->memory_limit != 0 && options->memory_limit < least) {
+        fprintf(stderr, "Memory limit of %zu bytes is below the %zu bytes a run with %u jobs needs\n",
+                options->memory_limit, least, options->jobs);
+        return -1;
+    }
+    return 0;
+}
+
+// Set 'prefix' up for entry 'index' from the run's hooks, in 'buf'
+// (PIPELINE_PREFIX_MAX bytes), and point *out at it; *out is NULL when the
+// run has no prefixes. Returns nonzero if the hook refused the file.
+static int pipeline_make_prefix(const pipeline_options_t *options, size_t index, const char *path, size_t size,
+                                unsigned char *buf, convert_prefix_t *prefix, const convert_prefix_t **out) {
+    *out = NULL;
+    if (!options->hooks || !options->hooks->prefix) {
+        return 0;
+    }
+    prefix->data = buf;
+    prefix->len = options->hooks->prefix(options->hooks->ctx, index, path, size, buf);
+    prefix->size = size;
+    if (prefix->len == 0) {
+        return -1;
+    }
+    *out = prefix;
+    return 0;
+}
+
+// Contents the run's hooks hold in memory for entry 'index', or NULL to
+// read the file
+static const unsigned char* pipeline_contents(const pipeline_options_t *options, size_t index, const char *path,
+                                              size_t *size) {
+    if (!options->hooks || !options->hooks->contents) {
+        return NULL;
+    }
+    return options->hooks->contents(options->hooks->ctx, index, path, size);
+}
+
+static size_t pipeline_prefix_len(const convert_prefix_t *prefix) {
+    return prefix ? prefix->len : 0;
+}
+
+// Report a finished array to the run's hooks
+static void pipeline_written(const pipeline_options_t *options, size_t index, const char *path, size_t size) {
+    if (options->hooks && options->hooks->written) {
+        options->hooks->written(options->hooks->ctx, index, path, size);
+    }
+}
+
+// Files below this size are loaded in batches by the serial path, unless
+// the hooks hold their contents
+static int pipeline_is_batched(const pipeline_options_t *options, size_t budget, size_t index, file_info_t *finfo) {
+    size_t size;
+    return file_info_size(finfo) < PLATFORM_INPUT_MMAP_THRESHOLD && file_info_size(finfo) <= budget &&
+           !pipeline_contents(options, index, finfo->path, &size);
+}
+
+// Single-threaded conversion, reading runs of small files in batches
+// (with io_uring where available) and streaming the rest.
+static int pipeline_run_serial(file_feed_t *feed, const pipeline_options_t *options, output_sink_t *out) {
+    unsigned long long run_start = platform_time_ns();
+    pipeline_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+
+    // One reader for the whole run so its buffer is reused for every file
+    platform_input *in = platform_input_create(options->input_strategy, CONVERT_STREAM_BLOCK_SIZE);
+    if (!in) {
+        fprintf(stderr, "Failed to create input reader: %s\n", platform_get_last_error());
+        return -1;
+    }
+
+    // Batching only makes sense when the input backend is left on auto. Every
+    // batch slot can end up holding a buffer for a file just under the mmap
+    // threshold, so the window is cut down to what fits in the memory limit,
+    // and files larger than the whole budget are streamed.
+    size_t limit = options->memory_limit ? options->memory_limit : PIPELINE_DEFAULT_MEMORY_LIMIT;
+    size_t budget = pipeline_file_budget(limit, 1);
+    size_t window = budget / PLATFORM_INPUT_MMAP_THRESHOLD;
+    window = window < 1 ? 1 : window > BATCH_READ_WINDOW ? BATCH_READ_WINDOW : window;
+    stats.memory_limit = limit;
+    batch_reader_t *batch = NULL;
+    if (options->input_strategy == PLATFORM_INPUT_AUTO) {
+        batch = batch_reader_create(window, 1);
+    }
+    // Batches on io_uring already have their reads in flight together, and
+    // opening each file once more to advise it only slows them down
+    prefetcher_t *pf = NULL;
+    if (options->prefetch && !(batch && batch_reader_uses_io_uring(batch))) {
+        pf = prefetcher_create(feed);
+    }
+
+    unsigned char *prefix_buf = NULL;
+    if (options->hooks && options->hooks->prefix) {
+        prefix_buf = (unsigned char*)alloc_malloc(PIPELINE_PREFIX_MAX);
+        if (!prefix_buf) {
+            fprintf(stderr, "Failed to allocate conversion buffers\n");
+            pipeline_prefetch_finish(pf, &stats);
+            batch_reader_destroy(batch);
+            platform_input_destroy(in);
+            return -1;
+        }
+    }
+
+    int result = 0;
+    int truncated = 0; // An array was cut short by a failed read
+    char var_name[64];
+    convert_prefix_t prefix_storage;
+    const convert_prefix_t *prefix;
+    file_info_t run[BATCH_READ_WINDOW];
+    file_info_t finfo;
+    size_t i = 0;
+    int more = file_feed_get(feed, 0, &finfo) == 0;
+    while (more) {
+        if (batch && pipeline_is_batched(options, budget, i, &finfo)) {
+            // Gather the run of small files starting here
+            size_t first = i;
+            size_t indices[BATCH_READ_WINDOW];
+            size_t count = 0;
+            while (more && count < window && pipeline_is_batched(options, budget, i, &finfo)) {
+                run[count] = finfo;
+                indices[count] = count;
+                count++;
+                more = file_feed_get(feed, ++i, &finfo) == 0;
+            }
+            if (pf) {
+                prefetcher_advance(pf, first + count - 1);
+            }
+            unsigned long long read_start = platform_time_ns();
+            if (batch_reader_read(batch, run, indices, count) != 0) {
+                fprintf(stderr, "Failed to read batch of files\n");
+                result = -1;
+                break;
+            }
+            // The batch is read as a whole, so each file is charged its share
+            unsigned long long read_ns = (platform_time_ns() - read_start) / count;
+            size_t batch_bytes = 0;
+            for (size_t k = 0; k < count; k++) {
+                batch_bytes += batch_reader_file(batch, k)->size;
+            }
+            if (batch_bytes > stats.peak_memory) {
+                stats.peak_memory = batch_bytes;
+            }
+            for (size_t k = 0; k < count; k++) {
+                const batch_file_t *bf = batch_reader_file(batch, k);
+                if (bf->error) {
+                    fprintf(stderr, "Failed to read file: %s\n", run[bf->index].path);
+                    continue; // Skip this file
+                }
+                if (pf) {
+                    prefetcher_done(pf, first + bf->index, run[bf->index].path, bf->size, read_ns);
+                }
+                if (pipeline_make_prefix(options, first + bf->index, run[bf->index].path, bf->size,
+                                         prefix_buf, &prefix_storage, &prefix) != 0) {
+                    fprintf(stderr, "Failed to prepare file: %s\n", run[bf->index].path);
+                    continue;
+                }
+                convert_var_name(var_name, sizeof(var_name), first + bf->index);
+                convert_write_c_array(var_name, prefix, bf->data, bf->size, out);
+                stats.files++;
+                stats.bytes_in += bf->size;
+                stats.bytes_out += convert_c_array_size(var_name, pipeline_prefix_len(prefix) + bf->size);
+                pipeline_written(options, first + bf->index, run[bf->index].path, bf->size);
+            }
+            continue;
+        }
+
+        convert_var_name(var_name, sizeof(var_name), i);
+        if (pf) {
+            prefetcher_advance(pf, i);
+        }
+        size_t held_size;
+        const unsigned char *held = pipeline_contents(options, i, finfo.path, &held_size);
+        if (held) {
+            if (pipeline_make_prefix(options, i, finfo.path, held_size, prefix_buf, &prefix_storage, &prefix) != 0) {
+                fprintf(stderr, "Failed to prepare file: %s\n", finfo.path);
+            } else {
+                convert_write_c_array(var_name, prefix, held, held_size, out);
+                stats.files++;
+                stats.bytes_in += held_size;
+                stats.bytes_out += convert_c_array_size(var_name, pipeline_prefix_len(prefix) + held_size);
+                pipeline_written(options, i, finfo.path, held_size);
+            }
+            more = file_feed_get(feed, ++i, &finfo) == 0;
+            continue;
+        }
+
+        // The file is streamed in blocks, so it is never held in memory whole
+        int streamed = 0;
+        if (pipeline_make_prefix(options, i, finfo.path, file_info_size(&finfo), prefix_buf, &prefix_storage, &prefix) != 0) {
+            fprintf(stderr, "Failed to prepare file: %s\n", finfo.path);
+        } else if ((streamed = convert_stream_c_array(var_name, prefix, finfo.path, in, out)) != 0) {
+            fprintf(stderr, "Failed to read file: %s\n", finfo.path);
+            truncated |= streamed > 0;
+        } else {
+            if (pf) {
+                prefetcher_done(pf, i, finfo.path, file_info_size(&finfo), 0); // Read and encode are not timed apart
+            }
+            stats.files++;
+            stats.streamed_files++;
+            stats.bytes_in += file_info_size(&finfo);
+            stats.bytes_out += convert_c_array_size(var_name, pipeline_prefix_len(prefix) + finfo.size);
+            pipeline_written(options, i, finfo.path, finfo.size);
+        }
+        more = file_feed_get(feed, ++i, &finfo) == 0;
+    }
+
+    pipeline_prefetch_finish(pf, &stats);
+    alloc_free(prefix_buf);
+    batch_reader_destroy(batch);
+    platform_input_destroy(in);
+
+    // Stages are not separated here, so only the totals are reported
+    if (options->stats) {
+        stats.peak_memory += pipeline_fixed_memory(1, limit);
+        stats.wall_seconds = pipeline_seconds(run_start, platform_time_ns());
+        *options->stats = stats;
+    }
+    return result == 0 && truncated ? 1 : result;
+}
+
+typedef struct pipeline pipeline_t;
+
+// One in-flight file. Slots form a ring indexed by sequence number, shared
+// by the reader, the encoders and the writer.
+typedef struct {
+    pipeline_t *p;
+    size_t index;           // Sequence number: position in the file list
+    file_info_t file;       // Copy of the list entry
+    unsigned char *data;    // File contents, owned until encoded
+    size_t size;
+    size_t data_capacity;   // Size of the pooled 'data' buffer
+    char *text;             // Encoded array, owned until written
+    size_t len;
+    size_t text_capacity;
+    size_t cost;            // Bytes reserved against the memory limit
+    int error;
+    int refused;            // The prefix hook turned the file down
+    int streamed;           // Too large to buffer; the writer streams it
+    int held;               // 'data' belongs to the hooks, see pipeline_hooks_t.contents
+    int ready;              // Set once text/error are final
+} pipeline_slot_t;
+
+struct pipeline {
+    file_feed_t *feed;
+    const pipeline_options_t *options;
+    platform_input_strategy input_strategy;
+    thread_pool_t *pool;
+    buffer_pool_t *buffers;         // File and text buffers, reused across files
+    prefetcher_t *prefetch;         // Reads ahead of the reader, or NULL
+    pipeline_slot_t *slots;
+    size_t window;
+
+    platform_mutex_t lock;
+    platform_cond_t slot_ready;     // Writer waits here for the next file
+    platform_cond_t space;          // Reader waits here for a slot or memory
+    size_t next_write;
+    size_t inflight;
+    size_t count;                   // Number of files, once 'read_done' is set
+    int read_done;                  // The reader has reached the end of the feed
+    int stopped;                    // The writer failed; the reader ends the feed early
+    size_t memory_limit;            // Budget for files in flight, without the fixed buffers
+
+    pipeline_stats_t stats;         // Busy times protected by 'lock'
+};
+
+// Read a whole file through 'in' into a buffer from 'buffers'
+static int pipeline_load_file(platform_input *in, buffer_pool_t *buffers, const char *path,
+                              unsigned char **data_out, size_t *size_out, size_t *capacity_out) {
+    if (platform_input_open(in, path) != 0) {
+        return -1;
+    }
+    size_t capacity = 0;
+    unsigned char *data = (unsigned char*)buffer_pool_acquire(buffers, platform_input_size(in), &capacity);
+    size_t size = 0;
+    int result = data ? 0 : -1;
+
+    while (result == 0) {
+        const unsigned char *block;
+        size_t n;
+        if (platform_input_next(in, &block, &n) != 0) {
+            result = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (size + n > capacity) {
+            // The file grew since it was opened
+            size_t grown_capacity;
+            unsigned char *grown = (unsigned char*)buffer_pool_acquire(buffers, (size + n) * 2, &grown_capacity);
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            memcpy(grown, data, size);
+            buffer_pool_release(buffers, data, capacity);
+            data = grown;
+            capacity = grown_capacity;
+        }
+        memcpy(data + size, block, n);
+        size += n;
+    }
+    platform_input_close(in);
+
+    if (result != 0) {
+        buffer_pool_release(buffers, data, capacity);
+        return -1;
+    }
+    *data_out = data;
+    *size_out = size;
+    *capacity_out = capacity;
+    return 0;
+}
+
+// Mark a slot finished and wake the writer
+static void pipeline_slot_done(pipeline_t *p, pipeline_slot_t *slot) {
+    platform_mutex_lock(&p->lock);
+    slot->ready = 1;
+    platform_cond_broadcast(&p->slot_ready);
+    platform_mutex_unlock(&p->lock);
+}
+
+// Encoder stage: turn one loaded file into its array text
+static void pipeline_encode_task(void *arg, unsigned worker) {
+    (void)worker;
+    pipeline_slot_t *slot = (pipeline_slot_t*)arg;
+    pipeline_t *p = slot->p;
+    unsigned long long start = platform_time_ns();
+
+    char var_name[64];
+    convert_var_name(var_name, sizeof(var_name), slot->index);
+    unsigned char prefix_buf[PIPELINE_PREFIX_MAX];
+    convert_prefix_t prefix_storage;
+    const convert_prefix_t *prefix;
+    if (pipeline_make_prefix(p->options, slot->index, slot->file.path, slot->size, prefix_buf, &prefix_storage, &prefix) != 0) {
+        slot->refused = 1;
+    } else {
+        size_t text_size = convert_c_array_size(var_name, pipeline_prefix_len(prefix) + slot->size);
+        slot->text = (char*)buffer_pool_acquire(p->buffers, text_size, &slot->text_capacity);
+        if (slot->text) {
+            slot->len = convert_format_c_array(slot->text, var_name, prefix, slot->data, slot->size);
+        } else {
+            slot->error = -1;
+        }
+    }
+    if (!slot->held) {
+        buffer_pool_release(p->buffers, slot->data, slot->data_capacity);
+    }
+    slot->data = NULL;
+
+    unsigned long long end = platform_time_ns();
+    platform_mutex_lock(&p->lock);
+    p->stats.encode_busy += pipeline_seconds(start, end);
+    platform_mutex_unlock(&p->lock);
+    pipeline_slot_done(p, slot);
+}
+
+// Reader stage: load files in order and hand them to the encoders
+static void pipeline_reader_main(void *arg) {
+    pipeline_t *p = (pipeline_t*)arg;
+
+    platform_input *in = platform_input_create(p->input_strategy, CONVERT_STREAM_BLOCK_SIZE);
+
+    // Entries may still be arriving from the scan; each one is waited for
+    size_t i = 0;
+    file_info_t entry;
+    for (; file_feed_get(p->feed, i, &entry) == 0; i++) {
+        // Sizes the scan left out are looked up here, off the scan's path.
+        // A file is charged for the pool buffers it will take, and streamed
+        // if those could never fit in the budget. Contents the hooks hold
+        // only need their text.
+        const file_info_t *finfo = &entry;
+        char var_name[64];
+        convert_var_name(var_name, sizeof(var_name), i);
+        size_t held_size = 0;
+        const unsigned char *held = pipeline_contents(p->options, i, entry.path, &held_size);
+        size_t size = held ? held_size : file_info_size(&entry);
+        size_t prefix_max = p->options->hooks && p->options->hooks->prefix ? PIPELINE_PREFIX_MAX : 0;
+        size_t data_capacity = held ? 0 : buffer_pool_capacity(size);
+        size_t text_capacity = buffer_pool_capacity(convert_c_array_size(var_name, prefix_max + size));
+        size_t cost = data_capacity + text_capacity;
+        int streamed = size >= PIPELINE_BUFFER_LIMIT || (!held && data_capacity == 0) || text_capacity == 0 ||
+                       cost > p->memory_limit;
+        if (streamed) {
+            cost = 0;
+        }
+
+        // Backpressure: wait for a free slot and room under the memory limit.
+        // A file is always admitted when nothing else is in flight.
+        unsigned long long wait_start = platform_time_ns();
+        platform_mutex_lock(&p->lock);
+        while (!p->stopped && (i >= p->next_write + p->window ||
+                               (p->inflight > 0 && p->inflight + cost > p->memory_limit))) {
+            platform_cond_wait(&p->space, &p->lock);
+        }
+        if (p->stopped) {
+            platform_mutex_unlock(&p->lock);
+            break;
+        }
+        p->stats.read_blocked += pipeline_seconds(wait_start, platform_time_ns());
+        p->inflight += cost;
+        if (p->inflight > p->stats.peak_memory) {
+            p->stats.peak_memory = p->inflight;
+        }
+        pipeline_slot_t *slot = &p->slots[i % p->window];
+        memset(slot, 0, sizeof(*slot));
+        slot->p = p;
+        slot->index = i;
+        slot->file = entry;
+        slot->cost = cost;
+        slot->streamed = streamed;
+        platform_mutex_unlock(&p->lock);
+
+        if (p->prefetch) {
+            prefetcher_advance(p->prefetch, i);
+        }
+        if (streamed) {
+            pipeline_slot_done(p, slot);
+            continue;
+        }
+        if (held) {
+            slot->data = (unsigned char*)held;
+            slot->size = held_size;
+            slot->held = 1;
+            if (thread_pool_submit(p->pool, pipeline_encode_task, slot) != 0) {
+                pipeline_encode_task(slot, 0);
+            }
+            continue;
+        }
+
+        unsigned long long start = platform_time_ns();
+        int error = in ? pipeline_load_file(in, p->buffers, finfo->path, &slot->data, &slot->size, &slot->data_capacity) : -1;
+        unsigned long long end = platform_time_ns();
+        platform_mutex_lock(&p->lock);
+        p->stats.read_busy += pipeline_seconds(start, end);
+        platform_mutex_unlock(&p->lock);
+        if (!error && p->prefetch) {
+            prefetcher_done(p->prefetch, i, finfo->path, slot->size, end - start);
+        }
+
+        if (error) {
+            slot->error = -1;
+            pipeline_slot_done(p, slot);
+        } else if (thread_pool_submit(p->pool, pipeline_encode_task, slot) != 0) {
+            pipeline_encode_task(slot, 0); // Could not queue it, encode here
+        }
+    }
+
+    platform_input_destroy(in);
+
+    // Tell the writer where the sequence ends
+    platform_mutex_lock(&p->lock);
+    p->count = i;
+    p->read_done = 1;
+    platform_cond_broadcast(&p->slot_ready);
+    platform_mutex_unlock(&p->lock);
+}
+
+// Stream a file too large to buffer, on the pool when there is room for more
+// than one chunk at a time
+static int pipeline_stream(const char *var_name, const convert_prefix_t *prefix, const char *path,
+                           platform_input *in, convert_parallel_t *cp, output_sink_t *out) {
+    if (cp) {
+        return convert_stream_c_array_parallel(var_name, prefix, path, in, cp, out);
+    }
+    return convert_stream_c_array(var_name, prefix, path, in, out);
+}
+
+// Three-stage conversion: reader thread -> encoder pool -> writer (the
+// calling thread), writing strictly in sequence order.
+static int pipeline_run_parallel(file_feed_t *feed, const pipeline_options_t *options, output_sink_t *out) {
+    unsigned long long run_start = platform_time_ns();
+
+    pipeline_t p;
+    memset(&p, 0, sizeof(p));
+    p.feed = feed;
+    p.options = options;
+    p.input_strategy = options->input_strategy;
+    p.window = (size_t)options->jobs * 4;
+    p.stats.memory_limit = options->memory_limit ? options->memory_limit : PIPELINE_DEFAULT_MEMORY_LIMIT;
+
+    p.pool = thread_pool_create(options->jobs);
+    if (!p.pool) {
+        fprintf(stderr, "Failed to start worker threads\n");
+        return -1;
+    }
+    unsigned threads = thread_pool_size(p.pool);
+    p.stats.encode_threads = threads;
+    p.memory_limit = pipeline_file_budget(p.stats.memory_limit, threads);
+
+    // The writer keeps its own reader for the large files it streams itself,
+    // with blocks big enough to give every worker a couple of chunks, or as
+    // many chunks as the memory limit leaves room for. At one chunk the
+    // writer encodes them itself.
+    size_t chunks = pipeline_stream_chunks(threads, p.stats.memory_limit);
+    platform_input *writer_in = platform_input_create(options->input_strategy, chunks * CONVERT_PARALLEL_CHUNK);
+    convert_parallel_t *writer_cp = chunks > 1 ? convert_parallel_create(p.pool, chunks) : NULL;
+    p.slots = (pipeline_slot_t*)alloc_calloc(p.window, sizeof(pipeline_slot_t));
+    unsigned char *prefix_buf = (unsigned char*)alloc_malloc(PIPELINE_PREFIX_MAX);
+    // Admission keeps the buffers in use within the budget, and the pool
+    // keeps what it holds for reuse within the same budget
+    p.buffers = buffer_pool_create(p.memory_limit);
+    if (!writer_in || (chunks > 1 && !writer_cp) || !p.slots || !p.buffers || !prefix_buf) {
+        fprintf(stderr, "Failed to allocate conversion buffers\n");
+        thread_pool_destroy(p.pool);
+        platform_input_destroy(writer_in);
+        convert_parallel_destroy(writer_cp);
+        alloc_free(p.slots);
+        alloc_free(prefix_buf);
+        buffer_pool_destroy(p.buffers);
+        return -1;
+    }
+
+    platform_mutex_init(&p.lock);
+    platform_cond_init(&p.slot_ready);
+    platform_cond_init(&p.space);
+    if (options->prefetch) {
+        p.prefetch = prefetcher_create(feed);
+    }
+
+    platform_thread_t reader;
+    int result = platform_thread_create(&reader, pipeline_reader_main, &p);
+    int reader_started = result == 0;
+    if (!reader_started) {
+        fprintf(stderr, "Failed to start reader thread\n");
+    }
+
+    char var_name[64];
+    int truncated = 0; // An array was cut short by a failed read
+    for (size_t i = 0; result == 0; i++) {
+        pipeline_slot_t *slot = &p.slots[i % p.window];
+
+        // Reorder: wait for the next file in sequence, or the end of the list
+        unsigned long long wait_start = platform_time_ns();
+        platform_mutex_lock(&p.lock);
+        while ((!slot->ready || slot->index != i) && !(p.read_done && i >= p.count)) {
+            platform_cond_wait(&p.slot_ready, &p.lock);
+        }
+        int finished = p.read_done && i >= p.count;
+        p.stats.write_blocked += pipeline_seconds(wait_start, platform_time_ns());
+        platform_mutex_unlock(&p.lock);
+        if (finished) {
+            break;
+        }
+
+        unsigned long long start = platform_time_ns();
+        const file_info_t *finfo = &slot->file;
+        if (slot->streamed) {
+            // Held contents are too large for one text buffer, so they are
+            // encoded in chunks like a streamed file
+            convert_var_name(var_name, sizeof(var_name), i);
+            size_t held_size;
+            const unsigned char *held = pipeline_contents(options, i, finfo->path, &held_size);
+            size_t size = held ? held_size : finfo->size;
+            convert_prefix_t prefix_storage;
+            const convert_prefix_t *prefix;
+            int streamed = 0;
+            if (pipeline_make_prefix(options, i, finfo->path, size, prefix_buf, &prefix_storage, &prefix) != 0) {
+                fprintf(stderr, "Failed to prepare file: %s\n", finfo->path);
+            } else if (!held && (streamed = pipeline_stream(var_name, prefix, finfo->path, writer_in, writer_cp, out)) != 0) {
+                fprintf(stderr, "Failed to read file: %s\n", finfo->path);
+                truncated |= streamed > 0;
+            } else {
+                if (held && writer_cp) {
+                    convert_write_c_array_parallel(var_name, prefix, held, size, writer_cp, out);
+                } else if (held) {
+                    convert_write_c_array(var_name, prefix, held, size, out);
+                } else if (p.prefetch) {
+                    prefetcher_done(p.prefetch, i, finfo->path, size, 0);
+                }
+                p.stats.files++;
+                p.stats.streamed_files++;
+                p.stats.bytes_in += size;
+                p.stats.bytes_out += convert_c_array_size(var_name, pipeline_prefix_len(prefix) + size);
+                pipeline_written(options, i, finfo->path, size);
+            }
+        } else if (slot->refused) {
+            fprintf(stderr, "Failed to prepare file: %s\n", finfo->path);
+        } else if (slot->error) {
+            fprintf(stderr, "Failed to read file: %s\n", finfo->path);
+        } else if (sink_write(out, slot->text, slot->len) != 0) {
+            // Nothing more can be written, so the reader stops like at the
+            // end of the feed and the run fails
+            fprintf(stderr, "Failed to write output\n");
+            result = -1;
+            platform_mutex_lock(&p.lock);
+            p.stopped = 1;
+            platform_cond_broadcast(&p.space);
+            platform_mutex_unlock(&p.lock);
+        } else {
+            p.stats.files++;
+            p.stats.bytes_in += slot->size;
+            p.stats.bytes_out += slot->len;
+            pipeline_written(options, i, finfo->path, slot->size);
+        }
+        buffer_pool_release(p.buffers, slot->text, slot->text_capacity);
+        slot->text = NULL;
+        p.stats.write_busy += pipeline_seconds(start, platform_time_ns());
+
+        // Release the slot and its memory to the reader
+        platform_mutex_lock(&p.lock);
+        p.inflight -= slot->cost;
+        p.next_write++;
+        platform_cond_broadcast(&p.space);
+        platform_mutex_unlock(&p.lock);
+    }
+
+    if (reader_started) {
+        platform_thread_join(reader);
+    }
+    // Let outstanding tasks finish before their slots go away
+    thread_pool_destroy(p.pool);
+    convert_parallel_destroy(writer_cp);
+    pipeline_prefetch_finish(p.prefetch, &p.stats);
+
+    for (size_t i = 0; i < p.window; i++) {
+        if (!p.slots[i].held) {
+            buffer_pool_release(p.buffers, p.slots[i].data, p.slots[i].data_capacity);
+        }
+        buffer_pool_release(p.buffers, p.slots[i].text, p.slots[i].text_capacity);
+    }
+    buffer_pool_destroy(p.buffers);
+    platform_cond_destroy(&p.space);
+    platform_cond_destroy(&p.slot_ready);
+    platform_mutex_destroy(&p.lock);
+    alloc_free(p.slots);
+    alloc_free(prefix_buf);
+    platform_input_destroy(writer_in);
+
+    if (options->stats) {
+        p.stats.peak_memory += pipeline_fixed_memory(threads, p.stats.memory_limit);
+        p.stats.wall_seconds = pipeline_seconds(run_start, platform_time_ns());
+        *options->stats = p.stats;
+    }
+    return result == 0 && truncated ? 1 : result;
+}
+
+int pipeline_run_feed(file_feed_t *feed, const pipeline_options_t *options, output_sink_t *out) {
+    int result;
+    if (pipeline_check_memory(options) != 0) {
+        return -1;
+    }
+    if (options->jobs <= 1) {
+        result = pipeline_run_serial(feed, options, out);
+    } else {
+        result = pipeline_run_parallel(feed, options, out);
+    }
+    if (result >= 0 && sink_flush(out) != 0) {
+        fprintf(stderr, "Failed to write output\n");
+        result = -1;
+    }
+    return result;
+}
+
+int pipeline_run(const file_list_t *list, const pipeline_options_t *options, output_sink_t *out) {
+    // A finished feed never appends, so the list is only read
+    file_feed_t feed;
+    file_feed_init(&feed, (file_list_t*)list);
+    file_feed_finish(&feed, 0);
+    int result = pipeline_run_feed(&feed, options, out);
+    file_feed_destroy(&feed);
+    return result;
+}
+
+// Input bytes per task of the positional writer. Larger files are split into
+// ranges of this size, so a single big file still keeps every thread busy.
+#define PIPELINE_RANGE_SIZE (4 * 1024 * 1024)
+
+// Input bytes encoded at a time by a positional task
+#define PIPELINE_SLICE_SIZE CONVERT_STREAM_BLOCK_SIZE
+
+typedef struct pipeline_layout pipeline_layout_t;
+
+// One task of the positional writer: part of one file
+typedef struct {
+    pipeline_layout_t *layout;
+    size_t index;                   // Entry in the list
+    size_t size;                    // Size of the file when laid out
+    size_t prefix_len;              // Bytes the prefix hook put ahead of it
+    size_t begin;                   // Byte range of the file this task encodes
+    size_t end;
+    unsigned long long offset;      // Where the file's array starts in the output
+} pipeline_range_t;
+
+struct pipeline_layout {
+    const file_list_t *list;
+    const pipeline_options_t *options;
+    platform_output *output;
+    unsigned char *map;             // Whole output, or NULL to use positional writes
+    platform_input **inputs;        // One reader per worker
+    char **texts;                   // One text buffer per worker, without a map
+
+    platform_mutex_t lock;
+    int changed;                    // A file could not be read as laid out
+    double encode_busy;
+};
+
+// Put 'len' characters at 'offset' in the output
+static int pipeline_place(pipeline_layout_t *l, const char *text, size_t len, unsigned long long offset) {
+    if (l->map) {
+        memcpy(l->map + offset, text, len);
+        return 0;
+    }
+    return platform_output_write_at(l->output, text, len, offset);
+}
+
+// Encode one range of a file into its place in the output
+static void pipeline_range_task(void *arg, unsigned worker) {
+    pipeline_range_t *r = (pipeline_range_t*)arg;
+    pipeline_layout_t *l = r->layout;
+    unsigned long long start = platform_time_ns();
+    platform_input *in = l->inputs[worker];
+    const char *path = file_list_path(l->list, r->index);
+
+    char var_name[64];
+    convert_var_name(var_name, sizeof(var_name), r->index);
+    unsigned long long body = r->offset + convert_header_size(var_name);
+
+    // The file has to be exactly as large as when the output was laid out
+    size_t held_size;
+    const unsigned char *held = pipeline_contents(l->options, r->index, path, &held_size);
+    int error;
+    if (held) {
+        error = held_size != r->size;
+    } else {
+        error = !in || platform_input_open(in, path) != 0;
+        if (!error && (platform_input_size(in) != r->size || platform_input_seek(in, r->begin) != 0)) {
+            error = 1;
+        }
+    }
+    char edge[128];
+    if (!error && r->begin == 0) {
+        error = pipeline_place(l, edge, convert_format_header(edge, var_name), r->offset) != 0;
+    }
+    if (!error && r->begin == 0 && r->prefix_len > 0) {
+        // The hook has to give the same prefix as when the output was laid out
+        unsigned char prefix_buf[PIPELINE_PREFIX_MAX];
+        convert_prefix_t prefix_storage;
+        const convert_prefix_t *prefix;
+        error = pipeline_make_prefix(l->options, r->index, path, r->size, prefix_buf, &prefix_storage, &prefix) != 0 ||
+                prefix->len != r->prefix_len;
+        if (!error && l->map) {
+            encode_hex((char*)l->map + body, prefix->data, prefix->len, 0);
+        } else if (!error) {
+            size_t text_len = encode_hex(l->texts[worker], prefix->data, prefix->len, 0);
+            error = platform_output_write_at(l->output, l->texts[worker], text_len, body) != 0;
+        }
+    }
+
+    // Contents follow the prefix in the same run of rows
+    size_t pos = r->begin;
+    while (!error && pos < r->end) {
+        const unsigned char *block;
+        size_t n;
+        if (held) {
+            block = held + pos;
+            n = r->end - pos;
+        } else if (platform_input_next(in, &block, &n) != 0 || n == 0) {
+            error = 1;
+            break;
+        }
+        if (n > r->end - pos) {
+            n = r->end - pos;
+        }
+        // mmap'd input comes as one block; encode it a slice at a time
+        for (size_t done = 0; done < n && !error; ) {
+            size_t len = n - done < PIPELINE_SLICE_SIZE ? n - done : PIPELINE_SLICE_SIZE;
+            size_t at_pos = r->prefix_len + pos;
+            unsigned long long at = body + encode_hex_size(0, at_pos);
+            if (l->map) {
+                encode_hex((char*)l->map + at, block + done, len, at_pos);
+            } else {
+                size_t text_len = encode_hex(l->texts[worker], block + done, len, at_pos);
+                error = platform_output_write_at(l->output, l->texts[worker], text_len, at) != 0;
+            }
+            done += len;
+            pos += len;
+        }
+    }
+
+    if (!error && r->end == r->size) {
+        error = pipeline_place(l, edge, convert_format_footer(edge), body + encode_hex_size(0, r->prefix_len + r->size)) != 0;
+    }
+    if (in && !held) {
+        platform_input_close(in);
+    }
+
+    unsigned long long end = platform_time_ns();
+    platform_mutex_lock(&l->lock);
+    l->encode_busy += pipeline_seconds(start, end);
+    if (error) {
+        l->changed = 1;
+    }
+    platform_mutex_unlock(&l->lock);
+}
+
+// Positional writer. Returns 0 on success, 1 if a file could not be read
+// the way it was laid out (the output is then incomplete), -1 on failure.
+static int pipeline_write_positional(const file_list_t *list, const pipeline_options_t *options, const char *path) {
+    unsigned long long run_start = platform_time_ns();
+    pipeline_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.memory_limit = options->memory_limit ? options->memory_limit : PIPELINE_DEFAULT_MEMORY_LIMIT;
+
+    // Lay out every array. Files that cannot be stat'ed are skipped like
+    // files that cannot be read, so they take no space, and so are files the
+    // prefix hook refuses.
+    size_t count = list->count ? list->count : 1;
+    size_t *sizes = (size_t*)alloc_malloc(count * sizeof(size_t));
+    size_t *prefix_lens = (size_t*)alloc_calloc(count, sizeof(size_t));
+    unsigned char *prefix_buf = options->hooks ? (unsigned char*)alloc_malloc(PIPELINE_PREFIX_MAX) : NULL;
+    if (!sizes || !prefix_lens || (options->hooks && !prefix_buf)) {
+        alloc_free(sizes);
+        alloc_free(prefix_lens);
+        alloc_free(prefix_buf);
+        return -1;
+    }
+    size_t range_count = 0;
+    unsigned long long total = 0;
+    char var_name[64];
+    convert_prefix_t prefix_storage;
+    const convert_prefix_t *prefix;
+    for (size_t i = 0; i < list->count; i++) {
+        const char *file_path = file_list_path(list, i);
+        size_t size = file_list_size(list, i);
+        size_t held_size;
+        if (pipeline_contents(options, i, file_path, &held_size)) {
+            size = held_size;
+        }
+        if (size == PLATFORM_SIZE_UNKNOWN && platform_stat_size(file_path, &size) != 0) {
+            fprintf(stderr, "Failed to read file: %s\n", file_path);
+            size = PLATFORM_SIZE_UNKNOWN;
+        } else if (pipeline_make_prefix(options, i, file_path, size, prefix_buf, &prefix_storage, &prefix) != 0) {
+            fprintf(stderr, "Failed to prepare file: %s\n", file_path);
+            size = PLATFORM_SIZE_UNKNOWN;
+        }
+        sizes[i] = size;
+        if (size != PLATFORM_SIZE_UNKNOWN) {
+            prefix_lens[i] = pipeline_prefix_len(prefix);
+            convert_var_name(var_name, sizeof(var_name), i);
+            total += convert_c_array_size(var_name, prefix_lens[i] + size);
+            range_count += size / PIPELINE_RANGE_SIZE + 1;
+            stats.files++;
+            stats.bytes_in += size;
+        }
+    }
+    stats.bytes_out = total;
+    alloc_free(prefix_buf);
+
+    pipeline_range_t *ranges = (pipeline_range_t*)alloc_malloc((range_count ? range_count : 1) * sizeof(pipeline_range_t));
+    if (!ranges) {
+        alloc_free(sizes);
+        alloc_free(prefix_lens);
+        return -1;
+    }
+
+    pipeline_layout_t l;
+    memset(&l, 0, sizeof(l));
+    l.list = list;
+    l.options = options;
+    unsigned long long offset = 0;
+    size_t k = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (sizes[i] == PLATFORM_SIZE_UNKNOWN) {
+            continue;
+        }
+        size_t begin = 0;
+        do {
+            pipeline_range_t *r = &ranges[k++];
+            r->layout = &l;
+            r->index = i;
+            r->size = sizes[i];
+            r->prefix_len = prefix_lens[i];
+            r->begin = begin;
+            r->end = sizes[i] - begin > PIPELINE_RANGE_SIZE ? begin + PIPELINE_RANGE_SIZE : sizes[i];
+            r->offset = offset;
+            begin = r->end;
+        } while (begin < sizes[i]);
+        convert_var_name(var_name, sizeof(var_name), i);
+        offset += convert_c_array_size(var_name, prefix_lens[i] + sizes[i]);
+    }
+    range_count = k;
+    alloc_free(prefix_lens);
+
+    thread_pool_t *pool = options->jobs > 1 ? thread_pool_create(options->jobs) : NULL;
+    unsigned workers = pool ? thread_pool_size(pool) : 1;
+    stats.encode_threads = pool ? workers : 0;
+
+    int result = -1;
+    l.output = platform_output_create(path, total);
+    l.map = l.output ? platform_output_map(l.output) : NULL;
+    l.inputs = (platform_input**)alloc_calloc(workers, sizeof(platform_input*));
+    l.texts = (char**)alloc_calloc(workers, sizeof(char*));
+    if (!l.output) {
+        fprintf(stderr, "Failed to create output file: %s\n", platform_get_last_error());
+    } else if ((options->jobs > 1 && !pool) || !l.inputs || !l.texts) {
+        fprintf(stderr, "Failed to start the positional writer\n");
+    } else {
+        result = 0;
+        for (unsigned w = 0; w < workers && result == 0; w++) {
+            l.inputs[w] = platform_input_create(options->input_strategy, CONVERT_STREAM_BLOCK_SIZE);
+            if (!l.map) {
+                l.texts[w] = (char*)alloc_malloc(encode_hex_size(0, PIPELINE_SLICE_SIZE) + ENCODE_ROW_CHARS);
+            }
+            if (!l.inputs[w] || (!l.map && !l.texts[w])) {
+                fprintf(stderr, "Failed to allocate conversion buffers\n");
+                result = -1;
+            }
+        }
+    }
+
+    if (result == 0) {
+        platform_mutex_init(&l.lock);
+        for (size_t i = 0; i < range_count; i++) {
+            if (!pool || thread_pool_submit(pool, pipeline_range_task, &ranges[i]) != 0) {
+                // Serial, or could not queue it. Worker 0's scratch is ours
+                // only once the pool is idle.
+                if (pool) {
+                    thread_pool_wait(pool);
+                }
+                pipeline_range_task(&ranges[i], 0);
+            }
+        }
+        if (pool) {
+            thread_pool_wait(pool);
+        }
+        platform_mutex_destroy(&l.lock);
+        result = l.changed ? 1 : 0;
+    }
+    thread_pool_destroy(pool);
+
+    if (l.output && platform_output_close(l.output) != 0 && result == 0) {
+        fprintf(stderr, "Failed to write output file: %s\n", platform_get_last_error());
+        result = -1;
+    }
+    for (unsigned w = 0; w < workers; w++) {
+        platform_input_destroy(l.inputs ? l.inputs[w] : NULL);
+        alloc_free(l.texts ? l.texts[w] : NULL);
+    }
+    alloc_free(l.inputs);
+    alloc_free(l.texts);
+    alloc_free(ranges);
+
+    for (size_t i = 0; i < list->count && result == 0; i++) {
+        if (sizes[i] != PLATFORM_SIZE_UNKNOWN) {
+            pipeline_written(options, i, file_list_path(list, i), sizes[i]);
+        }
+    }
+    alloc_free(sizes);
+
+    if (options->stats) {
+        stats.encode_busy = l.encode_busy;
+        stats.wall_seconds = pipeline_seconds(run_start, platform_time_ns());
+        *options->stats = stats;
+    }
+    return result;
+}
+
+int pipeline_write_file(const file_list_t *list, const pipeline_options_t *options, const char *path) {
+    if (pipeline_check_memory(options) != 0) {
+        return -1;
+    }
+    int result = pipeline_write_positional(list, options, path);
+    if (result <= 0) {
+        return result;
+    }
+
+    // Something changed under us since the layout was computed. Rewrite the
+    // file in order, which copes with any sizes.
+    fprintf(stderr, "Input files changed while writing %s; writing it again in order\n", path);
+    output_sink_t *out = sink_file_create(path, 0);
+    if (!out) {
+        fprintf(stderr, "Failed to create output file: %s\n", path);
+        return -1;
+    }
+    result = pipeline_run(list, options, out);
+    if (sink_close(out) != 0 && result == 0) {
+        result = -1;
+    }
+    return result;
+}
+
+void pipeline_print_stats(const pipeline_stats_t *stats, FILE *stream) {
+    double wall = stats->wall_seconds > 0 ? stats->wall_seconds : 1e-9;
+    unsigned threads = stats->encode_threads;
+
+    fprintf(stream, "pipeline: %zu files, %.1f MiB in, %.1f MiB out, %.3f s\n",
+            stats->files, (double)stats->bytes_in / (1024.0 * 1024.0), (double)stats->bytes_out / (1024.0 * 1024.0),
+            stats->wall_seconds);
+    fprintf(stream, "  memory: peak %.1f MiB held of a %.1f MiB limit, %zu files streamed\n",
+            (double)stats->peak_memory / (1024.0 * 1024.0), (double)stats->memory_limit / (1024.0 * 1024.0),
+            stats->streamed_files);
+    if (stats->prefetched_files > 0 || stats->dropped_files > 0) {
+        fprintf(stream, "  prefetch: %zu files read ahead (up to %u deep), %zu dropped from the cache after use\n",
+                stats->prefetched_files, stats->prefetch_depth, stats->dropped_files);
+    }
+    if (threads == 0) {
+        fprintf(stream, "  serial run, no per-stage breakdown\n");
+        return;
+    }
+    fprintf(stream, "  read:   %5.1f%% busy, %5.1f%% blocked by backpressure\n",
+            100.0 * stats->read_busy / wall, 100.0 * stats->read_blocked / wall);
+    fprintf(stream, "  encode: %5.1f%% busy across %u threads\n",
+            100.0 * stats->encode_busy / (wall * threads), threads);
+    fprintf(stream, "  write:  %5.1f%% busy, %5.1f%% waiting for the next file\n",
+            100.0 * stats->write_busy / wall, 100.0 * stats->write_blocked / wall);
+}
@@ -0,0 +1,130 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include "platform.h"
+#include "file_list.h"
+#include "sink.h"
+
+// Files at least this large are not encoded into per-file buffers by the
+// workers. The writer streams them when their turn comes instead, splitting
+// each block into chunks that all workers encode together.
+#define PIPELINE_BUFFER_LIMIT (8 * 1024 * 1024)
+
+// Default ceiling on file contents and encoded text held in memory at once.
+#define PIPELINE_DEFAULT_MEMORY_LIMIT (512 * 1024 * 1024)
+
+// Fixed buffers a run with 'threads' encoder threads needs whatever the
+// files are: the reader's block, and the block and text of a streamed file.
+// A streamed file is encoded in fewer chunks at once when 'memory_limit'
+// (0 = default) is tight. They are counted against the memory limit before
+// any file is admitted.
+size_t pipeline_fixed_memory(unsigned threads, size_t memory_limit);
+
+// Smallest memory limit a run with 'threads' encoder threads accepts: its
+// fixed buffers with a streamed file encoded one chunk at a time.
+size_t pipeline_min_memory(unsigned threads);
+
+// Per-stage counters for one run. Busy times are summed over the threads of
+// a stage; a stage whose busy time is close to wall time x threads is the
+// bottleneck.
+typedef struct {
+    size_t files;                   // Files written
+    unsigned long long bytes_in;    // Input bytes converted
+    unsigned long long bytes_out;   // Characters written
+    unsigned encode_threads;
+    double wall_seconds;
+    double read_busy;               // Reader thread reading files
+    double read_blocked;            // Reader thread held back by backpressure
+    double encode_busy;             // Encoder threads encoding
+    double write_busy;              // Writer writing (and streaming large files)
+    double write_blocked;           // Writer waiting for the next file in order
+    size_t peak_memory;             // Most bytes held at once, fixed buffers included
+    size_t memory_limit;            // Memory limit the run kept to
+    size_t streamed_files;          // Files streamed because they did not fit
+    size_t prefetched_files;        // Files the OS was asked to read ahead
+    size_t dropped_files;           // Files dropped from the page cache after use
+    unsigned prefetch_depth;        // Deepest read-ahead, in files
+} pipeline_stats_t;
+
+// Most bytes a prefix hook may put ahead of a file's contents
+#define PIPELINE_PREFIX_MAX (4 * 1024)
+
+// Lets a writer such as the fsdata generator shape the arrays of a run
+typedef struct {
+    // Store the bytes that open the array of entry 'index', a file of 'size'
+    // bytes, in 'dst' (PIPELINE_PREFIX_MAX bytes) and return how many there
+    // are, a multiple of ENCODE_BYTES_PER_ROW (see convert_prefix_t). Returns
+    // 0 if the file cannot have one; it is then skipped. May be NULL. Called
+    // from any thread.
+    size_t (*prefix)(void *ctx, size_t index, const char *path, size_t size, unsigned char *dst);
+    // Contents to convert for entry 'index' in place of the file at 'path',
+    // held in memory by the hooks: returns them and stores their size in
+    // *size, which must be the size of the entry in the list, or returns
+    // NULL to read the file. They must stay valid for the whole run. May be
+    // NULL. Called from any thread.
+    const unsigned char* (*contents)(void *ctx, size_t index, const char *path, size_t *size);
+    // The array of entry 'index' is complete in the output. Called in list
+    // order on the thread running the pipeline. May be NULL.
+    void (*written)(void *ctx, size_t index, const char *path, size_t size);
+    void *ctx;
+} pipeline_hooks_t;
+
+typedef struct {
+    unsigned jobs;                              // Encoder threads; 1 runs everything on the calling thread
+    platform_input_strategy input_strategy;     // Backend used to read input files
+    size_t memory_limit;                        // Bytes of buffers at once; 0 = PIPELINE_DEFAULT_MEMORY_LIMIT
+    int prefetch;                               // Read ahead across files and drop cold ones after use
+    const pipeline_hooks_t *hooks;              // NULL for plain arrays
+    pipeline_stats_t *stats;                    // Filled in if not NULL
+} pipeline_options_t;
+
+// Convert every file in 'list' to a C array and write them to 'out' in list
+// order, as file_0, file_1, ... Files that cannot be read are reported on
+// stderr and skipped. The output is identical for any number of jobs.
+//
+// With more than one job this runs as three stages: a reader thread loading
+// files, a pool of encoder threads, and the calling thread writing results
+// in order. The stages are connected by a bounded ring of slots, and the
+// reader stops while the ring is full or the memory limit is reached.
+//
+// The memory limit covers the fixed buffers (pipeline_fixed_memory) plus
+// every file and its text in flight, rounded up to pool buffer sizes. A file
+// that would not fit on its own even with nothing else in flight is streamed
+// in blocks instead of being loaded whole. A limit below
+// pipeline_min_memory is refused.
+//
+// With 'prefetch' set, the OS is asked to read the next files ahead of the
+// reader, as deep as read latency calls for (see prefetch.h).
+//
+// The sink is flushed at the end but not closed.
+// Returns 0 on success, -1 on a fatal error (out of memory, no threads, a
+// failed write), or 1 if a streamed file failed to read or changed size part
+// way: its array was closed early, so the output is valid C but incomplete.
+// Files that cannot be read at all are only skipped.
+int pipeline_run(const file_list_t *list, const pipeline_options_t *options, output_sink_t *out);
+
+// Same as pipeline_run, but takes files from 'feed' as they arrive, so a scan
+// running on another thread can overlap with conversion. Output order is the
+// order of the feed, so it matches pipeline_run over the finished list.
+int pipeline_run_feed(file_feed_t *feed, const pipeline_options_t *options, output_sink_t *out);
+
+// Positional writer: convert every file in 'list' into the file at 'path',
+// with the same content pipeline_run would write. The size of every array
+// follows from the file sizes, so the whole output is laid out and allocated
+// up front (fallocate where available). The files, split into ranges of a
+// few MiB, are then encoded by all jobs at once, each straight into its
+// place in the memory-mapped output, or written there with pwrite if the
+// output cannot be mapped. There is no ordered writer stage and no copy.
+//
+// If a file turns out not to match the layout (it changed size or could not
+// be read), the output is rewritten in order with pipeline_run. The 'written'
+// hook is only called once the output is complete, for the pass that made it.
+// Returns 0 on success, -1 on a fatal error, or 1 if the rewrite left a
+// truncated array as pipeline_run describes.
+int pipeline_write_file(const file_list_t *list, const pipeline_options_t *options, const char *path);
+
+// Print 'stats' as a short per-stage report.
+void pipeline_print_stats(const pipeline_stats_t *stats, FILE *stream);
+
+#endif // PIPELINE_H
@@ -1,10 +1,21 @@
+#if defined(PLATFORM_LINUX) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // statx
+#endif
 #include "platform.h"
+#include "alloc.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <wchar.h>
 
-static char g_platform_error[256]; // Global error buffer
+#ifdef _MSC_VER
+#define PLATFORM_THREAD_LOCAL __declspec(thread)
+#else
+#define PLATFORM_THREAD_LOCAL _Thread_local
+#endif
+
+// Error buffer, one per thread so concurrent failures do not mix
+static PLATFORM_THREAD_LOCAL char g_platform_error[256];
 
 static void platform_set_error(const char *fmt, ...) {
     va_list args;
@@ -17,14 +28,29 @@ const char* platform_get_last_error(void) {
     return g_platform_error[0] ? g_platform_error : "";
 }
 
+// Store a 64-bit file size in a size_t, failing on targets where it does
+// not fit rather than truncating it
+static int platform_size_from_off(unsigned long long size, size_t *out, const char *path) {
+    if (size > (unsigned long long)SIZE_MAX) {
+        platform_set_error("File too large for this build: %s", path);
+        return -1;
+    }
+    *out = (size_t)size;
+    return 0;
+}
+
 #ifdef _WIN32
 #include <windows.h>
 #include <io.h>
 #include <direct.h>
+#include <errno.h>
+#include <sys/stat.h>
 
-// Convert UTF-8 path to wide char (UTF-16)
+// Convert UTF-8 path to wide char (UTF-16). Paths that fit in 'local'
+// ('local_len' characters) are converted there; longer ones are allocated.
+// Release the result with platform_free_wpath.
 // Returns 0 on success, nonzero on error.
-static int platform_convert_path_to_wchar(const char *input_path, WCHAR **wpath){
+static int platform_convert_path_to_wchar(const char *input_path, WCHAR *local, size_t local_len, WCHAR **wpath){
     if (!input_path || !wpath) {
         platform_set_error("Invalid arguments to platform_convert_path_to_wchar\n");
         return -1;
@@ -39,7 +65,7 @@ static int platform_convert_path_to_wchar(const char *input_path, WCHAR **wpath)
         return -1;
     }
 
-    *wpath = (WCHAR*)malloc(wlen * sizeof(WCHAR)); // Allocate memory for WCHAR string
+    *wpath = wlen <= local_len ? local : (WCHAR*)alloc_malloc(wlen * sizeof(WCHAR));
     if (!*wpath) {
         platform_set_error("Memory allocation failed in platform_convert_path_to_wchar\n");
         return -1;
@@ -50,13 +76,39 @@ static int platform_convert_path_to_wchar(const char *input_path, WCHAR **wpath)
     return 0;
 }
 
+static void platform_free_wpath(WCHAR *wpath, const WCHAR *local) {
+    if (wpath != local) {
+        alloc_free(wpath);
+    }
+}
+
 #else
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <time.h>
+#ifdef PLATFORM_LINUX
+#include <sys/syscall.h>
+#endif
+
+#endif
+
+#ifdef PLATFORM_LINUX
+// Bytes of directory entries fetched per getdents64 call
+#define PLATFORM_DIR_BUFFER_SIZE (64 * 1024)
 
+// Record layout returned by getdents64
+typedef struct {
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} platform_dirent64;
 #endif
 
 struct platform_dir_handle {
@@ -65,15 +117,40 @@ struct platform_dir_handle {
     WIN32_FIND_DATAW fdata;
     int first;
     char searchPath[MAX_PATH_LENGTH];
+#elif defined(PLATFORM_LINUX)
+    int fd;
+    char *buf;              // Entries from the last getdents64 call
+    size_t pos;
+    size_t end;
+    size_t stat_calls;
 #else
     DIR *d;
+    size_t stat_calls;
 #endif
 };
 
+#ifdef PLATFORM_LINUX
+// Wrap an open directory descriptor, closing it on failure
+static platform_dir_handle* platform_dir_from_fd(int fd) {
+    platform_dir_handle *dh = (platform_dir_handle*)alloc_malloc(sizeof(platform_dir_handle));
+    if (!dh) {
+        platform_set_error("Out of memory");
+        close(fd);
+        return NULL;
+    }
+    dh->fd = fd;
+    dh->buf = NULL; // Allocated by the first platform_readdir
+    dh->pos = 0;
+    dh->end = 0;
+    dh->stat_calls = 0;
+    return dh;
+}
+#endif
+
 platform_dir_handle* platform_opendir(const char *searchPath) {
 
 #ifdef _WIN32
-    platform_dir_handle *dh = (platform_dir_handle*)malloc(sizeof(platform_dir_handle));
+    platform_dir_handle *dh = (platform_dir_handle*)alloc_malloc(sizeof(platform_dir_handle));
     if (!dh) {
         platform_set_error("Out of memory");
         return NULL;
@@ -83,7 +160,7 @@ platform_dir_handle* platform_opendir(const char *searchPath) {
     // Ensure searchPath fits in buffer
     if (strlen(searchPath) + 2 > MAX_PATH_LENGTH) {
         platform_set_error("Search path is too long");
-        free(dh);
+        alloc_free(dh);
         return NULL;
     }
 
@@ -100,7 +177,7 @@ platform_dir_handle* platform_opendir(const char *searchPath) {
     size_t convertedChars = 0;
     if (mbstowcs_s(&convertedChars, wideSearchPath, MAX_PATH_LENGTH, dh->searchPath, _TRUNCATE) != 0) {
         platform_set_error("Failed to convert searchPath to WCHAR");
-        free(dh);
+        alloc_free(dh);
         return NULL;
     }
 
@@ -108,29 +185,133 @@ platform_dir_handle* platform_opendir(const char *searchPath) {
     dh->hFind = FindFirstFileW(wideSearchPath, &dh->fdata);
     if (dh->hFind == INVALID_HANDLE_VALUE) {
         platform_set_error("Failed to open directory: %s", searchPath);
-        free(dh);
+        alloc_free(dh);
         return NULL;
     }
     dh->first = 1;
+#elif defined(PLATFORM_LINUX)
+    int fd = open(searchPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        platform_set_error("Failed to open directory: %s (errno=%d)", searchPath, errno);
+        return NULL;
+    }
+    platform_dir_handle *dh = platform_dir_from_fd(fd);
 #else
     DIR *d = opendir(searchPath);
     if (!d) {
         platform_set_error("Failed to open directory: %s (errno=%d)", searchPath, errno);
         return NULL;
     }
-    platform_dir_handle *dh = (platform_dir_handle*)malloc(sizeof(platform_dir_handle));
+    platform_dir_handle *dh = (platform_dir_handle*)alloc_malloc(sizeof(platform_dir_handle));
     if (!dh) {
         platform_set_error("Out of memory");
         closedir(d);
         return NULL;
     }
     dh->d = d;
+    dh->stat_calls = 0;
 #endif
 
     return dh;
 }
 
 
+platform_dir_handle* platform_opendir_at(platform_dir_handle *parent, const char *name) {
+    if (!parent || !name) {
+        platform_set_error("Invalid arguments to platform_opendir_at");
+        return NULL;
+    }
+
+#ifdef _WIN32
+    // No handle-relative opens here; join the name onto the parent's path
+    char path[MAX_PATH_LENGTH];
+    size_t len = strlen(parent->searchPath) - 1; // Without the trailing '*'
+    if (len + strlen(name) + 1 > MAX_PATH_LENGTH) {
+        platform_set_error("Search path is too long");
+        return NULL;
+    }
+    memcpy(path, parent->searchPath, len);
+    strcpy(path + len, name);
+    return platform_opendir(path);
+#else
+#ifdef PLATFORM_LINUX
+    int parent_fd = parent->fd;
+#else
+    int parent_fd = dirfd(parent->d);
+#endif
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        platform_set_error("Failed to open directory: %s (errno=%d)", name, errno);
+        return NULL;
+    }
+#ifdef PLATFORM_LINUX
+    return platform_dir_from_fd(fd);
+#else
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        platform_set_error("Failed to open directory: %s (errno=%d)", name, errno);
+        close(fd);
+        return NULL;
+    }
+    platform_dir_handle *dh = (platform_dir_handle*)alloc_malloc(sizeof(platform_dir_handle));
+    if (!dh) {
+        platform_set_error("Out of memory");
+        closedir(d);
+        return NULL;
+    }
+    dh->d = d;
+    dh->stat_calls = 0;
+    return dh;
+#endif
+#endif
+}
+
+#ifndef _WIN32
+// Fill 'info' for the entry 'name' of the directory open as 'dir_fd'.
+// The entry type from the listing is trusted when it is known, so regular
+// files and directories cost no stat call; the size of a regular file is
+// then left as PLATFORM_SIZE_UNKNOWN. Symlinks and unknown types are
+// stat'ed, following the link as before.
+static int platform_dirent_info(platform_dir_handle *dh, int dir_fd, const char *name, unsigned char type, platform_file_info *info) {
+    strncpy(info->name, name, MAX_FILENAME_LENGTH - 1);
+    info->name[MAX_FILENAME_LENGTH - 1] = '\0';
+
+#ifdef DT_UNKNOWN
+    if (type == DT_DIR) {
+        info->is_dir = 1;
+        info->size = 0;
+        return 0;
+    }
+    if (type == DT_REG) {
+        info->is_dir = 0;
+        info->size = PLATFORM_SIZE_UNKNOWN;
+        return 0;
+    }
+#else
+    (void)type;
+#endif
+
+    // Determine if directory using stat
+    struct stat st;
+    dh->stat_calls++;
+    if (fstatat(dir_fd, name, &st, 0) == -1) {
+        platform_set_error("Failed to stat directory entry: %s (errno=%d)", name, errno);
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        info->is_dir = 1;
+        info->size = 0;
+    } else {
+        info->is_dir = 0;
+        if (platform_size_from_off((unsigned long long)st.st_size, &info->size, name) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
 int platform_readdir(platform_dir_handle *dh, platform_file_info *info){
     if (!dh || !info) {
         platform_set_error("Invalid arguments to platform_readdir");
@@ -170,13 +351,50 @@ int platform_readdir(platform_dir_handle *dh, platform_file_info *info){
         LARGE_INTEGER size;
         size.LowPart = fdata->nFileSizeLow;
         size.HighPart = fdata->nFileSizeHigh;
-        info->size = (size_t) size.QuadPart;
+        if (platform_size_from_off((unsigned long long)size.QuadPart, &info->size, info->name) != 0) {
+            return -1;
+        }
     } else {
         info->size = 0;
     }
 
+#elif defined(PLATFORM_LINUX)
+    // On Linux, entries come from large getdents64 batches
+    for (;;) {
+        if (dh->pos >= dh->end) {
+            if (!dh->buf) {
+                dh->buf = (char*)alloc_malloc(PLATFORM_DIR_BUFFER_SIZE);
+                if (!dh->buf) {
+                    platform_set_error("Out of memory");
+                    return -1;
+                }
+            }
+            long n = syscall(SYS_getdents64, dh->fd, dh->buf, PLATFORM_DIR_BUFFER_SIZE);
+            if (n <= 0) {
+                // No more entries, or an error. The buffer is dropped here
+                // since the handle may be kept open for platform_opendir_at.
+                if (n < 0) {
+                    platform_set_error("Failed to read directory (errno=%d)", errno);
+                }
+                alloc_free(dh->buf);
+                dh->buf = NULL;
+                dh->pos = dh->end = 0;
+                return -1;
+            }
+            dh->pos = 0;
+            dh->end = (size_t)n;
+        }
+        const platform_dirent64 *entry = (const platform_dirent64*)(dh->buf + dh->pos);
+        dh->pos += entry->d_reclen;
+
+        // Skip "." and ".."
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        return platform_dirent_info(dh, dh->fd, entry->d_name, entry->d_type, info);
+    }
 #else
-    // On POSIX (macOS/Linux)
+    // On POSIX (macOS)
     struct dirent *entry = readdir(dh->d);
     if (entry == NULL) {
         // No more entries
@@ -188,23 +406,11 @@ int platform_readdir(platform_dir_handle *dh, platform_file_info *info){
         return platform_readdir(dh, info);
     }
 
-    strncpy(info->name, entry->d_name, MAX_FILENAME_LENGTH - 1);
-    info->name[MAX_FILENAME_LENGTH - 1] = '\0';
-
-    // Determine if directory using stat
-    struct stat st;
-    if (fstatat(dirfd(dh->d), entry->d_name, &st, 0) == -1) {
-        platform_set_error("Failed to stat directory entry: %s (errno=%d)", entry->d_name, errno);
-        return -1;
-    }
-
-    if (S_ISDIR(st.st_mode)) {
-        info->is_dir = 1;
-        info->size = 0;
-    } else {
-        info->is_dir = 0;
-        info->size = (size_t)st.st_size;
-    }
+#ifdef DT_UNKNOWN
+    return platform_dirent_info(dh, dirfd(dh->d), entry->d_name, entry->d_type, info);
+#else
+    return platform_dirent_info(dh, dirfd(dh->d), entry->d_name, 0, info);
+#endif
 #endif
 
     return 0;
@@ -217,13 +423,25 @@ int platform_closedir(platform_dir_handle *dh) {
     }
 #ifdef _WIN32
     FindClose(dh->hFind);
+#elif defined(PLATFORM_LINUX)
+    close(dh->fd);
+    alloc_free(dh->buf);
 #else
     closedir(dh->d);
 #endif
-    free(dh);
+    alloc_free(dh);
     return 0;
 }
 
+size_t platform_dir_stat_calls(const platform_dir_handle *dh) {
+#ifdef _WIN32
+    (void)dh;
+    return 0; // Sizes and types come with every entry
+#else
+    return dh->stat_calls;
+#endif
+}
+
 int platform_stat_file(const char *path, platform_file_info *info) {
     if (!path || !info) {
         platform_set_error("Invalid arguments to platform_stat_file");
@@ -231,19 +449,20 @@ int platform_stat_file(const char *path, platform_file_info *info) {
     }
 
 #ifdef _WIN32
+    WCHAR local[MAX_PATH];
     WCHAR *wpath = NULL;
-    if (platform_convert_path_to_wchar(path, &wpath) != 0) {
+    if (platform_convert_path_to_wchar(path, local, MAX_PATH, &wpath) != 0) {
         return -1; // error already set
     }
 
     WIN32_FILE_ATTRIBUTE_DATA fad;
     if (!GetFileAttributesExW(wpath, GetFileExInfoStandard, &fad)) {
         platform_set_error("Failed to stat file: %s", path);
-        free(wpath);
+        platform_free_wpath(wpath, local);
         return -1;
     }
 
-    free(wpath);
+    platform_free_wpath(wpath, local);
 
     if (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
         info->is_dir = 1;
@@ -253,7 +472,9 @@ int platform_stat_file(const char *path, platform_file_info *info) {
         LARGE_INTEGER size;
         size.LowPart = fad.nFileSizeLow;
         size.HighPart = fad.nFileSizeHigh;
-        info->size = (size_t) size.QuadPart;
+        if (platform_size_from_off((unsigned long long)size.QuadPart, &info->size, path) != 0) {
+            return -1;
+        }
     }
 
 #else
@@ -268,17 +489,46 @@ int platform_stat_file(const char *path, platform_file_info *info) {
         info->size = 0;
     } else {
         info->is_dir = 0;
-        info->size = (size_t)st.st_size;
+        if (platform_size_from_off((unsigned long long)st.st_size, &info->size, path) != 0) {
+            return -1;
+        }
+    }
+
+#endif
+    return 0;
+}
+
+int platform_stat_size(const char *path, size_t *size) {
+    if (!path || !size) {
+        platform_set_error("Invalid arguments to platform_stat_size");
+        return -1;
     }
 
+#if defined(PLATFORM_LINUX) && defined(STATX_SIZE)
+    // Only ask for the size, and accept cached attributes on network filesystems
+    struct statx stx;
+    if (statx(AT_FDCWD, path, AT_STATX_DONT_SYNC, STATX_SIZE, &stx) == 0 && (stx.stx_mask & STATX_SIZE)) {
+        return platform_size_from_off((unsigned long long)stx.stx_size, size, path);
+    }
+    if (errno != ENOSYS && errno != EINVAL) {
+        platform_set_error("Failed to stat file: %s (errno=%d)", path, errno);
+        return -1;
+    }
 #endif
+
+    platform_file_info info;
+    if (platform_stat_file(path, &info) != 0) {
+        return -1;
+    }
+    *size = info.size;
     return 0;
 }
 
 platform_file_handle platform_fopen(const char *path, const char *mode) {
 #ifdef _WIN32
+    WCHAR local[MAX_PATH];
     WCHAR *wpath = NULL;
-    if (platform_convert_path_to_wchar(path, &wpath) != 0) {
+    if (platform_convert_path_to_wchar(path, local, MAX_PATH, &wpath) != 0) {
         return NULL; // error set
     }
 
@@ -289,13 +539,13 @@ platform_file_handle platform_fopen(const char *path, const char *mode) {
     size_t convertedChars = 0;
     if (mbstowcs_s(&convertedChars, wmode, _countof(wmode), mode, _TRUNCATE) != 0) {
         platform_set_error("Failed to convert mode to WCHAR");
-        free(wpath);
+        platform_free_wpath(wpath, local);
         return NULL;
     }
 
     platform_file_handle fh = NULL;
     errno_t err = _wfopen_s(&fh, wpath, wmode);
-    free(wpath);
+    platform_free_wpath(wpath, local);
 
     if (err != 0 || !fh) {
         platform_set_error("Failed to open file: %s", path);
@@ -323,12 +573,635 @@ size_t platform_fwrite(const void *ptr, size_t size, size_t nmemb, platform_file
     return fwrite(ptr, size, nmemb, fh);
 }
 
-int platform_fseek(platform_file_handle fh, long offset, int whence) {
-    return fseek(fh, offset, whence);
+int platform_fseek(platform_file_handle fh, platform_off_t offset, int whence) {
+#ifdef _WIN32
+    return _fseeki64(fh, offset, whence);
+#else
+    return fseeko(fh, (off_t)offset, whence);
+#endif
+}
+
+platform_off_t platform_ftell(platform_file_handle fh) {
+#ifdef _WIN32
+    return _ftelli64(fh);
+#else
+    return (platform_off_t)ftello(fh);
+#endif
 }
 
-long platform_ftell(platform_file_handle fh) {
-    return ftell(fh);
+int platform_file_size(platform_file_handle fh, platform_off_t *size) {
+    if (!fh || !size) {
+        platform_set_error("Invalid arguments to platform_file_size");
+        return -1;
+    }
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_fstat64(_fileno(fh), &st) != 0) {
+#else
+    struct stat st;
+    if (fstat(fileno(fh), &st) != 0) {
+#endif
+        platform_set_error("Failed to stat open file (errno=%d)", errno);
+        return -1;
+    }
+    *size = (platform_off_t)st.st_size;
+    return 0;
+}
+
+void platform_hint_sequential(platform_file_handle fh) {
+#if defined(PLATFORM_LINUX) && defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(fh), 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)fh;
+#endif
+}
+
+int platform_advise_file(const char *path, size_t len, platform_advice advice) {
+#if defined(POSIX_FADV_WILLNEED) && defined(POSIX_FADV_DONTNEED)
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1) {
+        platform_set_error("Failed to open file: %s (errno=%d)", path, errno);
+        return -1;
+    }
+    // Advice is only a hint, so its own failures are ignored
+    posix_fadvise(fd, 0, (off_t)len, advice == PLATFORM_ADVISE_WILLNEED ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED);
+    close(fd);
+    return 0;
+#else
+    (void)path;
+    (void)len;
+    (void)advice;
+    return 0;
+#endif
+}
+
+#ifdef PLATFORM_LINUX
+// Whether the first 'len' bytes of open file 'fd' are all in the page cache
+static int platform_fd_resident(int fd, size_t len) {
+    if (len == 0) {
+        return 1;
+    }
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return 1; // Cannot tell, so leave it to the read times
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t pages = (len + page - 1) / page;
+    unsigned char vec[256];
+    int resident = 1;
+    for (size_t first = 0; resident && first < pages; first += sizeof(vec)) {
+        size_t n = pages - first < sizeof(vec) ? pages - first : sizeof(vec);
+        if (mincore((unsigned char*)map + first * page, n * page, vec) != 0) {
+            break;
+        }
+        for (size_t k = 0; k < n; k++) {
+            if (!(vec[k] & 1)) {
+                resident = 0;
+                break;
+            }
+        }
+    }
+    munmap(map, len);
+    return resident;
+}
+#endif
+
+int platform_prefetch_file(const char *path, size_t len) {
+#ifdef PLATFORM_LINUX
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1) {
+        platform_set_error("Failed to open file: %s (errno=%d)", path, errno);
+        return -1;
+    }
+    struct stat st;
+    size_t probe = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        probe = len == 0 || (unsigned long long)st.st_size < len ? (size_t)st.st_size : len;
+    }
+    int cold = !platform_fd_resident(fd, probe);
+    if (cold) {
+        posix_fadvise(fd, 0, (off_t)len, POSIX_FADV_WILLNEED);
+    }
+    close(fd);
+    return cold;
+#else
+    return platform_advise_file(path, len, PLATFORM_ADVISE_WILLNEED);
+#endif
+}
+
+// Above this size MAP_POPULATE is skipped, since prefaulting the whole
+// mapping up front would stall until the entire file has been read.
+#define PLATFORM_INPUT_POPULATE_LIMIT (64 * 1024 * 1024)
+
+struct platform_input {
+    platform_input_strategy strategy;   // Requested backend
+    platform_input_strategy active;     // Backend used for the open file
+    unsigned char *buffer;
+    size_t buffer_size;
+    size_t size;
+    int open;
+    platform_file_handle fh;            // stdio backend
+#ifndef _WIN32
+    int fd;                             // read and mmap backends
+    unsigned char *map;
+    size_t map_pos;                     // Start of the next mmap block
+#endif
+};
+
+platform_input* platform_input_create(platform_input_strategy strategy, size_t block_size) {
+    platform_input *in = (platform_input*)alloc_malloc(sizeof(platform_input));
+    if (!in) {
+        platform_set_error("Out of memory");
+        return NULL;
+    }
+    memset(in, 0, sizeof(*in));
+    in->strategy = strategy;
+    in->buffer_size = block_size ? block_size : PLATFORM_INPUT_BLOCK_SIZE;
+    in->buffer = (unsigned char*)alloc_aligned(in->buffer_size, BUFFER_POOL_ALIGNMENT);
+    if (!in->buffer) {
+        platform_set_error("Out of memory");
+        alloc_free(in);
+        return NULL;
+    }
+#ifndef _WIN32
+    in->fd = -1;
+#endif
+    return in;
+}
+
+static int platform_input_open_stdio(platform_input *in, const char *path) {
+    in->fh = platform_fopen(path, "rb");
+    if (!in->fh) {
+        return -1; // error set
+    }
+    platform_off_t size = 0;
+    if (platform_file_size(in->fh, &size) != 0
+        || platform_size_from_off((unsigned long long)size, &in->size, path) != 0) {
+        platform_fclose(in->fh);
+        in->fh = NULL;
+        return -1;
+    }
+    platform_hint_sequential(in->fh);
+    in->active = PLATFORM_INPUT_STDIO;
+    return 0;
+}
+
+int platform_input_open(platform_input *in, const char *path) {
+    if (!in || !path) {
+        platform_set_error("Invalid arguments to platform_input_open");
+        return -1;
+    }
+    platform_input_close(in);
+
+#ifdef _WIN32
+    if (platform_input_open_stdio(in, path) != 0) {
+        return -1;
+    }
+#else
+    if (in->strategy == PLATFORM_INPUT_STDIO) {
+        if (platform_input_open_stdio(in, path) != 0) {
+            return -1;
+        }
+        in->open = 1;
+        return 0;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        platform_set_error("Failed to open file: %s (errno=%d)", path, errno);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        platform_set_error("Failed to stat file: %s (errno=%d)", path, errno);
+        close(fd);
+        return -1;
+    }
+    if (platform_size_from_off((unsigned long long)st.st_size, &in->size, path) != 0) {
+        close(fd);
+        return -1;
+    }
+    in->fd = fd;
+
+    platform_input_strategy strategy = in->strategy;
+    if (strategy == PLATFORM_INPUT_AUTO) {
+        strategy = in->size >= PLATFORM_INPUT_MMAP_THRESHOLD ? PLATFORM_INPUT_MMAP : PLATFORM_INPUT_READ;
+    }
+
+    if (strategy == PLATFORM_INPUT_MMAP && in->size > 0) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (in->size <= PLATFORM_INPUT_POPULATE_LIMIT) {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        void *map = mmap(NULL, in->size, PROT_READ, flags, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, in->size, MADV_SEQUENTIAL);
+            in->map = (unsigned char*)map;
+            in->map_pos = 0;
+            in->active = PLATFORM_INPUT_MMAP;
+            in->open = 1;
+            return 0;
+        }
+        // Not mappable (e.g. a pipe or special file), read it instead
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    in->active = PLATFORM_INPUT_READ;
+#endif
+
+    in->open = 1;
+    return 0;
+}
+
+int platform_input_next(platform_input *in, const unsigned char **data, size_t *len) {
+    if (!in || !in->open || !data || !len) {
+        platform_set_error("Invalid arguments to platform_input_next");
+        return -1;
+    }
+
+    *data = in->buffer;
+    *len = 0;
+
+    switch (in->active) {
+#ifndef _WIN32
+    case PLATFORM_INPUT_MMAP:
+        *data = in->map + in->map_pos;
+        *len = in->size - in->map_pos;
+        in->map_pos = in->size;
+        return 0;
+
+    case PLATFORM_INPUT_READ:
+        for (;;) {
+            ssize_t n = read(in->fd, in->buffer, in->buffer_size);
+            if (n >= 0) {
+                *len = (size_t)n;
+                return 0;
+            }
+            if (errno != EINTR) {
+                platform_set_error("Failed to read file (errno=%d)", errno);
+                return -1;
+            }
+        }
+#endif
+
+    default:
+        *len = platform_fread(in->buffer, 1, in->buffer_size, in->fh);
+        if (*len < in->buffer_size && ferror(in->fh)) {
+            platform_set_error("Failed to read file");
+            return -1;
+        }
+        return 0;
+    }
+}
+
+int platform_input_seek(platform_input *in, size_t offset) {
+    if (!in || !in->open) {
+        platform_set_error("Invalid arguments to platform_input_seek");
+        return -1;
+    }
+    switch (in->active) {
+#ifndef _WIN32
+    case PLATFORM_INPUT_MMAP:
+        in->map_pos = offset < in->size ? offset : in->size;
+        return 0;
+
+    case PLATFORM_INPUT_READ:
+        if (lseek(in->fd, (off_t)offset, SEEK_SET) == (off_t)-1) {
+            platform_set_error("Failed to seek in file (errno=%d)", errno);
+            return -1;
+        }
+        return 0;
+#endif
+
+    default:
+        if (platform_fseek(in->fh, (platform_off_t)offset, SEEK_SET) != 0) {
+            platform_set_error("Failed to seek in file");
+            return -1;
+        }
+        return 0;
+    }
+}
+
+size_t platform_input_size(const platform_input *in) {
+    return in->size;
+}
+
+platform_input_strategy platform_input_active(const platform_input *in) {
+    return in->active;
+}
+
+void platform_input_close(platform_input *in) {
+    if (!in || !in->open) {
+        return;
+    }
+    if (in->fh) {
+        platform_fclose(in->fh);
+        in->fh = NULL;
+    }
+#ifndef _WIN32
+    if (in->map) {
+        munmap(in->map, in->size);
+        in->map = NULL;
+    }
+    if (in->fd != -1) {
+        close(in->fd);
+        in->fd = -1;
+    }
+#endif
+    in->size = 0;
+    in->open = 0;
+}
+
+void platform_input_destroy(platform_input *in) {
+    if (!in) {
+        return;
+    }
+    platform_input_close(in);
+    alloc_free_aligned(in->buffer);
+    alloc_free(in);
+}
+
+struct platform_output {
+    unsigned long long size;
+    unsigned char *map;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+platform_output* platform_output_create(const char *path, unsigned long long size) {
+    if (!path) {
+        platform_set_error("Invalid arguments to platform_output_create");
+        return NULL;
+    }
+    platform_output *out = (platform_output*)alloc_calloc(1, sizeof(platform_output));
+    if (!out) {
+        platform_set_error("Out of memory");
+        return NULL;
+    }
+    out->size = size;
+
+#ifdef _WIN32
+    WCHAR local[MAX_PATH];
+    WCHAR *wpath = NULL;
+    if (platform_convert_path_to_wchar(path, local, MAX_PATH, &wpath) != 0) {
+        alloc_free(out);
+        return NULL; // error set
+    }
+    out->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    platform_free_wpath(wpath, local);
+    if (out->file == INVALID_HANDLE_VALUE) {
+        platform_set_error("Failed to create output file: %s", path);
+        alloc_free(out);
+        return NULL;
+    }
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(out->file, end, NULL, FILE_BEGIN) || !SetEndOfFile(out->file)) {
+        platform_set_error("Failed to allocate output file: %s", path);
+        CloseHandle(out->file);
+        alloc_free(out);
+        return NULL;
+    }
+    // Creating the mapping commits the space, so a full disk shows up here
+    if (size > 0 && size <= (SIZE_T)-1) {
+        out->mapping = CreateFileMappingW(out->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+        if (out->mapping) {
+            out->map = (unsigned char*)MapViewOfFile(out->mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)size);
+            if (!out->map) {
+                CloseHandle(out->mapping);
+                out->mapping = NULL;
+            }
+        }
+    }
+#else
+    out->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out->fd == -1) {
+        platform_set_error("Failed to create output file: %s (errno=%d)", path, errno);
+        alloc_free(out);
+        return NULL;
+    }
+    if (size == 0) {
+        return out;
+    }
+    // Only map space that is really reserved: a store into a sparse mapping
+    // on a full disk would kill the process with SIGBUS instead of failing
+    int reserved = 0;
+#ifdef PLATFORM_LINUX
+    reserved = fallocate(out->fd, 0, 0, (off_t)size) == 0;
+#endif
+    if (!reserved && ftruncate(out->fd, (off_t)size) != 0) {
+        platform_set_error("Failed to allocate output file: %s (errno=%d)", path, errno);
+        close(out->fd);
+        alloc_free(out);
+        return NULL;
+    }
+    if (reserved && size <= (size_t)-1) {
+        void *map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd, 0);
+        if (map != MAP_FAILED) {
+            out->map = (unsigned char*)map;
+        }
+    }
+#endif
+    return out;
+}
+
+unsigned char* platform_output_map(platform_output *out) {
+    return out->map;
+}
+
+int platform_output_write_at(platform_output *out, const void *data, size_t len, unsigned long long offset) {
+    const unsigned char *p = (const unsigned char*)data;
+    while (len > 0) {
+#ifdef _WIN32
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD chunk = len > 0x40000000 ? 0x40000000 : (DWORD)len;
+        DWORD n = 0;
+        if (!WriteFile(out->file, p, chunk, &n, &ov)) {
+            platform_set_error("Failed to write output file");
+            return -1;
+        }
+#else
+        ssize_t n = pwrite(out->fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            platform_set_error("Failed to write output file (errno=%d)", errno);
+            return -1;
+        }
+#endif
+        p += n;
+        len -= (size_t)n;
+        offset += (unsigned long long)n;
+    }
+    return 0;
+}
+
+int platform_output_close(platform_output *out) {
+    if (!out) {
+        return 0;
+    }
+    int result = 0;
+#ifdef _WIN32
+    if (out->map) {
+        UnmapViewOfFile(out->map);
+        CloseHandle(out->mapping);
+    }
+    if (!CloseHandle(out->file)) {
+        platform_set_error("Failed to close output file");
+        result = -1;
+    }
+#else
+    if (out->map) {
+        munmap(out->map, (size_t)out->size);
+    }
+    if (close(out->fd) != 0) {
+        platform_set_error("Failed to close output file (errno=%d)", errno);
+        result = -1;
+    }
+#endif
+    alloc_free(out);
+    return result;
+}
+
+const char* platform_input_strategy_name(platform_input_strategy strategy) {
+    switch (strategy) {
+    case PLATFORM_INPUT_AUTO:  return "auto";
+    case PLATFORM_INPUT_STDIO: return "stdio";
+    case PLATFORM_INPUT_READ:  return "read";
+    case PLATFORM_INPUT_MMAP:  return "mmap";
+    default:                   return "unknown";
+    }
+}
+
+// Threads are started through a small heap block so that one signature
+// works for both CreateThread and pthread_create.
+typedef struct {
+    platform_thread_fn fn;
+    void *arg;
+} platform_thread_start;
+
+#ifdef _WIN32
+static DWORD WINAPI platform_thread_main(LPVOID param) {
+#else
+static void* platform_thread_main(void *param) {
+#endif
+    platform_thread_start start = *(platform_thread_start*)param;
+    alloc_free(param);
+    start.fn(start.arg);
+#ifdef _WIN32
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int platform_thread_create(platform_thread_t *thread, platform_thread_fn fn, void *arg) {
+    platform_thread_start *start = (platform_thread_start*)alloc_malloc(sizeof(platform_thread_start));
+    if (!start) {
+        platform_set_error("Out of memory");
+        return -1;
+    }
+    start->fn = fn;
+    start->arg = arg;
+
+#ifdef _WIN32
+    HANDLE h = CreateThread(NULL, 0, platform_thread_main, start, 0, NULL);
+    if (!h) {
+        platform_set_error("Failed to create thread");
+        alloc_free(start);
+        return -1;
+    }
+    *thread = h;
+#else
+    int err = pthread_create(thread, NULL, platform_thread_main, start);
+    if (err != 0) {
+        platform_set_error("Failed to create thread (errno=%d)", err);
+        alloc_free(start);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+int platform_thread_join(platform_thread_t thread) {
+#ifdef _WIN32
+    if (WaitForSingleObject((HANDLE)thread, INFINITE) != WAIT_OBJECT_0) {
+        platform_set_error("Failed to join thread");
+        return -1;
+    }
+    CloseHandle((HANDLE)thread);
+    return 0;
+#else
+    int err = pthread_join(thread, NULL);
+    if (err != 0) {
+        platform_set_error("Failed to join thread (errno=%d)", err);
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+#ifdef _WIN32
+void platform_mutex_init(platform_mutex_t *mutex) { InitializeSRWLock((PSRWLOCK)mutex); }
+void platform_mutex_destroy(platform_mutex_t *mutex) { (void)mutex; }
+void platform_mutex_lock(platform_mutex_t *mutex) { AcquireSRWLockExclusive((PSRWLOCK)mutex); }
+void platform_mutex_unlock(platform_mutex_t *mutex) { ReleaseSRWLockExclusive((PSRWLOCK)mutex); }
+
+void platform_cond_init(platform_cond_t *cond) { InitializeConditionVariable((PCONDITION_VARIABLE)cond); }
+void platform_cond_destroy(platform_cond_t *cond) { (void)cond; }
+void platform_cond_wait(platform_cond_t *cond, platform_mutex_t *mutex) {
+    SleepConditionVariableSRW((PCONDITION_VARIABLE)cond, (PSRWLOCK)mutex, INFINITE, 0);
+}
+void platform_cond_signal(platform_cond_t *cond) { WakeConditionVariable((PCONDITION_VARIABLE)cond); }
+void platform_cond_broadcast(platform_cond_t *cond) { WakeAllConditionVariable((PCONDITION_VARIABLE)cond); }
+#else
+void platform_mutex_init(platform_mutex_t *mutex) { pthread_mutex_init(mutex, NULL); }
+void platform_mutex_destroy(platform_mutex_t *mutex) { pthread_mutex_destroy(mutex); }
+void platform_mutex_lock(platform_mutex_t *mutex) { pthread_mutex_lock(mutex); }
+void platform_mutex_unlock(platform_mutex_t *mutex) { pthread_mutex_unlock(mutex); }
+
+void platform_cond_init(platform_cond_t *cond) { pthread_cond_init(cond, NULL); }
+void platform_cond_destroy(platform_cond_t *cond) { pthread_cond_destroy(cond); }
+void platform_cond_wait(platform_cond_t *cond, platform_mutex_t *mutex) { pthread_cond_wait(cond, mutex); }
+void platform_cond_signal(platform_cond_t *cond) { pthread_cond_signal(cond); }
+void platform_cond_broadcast(platform_cond_t *cond) { pthread_cond_broadcast(cond); }
+#endif
+
+unsigned platform_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (unsigned)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+#endif
+}
+
+unsigned long long platform_time_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000000ULL
+         + (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000000ULL / (unsigned long long)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+#endif
 }
 
 void platform_normalize_path(char *path, size_t path_len) {
@@ -6,8 +6,13 @@ extern "C" {
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #define MAX_FILENAME_LENGTH 256
 #define MAX_PATH_LENGTH 1024
 
@@ -33,11 +38,116 @@ size_t platform_fread(void *ptr, size_t size, size_t nmemb, platform_file_handle
 // Write to file
 size_t platform_fwrite(const void *ptr, size_t size, size_t nmemb, platform_file_handle fh);
 
+// File offsets and sizes, 64 bits wide on every target, including those
+// where long is 32 bits.
+typedef int64_t platform_off_t;
+
 // Seek in file
-int platform_fseek(platform_file_handle fh, long offset, int whence);
+int platform_fseek(platform_file_handle fh, platform_off_t offset, int whence);
+
+// Tell file position, or -1 on error
+platform_off_t platform_ftell(platform_file_handle fh);
+
+// Size of an open file, from fstat rather than seeking to the end.
+// Returns 0 on success, nonzero on error.
+int platform_file_size(platform_file_handle fh, platform_off_t *size);
+
+// Hint that the file will be read sequentially from start to end, so the OS
+// can read ahead aggressively. A no-op where no such hint exists.
+void platform_hint_sequential(platform_file_handle fh);
+
+// Page cache advice for a file that is not open
+typedef enum {
+    PLATFORM_ADVISE_WILLNEED,   // Start reading the first 'len' bytes in the background
+    PLATFORM_ADVISE_DONTNEED,   // Drop the file's clean cached pages
+} platform_advice;
+
+// Open 'path' just long enough to pass on 'advice' for its first 'len'
+// bytes (0 = the whole file). A no-op where no such advice exists.
+// Returns 0 on success, nonzero if the file could not be opened.
+int platform_advise_file(const char *path, size_t len, platform_advice advice);
+
+// Same as platform_advise_file with PLATFORM_ADVISE_WILLNEED, but only
+// advises if some of the first 'len' bytes are not in the page cache yet
+// (checked with mincore on Linux; elsewhere the file is always advised and
+// taken as cached). Returns 1 if the advice is what brings the file in, 0 if
+// it was already cached, -1 if the file could not be opened.
+int platform_prefetch_file(const char *path, size_t len);
+
+// Backends for reading input files block by block.
+typedef enum {
+    PLATFORM_INPUT_AUTO = 0,    // Pick per file by size: mmap for large files, read() otherwise
+    PLATFORM_INPUT_STDIO,       // fopen/fread
+    PLATFORM_INPUT_READ,        // open/read into a reused buffer
+    PLATFORM_INPUT_MMAP,        // mmap the whole file
+} platform_input_strategy;
+
+// With PLATFORM_INPUT_AUTO, files at least this large are memory mapped.
+#define PLATFORM_INPUT_MMAP_THRESHOLD (1024 * 1024)
+
+// Default size of the buffer used by the stdio and read() backends.
+#define PLATFORM_INPUT_BLOCK_SIZE (256 * 1024)
+
+// Opaque reader that can be opened on one file after another.
+// Its buffer is allocated once and reused for every file.
+typedef struct platform_input platform_input;
+
+// Create a reader using 'strategy' and a buffer of 'block_size' bytes
+// (0 selects PLATFORM_INPUT_BLOCK_SIZE). Returns NULL on failure.
+platform_input* platform_input_create(platform_input_strategy strategy, size_t block_size);
+
+// Open 'path' for reading. Returns 0 on success, nonzero on error.
+// Backends not available on this platform fall back to stdio.
+int platform_input_open(platform_input *in, const char *path);
+
+// Get the next block of the open file. On success sets *data and *len and
+// returns 0; *len is 0 at end of file. The block stays valid until the next
+// call. Returns nonzero on a read error.
+int platform_input_next(platform_input *in, const unsigned char **data, size_t *len);
+
+// Continue reading the open file at byte 'offset': the next block starts
+// there. Returns 0 on success, nonzero on error.
+int platform_input_seek(platform_input *in, size_t offset);
+
+// Size of the open file in bytes.
+size_t platform_input_size(const platform_input *in);
+
+// Backend actually used for the open file (never PLATFORM_INPUT_AUTO).
+platform_input_strategy platform_input_active(const platform_input *in);
+
+// Close the open file. The reader can then be opened again.
+void platform_input_close(platform_input *in);
+
+// Close any open file and free the reader.
+void platform_input_destroy(platform_input *in);
+
+// Name of a strategy as accepted on the command line ("auto", "stdio", ...).
+const char* platform_input_strategy_name(platform_input_strategy strategy);
+
+// Output file whose final size is known before anything is written, so
+// that any number of threads can write their parts at fixed offsets.
+typedef struct platform_output platform_output;
+
+// Create (or truncate) 'path' and allocate 'size' bytes for it up front.
+// Where the space can really be reserved (fallocate on Linux, a file mapping
+// on Windows) the file is also memory mapped; see platform_output_map.
+// Returns NULL on failure.
+platform_output* platform_output_create(const char *path, unsigned long long size);
 
-// Tell file position
-long platform_ftell(platform_file_handle fh);
+// The whole file mapped writable, or NULL if it is not mapped. Without a
+// mapping, use platform_output_write_at.
+unsigned char* platform_output_map(platform_output *out);
+
+// Write 'len' bytes at 'offset' (pwrite). Safe to call from several threads
+// for parts that do not overlap. Returns 0 on success, nonzero on error.
+int platform_output_write_at(platform_output *out, const void *data, size_t len, unsigned long long offset);
+
+// Unmap and close the file. Returns 0 on success, nonzero on error.
+int platform_output_close(platform_output *out);
+
+// Size reported by platform_readdir for files whose directory entry does not
+// carry it. Look it up with platform_stat_size when it is needed.
+#define PLATFORM_SIZE_UNKNOWN ((size_t)-1)
 
 // Opaque handle for directory iteration
 typedef struct platform_dir_handle platform_dir_handle;
@@ -46,20 +156,38 @@ typedef struct platform_dir_handle platform_dir_handle;
 // Returns NULL on failure.
 platform_dir_handle* platform_opendir(const char *path);
 
+// Open the subdirectory 'name' of 'parent' relative to the parent's handle
+// (openat), so the kernel does not resolve the full path again. 'parent'
+// stays usable, also after all its entries have been read.
+// Returns NULL on failure.
+platform_dir_handle* platform_opendir_at(platform_dir_handle *parent, const char *name);
+
 // Read the next entry in the directory.
 // On sucess fills `info` with details of the entry and returns 0.
 // On error or no more entires, returns nonzero.
 // The caller may copy data from info->name before calling again
 // since subsuqeuent calls may overwrite the buffer 
+// On Linux entries are read in large getdents64 batches and their type is
+// taken from the listing, so info->size of a regular file is
+// PLATFORM_SIZE_UNKNOWN. Entries of unknown type are stat'ed.
 int platform_readdir(platform_dir_handle *dh, platform_file_info *info);
 
 // Close the directory handle.
 int platform_closedir(platform_dir_handle *dh);
 
+// Number of entries 'dh' has had to stat so far because the listing did not
+// say whether they are directories.
+size_t platform_dir_stat_calls(const platform_dir_handle *dh);
+
 // Get information about a specific file.
 // Returns 0 on success, nonzero on error.
 int platform_stat_file(const char *path, platform_file_info *info);
 
+// Get the size of a file. On Linux this is a statx call asking for the size
+// only, without forcing a sync with the server on network filesystems.
+// Returns 0 on success, nonzero on error.
+int platform_stat_size(const char *path, size_t *size);
+
 // The caller uses fread/fclose from standard C library to read and close files.
 // This is acceptable since C standard I/O is portable enough.
 
@@ -69,10 +197,47 @@ int platform_stat_file(const char *path, platform_file_info *info);
 void platform_normalize_path(char *path, size_t path_len);
 
 // Get the last error message.
-// Returns a pointer to a static buffer containing the last error message set by
-// playform functions.
+// Returns a pointer to a thread-local buffer containing the last error message
+// set by platform functions on the calling thread.
 const char* platform_get_last_error(void);
 
+// Threads and synchronization. On Windows these wrap native threads, SRW
+// locks and condition variables; elsewhere they wrap pthreads.
+#ifdef _WIN32
+typedef void* platform_thread_t;
+typedef struct { void *ptr; } platform_mutex_t;    // Layout of SRWLOCK
+typedef struct { void *ptr; } platform_cond_t;     // Layout of CONDITION_VARIABLE
+#else
+typedef pthread_t platform_thread_t;
+typedef pthread_mutex_t platform_mutex_t;
+typedef pthread_cond_t platform_cond_t;
+#endif
+
+typedef void (*platform_thread_fn)(void *arg);
+
+// Start a thread running fn(arg). Returns 0 on success, nonzero on error.
+int platform_thread_create(platform_thread_t *thread, platform_thread_fn fn, void *arg);
+
+// Wait for a thread to finish. Returns 0 on success, nonzero on error.
+int platform_thread_join(platform_thread_t thread);
+
+void platform_mutex_init(platform_mutex_t *mutex);
+void platform_mutex_destroy(platform_mutex_t *mutex);
+void platform_mutex_lock(platform_mutex_t *mutex);
+void platform_mutex_unlock(platform_mutex_t *mutex);
+
+void platform_cond_init(platform_cond_t *cond);
+void platform_cond_destroy(platform_cond_t *cond);
+void platform_cond_wait(platform_cond_t *cond, platform_mutex_t *mutex);
+void platform_cond_signal(platform_cond_t *cond);
+void platform_cond_broadcast(platform_cond_t *cond);
+
+// Number of online CPU cores (at least 1).
+unsigned platform_cpu_count(void);
+
+// Monotonic clock in nanoseconds, for measuring intervals.
+unsigned long long platform_time_ns(void);
+
 // Path separator character
 #ifdef _WIN32
 #define PLATFORM_PATH_SEP '\\'
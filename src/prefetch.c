@@ -0,0 +1,184 @@
+#include "prefetch.h"
+#include "platform.h"
+#include "alloc.h"
+#include <string.h>
+
+// Finished files waiting to be dropped from the page cache
+#define PREFETCH_DROP_QUEUE 256
+
+// Entries remembered as brought in by the prefetcher, by index modulo this.
+// Well past the deepest prefetch, so the reader finishes an entry long
+// before its place is taken by a later one.
+#define PREFETCH_COLD_WINDOW 1024
+
+struct prefetcher {
+    file_feed_t *feed;
+    platform_thread_t thread;
+    platform_mutex_t lock;
+    platform_cond_t wake;       // Signalled when there is new work or on stop
+    size_t cursor;              // First entry the reader has not started on
+    unsigned depth;
+    unsigned fast_reads;        // Fast reads since the last slow one or decay
+    int feed_done;
+    int stop;
+
+    const char *drops[PREFETCH_DROP_QUEUE];
+    size_t drop_head;
+    size_t drop_count;
+
+    size_t cold[PREFETCH_COLD_WINDOW]; // Index + 1 of entries advised while not cached, 0 = none
+
+    prefetch_stats_t stats;
+};
+
+static void prefetcher_main(void *arg) {
+    prefetcher_t *pf = (prefetcher_t*)arg;
+    size_t next = 0;
+
+    platform_mutex_lock(&pf->lock);
+    for (;;) {
+        // Drops go first, and are all done before the thread stops
+        if (pf->drop_count > 0) {
+            const char *path = pf->drops[pf->drop_head];
+            pf->drop_head = (pf->drop_head + 1) % PREFETCH_DROP_QUEUE;
+            pf->drop_count--;
+            platform_mutex_unlock(&pf->lock);
+            platform_advise_file(path, 0, PLATFORM_ADVISE_DONTNEED);
+            platform_mutex_lock(&pf->lock);
+            continue;
+        }
+        if (pf->stop) {
+            break;
+        }
+
+        // Entries the reader has already reached are not worth advising
+        if (next < pf->cursor) {
+            next = pf->cursor;
+        }
+        if (!pf->feed_done && next < pf->cursor + pf->depth) {
+            platform_mutex_unlock(&pf->lock);
+            // May wait for the scan to append the entry
+            file_info_t entry;
+            int found = file_feed_get(pf->feed, next, &entry) == 0;
+            int cold = 0;
+            if (found) {
+                size_t len = entry.size < PREFETCH_HEAD_BYTES ? entry.size : PREFETCH_HEAD_BYTES;
+                cold = platform_prefetch_file(entry.path, len) > 0;
+            }
+            platform_mutex_lock(&pf->lock);
+            if (found) {
+                pf->stats.advised++;
+                if (cold) {
+                    pf->cold[next % PREFETCH_COLD_WINDOW] = next + 1;
+                }
+                next++;
+            } else {
+                pf->feed_done = 1;
+            }
+            continue;
+        }
+        platform_cond_wait(&pf->wake, &pf->lock);
+    }
+    platform_mutex_unlock(&pf->lock);
+}
+
+prefetcher_t* prefetcher_create(file_feed_t *feed) {
+    prefetcher_t *pf = (prefetcher_t*)alloc_calloc(1, sizeof(prefetcher_t));
+    if (!pf) {
+        return NULL;
+    }
+    pf->feed = feed;
+    platform_mutex_init(&pf->lock);
+    platform_cond_init(&pf->wake);
+    if (platform_thread_create(&pf->thread, prefetcher_main, pf) != 0) {
+        platform_cond_destroy(&pf->wake);
+        platform_mutex_destroy(&pf->lock);
+        alloc_free(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+void prefetcher_advance(prefetcher_t *pf, size_t index) {
+    platform_mutex_lock(&pf->lock);
+    if (index + 1 > pf->cursor) {
+        pf->cursor = index + 1;
+        if (pf->depth > 0) {
+            platform_cond_signal(&pf->wake);
+        }
+    }
+    platform_mutex_unlock(&pf->lock);
+}
+
+void prefetcher_done(prefetcher_t *pf, size_t index, const char *path, size_t bytes, unsigned long long ns) {
+    int drop_here = 0;
+    int wake = 0;
+    platform_mutex_lock(&pf->lock);
+    int slow = ns > PREFETCH_SLOW_NS + (unsigned long long)bytes;
+    int cold = pf->cold[index % PREFETCH_COLD_WINDOW] == index + 1;
+    if (cold) {
+        pf->cold[index % PREFETCH_COLD_WINDOW] = 0;
+    }
+    if (slow) {
+        wake = 1;
+        pf->stats.slow_reads++;
+        pf->fast_reads = 0;
+        pf->depth = pf->depth == 0 ? 1 : pf->depth * 2 > PREFETCH_MAX_DEPTH ? PREFETCH_MAX_DEPTH : pf->depth * 2;
+        if (pf->depth > pf->stats.max_depth) {
+            pf->stats.max_depth = pf->depth;
+        }
+    } else if (ns > 0 && ++pf->fast_reads >= PREFETCH_DECAY_READS) {
+        pf->fast_reads = 0;
+        pf->depth /= 2;
+    }
+
+    // Only files this run brought in are dropped again, and only those worth
+    // opening once more for it: files the prefetcher found uncached, which
+    // then read fast because of it, and files whose own read was slow. A
+    // fast read of a file the prefetcher did not bring in means it was
+    // cached before, so it stays.
+    if ((slow || cold) && bytes >= PREFETCH_DROP_MIN_BYTES) {
+        pf->stats.dropped++;
+        if (pf->drop_count < PREFETCH_DROP_QUEUE) {
+            pf->drops[(pf->drop_head + pf->drop_count) % PREFETCH_DROP_QUEUE] = path;
+            pf->drop_count++;
+            wake = 1;
+        } else {
+            drop_here = 1; // The thread is behind, do this one here
+        }
+    }
+    // Waking the thread for nothing costs a context switch per file
+    if (wake) {
+        platform_cond_signal(&pf->wake);
+    }
+    platform_mutex_unlock(&pf->lock);
+
+    if (drop_here) {
+        platform_advise_file(path, 0, PLATFORM_ADVISE_DONTNEED);
+    }
+}
+
+unsigned prefetcher_depth(prefetcher_t *pf) {
+    platform_mutex_lock(&pf->lock);
+    unsigned depth = pf->depth;
+    platform_mutex_unlock(&pf->lock);
+    return depth;
+}
+
+void prefetcher_destroy(prefetcher_t *pf, prefetch_stats_t *stats) {
+    if (!pf) {
+        return;
+    }
+    platform_mutex_lock(&pf->lock);
+    pf->stop = 1;
+    platform_cond_signal(&pf->wake);
+    platform_mutex_unlock(&pf->lock);
+    platform_thread_join(pf->thread);
+
+    if (stats) {
+        *stats = pf->stats;
+    }
+    platform_cond_destroy(&pf->wake);
+    platform_mutex_destroy(&pf->lock);
+    alloc_free(pf);
+}
@@ -0,0 +1,66 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stddef.h>
+#include "file_list.h"
+
+// Most files the prefetcher asks for ahead of the reader
+#define PREFETCH_MAX_DEPTH 64
+
+// Bytes at the head of each file asked for in advance. Once a file is being
+// read sequentially the kernel's own readahead takes over.
+#define PREFETCH_HEAD_BYTES (2 * 1024 * 1024)
+
+// A read counts as slow (a page cache miss) when it takes longer than this
+// plus one nanosecond per byte, well above what a cached read costs.
+#define PREFETCH_SLOW_NS 50000
+
+// Smaller files are not dropped from the page cache, since that means
+// opening them again for little memory
+#define PREFETCH_DROP_MIN_BYTES (256 * 1024)
+
+// Fast reads in a row after which the depth is halved
+#define PREFETCH_DECAY_READS 16
+
+// Counters for one run
+typedef struct {
+    size_t advised;         // Files asked for ahead of the reader
+    size_t dropped;         // Files dropped from the page cache after use
+    size_t slow_reads;      // Reads that missed the page cache
+    unsigned max_depth;     // Deepest the prefetcher went
+} prefetch_stats_t;
+
+// Walks ahead of a reader through a file feed on its own thread, asking the
+// OS to start reading the next files (POSIX_FADV_WILLNEED) while the current
+// one is read and encoded.
+//
+// The depth follows the read times the reader reports. A slow read doubles
+// it, and a run of fast reads halves it, down to zero, so a warm page cache
+// costs nothing. A file whose own read missed the page cache is dropped from
+// it once finished (POSIX_FADV_DONTNEED), so a large run does not push the
+// rest of the build's working set out. So is a file the prefetcher found
+// uncached before advising it, however fast its read then was. Other files
+// read fast, which were already cached, and small files are left there.
+// Residency is checked before advising, so cached files are not advised.
+typedef struct prefetcher prefetcher_t;
+
+// Start prefetching entries of 'feed'. Returns NULL on failure.
+prefetcher_t* prefetcher_create(file_feed_t *feed);
+
+// The reader is about to read entry 'index'; prefetch the entries after it.
+void prefetcher_advance(prefetcher_t *pf, size_t index);
+
+// The reader is finished with entry 'index' at 'path', which must stay valid
+// until the prefetcher is destroyed. 'ns' is the time it took to read 'bytes'
+// of it, or 0 if the read was not timed on its own.
+void prefetcher_done(prefetcher_t *pf, size_t index, const char *path, size_t bytes, unsigned long long ns);
+
+// Current depth in files, 0 while reads are served from the page cache
+unsigned prefetcher_depth(prefetcher_t *pf);
+
+// Finish pending drops, stop the thread and free the prefetcher. Waits for
+// an entry the thread is waiting on to be appended, or for the feed to
+// finish. NULL is ignored. Counters are stored in 'stats' if it is not NULL.
+void prefetcher_destroy(prefetcher_t *pf, prefetch_stats_t *stats);
+
+#endif // PREFETCH_H
@@ -1,43 +1,655 @@
 #include "scan.h"
 #include "platform.h"
+#include "alloc.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-static int scan_single_dir(const char *dir, const config_t *config, file_list_t *list) {
-    platform_dir_handle *dh = platform_opendir(dir);
+// Where found files go: a plain list, or a feed read by another thread
+typedef struct {
+    file_list_t *list;
+    file_feed_t *feed;
+} scan_sink_t;
+
+static int scan_emit(const scan_sink_t *sink, const file_info_t *fi) {
+    if (sink->feed) {
+        return file_feed_append(sink->feed, fi);
+    }
+    return file_list_append(sink->list, fi);
+}
+
+// One directory of the traversal. Its entries are filled in by whichever
+// thread scans it, and read by the emitting thread once 'done' is set.
+// Directories are opened relative to their parent's handle, and full paths
+// are only put together by the emitting thread, for the files it outputs.
+typedef struct scan_node scan_node_t;
+
+typedef struct {
+    const char *name;           // Points into the node's name buffer once listed
+    size_t name_offset;
+    size_t size;
+    scan_node_t *child;         // Subdirectory to descend into, NULL for a file
+} scan_entry_t;
+
+struct scan_node {
+    scan_node_t *parent;
+    char *name;                 // Name within the parent; the scanned path for the top node
+    char *path;                 // Full path, built when the node is emitted
+    platform_dir_handle *dh;    // Kept open until every subdirectory has been opened from it
+    size_t unopened;            // Subdirectories not opened from 'dh' yet
+    int listed;                 // All entries have been read
+
+    scan_entry_t *entries;      // Sorted by name once done
+    size_t count;
+    size_t capacity;
+    char *names;                // Entry names, back to back
+    size_t names_len;
+    size_t names_capacity;
+    size_t cursor;              // Next entry to look at while freeing
+
+    size_t stat_calls;          // Entries that had to be stat'ed
+    int error;
+    int done;
+};
+
+// Directories waiting to be scanned by one worker. The owner pushes and pops
+// at the tail, so it goes depth first; idle workers steal the oldest
+// directories from the head, which tend to be the biggest subtrees.
+typedef struct {
+    platform_mutex_t lock;
+    scan_node_t **items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} scan_deque_t;
+
+typedef struct scan_pool scan_pool_t;
+
+typedef struct {
+    scan_pool_t *pool;
+    unsigned id;
+    platform_thread_t thread;
+} scan_worker_t;
+
+struct scan_pool {
+    const config_t *config;
+    unsigned workers;
+    scan_deque_t *deques;
+    scan_worker_t *threads;
+
+    platform_mutex_t lock;
+    platform_cond_t work;       // Idle workers wait for queued directories
+    platform_cond_t finished;   // The emitting thread waits for directories
+    size_t queued;              // Directories in all deques
+    int stop;
+};
+
+// Lock the pool if there is one; without a pool everything runs on one thread
+static void scan_lock(scan_pool_t *pool) {
+    if (pool) {
+        platform_mutex_lock(&pool->lock);
+    }
+}
+
+static void scan_unlock(scan_pool_t *pool) {
+    if (pool) {
+        platform_mutex_unlock(&pool->lock);
+    }
+}
+
+static char* scan_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char*)alloc_malloc(len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+// Join 'dir' and 'name' into '*buf', growing it as needed.
+// Returns the joined path, or NULL when out of memory.
+static char* scan_join(char **buf, size_t *capacity, const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    size_t needed = dir_len + 1 + name_len + 1;
+    if (needed > *capacity) {
+        size_t grown = needed > 2 * *capacity ? needed : 2 * *capacity;
+        char *p = (char*)alloc_realloc(*buf, grown);
+        if (!p) {
+            return NULL;
+        }
+        *buf = p;
+        *capacity = grown;
+    }
+    memcpy(*buf, dir, dir_len);
+    (*buf)[dir_len] = '/';
+    memcpy(*buf + dir_len + 1, name, name_len + 1);
+    return *buf;
+}
+
+static scan_node_t* scan_node_create(scan_node_t *parent, const char *name) {
+    scan_node_t *node = (scan_node_t*)alloc_calloc(1, sizeof(scan_node_t));
+    if (!node) {
+        return NULL;
+    }
+    node->parent = parent;
+    node->name = scan_strdup(name);
+    if (!node->name) {
+        alloc_free(node);
+        return NULL;
+    }
+    return node;
+}
+
+static int scan_node_add(scan_node_t *node, const char *name, size_t size, scan_node_t *child) {
+    size_t len = strlen(name) + 1;
+    if (node->names_len + len > node->names_capacity) {
+        size_t capacity = node->names_capacity ? node->names_capacity * 2 : 1024;
+        while (capacity < node->names_len + len) {
+            capacity *= 2;
+        }
+        char *names = (char*)alloc_realloc(node->names, capacity);
+        if (!names) {
+            return -1;
+        }
+        node->names = names;
+        node->names_capacity = capacity;
+    }
+    if (node->count == node->capacity) {
+        size_t capacity = node->capacity ? node->capacity * 2 : 16;
+        scan_entry_t *entries = (scan_entry_t*)alloc_realloc(node->entries, capacity * sizeof(scan_entry_t));
+        if (!entries) {
+            return -1;
+        }
+        node->entries = entries;
+        node->capacity = capacity;
+    }
+    memcpy(node->names + node->names_len, name, len);
+    scan_entry_t *entry = &node->entries[node->count++];
+    entry->name = NULL;
+    entry->name_offset = node->names_len;
+    entry->size = size;
+    entry->child = child;
+    node->names_len += len;
+    return 0;
+}
+
+// Free 'node' and any subdirectories still attached to it. Walks down
+// through the parent links instead of recursing, so depth does not matter.
+static void scan_node_free(scan_node_t *node) {
+    scan_node_t *stop = node->parent;
+    scan_node_t *cur = node;
+    while (cur != stop) {
+        scan_node_t *child = NULL;
+        while (!child && cur->cursor < cur->count) {
+            child = cur->entries[cur->cursor++].child;
+        }
+        if (child) {
+            cur = child;
+            continue;
+        }
+        scan_node_t *parent = cur->parent;
+        if (cur->dh) {
+            platform_closedir(cur->dh);
+        }
+        alloc_free(cur->entries);
+        alloc_free(cur->names);
+        alloc_free(cur->name);
+        alloc_free(cur->path);
+        alloc_free(cur);
+        cur = parent;
+    }
+}
+
+// One fewer subdirectory of 'node' needs its handle; close it after the last
+static void scan_node_release(scan_pool_t *pool, scan_node_t *node) {
+    platform_dir_handle *dh = NULL;
+    scan_lock(pool);
+    node->unopened--;
+    if (node->listed && node->unopened == 0) {
+        dh = node->dh;
+        node->dh = NULL;
+    }
+    scan_unlock(pool);
+    if (dh) {
+        platform_closedir(dh);
+    }
+}
+
+// Open the directory of 'node', relative to its parent where there is one
+static platform_dir_handle* scan_node_open(scan_pool_t *pool, scan_node_t *node) {
+    if (!node->parent) {
+        return platform_opendir(node->name);
+    }
+    platform_dir_handle *dh = platform_opendir_at(node->parent->dh, node->name);
+    scan_node_release(pool, node->parent);
+    return dh;
+}
+
+static int scan_entry_compare(const void *a, const void *b) {
+    return strcmp(((const scan_entry_t*)a)->name, ((const scan_entry_t*)b)->name);
+}
+
+static int scan_deque_push(scan_deque_t *dq, scan_node_t *node) {
+    int result = 0;
+    platform_mutex_lock(&dq->lock);
+    if (dq->tail == dq->capacity) {
+        if (dq->head > 0) {
+            // Reuse the space freed by steals
+            memmove(dq->items, dq->items + dq->head, (dq->tail - dq->head) * sizeof(scan_node_t*));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        } else {
+            size_t capacity = dq->capacity ? dq->capacity * 2 : 64;
+            scan_node_t **items = (scan_node_t**)alloc_realloc(dq->items, capacity * sizeof(scan_node_t*));
+            if (items) {
+                dq->items = items;
+                dq->capacity = capacity;
+            } else {
+                result = -1;
+            }
+        }
+    }
+    if (result == 0) {
+        dq->items[dq->tail++] = node;
+    }
+    platform_mutex_unlock(&dq->lock);
+    return result;
+}
+
+// Take the newest directory (owner) or the oldest one (thief)
+static scan_node_t* scan_deque_take(scan_deque_t *dq, int steal) {
+    scan_node_t *node = NULL;
+    platform_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) {
+        node = steal ? dq->items[dq->head++] : dq->items[--dq->tail];
+    }
+    if (dq->tail == dq->head) {
+        dq->head = dq->tail = 0;
+    }
+    platform_mutex_unlock(&dq->lock);
+    return node;
+}
+
+static void scan_pool_push(scan_pool_t *pool, unsigned id, scan_node_t *node);
+
+// Read one directory into 'node'. Subdirectories become new nodes, queued on
+// worker 'id' when running in a pool and scanned later otherwise.
+static void scan_node_run(const config_t *config, scan_pool_t *pool, unsigned id, scan_node_t *node) {
+    platform_dir_handle *dh = scan_node_open(pool, node);
     if (!dh) {
         // platform_set_error was likely called by platform_opendir
-        return -1; 
+        node->error = -1;
+        node->listed = 1;
+        return;
     }
+    node->dh = dh;
 
     platform_file_info info;
     while (platform_readdir(dh, &info) == 0) {
-        char fullpath[512];
-        snprintf(fullpath, sizeof(fullpath), "%s/%s", dir, info.name);
-
+        scan_node_t *child = NULL;
         if (info.is_dir) {
-            if (config->recursive) {
-                // Recursively scan subdirectories
-                if (scan_single_dir(fullpath, config, list) != 0) {
-                    // TODO: If an error occurs in a subdirectory, should we continue the operation or fail it?
-                }
+            if (!config->recursive) {
+                continue;
             }
-        } else {
-            // It's a file, add to the list
-            file_info_t fi;
-            strncpy(fi.path, fullpath, sizeof(fi.path)-1);
-            fi.path[sizeof(fi.path)-1] = '\0';
-            fi.size = info.size;
-            fi.is_dir = 0;
+            child = scan_node_create(node, info.name);
+            if (!child) {
+                continue; // Out of memory; leave this subdirectory out
+            }
+        }
+        if (scan_node_add(node, info.name, info.is_dir ? 0 : info.size, child) != 0) {
+            scan_node_free(child);
+            continue;
+        }
+        if (child) {
+            // The child opens itself from our handle, possibly on another thread
+            scan_lock(pool);
+            node->unopened++;
+            scan_unlock(pool);
+            if (pool) {
+                scan_pool_push(pool, id, child);
+            }
+        }
+    }
+    node->stat_calls = platform_dir_stat_calls(dh);
+
+    // The name buffer no longer moves, so entries can point into it
+    for (size_t i = 0; i < node->count; i++) {
+        node->entries[i].name = node->names + node->entries[i].name_offset;
+    }
+    qsort(node->entries, node->count, sizeof(scan_entry_t), scan_entry_compare);
+
+    // Keep the handle only while subdirectories still have to be opened from it
+    scan_lock(pool);
+    node->listed = 1;
+    int close_here = node->unopened == 0;
+    if (close_here) {
+        node->dh = NULL;
+    }
+    scan_unlock(pool);
+    // Otherwise the last child closes it, maybe already
+    if (close_here) {
+        platform_closedir(dh);
+    }
+}
+
+static void scan_pool_push(scan_pool_t *pool, unsigned id, scan_node_t *node) {
+    if (scan_deque_push(&pool->deques[id], node) != 0) {
+        // No room to queue it; scan it here instead
+        scan_node_run(pool->config, pool, id, node);
+        platform_mutex_lock(&pool->lock);
+        node->done = 1;
+        platform_cond_broadcast(&pool->finished);
+        platform_mutex_unlock(&pool->lock);
+        return;
+    }
+    platform_mutex_lock(&pool->lock);
+    pool->queued++;
+    platform_cond_signal(&pool->work);
+    platform_mutex_unlock(&pool->lock);
+}
+
+static void scan_worker_main(void *arg) {
+    scan_worker_t *self = (scan_worker_t*)arg;
+    scan_pool_t *pool = self->pool;
+
+    for (;;) {
+        // Own work first, then steal, starting with the next worker along
+        scan_node_t *node = scan_deque_take(&pool->deques[self->id], 0);
+        for (unsigned k = 1; !node && k < pool->workers; k++) {
+            node = scan_deque_take(&pool->deques[(self->id + k) % pool->workers], 1);
+        }
+
+        platform_mutex_lock(&pool->lock);
+        if (!node) {
+            while (pool->queued == 0 && !pool->stop) {
+                platform_cond_wait(&pool->work, &pool->lock);
+            }
+            int stop = pool->stop;
+            platform_mutex_unlock(&pool->lock);
+            if (stop) {
+                return;
+            }
+            continue;
+        }
+        pool->queued--;
+        platform_mutex_unlock(&pool->lock);
+
+        scan_node_run(pool->config, pool, self->id, node);
+
+        platform_mutex_lock(&pool->lock);
+        node->done = 1;
+        platform_cond_broadcast(&pool->finished);
+        platform_mutex_unlock(&pool->lock);
+    }
+}
 
-            file_list_append(list, &fi);
+static void scan_pool_destroy(scan_pool_t *pool) {
+    if (pool->threads) {
+        platform_mutex_lock(&pool->lock);
+        pool->stop = 1;
+        platform_cond_broadcast(&pool->work);
+        platform_mutex_unlock(&pool->lock);
+        for (unsigned i = 0; i < pool->workers; i++) {
+            platform_thread_join(pool->threads[i].thread);
         }
     }
+    for (unsigned i = 0; pool->deques && i < pool->workers; i++) {
+        alloc_free(pool->deques[i].items);
+        platform_mutex_destroy(&pool->deques[i].lock);
+    }
+    platform_cond_destroy(&pool->finished);
+    platform_cond_destroy(&pool->work);
+    platform_mutex_destroy(&pool->lock);
+    alloc_free(pool->deques);
+    alloc_free(pool->threads);
+}
+
+// Start 'workers' traversal threads. Returns 0 on success.
+static int scan_pool_init(scan_pool_t *pool, const config_t *config, unsigned workers) {
+    memset(pool, 0, sizeof(*pool));
+    pool->config = config;
+    pool->workers = workers;
+    platform_mutex_init(&pool->lock);
+    platform_cond_init(&pool->work);
+    platform_cond_init(&pool->finished);
 
-    platform_closedir(dh);
+    pool->deques = (scan_deque_t*)alloc_calloc(workers, sizeof(scan_deque_t));
+    if (!pool->deques) {
+        scan_pool_destroy(pool);
+        return -1;
+    }
+    for (unsigned i = 0; i < workers; i++) {
+        platform_mutex_init(&pool->deques[i].lock);
+    }
+
+    scan_worker_t *threads = (scan_worker_t*)alloc_calloc(workers, sizeof(scan_worker_t));
+    if (!threads) {
+        scan_pool_destroy(pool);
+        return -1;
+    }
+    unsigned started = 0;
+    for (; started < workers; started++) {
+        threads[started].pool = pool;
+        threads[started].id = started;
+        if (platform_thread_create(&threads[started].thread, scan_worker_main, &threads[started]) != 0) {
+            break;
+        }
+    }
+    pool->threads = threads;
+    if (started < workers) {
+        pool->workers = started; // Only join the threads that exist
+        scan_pool_destroy(pool);
+        return -1;
+    }
     return 0;
 }
 
+// Wait for 'node' to be scanned, or scan it here when there is no pool, and
+// work out its full path
+static int scan_enter(const config_t *config, scan_pool_t *pool, scan_node_t *node, scan_stats_t *stats) {
+    if (pool) {
+        platform_mutex_lock(&pool->lock);
+        while (!node->done) {
+            platform_cond_wait(&pool->finished, &pool->lock);
+        }
+        platform_mutex_unlock(&pool->lock);
+    } else {
+        scan_node_run(config, NULL, 0, node);
+    }
+    if (!node->error) {
+        stats->directories++;
+        stats->stat_calls += node->stat_calls;
+    }
+
+    if (!node->parent) {
+        node->path = scan_strdup(node->name);
+    } else {
+        char *buf = NULL;
+        size_t capacity = 0;
+        node->path = scan_join(&buf, &capacity, node->parent->path, node->name);
+    }
+    return node->path ? 0 : -1;
+}
+
+// A directory being emitted, and the next of its entries to look at
+typedef struct {
+    scan_node_t *node;
+    size_t next;
+} scan_frame_t;
+
+// Emit the files under 'root' in order: each directory's entries by name,
+// descending into subdirectories where they sort. Runs on an explicit stack
+// and frees each subdirectory once it has been emitted.
+static int scan_emit_tree(const config_t *config, scan_pool_t *pool, scan_node_t *root,
+                          const scan_sink_t *sink, scan_stats_t *stats) {
+    if (scan_enter(config, pool, root, stats) != 0) {
+        return -1;
+    }
+
+    size_t depth = 0;
+    size_t capacity = 16;
+    scan_frame_t *stack = (scan_frame_t*)alloc_malloc(capacity * sizeof(scan_frame_t));
+    char *path = NULL;
+    size_t path_capacity = 0;
+    int result = stack ? root->error : -1;
+    if (stack) {
+        stack[depth].node = root;
+        stack[depth].next = 0;
+        depth++;
+    }
+
+    while (depth > 0) {
+        scan_frame_t *frame = &stack[depth - 1];
+        scan_node_t *node = frame->node;
+        if (frame->next == node->count) {
+            // Done with this subdirectory; detach it from its parent and free it
+            depth--;
+            if (depth > 0) {
+                scan_frame_t *up = &stack[depth - 1];
+                up->node->entries[up->next - 1].child = NULL;
+                scan_node_free(node);
+            }
+            continue;
+        }
+
+        scan_entry_t *entry = &node->entries[frame->next++];
+        if (entry->child) {
+            scan_node_t *child = entry->child;
+            if (depth == capacity) {
+                scan_frame_t *grown = (scan_frame_t*)alloc_realloc(stack, 2 * capacity * sizeof(scan_frame_t));
+                if (!grown) {
+                    result = -1;
+                    break;
+                }
+                stack = grown;
+                capacity *= 2;
+            }
+            if (scan_enter(config, pool, child, stats) != 0) {
+                result = -1;
+                break;
+            }
+            if (child->error) {
+                // TODO: If an error occurs in a subdirectory, should we continue the operation or fail it?
+            }
+            stack[depth].node = child;
+            stack[depth].next = 0;
+            depth++;
+            continue;
+        }
+
+        file_info_t fi;
+        fi.path = scan_join(&path, &path_capacity, node->path, entry->name);
+        if (!fi.path) {
+            result = -1;
+            break;
+        }
+        fi.size = entry->size;
+        fi.is_dir = 0;
+        stats->files++;
+        if (fi.size == PLATFORM_SIZE_UNKNOWN) {
+            stats->deferred_sizes++;
+        }
+        if (scan_emit(sink, &fi) != 0) {
+            result = -1;
+            break;
+        }
+    }
+
+    // Anything left after a failure is still attached to the root, which the
+    // caller frees once the workers have stopped
+    alloc_free(path);
+    alloc_free(stack);
+    return result;
+}
+
+// Number of traversal threads for this scan; 0 scans on the calling thread
+static unsigned scan_worker_count(const config_t *config) {
+    if (!config->recursive) {
+        return 0; // A single directory, nothing to share out
+    }
+    unsigned jobs = config->jobs ? config->jobs : platform_cpu_count();
+    return jobs > 1 ? jobs : 0;
+}
+
+static int scan_walk(const char *dir, const config_t *config, const scan_sink_t *sink, scan_stats_t *stats) {
+    unsigned long long start = platform_time_ns();
+    memset(stats, 0, sizeof(*stats));
+    scan_node_t *root = scan_node_create(NULL, dir);
+    if (!root) {
+        return -1;
+    }
+
+    scan_pool_t pool;
+    scan_pool_t *active = NULL;
+    unsigned workers = scan_worker_count(config);
+    if (workers > 0 && scan_pool_init(&pool, config, workers) == 0) {
+        active = &pool;
+        scan_pool_push(active, 0, root);
+    }
+
+    int result = scan_emit_tree(config, active, root, sink, stats);
+
+    if (active) {
+        scan_pool_destroy(active);
+    }
+    scan_node_free(root);
+    stats->seconds = (double)(platform_time_ns() - start) / 1e9;
+    return result;
+}
+
 int scan_directory(const char *dir, const config_t *config, file_list_t *list) {
-    return scan_single_dir(dir, config, list);
+    scan_sink_t sink = { list, NULL };
+    scan_stats_t stats;
+    return scan_walk(dir, config, &sink, &stats);
+}
+
+struct scan_job {
+    const char *dir;
+    const config_t *config;
+    file_feed_t *feed;
+    platform_thread_t thread;
+    scan_stats_t stats;
+    int result;
+};
+
+static void scan_job_main(void *arg) {
+    scan_job_t *job = (scan_job_t*)arg;
+    scan_sink_t sink = { NULL, job->feed };
+    job->result = scan_walk(job->dir, job->config, &sink, &job->stats);
+    file_feed_finish(job->feed, job->result);
+}
+
+scan_job_t* scan_start(const char *dir, const config_t *config, file_feed_t *feed) {
+    scan_job_t *job = (scan_job_t*)alloc_calloc(1, sizeof(scan_job_t));
+    if (!job) {
+        return NULL;
+    }
+    job->dir = dir;
+    job->config = config;
+    job->feed = feed;
+    if (platform_thread_create(&job->thread, scan_job_main, job) != 0) {
+        alloc_free(job);
+        return NULL;
+    }
+    return job;
+}
+
+int scan_wait(scan_job_t *job, scan_stats_t *stats) {
+    platform_thread_join(job->thread);
+    int result = job->result;
+    if (stats) {
+        *stats = job->stats;
+    }
+    alloc_free(job);
+    return result;
+}
+
+void scan_print_stats(const scan_stats_t *stats, FILE *stream) {
+    // Every entry but the top directory was listed by its parent
+    size_t entries = stats->files + (stats->directories > 0 ? stats->directories - 1 : 0);
+    fprintf(stream, "scan: %zu directories, %zu files, %.3f s\n",
+            stats->directories, stats->files, stats->seconds);
+    fprintf(stream, "  %zu stat calls for %zu entries, %zu sizes left to the reader\n",
+            stats->stat_calls, entries, stats->deferred_sizes);
 }
@@ -1,11 +1,40 @@
 #ifndef SCAN_H
 #define SCAN_H
 
+#include <stdio.h>
 #include "config.h"
 #include "file_list.h"
 
+// Counters for one scan.
+typedef struct {
+    size_t directories;     // Directories listed
+    size_t files;           // Files found
+    size_t stat_calls;      // Entries stat'ed to find out whether they are directories
+    size_t deferred_sizes;  // Files whose size is looked up later, if at all
+    double seconds;
+} scan_stats_t;
+
 // Recursively scan the directory specified in config.input_dir and populate the list.
-// If config.recursive is true, also scan subdirectories.
+// If config.recursive is true, also scan subdirectories, using config.jobs
+// threads that steal directories from each other.
+// Entries of each directory are listed by name, with a subdirectory's files
+// in place of the subdirectory, so the order never depends on thread timing.
 int scan_directory(const char *dir, const config_t *config, file_list_t *list);
 
+// A scan running on a background thread.
+typedef struct scan_job scan_job_t;
+
+// Start scanning 'dir' on a new thread. Files are appended to 'feed' as they
+// are found, in the same order scan_directory would list them, and the feed
+// is finished with the scan result at the end. 'dir' and 'config' must stay
+// valid until scan_wait. Returns NULL if the thread could not be started.
+scan_job_t* scan_start(const char *dir, const config_t *config, file_feed_t *feed);
+
+// Wait for the scan to end and free the job. Returns the scan result and
+// fills 'stats' if it is not NULL.
+int scan_wait(scan_job_t *job, scan_stats_t *stats);
+
+// Print 'stats' as a short report.
+void scan_print_stats(const scan_stats_t *stats, FILE *stream);
+
 #endif // SCAN_H
@@ -0,0 +1,410 @@
+#if defined(PLATFORM_LINUX) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // vmsplice, F_SETPIPE_SZ
+#endif
+
+#include "sink.h"
+#include "platform.h"
+#include "alloc.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#endif
+#ifdef PLATFORM_LINUX
+#include <sys/mman.h>
+#endif
+
+int sink_write(output_sink_t *sink, const void *data, size_t len) {
+    if (sink->error) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (sink->ops->write(sink, data, len) != 0) {
+        sink->error = 1;
+        return -1;
+    }
+    sink->bytes += len;
+    return 0;
+}
+
+int sink_flush(output_sink_t *sink) {
+    if (sink->error) {
+        return -1;
+    }
+    if (sink->ops->flush && sink->ops->flush(sink) != 0) {
+        sink->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+int sink_close(output_sink_t *sink) {
+    if (!sink) {
+        return 0;
+    }
+    int result = sink_flush(sink);
+    sink->ops->destroy(sink);
+    return result;
+}
+
+// File descriptor sink, optionally buffered
+typedef struct {
+    output_sink_t base;
+    int fd;
+    int owns_fd;
+    char *buffer;
+    size_t capacity;
+    size_t used;
+} sink_fd_t;
+
+// Write two pieces completely, in one system call where possible
+static int sink_fd_write_pair(int fd, const char *a, size_t a_len, const char *b, size_t b_len) {
+#ifdef _WIN32
+    const char *parts[2] = { a, b };
+    size_t lens[2] = { a_len, b_len };
+    for (int i = 0; i < 2; i++) {
+        while (lens[i] > 0) {
+            unsigned chunk = lens[i] > 0x40000000 ? 0x40000000 : (unsigned)lens[i];
+            int n = _write(fd, parts[i], chunk);
+            if (n < 0) {
+                return -1;
+            }
+            parts[i] += n;
+            lens[i] -= (size_t)n;
+        }
+    }
+    return 0;
+#else
+    struct iovec iov[2];
+    iov[0].iov_base = (void*)a;
+    iov[0].iov_len = a_len;
+    iov[1].iov_base = (void*)b;
+    iov[1].iov_len = b_len;
+    struct iovec *v = iov;
+    int count = 2;
+    while (count > 0) {
+        if (v->iov_len == 0) {
+            v++;
+            count--;
+            continue;
+        }
+        ssize_t n = writev(fd, v, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // Skip what was written, which may end part way through a piece
+        size_t done = (size_t)n;
+        while (count > 0 && done >= v->iov_len) {
+            done -= v->iov_len;
+            v++;
+            count--;
+        }
+        if (count > 0) {
+            v->iov_base = (char*)v->iov_base + done;
+            v->iov_len -= done;
+        }
+    }
+    return 0;
+#endif
+}
+
+static int sink_fd_write(output_sink_t *sink, const void *data, size_t len) {
+    sink_fd_t *s = (sink_fd_t*)sink;
+    if (s->used + len <= s->capacity) {
+        memcpy(s->buffer + s->used, data, len);
+        s->used += len;
+        return 0;
+    }
+    // Send the buffered bytes and this write together
+    size_t used = s->used;
+    s->used = 0;
+    return sink_fd_write_pair(s->fd, s->buffer, used, (const char*)data, len);
+}
+
+static int sink_fd_flush(output_sink_t *sink) {
+    sink_fd_t *s = (sink_fd_t*)sink;
+    size_t used = s->used;
+    s->used = 0;
+    return sink_fd_write_pair(s->fd, s->buffer, used, NULL, 0);
+}
+
+static void sink_fd_destroy(output_sink_t *sink) {
+    sink_fd_t *s = (sink_fd_t*)sink;
+    if (s->owns_fd) {
+#ifdef _WIN32
+        _close(s->fd);
+#else
+        close(s->fd);
+#endif
+    }
+    alloc_free_aligned(s->buffer);
+    alloc_free(s);
+}
+
+static const output_sink_ops_t sink_fd_ops = { sink_fd_write, sink_fd_flush, sink_fd_destroy };
+
+output_sink_t* sink_fd_create(int fd, size_t buffer_size) {
+    sink_fd_t *s = (sink_fd_t*)alloc_calloc(1, sizeof(sink_fd_t));
+    if (!s) {
+        return NULL;
+    }
+    s->base.ops = &sink_fd_ops;
+    s->fd = fd;
+    if (buffer_size > 0) {
+        s->buffer = (char*)alloc_aligned(buffer_size, BUFFER_POOL_ALIGNMENT);
+        if (!s->buffer) {
+            alloc_free(s);
+            return NULL;
+        }
+        s->capacity = buffer_size;
+    }
+    return &s->base;
+}
+
+// Open 'path' for writing, truncated or appended to
+static output_sink_t* sink_file_open(const char *path, size_t buffer_size, int append) {
+#ifdef _WIN32
+    int fd = _open(path, _O_WRONLY | _O_CREAT | (append ? _O_APPEND : _O_TRUNC) | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC, 0644);
+#endif
+    if (fd < 0) {
+        return NULL;
+    }
+    output_sink_t *sink = sink_fd_create(fd, buffer_size ? buffer_size : SINK_BUFFER_SIZE);
+    if (!sink) {
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+        return NULL;
+    }
+    ((sink_fd_t*)sink)->owns_fd = 1;
+    return sink;
+}
+
+output_sink_t* sink_file_create(const char *path, size_t buffer_size) {
+    return sink_file_open(path, buffer_size, 0);
+}
+
+output_sink_t* sink_file_append(const char *path, size_t buffer_size) {
+    return sink_file_open(path, buffer_size, 1);
+}
+
+#ifdef PLATFORM_LINUX
+// Pipe sink: output is copied once into a page-aligned buffer the size of
+// the pipe, and full buffers are gifted to the pipe with vmsplice. The pipe
+// keeps references to the gifted pages, and so may whatever reads it (tee,
+// or a splice on to a socket), so a gifted buffer is never written again:
+// it is unmapped, leaving its pages to the pipe, and a fresh one is mapped.
+// Partial buffers (on flush) are written with write, which copies them.
+typedef struct {
+    output_sink_t base;
+    int fd;
+    int use_write;          // vmsplice failed; write everything instead
+    char *buffer;
+    size_t capacity;
+    size_t used;
+} sink_pipe_t;
+
+static char* sink_pipe_map(size_t capacity) {
+    void *p = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : (char*)p;
+}
+
+// Gift the full buffer to the pipe, falling back to write if vmsplice is
+// refused. Gifted pages go with it and the sink maps a new buffer.
+static int sink_pipe_gift(sink_pipe_t *s) {
+    const char *data = s->buffer;
+    size_t len = s->capacity;
+    int gifted = 0;
+    while (len > 0 && !s->use_write) {
+        struct iovec iov;
+        iov.iov_base = (void*)data;
+        iov.iov_len = len;
+        ssize_t n = vmsplice(s->fd, &iov, 1, SPLICE_F_GIFT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS || errno == EBADF) {
+                s->use_write = 1;
+                break;
+            }
+            return -1;
+        }
+        gifted = gifted || n > 0;
+        data += n;
+        len -= (size_t)n;
+    }
+    if (sink_fd_write_pair(s->fd, data, len, NULL, 0) != 0) {
+        return -1;
+    }
+    if (gifted) {
+        munmap(s->buffer, s->capacity);
+        s->buffer = sink_pipe_map(s->capacity);
+        if (!s->buffer) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int sink_pipe_write(output_sink_t *sink, const void *data, size_t len) {
+    sink_pipe_t *s = (sink_pipe_t*)sink;
+    const char *src = (const char*)data;
+    while (len > 0) {
+        size_t n = s->capacity - s->used;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(s->buffer + s->used, src, n);
+        s->used += n;
+        src += n;
+        len -= n;
+        if (s->used == s->capacity) {
+            s->used = 0;
+            if (sink_pipe_gift(s) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int sink_pipe_flush(output_sink_t *sink) {
+    sink_pipe_t *s = (sink_pipe_t*)sink;
+    size_t used = s->used;
+    s->used = 0;
+    return sink_fd_write_pair(s->fd, s->buffer, used, NULL, 0);
+}
+
+static void sink_pipe_destroy(output_sink_t *sink) {
+    sink_pipe_t *s = (sink_pipe_t*)sink;
+    if (s->buffer) {
+        munmap(s->buffer, s->capacity);
+    }
+    alloc_free(s);
+}
+
+static const output_sink_ops_t sink_pipe_ops = { sink_pipe_write, sink_pipe_flush, sink_pipe_destroy };
+#endif
+
+output_sink_t* sink_pipe_create(int fd) {
+#ifdef PLATFORM_LINUX
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return NULL;
+    }
+    // Grow the pipe to the buffer size if allowed, and size the buffer to match
+    int pipe_size = fcntl(fd, F_SETPIPE_SZ, SINK_BUFFER_SIZE);
+    if (pipe_size < 0) {
+        pipe_size = fcntl(fd, F_GETPIPE_SZ);
+    }
+    if (pipe_size <= 0) {
+        return NULL;
+    }
+    sink_pipe_t *s = (sink_pipe_t*)alloc_calloc(1, sizeof(sink_pipe_t));
+    if (!s) {
+        return NULL;
+    }
+    s->base.ops = &sink_pipe_ops;
+    s->fd = fd;
+    s->capacity = (size_t)pipe_size;
+    s->buffer = sink_pipe_map(s->capacity);
+    if (!s->buffer) {
+        sink_pipe_destroy(&s->base);
+        return NULL;
+    }
+    return &s->base;
+#else
+    (void)fd;
+    return NULL;
+#endif
+}
+
+// Growable memory sink
+typedef struct {
+    output_sink_t base;
+    char *data;
+    size_t len;
+    size_t capacity;
+} sink_memory_t;
+
+static int sink_memory_write(output_sink_t *sink, const void *data, size_t len) {
+    sink_memory_t *s = (sink_memory_t*)sink;
+    if (s->len + len > s->capacity) {
+        size_t capacity = s->capacity ? s->capacity : 4096;
+        while (capacity < s->len + len) {
+            capacity *= 2;
+        }
+        char *grown = (char*)alloc_realloc(s->data, capacity);
+        if (!grown) {
+            return -1;
+        }
+        s->data = grown;
+        s->capacity = capacity;
+    }
+    memcpy(s->data + s->len, data, len);
+    s->len += len;
+    return 0;
+}
+
+static void sink_memory_destroy(output_sink_t *sink) {
+    sink_memory_t *s = (sink_memory_t*)sink;
+    alloc_free(s->data);
+    alloc_free(s);
+}
+
+static const output_sink_ops_t sink_memory_ops = { sink_memory_write, NULL, sink_memory_destroy };
+
+output_sink_t* sink_memory_create(void) {
+    sink_memory_t *s = (sink_memory_t*)alloc_calloc(1, sizeof(sink_memory_t));
+    if (!s) {
+        return NULL;
+    }
+    s->base.ops = &sink_memory_ops;
+    return &s->base;
+}
+
+const char* sink_memory_data(const output_sink_t *sink, size_t *len) {
+    const sink_memory_t *s = (const sink_memory_t*)sink;
+    *len = s->len;
+    return s->data;
+}
+
+// Null sink: only the byte count is kept
+static int sink_null_write(output_sink_t *sink, const void *data, size_t len) {
+    (void)sink;
+    (void)data;
+    (void)len;
+    return 0;
+}
+
+static void sink_null_destroy(output_sink_t *sink) {
+    alloc_free(sink);
+}
+
+static const output_sink_ops_t sink_null_ops = { sink_null_write, NULL, sink_null_destroy };
+
+output_sink_t* sink_null_create(void) {
+    output_sink_t *sink = (output_sink_t*)alloc_calloc(1, sizeof(output_sink_t));
+    if (sink) {
+        sink->ops = &sink_null_ops;
+    }
+    return sink;
+}
@@ -0,0 +1,68 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+
+// Default buffer of file sinks. Writes that do not fit are sent to the OS
+// together with the buffered bytes in one writev call, never copied.
+#define SINK_BUFFER_SIZE (1024 * 1024)
+
+typedef struct output_sink output_sink_t;
+
+// Operations of one kind of sink. Use the sink_* functions below rather
+// than calling these directly.
+typedef struct {
+    int (*write)(output_sink_t *sink, const void *data, size_t len);
+    int (*flush)(output_sink_t *sink);
+    void (*destroy)(output_sink_t *sink);
+} output_sink_ops_t;
+
+// Where converted output goes. Sinks are not thread-safe; one thread writes.
+struct output_sink {
+    const output_sink_ops_t *ops;
+    unsigned long long bytes;   // Bytes written so far
+    int error;                  // Set by the first failed write; later writes are dropped
+};
+
+// Write 'len' bytes. Returns 0 on success, nonzero if this or an earlier
+// write failed.
+int sink_write(output_sink_t *sink, const void *data, size_t len);
+
+// Push buffered bytes to the OS. Returns 0 on success, nonzero on error.
+int sink_flush(output_sink_t *sink);
+
+// Flush and free the sink. NULL is ignored. Returns nonzero if any write
+// or the flush failed.
+int sink_close(output_sink_t *sink);
+
+// Create (or truncate) 'path' and write it through a buffer of
+// 'buffer_size' bytes (0 selects SINK_BUFFER_SIZE). Returns NULL on failure.
+output_sink_t* sink_file_create(const char *path, size_t buffer_size);
+
+// Same as sink_file_create, but writes go to the end of 'path' if it exists.
+output_sink_t* sink_file_append(const char *path, size_t buffer_size);
+
+// Write to an open file descriptor, such as a pipe, which is not closed by
+// sink_close. With a 'buffer_size' of 0 every write goes straight to the fd.
+// Returns NULL on failure.
+output_sink_t* sink_fd_create(int fd, size_t buffer_size);
+
+// Write to a pipe without copying through the kernel: full page-aligned
+// buffers are handed over with vmsplice(SPLICE_F_GIFT). Linux only. Returns
+// NULL if 'fd' is not a pipe or this is not supported, so the caller can
+// fall back to sink_fd_create. The fd is not closed by sink_close. Gifted
+// buffers are left to the pipe and never written again, so the reader may
+// keep the pages (tee, splice to a socket) as well as copy them out.
+output_sink_t* sink_pipe_create(int fd);
+
+// Collect everything in a growable buffer in memory. Returns NULL on failure.
+output_sink_t* sink_memory_create(void);
+
+// Bytes collected by a memory sink so far; stays valid until the next write.
+const char* sink_memory_data(const output_sink_t *sink, size_t *len);
+
+// Count and discard everything, to time conversion without any I/O.
+// Returns NULL on failure.
+output_sink_t* sink_null_create(void);
+
+#endif // SINK_H
@@ -0,0 +1,166 @@
+#include "thread_pool.h"
+#include "platform.h"
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    thread_pool_task_fn fn;
+    void *arg;
+} thread_pool_task_t;
+
+typedef struct {
+    thread_pool_t *pool;
+    unsigned index;
+} thread_pool_worker_t;
+
+struct thread_pool {
+    platform_mutex_t lock;
+    platform_cond_t task_ready;     // Signalled when a task is queued or on shutdown
+    platform_cond_t all_done;       // Signalled when the pool becomes idle
+
+    // Ring buffer of queued tasks, grown by doubling
+    thread_pool_task_t *tasks;
+    size_t capacity;
+    size_t head;
+    size_t count;
+
+    size_t running;
+    int shutdown;
+
+    unsigned threads;
+    platform_thread_t *handles;
+    thread_pool_worker_t *workers;
+};
+
+static void thread_pool_worker_main(void *arg) {
+    thread_pool_worker_t *worker = (thread_pool_worker_t*)arg;
+    thread_pool_t *pool = worker->pool;
+
+    platform_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->count == 0 && !pool->shutdown) {
+            platform_cond_wait(&pool->task_ready, &pool->lock);
+        }
+        if (pool->count == 0) {
+            break; // Shutting down and nothing left to do
+        }
+
+        thread_pool_task_t task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pool->running++;
+        platform_mutex_unlock(&pool->lock);
+
+        task.fn(task.arg, worker->index);
+
+        platform_mutex_lock(&pool->lock);
+        pool->running--;
+        if (pool->count == 0 && pool->running == 0) {
+            platform_cond_broadcast(&pool->all_done);
+        }
+    }
+    platform_mutex_unlock(&pool->lock);
+}
+
+thread_pool_t* thread_pool_create(unsigned threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    thread_pool_t *pool = (thread_pool_t*)alloc_malloc(sizeof(thread_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(*pool));
+    pool->capacity = 64;
+    pool->tasks = (thread_pool_task_t*)alloc_malloc(pool->capacity * sizeof(thread_pool_task_t));
+    pool->handles = (platform_thread_t*)alloc_malloc(threads * sizeof(platform_thread_t));
+    pool->workers = (thread_pool_worker_t*)alloc_malloc(threads * sizeof(thread_pool_worker_t));
+    if (!pool->tasks || !pool->handles || !pool->workers) {
+        alloc_free(pool->tasks);
+        alloc_free(pool->handles);
+        alloc_free(pool->workers);
+        alloc_free(pool);
+        return NULL;
+    }
+
+    platform_mutex_init(&pool->lock);
+    platform_cond_init(&pool->task_ready);
+    platform_cond_init(&pool->all_done);
+
+    for (unsigned i = 0; i < threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (platform_thread_create(&pool->handles[i], thread_pool_worker_main, &pool->workers[i]) != 0) {
+            break;
+        }
+        pool->threads++;
+    }
+    if (pool->threads == 0) {
+        thread_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+unsigned thread_pool_size(const thread_pool_t *pool) {
+    return pool->threads;
+}
+
+int thread_pool_submit(thread_pool_t *pool, thread_pool_task_fn fn, void *arg) {
+    platform_mutex_lock(&pool->lock);
+    if (pool->count == pool->capacity) {
+        size_t capacity = pool->capacity * 2;
+        thread_pool_task_t *tasks = (thread_pool_task_t*)alloc_malloc(capacity * sizeof(thread_pool_task_t));
+        if (!tasks) {
+            platform_mutex_unlock(&pool->lock);
+            return -1;
+        }
+        // Unwrap the ring into the new buffer
+        for (size_t i = 0; i < pool->count; i++) {
+            tasks[i] = pool->tasks[(pool->head + i) % pool->capacity];
+        }
+        alloc_free(pool->tasks);
+        pool->tasks = tasks;
+        pool->capacity = capacity;
+        pool->head = 0;
+    }
+    pool->tasks[(pool->head + pool->count) % pool->capacity].fn = fn;
+    pool->tasks[(pool->head + pool->count) % pool->capacity].arg = arg;
+    pool->count++;
+    platform_cond_signal(&pool->task_ready);
+    platform_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void thread_pool_wait(thread_pool_t *pool) {
+    platform_mutex_lock(&pool->lock);
+    while (pool->count > 0 || pool->running > 0) {
+        platform_cond_wait(&pool->all_done, &pool->lock);
+    }
+    platform_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+
+    platform_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    platform_cond_broadcast(&pool->task_ready);
+    platform_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->threads; i++) {
+        platform_thread_join(pool->handles[i]);
+    }
+
+    platform_cond_destroy(&pool->all_done);
+    platform_cond_destroy(&pool->task_ready);
+    platform_mutex_destroy(&pool->lock);
+    alloc_free(pool->tasks);
+    alloc_free(pool->handles);
+    alloc_free(pool->workers);
+    alloc_free(pool);
+}
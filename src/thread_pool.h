@@ -0,0 +1,28 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stddef.h>
+
+// Task run by a pool thread. 'worker' is the index of the thread running it
+// (0 .. threads-1), so callers can keep per-thread state such as buffers.
+typedef void (*thread_pool_task_fn)(void *arg, unsigned worker);
+
+// Fixed set of worker threads taking tasks from a shared FIFO queue.
+typedef struct thread_pool thread_pool_t;
+
+// Start a pool with 'threads' workers (at least 1). Returns NULL on failure.
+thread_pool_t* thread_pool_create(unsigned threads);
+
+// Number of worker threads in the pool.
+unsigned thread_pool_size(const thread_pool_t *pool);
+
+// Queue fn(arg) to run on a worker. Returns 0 on success, nonzero on error.
+int thread_pool_submit(thread_pool_t *pool, thread_pool_task_fn fn, void *arg);
+
+// Block until every submitted task has finished.
+void thread_pool_wait(thread_pool_t *pool);
+
+// Finish all queued tasks, stop the workers and free the pool.
+void thread_pool_destroy(thread_pool_t *pool);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,32 @@
+#ifndef LWIP_HDR_APPS_FS_H
+#define LWIP_HDR_APPS_FS_H
+
+#include "lwip/def.h"
+
+#ifndef HTTPD_PRECALCULATED_CHECKSUM
+#define HTTPD_PRECALCULATED_CHECKSUM 0
+#endif
+
+struct fsdata_chksum {
+    u32_t offset;
+    u16_t chksum;
+    u16_t len;
+};
+
+// The file table entry as lwIP's httpd defines it
+struct fsdata_file {
+    const struct fsdata_file *next;
+    const unsigned char *name;
+    const unsigned char *data;
+    int len;
+    u8_t flags;
+#if HTTPD_PRECALCULATED_CHECKSUM
+    u16_t chksum_count;
+    const struct fsdata_chksum *chksum;
+#endif
+};
+
+#define FS_FILE_FLAGS_HEADER_INCLUDED 0x01
+#define FS_FILE_FLAGS_HEADER_PERSISTENT 0x02
+
+#endif // LWIP_HDR_APPS_FS_H
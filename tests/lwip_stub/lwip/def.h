@@ -0,0 +1,23 @@
+#ifndef LWIP_HDR_DEF_H
+#define LWIP_HDR_DEF_H
+
+// Just enough of lwIP's types to compile a generated fsdata.c on the host
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+
+#define LWIP_UNUSED_ARG(x) (void)x
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PP_HTONS(x) ((u16_t)(x))
+#else
+#define PP_HTONS(x) ((u16_t)((((x) & 0x00ffUL) << 8) | (((x) & 0xff00UL) >> 8)))
+#endif
+
+#endif // LWIP_HDR_DEF_H
@@ -0,0 +1,122 @@
+#include "alloc.h"
+#include "file_list.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    size_t mallocs;
+    size_t frees;
+} alloc_test_hooks_state;
+
+static void* alloc_test_malloc(void *ctx, size_t size) {
+    ((alloc_test_hooks_state*)ctx)->mallocs++;
+    return malloc(size);
+}
+
+static void* alloc_test_realloc(void *ctx, void *ptr, size_t size) {
+    if (!ptr) {
+        ((alloc_test_hooks_state*)ctx)->mallocs++;
+    }
+    return realloc(ptr, size);
+}
+
+static void alloc_test_free(void *ctx, void *ptr) {
+    ((alloc_test_hooks_state*)ctx)->frees++;
+    free(ptr);
+}
+
+// Test that installed hooks see every library allocation, and that the
+// default allocator comes back afterwards
+void test_alloc_hooks(void) {
+    alloc_test_hooks_state state = { 0, 0 };
+    alloc_hooks_t hooks = { alloc_test_malloc, alloc_test_realloc, alloc_test_free, &state };
+    alloc_set_hooks(&hooks);
+
+    file_list_t files;
+    file_list_init(&files);
+    file_info_t fi = { "some/path", 1, 0 };
+    file_list_append(&files, &fi);
+    file_list_free(&files);
+
+    void *aligned = alloc_aligned(100, 4096);
+    TEST_ASSERT_EQUAL_UINT64(0, (uintptr_t)aligned % 4096);
+    alloc_free_aligned(aligned);
+
+    alloc_set_hooks(NULL);
+    TEST_ASSERT_TRUE(state.mallocs > 0);
+    TEST_ASSERT_EQUAL_UINT64(state.mallocs, state.frees);
+
+    alloc_counters_t before, after;
+    alloc_get_counters(&before);
+    alloc_free(alloc_malloc(16));
+    alloc_get_counters(&after);
+    TEST_ASSERT_EQUAL_UINT64(before.allocs + 1, after.allocs);
+    TEST_ASSERT_EQUAL_UINT64(before.frees + 1, after.frees);
+    TEST_ASSERT_EQUAL_UINT64(state.mallocs, state.frees); // No longer hooked
+}
+
+// Test arena alignment, offsets, and allocations larger than a block
+void test_alloc_arena(void) {
+    arena_t arena;
+    arena_init(&arena, 256);
+
+    char *a = (char*)arena_alloc(&arena, 3);
+    double *d = (double*)arena_alloc(&arena, sizeof(double));
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_EQUAL_UINT64(0, (uintptr_t)d % sizeof(double));
+    TEST_ASSERT_EQUAL_UINT64(1, arena.block_count);
+
+    uint64_t offset;
+    char *big = (char*)arena_alloc_at(&arena, 1000, &offset);
+    memset(big, 'x', 1000);
+    TEST_ASSERT_EQUAL_PTR(big, arena_at(&arena, offset));
+    TEST_ASSERT_EQUAL_UINT64(2, arena.block_count);
+
+    char *copy = arena_strdup(&arena, "hello");
+    TEST_ASSERT_EQUAL_STRING("hello", copy);
+    TEST_ASSERT_EQUAL_UINT64(3, arena.block_count);
+    TEST_ASSERT_EQUAL_UINT64(256 + 1000 + 256, arena.bytes);
+
+    arena_free(&arena);
+    TEST_ASSERT_EQUAL_UINT64(0, arena.block_count);
+    TEST_ASSERT_NOT_NULL(arena_alloc(&arena, 8)); // Usable again after free
+    arena_free(&arena);
+}
+
+// Test that released buffers are handed out again and stay aligned
+void test_alloc_buffer_pool(void) {
+    buffer_pool_t *pool = buffer_pool_create(1024 * 1024);
+    TEST_ASSERT_NOT_NULL(pool);
+
+    size_t capacity = 0;
+    void *a = buffer_pool_acquire(pool, 5000, &capacity);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_TRUE(capacity >= 5000 && capacity <= 5000 + 5000 / 4);
+    TEST_ASSERT_EQUAL_UINT64(0, (uintptr_t)a % BUFFER_POOL_ALIGNMENT);
+    memset(a, 0, capacity);
+    buffer_pool_release(pool, a, capacity);
+
+    // Same size class: the same buffer, without touching the allocator
+    alloc_counters_t before, after;
+    alloc_get_counters(&before);
+    size_t again = 0;
+    void *b = buffer_pool_acquire(pool, 4500, &again);
+    alloc_get_counters(&after);
+    TEST_ASSERT_EQUAL_PTR(a, b);
+    TEST_ASSERT_EQUAL_UINT64(capacity, again);
+    TEST_ASSERT_EQUAL_UINT64(before.allocs, after.allocs);
+
+    // Over the retain limit a buffer is freed instead of kept
+    size_t big_capacity = 0;
+    void *big = buffer_pool_acquire(pool, 2 * 1024 * 1024, &big_capacity);
+    TEST_ASSERT_NOT_NULL(big);
+    alloc_get_counters(&before);
+    buffer_pool_release(pool, big, big_capacity);
+    alloc_get_counters(&after);
+    TEST_ASSERT_EQUAL_UINT64(before.frees + 1, after.frees);
+
+    buffer_pool_release(pool, b, again);
+    buffer_pool_destroy(pool);
+}
@@ -0,0 +1,61 @@
+#include "batch_read.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <stdio.h>
+#include <string.h>
+
+// Load the shared test files in one batch and check each result
+static void check_batch(int use_io_uring) {
+    batch_reader_t *br = batch_reader_create(4, use_io_uring);
+    TEST_ASSERT_NOT_NULL(br);
+    printf("[DEBUG] Batch reader using io_uring: %d\n", batch_reader_uses_io_uring(br));
+    if (!use_io_uring) {
+        TEST_ASSERT_FALSE(batch_reader_uses_io_uring(br));
+    }
+
+    const char *paths[] = { nonempty_filename, empty_filename, nonexistent_filename, large_filename };
+    file_info_t files[4];
+    for (size_t i = 0; i < 4; i++) {
+        files[i].path = paths[i];
+        files[i].size = 0;
+        files[i].is_dir = 0;
+    }
+
+    // Read twice so the second batch reuses the buffers of the first
+    for (int pass = 0; pass < 2; pass++) {
+        size_t indices[] = { 3, 2, 1, 0 };
+        TEST_ASSERT_EQUAL_INT(0, batch_reader_read(br, files, indices, 4));
+
+        const batch_file_t *large = batch_reader_file(br, 0);
+        TEST_ASSERT_EQUAL_UINT64(3, large->index);
+        TEST_ASSERT_EQUAL_INT(0, large->error);
+        TEST_ASSERT_EQUAL_UINT64(1048576, large->size);
+        TEST_ASSERT_EQUAL_INT('A', large->data[0]);
+        TEST_ASSERT_EQUAL_INT('A', large->data[large->size - 1]);
+
+        TEST_ASSERT_NOT_EQUAL(0, batch_reader_file(br, 1)->error);
+
+        const batch_file_t *empty = batch_reader_file(br, 2);
+        TEST_ASSERT_EQUAL_INT(0, empty->error);
+        TEST_ASSERT_EQUAL_UINT64(0, empty->size);
+
+        const batch_file_t *nonempty = batch_reader_file(br, 3);
+        TEST_ASSERT_EQUAL_INT(0, nonempty->error);
+        TEST_ASSERT_EQUAL_UINT64(strlen("Hello convert!\nSecond line.\n"), nonempty->size);
+        TEST_ASSERT_EQUAL_MEMORY("Hello convert!", nonempty->data, 14);
+    }
+
+    // More files than the window is an error
+    size_t too_many[] = { 0, 1, 2, 3, 0 };
+    TEST_ASSERT_NOT_EQUAL(0, batch_reader_read(br, files, too_many, 5));
+
+    batch_reader_destroy(br);
+}
+
+void test_batch_read_io_uring(void) {
+    check_batch(1);
+}
+
+void test_batch_read_sync(void) {
+    check_batch(0);
+}
@@ -0,0 +1,92 @@
+#include "chksum.h"
+#include "unity.h"
+#include <stdio.h>
+#include <string.h>
+
+// Reference sum of big-endian 16-bit words, one word at a time
+static uint16_t reference_sum(const unsigned char *data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < len; i += 2) {
+        sum += (uint32_t)data[i] << 8;
+        if (i + 1 < len) {
+            sum += data[i + 1];
+        }
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+// Fuzz every kernel supported by this CPU against the reference sum, with
+// random data, lengths and alignments.
+void test_chksum_kernels_fuzz(void) {
+    static unsigned char data[4096 + 64];
+    unsigned int seed = 4242;
+
+    for (int k = CHKSUM_KERNEL_SCALAR; k <= CHKSUM_KERNEL_AVX2; k++) {
+        if (!chksum_kernel_supported((chksum_kernel_t)k)) {
+            printf("[DEBUG] Skipping unsupported kernel: %s\n", chksum_kernel_name((chksum_kernel_t)k));
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(0, chksum_set_kernel((chksum_kernel_t)k));
+
+        // All 0xFF bytes carry on every add
+        memset(data, 0xFF, sizeof(data));
+        TEST_ASSERT_EQUAL_HEX16(reference_sum(data, 4096), chksum_sum(data, 4096));
+
+        for (int trial = 0; trial < 200; trial++) {
+            seed = seed * 1103515245u + 12345u;
+            size_t len = (seed >> 8) % 4096;
+            seed = seed * 1103515245u + 12345u;
+            size_t start = (seed >> 8) % 64;
+            for (size_t i = 0; i < len; i++) {
+                seed = seed * 1103515245u + 12345u;
+                data[start + i] = (unsigned char)(seed >> 16);
+            }
+            TEST_ASSERT_EQUAL_HEX16_MESSAGE(reference_sum(data + start, len), chksum_sum(data + start, len),
+                                            chksum_kernel_name((chksum_kernel_t)k));
+        }
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, chksum_set_kernel(CHKSUM_KERNEL_AUTO));
+}
+
+// Segment sums of bytes added in random pieces match the sums of each
+// segment taken whole, for odd and even segment sizes.
+void test_chksum_segments(void) {
+    static unsigned char data[10000];
+    unsigned int seed = 777;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (unsigned char)(seed >> 16);
+    }
+
+    // A piece at an odd offset swaps into place
+    TEST_ASSERT_EQUAL_HEX16(reference_sum(data, 101),
+                            chksum_combine(chksum_sum(data, 37), chksum_sum(data + 37, 64), 37));
+
+    const size_t mss_values[] = { 1, 7, 536, 1460, sizeof(data) + 1 };
+    for (size_t m = 0; m < sizeof(mss_values) / sizeof(mss_values[0]); m++) {
+        size_t mss = mss_values[m];
+        chksum_segments_t s;
+        chksum_segments_init(&s, mss);
+        size_t done = 0;
+        while (done < sizeof(data)) {
+            seed = seed * 1103515245u + 12345u;
+            size_t n = (seed >> 8) % 3000;
+            if (n > sizeof(data) - done) {
+                n = sizeof(data) - done;
+            }
+            TEST_ASSERT_EQUAL_INT(0, chksum_segments_add(&s, data + done, n));
+            done += n;
+        }
+        TEST_ASSERT_EQUAL_INT(0, chksum_segments_finish(&s));
+
+        TEST_ASSERT_EQUAL_UINT64((sizeof(data) + mss - 1) / mss, s.count);
+        for (size_t i = 0; i < s.count; i++) {
+            size_t off = i * mss;
+            size_t len = sizeof(data) - off < mss ? sizeof(data) - off : mss;
+            TEST_ASSERT_EQUAL_HEX16(reference_sum(data + off, len), s.sums[i]);
+        }
+        chksum_segments_free(&s);
+    }
+}
@@ -116,3 +116,196 @@ void test_parse_args_no_recursion(void) {
     TEST_ASSERT_FALSE(config.recursive);
     TEST_ASSERT_FALSE(config.show_help);
 }
+
+// Test: --io selects an input backend
+void test_parse_args_io(void) {
+    char *argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--io", "mmap"
+    };
+    int argc = (int)(sizeof(argv) / sizeof(argv[0]));
+
+    bool result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --io mmap");
+    TEST_ASSERT_EQUAL_INT(PLATFORM_INPUT_MMAP, config.input_strategy);
+
+    char *bad_argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--io", "carrier-pigeon"
+    };
+    argc = (int)(sizeof(bad_argv) / sizeof(bad_argv[0]));
+
+    result = parse_args(argc, bad_argv, &config);
+    TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to fail on an unknown --io backend");
+}
+
+// Test: --jobs takes a positive thread count
+void test_parse_args_jobs(void) {
+    char *argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--jobs", "8"
+    };
+    int argc = (int)(sizeof(argv) / sizeof(argv[0]));
+
+    bool result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --jobs 8");
+    TEST_ASSERT_EQUAL_UINT(8, config.jobs);
+
+    char *bad_argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--jobs", "0"
+    };
+    argc = (int)(sizeof(bad_argv) / sizeof(bad_argv[0]));
+
+    result = parse_args(argc, bad_argv, &config);
+    TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to fail with --jobs 0");
+}
+
+// Test: --max-memory takes a byte count with an optional suffix
+void test_parse_args_max_memory(void) {
+    char *argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--max-memory", "256M"
+    };
+    int argc = (int)(sizeof(argv) / sizeof(argv[0]));
+
+    bool result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --max-memory 256M");
+    TEST_ASSERT_EQUAL_UINT64(256u * 1024 * 1024, config.max_memory);
+
+    argv[6] = "4096";
+    result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --max-memory 4096");
+    TEST_ASSERT_EQUAL_UINT64(4096, config.max_memory);
+
+    const char *bad[] = { "0", "-1", "12X", "M", "1MB" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        argv[6] = (char*)bad[i];
+        result = parse_args(argc, argv, &config);
+        TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to reject a bad --max-memory size");
+    }
+}
+
+// Test: --writer selects how the arrays are written
+void test_parse_args_writer(void) {
+    char *argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--writer", "positional"
+    };
+    int argc = (int)(sizeof(argv) / sizeof(argv[0]));
+
+    bool result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --writer positional");
+    TEST_ASSERT_EQUAL_INT(CONFIG_WRITER_POSITIONAL, config.writer);
+
+    result = parse_args(argc - 2, argv, &config);
+    TEST_ASSERT_TRUE(result);
+    TEST_ASSERT_EQUAL_INT(CONFIG_WRITER_STREAM, config.writer);
+
+    argv[6] = "null";
+    result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --writer null");
+    TEST_ASSERT_EQUAL_INT(CONFIG_WRITER_NULL, config.writer);
+
+    argv[4] = "-";
+    result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to accept stdout as output");
+    argv[6] = "positional";
+    result = parse_args(argc, argv, &config);
+    TEST_ASSERT_FALSE_MESSAGE(result, "Expected the positional writer to refuse stdout");
+    argv[4] = "fsdata.c";
+
+    argv[6] = "sideways";
+    result = parse_args(argc, argv, &config);
+    TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to fail on an unknown --writer mode");
+}
+
+// Test: --precalc-chksum and --mss
+void test_parse_args_precalc_chksum(void) {
+    char *argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--precalc-chksum",
+        "--mss", "536"
+    };
+    int argc = (int)(sizeof(argv) / sizeof(argv[0]));
+
+    bool result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --precalc-chksum --mss 536");
+    TEST_ASSERT_TRUE(config.precalc_chksum);
+    TEST_ASSERT_EQUAL_UINT64(536, config.mss);
+
+    result = parse_args(argc - 2, argv, &config);
+    TEST_ASSERT_TRUE(result);
+    TEST_ASSERT_TRUE(config.precalc_chksum);
+    TEST_ASSERT_EQUAL_UINT64(0, config.mss);
+
+    result = parse_args(argc - 3, argv, &config);
+    TEST_ASSERT_TRUE(result);
+    TEST_ASSERT_FALSE(config.precalc_chksum);
+
+    const char *bad[] = { "0", "-1", "65536", "1k" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        argv[7] = (char*)bad[i];
+        result = parse_args(argc, argv, &config);
+        TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to reject a bad --mss");
+    }
+
+    // --mss means nothing without --precalc-chksum
+    argv[5] = "--mss";
+    argv[6] = "536";
+    result = parse_args(argc - 1, argv, &config);
+    TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to reject --mss without --precalc-chksum");
+}
+
+// Test: --gzip and --gzip-min-saving
+void test_parse_args_gzip(void) {
+    char *argv[] = {
+        "makefsdata_portable",
+        "--input", "webfiles",
+        "--output", "fsdata.c",
+        "--gzip",
+        "--gzip-min-saving", "20"
+    };
+    int argc = (int)(sizeof(argv) / sizeof(argv[0]));
+
+    bool result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE_MESSAGE(result, "Expected parse_args to succeed with --gzip --gzip-min-saving 20");
+    TEST_ASSERT_TRUE(config.gzip);
+    TEST_ASSERT_EQUAL_INT(20, config.gzip_min_saving);
+
+    argv[7] = "0";
+    result = parse_args(argc, argv, &config);
+    TEST_ASSERT_TRUE(result);
+    TEST_ASSERT_EQUAL_INT(0, config.gzip_min_saving);
+
+    result = parse_args(argc - 2, argv, &config);
+    TEST_ASSERT_TRUE(result);
+    TEST_ASSERT_EQUAL_INT(-1, config.gzip_min_saving);
+
+    const char *bad[] = { "100", "-1", "5%", "" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        argv[7] = (char*)bad[i];
+        result = parse_args(argc, argv, &config);
+        TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to reject a bad --gzip-min-saving");
+    }
+
+    // The threshold means nothing without --gzip
+    argv[5] = "--gzip-min-saving";
+    argv[6] = "20";
+    result = parse_args(argc - 1, argv, &config);
+    TEST_ASSERT_FALSE_MESSAGE(result, "Expected parse_args to reject --gzip-min-saving without --gzip");
+}
@@ -2,6 +2,8 @@
 #include "unity.h"
 #include "test_shared.h"
 #include "platform.h"
+#include "alloc.h"
+#include "encode.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -12,7 +14,7 @@ void test_convert_read_nonempty(void) {
     TEST_ASSERT_NOT_NULL_MESSAGE(data, "Expected to read non-empty file.");
     TEST_ASSERT_MESSAGE(size_out > 0, "Size should be > 0 for non-empty file.");
     TEST_ASSERT_NOT_EQUAL(0, strstr((char*)data, "Hello convert!") != NULL);
-    free(data);
+    alloc_free(data);
 }
 
 // Test reading empty file
@@ -23,7 +25,7 @@ void test_convert_read_empty(void) {
         TEST_FAIL_MESSAGE("convert_read_file_contents returned NULL for empty file.");
     } else {
         TEST_ASSERT_EQUAL_UINT(0, size_out);
-        free(data);
+        alloc_free(data);
     }
 }
 
@@ -44,7 +46,7 @@ void test_convert_read_large(void) {
     for (size_t i = 0; i < size_out; i++) {
         TEST_ASSERT_EQUAL_MESSAGE('A', data[i], "Expected 'A' in large file content");
     }
-    free(data);
+    alloc_free(data);
 }
 
 // Test convert_write_c_array with known data
@@ -52,16 +54,19 @@ void test_convert_write_c_array_basic(void) {
     const unsigned char test_data[] = {0x48, 0x65, 0x6C, 0x6C, 0x6F}; // "Hello in ASCII"
     size_t size = sizeof(test_data);
 
-    // Use tmpfile() to capture output
-    platform_file_handle out = tmpfile();
-    TEST_ASSERT_NOT_NULL_MESSAGE(out, "Failed to create tmpfile for testing c array output.");
+    // Capture the output in memory
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL_MESSAGE(out, "Failed to create memory sink for testing c array output.");
 
-    convert_write_c_array("test_var", test_data, size, out);
+    convert_write_c_array("test_var", NULL, test_data, size, out);
 
-    platform_fseek(out, 0, SEEK_SET);
     char buffer[256];
-    size_t read_count = fread(buffer, 1, sizeof(buffer)-1, out);
-    buffer[read_count] = '\0';
+    size_t len = 0;
+    const char *text = sink_memory_data(out, &len);
+    TEST_ASSERT_TRUE(len < sizeof(buffer));
+    memcpy(buffer, text, len);
+    buffer[len] = '\0';
+    sink_close(out);
 
     // Check that we see "static const unsigned char test_var[] = {"
     // and "0x48, 0x65, 0x6C, 0x6C, 0x6F" in output
@@ -73,17 +78,205 @@ void test_convert_write_c_array_empty(void) {
     const unsigned char *empty_data = NULL;
     size_t size = 0;
 
-    platform_file_handle out = tmpfile();
-    TEST_ASSERT_NOT_NULL_MESSAGE(out, "tmpfile failed for empty data test.");
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL_MESSAGE(out, "Memory sink failed for empty data test.");
 
-    convert_write_c_array("empty_var", empty_data, size, out);
+    convert_write_c_array("empty_var", NULL, empty_data, size, out);
 
-    fseek(out, 0, SEEK_SET);
     char buffer[256];
-    size_t read_count = platform_fread(buffer, 1, sizeof(buffer)-1, out);
-    buffer[read_count] = '\0';
+    size_t len = 0;
+    const char *text = sink_memory_data(out, &len);
+    TEST_ASSERT_TRUE(len < sizeof(buffer));
+    memcpy(buffer, text, len);
+    buffer[len] = '\0';
+    sink_close(out);
 
     TEST_ASSERT_NOT_EQUAL(NULL, strstr(buffer, "static const unsigned char empty_var[] = {"));
     // It should just have a newline after this and then "};"
     TEST_ASSERT_NOT_EQUAL(NULL, strstr(buffer, "};"));
 }
+
+// Test that multi-row output matches the original per-byte formatting exactly
+void test_convert_write_c_array_rows(void) {
+    unsigned char test_data[40];
+    for (size_t i = 0; i < sizeof(test_data); i++) {
+        test_data[i] = (unsigned char)(0xF0 + i);
+    }
+
+    char expected[512];
+    char *p = expected;
+    p += sprintf(p, "static const unsigned char rows_var[] = {\n");
+    for (size_t i = 0; i < sizeof(test_data); i++) {
+        p += sprintf(p, "0x%02X,", test_data[i]);
+        if ((i + 1) % 16 == 0) {
+            p += sprintf(p, "\n");
+        }
+    }
+    p += sprintf(p, "\n};\n\n");
+
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL_MESSAGE(out, "Memory sink failed for multi-row test.");
+
+    convert_write_c_array("rows_var", NULL, test_data, sizeof(test_data), out);
+
+    size_t len = 0;
+    const char *text = sink_memory_data(out, &len);
+    TEST_ASSERT_EQUAL_UINT64(strlen(expected), len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, text, len);
+    sink_close(out);
+}
+
+// Check that two memory sinks hold the same bytes, then close them
+static void assert_same_output(output_sink_t *expected_out, output_sink_t *actual_out) {
+    size_t expected_len = 0;
+    size_t actual_len = 0;
+    const char *expected = sink_memory_data(expected_out, &expected_len);
+    const char *actual = sink_memory_data(actual_out, &actual_len);
+    TEST_ASSERT_EQUAL_UINT64(expected_len, actual_len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, expected_len);
+    sink_close(expected_out);
+    sink_close(actual_out);
+}
+
+// Test that streaming a file spanning several blocks matches the in-memory path
+void test_convert_stream_matches_write(void) {
+    size_t size = 0;
+    unsigned char *data = convert_read_file_contents(large_filename, &size);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_TRUE(size > CONVERT_STREAM_BLOCK_SIZE);
+
+    output_sink_t *expected_out = sink_memory_create();
+    output_sink_t *actual_out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(expected_out);
+    TEST_ASSERT_NOT_NULL(actual_out);
+
+    convert_write_c_array("large_var", NULL, data, size, expected_out);
+    TEST_ASSERT_EQUAL_INT(0, convert_stream_c_array("large_var", NULL, large_filename, NULL, actual_out));
+    alloc_free(data);
+
+    assert_same_output(expected_out, actual_out);
+}
+
+// Test streaming a nonexistent file writes nothing and reports failure
+void test_convert_stream_nonexistent(void) {
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(out);
+
+    TEST_ASSERT_EQUAL_INT(-1, convert_stream_c_array("missing_var", NULL, nonexistent_filename, NULL, out));
+    TEST_ASSERT_EQUAL_UINT64(0, out->bytes);
+    sink_close(out);
+}
+
+// Test that encoding chunks on a pool gives the serial output, including for
+// reader blocks that do not end on a row boundary
+void test_convert_parallel_matches_write(void) {
+    size_t size = 3 * CONVERT_PARALLEL_CHUNK + 7;
+    unsigned char *data = (unsigned char*)malloc(size);
+    TEST_ASSERT_NOT_NULL(data);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (unsigned char)(i * 131 + (i >> 9));
+    }
+
+    thread_pool_t *pool = thread_pool_create(3);
+    TEST_ASSERT_NOT_NULL(pool);
+    convert_parallel_t *cp = convert_parallel_create(pool, 6);
+    TEST_ASSERT_NOT_NULL(cp);
+
+    output_sink_t *expected_out = sink_memory_create();
+    output_sink_t *actual_out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(expected_out);
+    TEST_ASSERT_NOT_NULL(actual_out);
+    convert_write_c_array("par_var", NULL, data, size, expected_out);
+    convert_write_c_array_parallel("par_var", NULL, data, size, cp, actual_out);
+    assert_same_output(expected_out, actual_out);
+    free(data);
+
+    // Stream the large file through a reader with an odd block size
+    platform_input *in = platform_input_create(PLATFORM_INPUT_READ, 100003);
+    TEST_ASSERT_NOT_NULL(in);
+    expected_out = sink_memory_create();
+    actual_out = sink_memory_create();
+    TEST_ASSERT_EQUAL_INT(0, convert_stream_c_array("large_var", NULL, large_filename, NULL, expected_out));
+    TEST_ASSERT_EQUAL_INT(0, convert_stream_c_array_parallel("large_var", NULL, large_filename, in, cp, actual_out));
+    assert_same_output(expected_out, actual_out);
+
+    platform_input_destroy(in);
+    convert_parallel_destroy(cp);
+    thread_pool_destroy(pool);
+}
+
+// Test that a prefix encodes like bytes in front of the contents, on every
+// writer, and that streaming refuses a file of another size
+void test_convert_prefix(void) {
+    size_t size = 0;
+    unsigned char *data = convert_read_file_contents(large_filename, &size);
+    TEST_ASSERT_NOT_NULL(data);
+
+    unsigned char head[2 * ENCODE_BYTES_PER_ROW];
+    for (size_t i = 0; i < sizeof(head); i++) {
+        head[i] = (unsigned char)(0xA0 + i);
+    }
+    unsigned char *joined = (unsigned char*)malloc(sizeof(head) + size);
+    TEST_ASSERT_NOT_NULL(joined);
+    memcpy(joined, head, sizeof(head));
+    memcpy(joined + sizeof(head), data, size);
+    convert_prefix_t prefix = { head, sizeof(head), size };
+
+    output_sink_t *expected_out = sink_memory_create();
+    output_sink_t *actual_out = sink_memory_create();
+    convert_write_c_array("pre_var", NULL, joined, sizeof(head) + size, expected_out);
+    convert_write_c_array("pre_var", &prefix, data, size, actual_out);
+    size_t expected_len = 0;
+    const char *expected = sink_memory_data(expected_out, &expected_len);
+    TEST_ASSERT_EQUAL_UINT64(convert_c_array_size("pre_var", sizeof(head) + size), expected_len);
+
+    char *formatted = (char*)malloc(expected_len);
+    TEST_ASSERT_NOT_NULL(formatted);
+    TEST_ASSERT_EQUAL_UINT64(expected_len, convert_format_c_array(formatted, "pre_var", &prefix, data, size));
+    TEST_ASSERT_EQUAL_MEMORY(expected, formatted, expected_len);
+    free(formatted);
+    assert_same_output(expected_out, actual_out);
+
+    expected_out = sink_memory_create();
+    actual_out = sink_memory_create();
+    convert_write_c_array("pre_var", NULL, joined, sizeof(head) + size, expected_out);
+    TEST_ASSERT_EQUAL_INT(0, convert_stream_c_array("pre_var", &prefix, large_filename, NULL, actual_out));
+    assert_same_output(expected_out, actual_out);
+
+    thread_pool_t *pool = thread_pool_create(2);
+    convert_parallel_t *cp = convert_parallel_create(pool, 4);
+    platform_input *in = platform_input_create(PLATFORM_INPUT_READ, 100003);
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT_NOT_NULL(cp);
+    TEST_ASSERT_NOT_NULL(in);
+    expected_out = sink_memory_create();
+    actual_out = sink_memory_create();
+    convert_write_c_array("pre_var", NULL, joined, sizeof(head) + size, expected_out);
+    TEST_ASSERT_EQUAL_INT(0, convert_stream_c_array_parallel("pre_var", &prefix, large_filename, in, cp, actual_out));
+    assert_same_output(expected_out, actual_out);
+
+    // A prefix made for another size would announce the wrong length
+    prefix.size = size - 1;
+    actual_out = sink_memory_create();
+    TEST_ASSERT_EQUAL_INT(-1, convert_stream_c_array("pre_var", &prefix, large_filename, NULL, actual_out));
+    TEST_ASSERT_EQUAL_INT(-1, convert_stream_c_array_parallel("pre_var", &prefix, large_filename, in, cp, actual_out));
+    TEST_ASSERT_EQUAL_UINT64(0, actual_out->bytes);
+    sink_close(actual_out);
+
+#ifdef __linux__
+    // A file that reads longer than its size (as /proc files do) leaves a
+    // truncated array behind, which is told apart from a file never opened
+    prefix.size = 0;
+    actual_out = sink_memory_create();
+    TEST_ASSERT_EQUAL_INT(1, convert_stream_c_array("pre_var", &prefix, "/proc/self/status", NULL, actual_out));
+    TEST_ASSERT_EQUAL_INT(1, convert_stream_c_array_parallel("pre_var", &prefix, "/proc/self/status", in, cp, actual_out));
+    TEST_ASSERT_TRUE(actual_out->bytes > 0);
+    sink_close(actual_out);
+#endif
+
+    platform_input_destroy(in);
+    convert_parallel_destroy(cp);
+    thread_pool_destroy(pool);
+    alloc_free(data);
+    free(joined);
+}
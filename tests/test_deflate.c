@@ -0,0 +1,347 @@
+#include "deflate.h"
+#include "alloc.h"
+#include "unity.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Reference inflater, written from RFC 1951 and kept simple rather than fast
+typedef struct {
+    const unsigned char *in;
+    size_t in_len;
+    size_t pos;
+    uint32_t bits;
+    unsigned count;
+    unsigned char *out;
+    size_t out_len;
+    size_t out_cap;
+    int error;
+} inflate_t;
+
+typedef struct {
+    short count[16];        // Codes of each length
+    short symbol[288];      // Symbols in canonical order
+} inflate_huffman_t;
+
+static unsigned inflate_bits(inflate_t *s, unsigned n) {
+    while (s->count < n) {
+        if (s->pos >= s->in_len) {
+            s->error = 1;
+            return 0;
+        }
+        s->bits |= (uint32_t)s->in[s->pos++] << s->count;
+        s->count += 8;
+    }
+    unsigned v = s->bits & ((1u << n) - 1);
+    s->bits >>= n;
+    s->count -= n;
+    return v;
+}
+
+static void inflate_put(inflate_t *s, unsigned char c) {
+    if (s->out_len == s->out_cap) {
+        s->out_cap = s->out_cap ? s->out_cap * 2 : 1024;
+        s->out = (unsigned char*)realloc(s->out, s->out_cap);
+    }
+    s->out[s->out_len++] = c;
+}
+
+// Returns nonzero if the lengths are over-subscribed
+static int inflate_build(inflate_huffman_t *h, const unsigned char *lengths, int n) {
+    short offs[16];
+    memset(h->count, 0, sizeof(h->count));
+    for (int s = 0; s < n; s++) {
+        h->count[lengths[s]]++;
+    }
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left = left * 2 - h->count[len];
+        if (left < 0) {
+            return -1;
+        }
+    }
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) {
+        offs[len + 1] = (short)(offs[len] + h->count[len]);
+    }
+    for (int s = 0; s < n; s++) {
+        if (lengths[s]) {
+            h->symbol[offs[lengths[s]]++] = (short)s;
+        }
+    }
+    return 0;
+}
+
+static int inflate_decode(inflate_t *s, const inflate_huffman_t *h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= (int)inflate_bits(s, 1);
+        int count = h->count[len];
+        if (code - count < first) {
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    s->error = 1;
+    return 0;
+}
+
+static const short inflate_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const short inflate_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const short inflate_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577 };
+static const short inflate_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void inflate_codes(inflate_t *s, const inflate_huffman_t *lit, const inflate_huffman_t *dist) {
+    while (!s->error) {
+        int sym = inflate_decode(s, lit);
+        if (sym < 256) {
+            inflate_put(s, (unsigned char)sym);
+        } else if (sym == 256) {
+            return;
+        } else if (sym - 257 >= 29) {
+            s->error = 1;
+        } else {
+            sym -= 257;
+            size_t len = (size_t)inflate_len_base[sym] + inflate_bits(s, (unsigned)inflate_len_extra[sym]);
+            int dsym = inflate_decode(s, dist);
+            if (dsym >= 30) {
+                s->error = 1;
+                return;
+            }
+            size_t d = (size_t)inflate_dist_base[dsym] + inflate_bits(s, (unsigned)inflate_dist_extra[dsym]);
+            if (d > s->out_len || d > 32768) {
+                s->error = 1;
+                return;
+            }
+            for (size_t k = 0; k < len; k++) {
+                inflate_put(s, s->out[s->out_len - d]);
+            }
+        }
+    }
+}
+
+// Inflate a raw DEFLATE stream. Returns nonzero on a malformed stream.
+static int inflate_raw(inflate_t *s) {
+    int last = 0;
+    while (!last && !s->error) {
+        last = (int)inflate_bits(s, 1);
+        unsigned type = inflate_bits(s, 2);
+        inflate_huffman_t lit, dist;
+        unsigned char lengths[320];
+        if (type == 0) {
+            s->bits = 0;
+            s->count = 0;
+            if (s->pos + 4 > s->in_len) {
+                return -1;
+            }
+            unsigned len = s->in[s->pos] | (unsigned)s->in[s->pos + 1] << 8;
+            unsigned nlen = s->in[s->pos + 2] | (unsigned)s->in[s->pos + 3] << 8;
+            s->pos += 4;
+            if (len != (~nlen & 0xFFFF) || s->pos + len > s->in_len) {
+                return -1;
+            }
+            for (unsigned k = 0; k < len; k++) {
+                inflate_put(s, s->in[s->pos++]);
+            }
+        } else if (type == 1) {
+            for (int k = 0; k < 288; k++) {
+                lengths[k] = k < 144 ? 8 : k < 256 ? 9 : k < 280 ? 7 : 8;
+            }
+            inflate_build(&lit, lengths, 288);
+            memset(lengths, 5, 30);
+            inflate_build(&dist, lengths, 30);
+            inflate_codes(s, &lit, &dist);
+        } else if (type == 2) {
+            static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            unsigned nlit = inflate_bits(s, 5) + 257;
+            unsigned ndist = inflate_bits(s, 5) + 1;
+            unsigned ncode = inflate_bits(s, 4) + 4;
+            memset(lengths, 0, sizeof(lengths));
+            for (unsigned k = 0; k < ncode; k++) {
+                lengths[order[k]] = (unsigned char)inflate_bits(s, 3);
+            }
+            inflate_huffman_t clen;
+            if (inflate_build(&clen, lengths, 19) != 0) {
+                return -1;
+            }
+            for (unsigned k = 0; k < nlit + ndist && !s->error; ) {
+                int sym = inflate_decode(s, &clen);
+                unsigned repeat = 0;
+                unsigned char v = 0;
+                if (sym < 16) {
+                    lengths[k++] = (unsigned char)sym;
+                    continue;
+                } else if (sym == 16) {
+                    if (k == 0) {
+                        return -1;
+                    }
+                    v = lengths[k - 1];
+                    repeat = 3 + inflate_bits(s, 2);
+                } else if (sym == 17) {
+                    repeat = 3 + inflate_bits(s, 3);
+                } else {
+                    repeat = 11 + inflate_bits(s, 7);
+                }
+                if (k + repeat > nlit + ndist) {
+                    return -1;
+                }
+                while (repeat--) {
+                    lengths[k++] = v;
+                }
+            }
+            if (inflate_build(&lit, lengths, (int)nlit) != 0 || inflate_build(&dist, lengths + nlit, (int)ndist) != 0) {
+                return -1;
+            }
+            inflate_codes(s, &lit, &dist);
+        } else {
+            return -1;
+        }
+    }
+    return s->error ? -1 : 0;
+}
+
+// Check that 'gz' is one gzip member holding exactly 'data'
+static void check_gzip(const unsigned char *gz, size_t gz_len, const unsigned char *data, size_t size) {
+    TEST_ASSERT_TRUE(gz_len >= 18);
+    TEST_ASSERT_EQUAL_HEX8(0x1f, gz[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8b, gz[1]);
+    TEST_ASSERT_EQUAL_HEX8(8, gz[2]);
+    inflate_t s;
+    memset(&s, 0, sizeof(s));
+    s.in = gz + 10;
+    s.in_len = gz_len - 8 - 10;
+    TEST_ASSERT_EQUAL_INT(0, inflate_raw(&s));
+    TEST_ASSERT_EQUAL_UINT64(s.in_len, s.pos); // Nothing left over
+    TEST_ASSERT_EQUAL_UINT64(size, s.out_len);
+    if (size > 0) {
+        TEST_ASSERT_EQUAL_MEMORY(data, s.out, size);
+    }
+    const unsigned char *t = gz + gz_len - 8;
+    uint32_t crc = t[0] | (uint32_t)t[1] << 8 | (uint32_t)t[2] << 16 | (uint32_t)t[3] << 24;
+    uint32_t isize = t[4] | (uint32_t)t[5] << 8 | (uint32_t)t[6] << 16 | (uint32_t)t[7] << 24;
+    TEST_ASSERT_EQUAL_HEX32(deflate_crc32(0, data, size), crc);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)size, isize);
+    free(s.out);
+}
+
+// Test the CRC against the standard check value, also in pieces
+void test_deflate_crc32(void) {
+    const char *check = "123456789";
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926u, deflate_crc32(0, check, 9));
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926u, deflate_crc32(deflate_crc32(0, check, 4), check + 4, 5));
+    TEST_ASSERT_EQUAL_HEX32(0, deflate_crc32(0, check, 0));
+    for (size_t split = 0; split <= 9; split++) {
+        uint32_t crc = deflate_crc32_combine(deflate_crc32(0, check, split), deflate_crc32(0, check + split, 9 - split),
+                                             9 - split);
+        TEST_ASSERT_EQUAL_HEX32(0xCBF43926u, crc);
+    }
+}
+
+// Test that data of every kind comes back intact from the reference
+// inflater: nothing, random bytes (stored blocks), text (dynamic blocks),
+// long runs (longest matches) and a mix spanning many blocks, both in one
+// go and in chunks
+void test_deflate_gzip(void) {
+    size_t max = 600 * 1024;
+    unsigned char *data = (unsigned char*)malloc(max);
+    unsigned int seed = 99;
+    const char *words[] = { "static ", "const ", "unsigned ", "char ", "file_", "0x2F,", "{\n", "}\n", "return ", "size_t " };
+
+    for (int kind = 0; kind < 6; kind++) {
+        size_t size = 0;
+        if (kind == 1) {
+            data[size++] = 'x';
+        } else if (kind == 2) {
+            for (; size < 100 * 1024; size++) {
+                seed = seed * 1103515245u + 12345u;
+                data[size] = (unsigned char)(seed >> 16);
+            }
+        } else if (kind == 3) {
+            while (size < 200 * 1024) {
+                seed = seed * 1103515245u + 12345u;
+                const char *w = words[(seed >> 16) % 10];
+                memcpy(data + size, w, strlen(w));
+                size += strlen(w);
+            }
+        } else if (kind == 4) {
+            memset(data, 0, 300 * 1024);
+            size = 300 * 1024;
+        } else if (kind == 5) {
+            // Text with stretches of noise, so blocks change form
+            while (size < max - 300) {
+                seed = seed * 1103515245u + 12345u;
+                if ((seed >> 16) % 50 == 0) {
+                    for (int k = 0; k < 256; k++) {
+                        seed = seed * 1103515245u + 12345u;
+                        data[size++] = (unsigned char)(seed >> 16);
+                    }
+                } else {
+                    const char *w = words[(seed >> 16) % 10];
+                    memcpy(data + size, w, strlen(w));
+                    size += strlen(w);
+                }
+            }
+        }
+
+        unsigned char *gz = NULL;
+        size_t gz_len = 0;
+        TEST_ASSERT_EQUAL_INT(0, deflate_gzip(data, size, &gz, &gz_len));
+        check_gzip(gz, gz_len, data, size);
+
+        // Chunks compressed out of order join into one member, barely longer
+        size_t count = deflate_chunk_count(size);
+        TEST_ASSERT_EQUAL_UINT64(size <= DEFLATE_CHUNK_SIZE ? 1 : (size + DEFLATE_CHUNK_SIZE - 1) / DEFLATE_CHUNK_SIZE,
+                                 count);
+        deflate_chunk_t chunks[4];
+        TEST_ASSERT_TRUE(count <= 4);
+        for (size_t i = count; i-- > 0; ) {
+            TEST_ASSERT_EQUAL_INT(0, deflate_chunk(data, size, i, &chunks[i]));
+
+            // Compressing from a copy of just the part it reads gives the same
+            size_t offset;
+            size_t len = deflate_chunk_window(size, i, &offset);
+            TEST_ASSERT_TRUE(offset + len <= size);
+            unsigned char *window = (unsigned char*)malloc(len ? len : 1);
+            TEST_ASSERT_NOT_NULL(window);
+            memcpy(window, data + offset, len);
+            deflate_chunk_t from;
+            TEST_ASSERT_EQUAL_INT(0, deflate_chunk_from(window, size, i, &from));
+            TEST_ASSERT_EQUAL_UINT64(chunks[i].len, from.len);
+            TEST_ASSERT_EQUAL_MEMORY(chunks[i].data, from.data, from.len);
+            TEST_ASSERT_EQUAL_UINT32(chunks[i].crc, from.crc);
+            alloc_free(from.data);
+            free(window);
+        }
+        unsigned char *joined = NULL;
+        size_t joined_len = 0;
+        TEST_ASSERT_EQUAL_INT(0, deflate_join(chunks, count, size, &joined, &joined_len));
+        check_gzip(joined, joined_len, data, size);
+        if (count == 1) {
+            TEST_ASSERT_EQUAL_UINT64(gz_len, joined_len);
+            TEST_ASSERT_EQUAL_MEMORY(gz, joined, gz_len);
+        } else {
+            // Within 1%, allowing a few block headers for what shrinks to nothing
+            TEST_ASSERT_TRUE(joined_len <= gz_len + gz_len / 100 + 64 * count);
+        }
+        for (size_t i = 0; i < count; i++) {
+            alloc_free(chunks[i].data);
+        }
+        alloc_free(joined);
+        if (kind == 2) {
+            // Stored blocks add a few bytes per 64 KiB
+            TEST_ASSERT_TRUE(gz_len <= size + 64);
+        } else if (kind == 3 || kind == 4) {
+            TEST_ASSERT_TRUE(gz_len < size / 3);
+        } else if (kind == 5) {
+            TEST_ASSERT_TRUE(gz_len < size);
+        }
+        alloc_free(gz);
+    }
+    free(data);
+}
@@ -0,0 +1,92 @@
+#include "encode.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <stdio.h>
+#include <string.h>
+
+// Reference formatting, identical to the original per-byte fprintf loop
+static size_t reference_encode(char *dst, const unsigned char *src, size_t len, size_t pos) {
+    char *p = dst;
+    for (size_t i = 0; i < len; i++) {
+        p += sprintf(p, "0x%02X,", src[i]);
+        if ((pos + i + 1) % 16 == 0) {
+            *p++ = '\n';
+        }
+    }
+    return (size_t)(p - dst);
+}
+
+// Test that every byte value encodes like "0x%02X,"
+void test_encode_hex_all_values(void) {
+    unsigned char data[256];
+    for (int i = 0; i < 256; i++) {
+        data[i] = (unsigned char)i;
+    }
+
+    static char expected[256 * 6];
+    static char actual[256 * 6];
+    size_t expected_len = reference_encode(expected, data, sizeof(data), 0);
+    size_t actual_len = encode_hex(actual, data, sizeof(data), 0);
+
+    TEST_ASSERT_EQUAL_UINT64(expected_len, actual_len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, actual, expected_len);
+}
+
+// Test that row breaks follow the array offset, not the block start
+void test_encode_hex_offsets(void) {
+    unsigned char data[100];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 37 + 11);
+    }
+
+    char expected[sizeof(data) * 6];
+    char actual[sizeof(data) * 6];
+    for (size_t pos = 0; pos < 40; pos += 3) {
+        for (size_t len = 0; len <= sizeof(data); len += 7) {
+            size_t expected_len = reference_encode(expected, data, len, pos);
+            TEST_ASSERT_EQUAL_UINT64(expected_len, encode_hex_size(pos, len));
+            size_t actual_len = encode_hex(actual, data, len, pos);
+            TEST_ASSERT_EQUAL_UINT64(expected_len, actual_len);
+            if (expected_len > 0) {
+                TEST_ASSERT_EQUAL_MEMORY(expected, actual, expected_len);
+            }
+        }
+    }
+}
+
+// Fuzz every kernel supported by this CPU against the reference formatting,
+// with random data, lengths and starting offsets.
+void test_encode_kernels_fuzz(void) {
+    static unsigned char data[4096];
+    static char expected[sizeof(data) * 6];
+    static char actual[sizeof(data) * 6];
+    unsigned int seed = 12345;
+
+    for (int k = ENCODE_KERNEL_SCALAR; k <= ENCODE_KERNEL_AVX512; k++) {
+        if (!encode_kernel_supported((encode_kernel_t)k)) {
+            printf("[DEBUG] Skipping unsupported kernel: %s\n", encode_kernel_name((encode_kernel_t)k));
+            continue;
+        }
+        TEST_ASSERT_EQUAL_INT(0, encode_set_kernel((encode_kernel_t)k));
+
+        for (int trial = 0; trial < 200; trial++) {
+            seed = seed * 1103515245u + 12345u;
+            size_t len = (seed >> 8) % sizeof(data);
+            seed = seed * 1103515245u + 12345u;
+            size_t pos = (seed >> 8) % 64;
+            for (size_t i = 0; i < len; i++) {
+                seed = seed * 1103515245u + 12345u;
+                data[i] = (unsigned char)(seed >> 16);
+            }
+
+            size_t expected_len = reference_encode(expected, data, len, pos);
+            size_t actual_len = encode_hex(actual, data, len, pos);
+            TEST_ASSERT_EQUAL_UINT64_MESSAGE(expected_len, actual_len, encode_kernel_name((encode_kernel_t)k));
+            if (expected_len > 0) {
+                TEST_ASSERT_EQUAL_MEMORY_MESSAGE(expected, actual, expected_len, encode_kernel_name((encode_kernel_t)k));
+            }
+        }
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, encode_set_kernel(ENCODE_KERNEL_AUTO));
+}
@@ -1,33 +1,39 @@
 #include "file_list.h"
+#include "alloc.h"
 #include "test_shared.h"
 #include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 void test_file_list_init(void) {
     TEST_ASSERT_EQUAL_UINT64(0, list.count);
     TEST_ASSERT_TRUE(list.capacity > 0);
-    TEST_ASSERT_NOT_NULL(list.files);
+    TEST_ASSERT_NOT_NULL(list.offsets);
+    TEST_ASSERT_NOT_NULL(list.sizes);
+    TEST_ASSERT_NOT_NULL(list.flags);
 }
 
 void test_file_list_append_single(void) {
     file_info_t fi;
-    strncpy(fi.path, "testpath", sizeof(fi.path)-1);
-    fi.path[sizeof(fi.path)-1] = '\0';
+    fi.path = "testpath";
     fi.size = 123;
     fi.is_dir = 0;
 
     file_list_append(&list, &fi);
 
     TEST_ASSERT_EQUAL_UINT64(1, list.count);
-    TEST_ASSERT_EQUAL_STRING("testpath", list.files[0].path);
-    TEST_ASSERT_EQUAL_UINT64(123, list.files[0].size);
-    TEST_ASSERT_EQUAL(0, list.files[0].is_dir);
+    TEST_ASSERT_EQUAL_STRING("testpath", file_list_path(&list, 0));
+    TEST_ASSERT_EQUAL_UINT64(123, file_list_size(&list, 0));
+    TEST_ASSERT_EQUAL(0, file_list_is_dir(&list, 0));
 }
 
 void test_file_list_append_multiple(void) {
     for (int i = 0; i < 25; i++) {
         file_info_t fi;
-        snprintf(fi.path, sizeof(fi.path), "file%d", i);
+        char path[32];
+        snprintf(path, sizeof(path), "file%d", i);
+        fi.path = path;
         fi.size = i * 10;
         fi.is_dir = (i % 2 == 0) ? 1 : 0;
         file_list_append(&list, &fi);
@@ -35,25 +41,167 @@ void test_file_list_append_multiple(void) {
 
     TEST_ASSERT_EQUAL_UINT64(25, list.count);
     // Check a few entries
-    TEST_ASSERT_EQUAL_STRING("file0", list.files[0].path);
-    TEST_ASSERT_EQUAL(0, list.files[0].size);
-    TEST_ASSERT_EQUAL(1, list.files[0].is_dir); // Even => is_dir = 1
+    TEST_ASSERT_EQUAL_STRING("file0", file_list_path(&list, 0));
+    TEST_ASSERT_EQUAL(0, file_list_size(&list, 0));
+    TEST_ASSERT_EQUAL(1, file_list_is_dir(&list, 0)); // Even => is_dir = 1
 
-    TEST_ASSERT_EQUAL_STRING("file24", list.files[24].path);
-    TEST_ASSERT_EQUAL(240, list.files[24].size);
-    TEST_ASSERT_EQUAL(1, list.files[24].is_dir); // Even => is_dir = 1
+    TEST_ASSERT_EQUAL_STRING("file24", file_list_path(&list, 24));
+    TEST_ASSERT_EQUAL(240, file_list_size(&list, 24));
+    TEST_ASSERT_EQUAL(1, file_list_is_dir(&list, 24)); // Even => is_dir = 1
 }
 
 void test_file_list_free(void) {
     // Adding a few entries before freeing
     file_info_t fi;
-    strcpy(fi.path, "dummy");
+    fi.path = "dummy";
     fi.size = 100;
     fi.is_dir = 0;
     file_list_append(&list, &fi);
 
     file_list_free(&list);
-    TEST_ASSERT_NULL(list.files);
+    TEST_ASSERT_NULL(list.offsets);
+    TEST_ASSERT_NULL(list.paths.blocks);
     TEST_ASSERT_EQUAL_UINT64(0, list.count);
     TEST_ASSERT_EQUAL_UINT64(0, list.capacity);
 }
+
+// Test that entries keep their paths across many arena blocks, including
+// paths longer than a block
+void test_file_list_arena(void) {
+    static char long_path[FILE_LIST_BLOCK_SIZE + 100];
+    memset(long_path, 'x', sizeof(long_path) - 1);
+    long_path[sizeof(long_path) - 1] = '\0';
+
+    char path[64];
+    for (int i = 0; i < 20000; i++) {
+        file_info_t fi;
+        snprintf(path, sizeof(path), "dir%d/file%d.txt", i / 100, i);
+        fi.path = i == 5000 ? long_path : path;
+        fi.size = (size_t)i;
+        fi.is_dir = 0;
+        file_list_append(&list, &fi);
+    }
+    TEST_ASSERT_EQUAL_UINT64(20000, list.count);
+    TEST_ASSERT_TRUE(list.paths.block_count > 2);
+
+    for (int i = 0; i < 20000; i += 997) {
+        snprintf(path, sizeof(path), "dir%d/file%d.txt", i / 100, i);
+        TEST_ASSERT_EQUAL_STRING(path, file_list_path(&list, (size_t)i));
+        TEST_ASSERT_EQUAL_UINT64((size_t)i, file_list_size(&list, (size_t)i));
+    }
+    TEST_ASSERT_EQUAL_STRING(long_path, file_list_path(&list, 5000));
+
+    file_info_t fi;
+    file_list_get(&list, 19999, &fi);
+    TEST_ASSERT_EQUAL_STRING("dir199/file19999.txt", fi.path);
+    file_list_set_size(&list, 19999, 7);
+    TEST_ASSERT_EQUAL_UINT64(7, file_list_size(&list, 19999));
+}
+
+// Test that front coding gives back every path and takes less memory
+void test_file_list_front_coded(void) {
+    file_list_t coded;
+    file_list_init_front_coded(&coded);
+
+    char path[128];
+    for (int i = 0; i < 5000; i++) {
+        file_info_t fi;
+        snprintf(path, sizeof(path), "www/assets/images/gallery%d/photo_%05d.jpg", i / 300, i);
+        fi.path = path;
+        fi.size = 100;
+        fi.is_dir = 0;
+        file_list_append(&list, &fi);
+        file_list_append(&coded, &fi);
+    }
+    TEST_ASSERT_NULL(file_list_path(&coded, 0));
+    TEST_ASSERT_TRUE(file_list_memory(&coded) < file_list_memory(&list));
+
+    char decoded[128];
+    for (size_t i = 0; i < coded.count; i++) {
+        size_t len = file_list_copy_path(&coded, i, decoded, sizeof(decoded));
+        TEST_ASSERT_EQUAL_STRING(file_list_path(&list, i), decoded);
+        TEST_ASSERT_EQUAL_UINT64(strlen(decoded), len);
+    }
+
+    // A short buffer gets a truncated copy but the full length
+    char small[8];
+    size_t len = file_list_copy_path(&coded, 4999, small, sizeof(small));
+    TEST_ASSERT_EQUAL_UINT64(strlen(file_list_path(&list, 4999)), len);
+    TEST_ASSERT_EQUAL_STRING("www/ass", small);
+
+    file_list_free(&coded);
+}
+
+// Allocator that fails every request once 'left' runs out
+typedef struct {
+    size_t left;
+} failing_alloc_t;
+
+static void* failing_malloc(void *ctx, size_t size) {
+    failing_alloc_t *f = (failing_alloc_t*)ctx;
+    if (f->left == 0) {
+        return NULL;
+    }
+    f->left--;
+    return malloc(size);
+}
+
+static void* failing_realloc(void *ctx, void *ptr, size_t size) {
+    failing_alloc_t *f = (failing_alloc_t*)ctx;
+    if (f->left == 0) {
+        return NULL;
+    }
+    f->left--;
+    return realloc(ptr, size);
+}
+
+static void failing_free(void *ctx, void *ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+// Test that an append that runs out of memory fails, leaves the entries
+// already there intact, and that the list can be appended to again later
+void test_file_list_append_out_of_memory(void) {
+    for (int front_coded = 0; front_coded < 2; front_coded++) {
+        // Each round lets one more allocation through
+        for (size_t budget = 0; budget < 8; budget++) {
+            failing_alloc_t state = { budget };
+            alloc_hooks_t hooks = { failing_malloc, failing_realloc, failing_free, &state };
+            alloc_set_hooks(&hooks);
+            file_list_t files;
+            if (front_coded) {
+                file_list_init_front_coded(&files);
+            } else {
+                file_list_init(&files);
+            }
+            char path[64];
+            size_t appended = 0;
+            for (int i = 0; i < 40; i++) {
+                snprintf(path, sizeof(path), "dir/file_%02d.txt", i);
+                file_info_t fi = { path, (size_t)i, 0 };
+                if (file_list_append(&files, &fi) != 0) {
+                    break;
+                }
+                appended++;
+            }
+            TEST_ASSERT_TRUE(appended < 40);
+            TEST_ASSERT_EQUAL_UINT64(appended, files.count);
+
+            alloc_set_hooks(NULL);
+            snprintf(path, sizeof(path), "dir/file_%02d.txt", (int)appended);
+            file_info_t fi = { path, appended, 0 };
+            TEST_ASSERT_EQUAL_INT(0, file_list_append(&files, &fi));
+            TEST_ASSERT_EQUAL_UINT64(appended + 1, files.count);
+            for (size_t i = 0; i <= appended; i++) {
+                char expected[64];
+                char copy[64];
+                snprintf(expected, sizeof(expected), "dir/file_%02d.txt", (int)i);
+                file_list_copy_path(&files, i, copy, sizeof(copy));
+                TEST_ASSERT_EQUAL_STRING(expected, copy);
+                TEST_ASSERT_EQUAL_UINT64(i, file_list_size(&files, i));
+            }
+            file_list_free(&files);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+// Compiles a generated fsdata.c the way lwIP's fs.c does and checks that
+// fs_lookup finds every file in it and nothing else, and that the
+// precalculated checksums are what the device would compute
+#include <stdio.h>
+#include <string.h>
+#include "lwip/apps/fs.h"
+#include FSDATA_FILE
+
+#if HTTPD_PRECALCULATED_CHECKSUM
+// One's complement sum of host order words, like lwip_standard_chksum
+static u16_t host_chksum(const unsigned char *data, size_t len) {
+    u32_t sum = 0;
+    size_t i = 0;
+    for (; i + 2 <= len; i += 2) {
+        u16_t w;
+        memcpy(&w, data + i, 2);
+        sum += w;
+    }
+    if (i < len) {
+        unsigned char last[2] = { data[i], 0 };
+        u16_t w;
+        memcpy(&w, last, 2);
+        sum += w;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (u16_t)sum;
+}
+
+// The segments cover the response in order and each sum matches
+static int check_chksums(const struct fsdata_file *f) {
+    u32_t offset = 0;
+    for (u16_t k = 0; k < f->chksum_count; k++) {
+        const struct fsdata_chksum *c = &f->chksum[k];
+        if (c->offset != offset || c->len == 0 || c->chksum != host_chksum(f->data + c->offset, c->len)) {
+            return -1;
+        }
+        offset += c->len;
+    }
+    return f->chksum_count > 0 && offset == (u32_t)f->len ? 0 : -1;
+}
+#endif
+
+int main(void) {
+    int failures = 0;
+    int count = 0;
+    char other[512];
+    for (const struct fsdata_file *f = FS_ROOT; f; f = f->next) {
+        const char *name = (const char*)f->name;
+        count++;
+        if (fs_lookup(name) != f) {
+            printf("FAIL: %s not found\n", name);
+            failures++;
+        }
+        if (strncmp((const char*)f->data, "HTTP/1.", 7) != 0 || !(f->flags & FS_FILE_FLAGS_HEADER_INCLUDED)) {
+            printf("FAIL: %s has no header\n", name);
+            failures++;
+        }
+#if HTTPD_PRECALCULATED_CHECKSUM
+        if (check_chksums(f) != 0) {
+            printf("FAIL: %s has wrong checksums\n", name);
+            failures++;
+        }
+#endif
+        // Names that differ by a character at either end are not files
+        snprintf(other, sizeof(other), "%sx", name);
+        if (fs_lookup(other)) {
+            printf("FAIL: %s found\n", other);
+            failures++;
+        }
+        snprintf(other, sizeof(other), "%.*s", (int)strlen(name) - 1, name);
+        if (fs_lookup(other)) {
+            printf("FAIL: %s found\n", other);
+            failures++;
+        }
+    }
+    const char *missing[] = { "", "/", "/missing.html", "file1.txt", "/single_file" };
+    for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+        if (fs_lookup(missing[i])) {
+            printf("FAIL: %s found\n", missing[i]);
+            failures++;
+        }
+    }
+    if (count != FS_NUMFILES || count == 0) {
+        printf("FAIL: %d files listed, %d expected\n", count, FS_NUMFILES);
+        failures++;
+    }
+    printf("%d files, %d failures\n", count, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,377 @@
+#include "generate.h"
+#include "convert.h"
+#include "encode.h"
+#include "deflate.h"
+#include "alloc.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Build the prefix for 'rel' below temp_dir and check the name and alignment
+static size_t make_prefix(generator_t *gen, const char *rel, size_t size, unsigned char *prefix, size_t *offset) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", temp_dir, rel);
+    size_t len = generate_prefix(gen, path, size, prefix, offset);
+    TEST_ASSERT_TRUE(len > 0);
+    TEST_ASSERT_EQUAL_UINT64(0, len % ENCODE_BYTES_PER_ROW);
+    TEST_ASSERT_TRUE(*offset >= strlen(rel) + 2);
+    TEST_ASSERT_EQUAL_STRING_LEN("/", (const char*)prefix, 1);
+    TEST_ASSERT_EQUAL_STRING(rel, (const char*)prefix + 1);
+    prefix[len] = '\0';
+    return len;
+}
+
+// Test the name and HTTP header baked into each array
+void test_generate_prefix(void) {
+    generate_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.input_dir = temp_dir;
+    options.keep_alive = false;
+    generator_t *gen = generate_create(&options);
+    TEST_ASSERT_NOT_NULL(gen);
+
+    unsigned char prefix[PIPELINE_PREFIX_MAX + 1];
+    size_t offset = 0;
+    make_prefix(gen, "subdir/page.html", 123, prefix, &offset);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nContent-Length: 123\r\n"
+                             "Connection: close\r\n\r\n", (const char*)prefix + offset);
+
+    make_prefix(gen, "404.html", 7, prefix, &offset);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.0 404 File not found\r\nContent-Type: text/html\r\nContent-Length: 7\r\n"
+                             "Connection: close\r\n\r\n", (const char*)prefix + offset);
+
+    // SSI files are completed by the httpd, so their length is not known
+    make_prefix(gen, "status.SHTML", 7, prefix, &offset);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n",
+                             (const char*)prefix + offset);
+    generate_destroy(gen);
+
+    options.keep_alive = true;
+    gen = generate_create(&options);
+    TEST_ASSERT_NOT_NULL(gen);
+    make_prefix(gen, "logo.bin", 0, prefix, &offset);
+    TEST_ASSERT_EQUAL_STRING("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 0\r\n"
+                             "Connection: keep-alive\r\n\r\n", (const char*)prefix + offset);
+    generate_destroy(gen);
+}
+
+// Test that every writer bakes the same headers into the arrays, and that
+// the table links the files that were written
+void test_generate_pipeline(void) {
+    char file1[512], nested[512];
+    snprintf(file1, sizeof(file1), "%s/file1.txt", temp_dir);
+    snprintf(nested, sizeof(nested), "%s/subdir/nested.txt", temp_dir);
+    const char *paths[] = { file1, nonexistent_filename, nested, large_filename };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        file_info_t fi;
+        fi.path = paths[i];
+        fi.size = PLATFORM_SIZE_UNKNOWN;
+        fi.is_dir = 0;
+        file_list_append(&list, &fi);
+    }
+
+    generate_options_t generate_options;
+    memset(&generate_options, 0, sizeof(generate_options));
+    generate_options.input_dir = temp_dir;
+    generate_options.keep_alive = false;
+    generator_t *gen = generate_create(&generate_options);
+    TEST_ASSERT_NOT_NULL(gen);
+
+    // The arrays as the converter makes them with each prefix
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(out);
+    unsigned char prefix_buf[PIPELINE_PREFIX_MAX];
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        size_t size = 0;
+        unsigned char *data = convert_read_file_contents(paths[i], &size);
+        if (!data) {
+            continue;
+        }
+        size_t offset = 0;
+        convert_prefix_t prefix;
+        prefix.data = prefix_buf;
+        prefix.len = generate_prefix(gen, paths[i], size, prefix_buf, &offset);
+        prefix.size = size;
+        char var_name[64];
+        convert_var_name(var_name, sizeof(var_name), i);
+        convert_write_c_array(var_name, &prefix, data, size, out);
+        alloc_free(data);
+    }
+    size_t expected_len = 0;
+    const char *data = sink_memory_data(out, &expected_len);
+    char *expected = (char*)malloc(expected_len);
+    memcpy(expected, data, expected_len);
+    sink_close(out);
+    TEST_ASSERT_EQUAL_STRING_LEN("static const unsigned char file_0[] = {\n0x2F,", expected, 45);
+
+    unsigned jobs[] = { 1, 4 };
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        for (int streamed = 0; streamed < 2; streamed++) {
+            pipeline_options_t options;
+            memset(&options, 0, sizeof(options));
+            options.jobs = jobs[j];
+            options.memory_limit = streamed ? pipeline_min_memory(jobs[j]) : 0;
+            options.hooks = generate_hooks(gen);
+            out = sink_memory_create();
+            TEST_ASSERT_NOT_NULL(out);
+            TEST_ASSERT_EQUAL_INT(0, pipeline_run(&list, &options, out));
+            size_t len = 0;
+            data = sink_memory_data(out, &len);
+            TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+            TEST_ASSERT_EQUAL_MEMORY(expected, data, expected_len);
+            sink_close(out);
+        }
+
+        const char *path = "test_generate_positional.c";
+        pipeline_options_t options;
+        memset(&options, 0, sizeof(options));
+        options.jobs = jobs[j];
+        options.hooks = generate_hooks(gen);
+        TEST_ASSERT_EQUAL_INT(0, pipeline_write_file(&list, &options, path));
+        size_t len = 0;
+        unsigned char *written = convert_read_file_contents(path, &len);
+        TEST_ASSERT_NOT_NULL(written);
+        TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, written, expected_len);
+        alloc_free(written);
+        remove(path);
+    }
+    free(expected);
+    generate_destroy(gen);
+
+    // One run's table links its three files in list order
+    gen = generate_create(&generate_options);
+    TEST_ASSERT_NOT_NULL(gen);
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = 1;
+    options.hooks = generate_hooks(gen);
+    out = sink_null_create();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL_INT(0, pipeline_run(&list, &options, out));
+    sink_close(out);
+    TEST_ASSERT_EQUAL_UINT64(3, generate_file_count(gen));
+
+    out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL_INT(0, generate_write_table(gen, out));
+    size_t len = 0;
+    data = sink_memory_data(out, &len);
+    char *table = (char*)malloc(len + 1);
+    memcpy(table, data, len);
+    table[len] = '\0';
+    sink_close(out);
+
+    // "/file1.txt" and its NUL are padded to 13 bytes, so with the 83 byte
+    // header the contents start on a row
+    TEST_ASSERT_NOT_NULL(strstr(table, "#include \"lwip/apps/fs.h\"\n"));
+    TEST_ASSERT_NOT_NULL(strstr(table, "const struct fsdata_file fsdata_file_0[] = { {\nfile_NULL,\nfile_0,\nfile_0 + 13,\n"
+                                       "sizeof(file_0) - 13,\nFS_FILE_FLAGS_HEADER_INCLUDED,\n} };\n"));
+    TEST_ASSERT_NOT_NULL(strstr(table, "fsdata_file_2[] = { {\nfsdata_file_0,\n"));
+    TEST_ASSERT_NOT_NULL(strstr(table, "fsdata_file_3[] = { {\nfsdata_file_2,\n"));
+    TEST_ASSERT_NULL(strstr(table, "fsdata_file_1[]"));
+    TEST_ASSERT_NOT_NULL(strstr(table, "#define FS_ROOT fsdata_file_3\n#define FS_NUMFILES 3\n"));
+    TEST_ASSERT_NOT_NULL(strstr(table, "#define FS_HASH_BUCKETS 2\n"));
+    TEST_ASSERT_NOT_NULL(strstr(table, "const struct fsdata_file *fs_lookup(const char *name)\n{"));
+    free(table);
+    generate_destroy(gen);
+}
+
+// Write 'len' bytes to 'rel' below temp_dir and append it to 'files'
+static void add_file(file_list_t *files, const char *rel, const void *data, size_t len, char *path, size_t path_len) {
+    snprintf(path, path_len, "%s/%s", temp_dir, rel);
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(fp);
+    fwrite(data, 1, len, fp);
+    fclose(fp);
+    file_info_t fi;
+    fi.path = path;
+    fi.size = len;
+    fi.is_dir = 0;
+    file_list_append(files, &fi);
+}
+
+// Test which files generate_compress serves compressed, that the header
+// says so, and that every writer converts the compressed contents alike
+void test_generate_gzip(void) {
+    static unsigned char page[20000];
+    static unsigned char noise[4000];
+    unsigned int seed = 5;
+    for (size_t i = 0; i < sizeof(page); i++) {
+        page[i] = (unsigned char)"<p>hello gzip</p>\n"[i % 18];
+    }
+    for (size_t i = 0; i < sizeof(noise); i++) {
+        seed = seed * 1103515245u + 12345u;
+        noise[i] = (unsigned char)(seed >> 16);
+    }
+    unsigned char *page_gz = NULL;
+    size_t page_gz_len = 0;
+    TEST_ASSERT_EQUAL_INT(0, deflate_gzip(page, sizeof(page), &page_gz, &page_gz_len));
+    // The sibling holds other data, to tell it from a fresh compression
+    unsigned char *app_gz = NULL;
+    size_t app_gz_len = 0;
+    TEST_ASSERT_EQUAL_INT(0, deflate_gzip(page, 1000, &app_gz, &app_gz_len));
+    // A bundle large enough to be compressed in chunks
+    size_t bundle_size = DEFLATE_CHUNK_SIZE * 5 / 2;
+    unsigned char *bundle = (unsigned char*)malloc(bundle_size);
+    TEST_ASSERT_NOT_NULL(bundle);
+    for (size_t i = 0; i < bundle_size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        bundle[i] = (unsigned char)"var x = 1;\n"[(seed >> 16) % 11];
+    }
+    deflate_chunk_t chunks[3];
+    TEST_ASSERT_EQUAL_UINT64(3, deflate_chunk_count(bundle_size));
+    for (size_t i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(0, deflate_chunk(bundle, bundle_size, i, &chunks[i]));
+    }
+    unsigned char *bundle_gz = NULL;
+    size_t bundle_gz_len = 0;
+    TEST_ASSERT_EQUAL_INT(0, deflate_join(chunks, 3, bundle_size, &bundle_gz, &bundle_gz_len));
+    for (size_t i = 0; i < 3; i++) {
+        alloc_free(chunks[i].data);
+    }
+
+    char paths[7][512];
+    file_list_t files;
+    file_list_init(&files);
+    add_file(&files, "page.html", page, sizeof(page), paths[0], sizeof(paths[0]));
+    add_file(&files, "app.js.gz", app_gz, app_gz_len, paths[1], sizeof(paths[1]));
+    add_file(&files, "noise.bin", noise, sizeof(noise), paths[2], sizeof(paths[2]));
+    add_file(&files, "app.js", page, sizeof(page), paths[3], sizeof(paths[3]));
+    add_file(&files, "status.shtml", page, sizeof(page), paths[4], sizeof(paths[4]));
+    add_file(&files, "bundle.js", bundle, bundle_size, paths[5], sizeof(paths[5]));
+
+    generate_options_t generate_options;
+    memset(&generate_options, 0, sizeof(generate_options));
+    generate_options.input_dir = temp_dir;
+    generate_options.gzip = true;
+    generate_options.gzip_min_saving = -1;
+    generator_t *gen = generate_create(&generate_options);
+    TEST_ASSERT_NOT_NULL(gen);
+    file_list_t served;
+    file_list_init(&served);
+    pipeline_options_t compress_options;
+    memset(&compress_options, 0, sizeof(compress_options));
+    compress_options.jobs = 4;
+    TEST_ASSERT_EQUAL_INT(0, generate_compress(gen, &files, &compress_options, &served));
+
+    // The sibling has no entry of its own
+    TEST_ASSERT_EQUAL_UINT64(5, served.count);
+    const pipeline_hooks_t *hooks = generate_hooks(gen);
+    const char *expect_path[] = { paths[0], paths[2], paths[3], paths[4], paths[5] };
+    const unsigned char *expect_data[] = { page_gz, NULL, app_gz, NULL, bundle_gz };
+    size_t expect_size[] = { page_gz_len, sizeof(noise), app_gz_len, sizeof(page), bundle_gz_len };
+    for (size_t i = 0; i < served.count; i++) {
+        TEST_ASSERT_EQUAL_STRING(expect_path[i], file_list_path(&served, i));
+        TEST_ASSERT_EQUAL_UINT64(expect_size[i], file_list_size(&served, i));
+        size_t size = 0;
+        const unsigned char *held = hooks->contents(hooks->ctx, i, expect_path[i], &size);
+        if (!expect_data[i]) {
+            TEST_ASSERT_NULL(held);
+            continue;
+        }
+        TEST_ASSERT_NOT_NULL(held);
+        TEST_ASSERT_EQUAL_UINT64(expect_size[i], size);
+        TEST_ASSERT_EQUAL_MEMORY(expect_data[i], held, size);
+
+        unsigned char prefix[PIPELINE_PREFIX_MAX + 1];
+        size_t len = hooks->prefix(hooks->ctx, i, expect_path[i], size, prefix);
+        TEST_ASSERT_TRUE(len > 0);
+        prefix[len] = '\0';
+        size_t offset = strlen((const char*)prefix) + 1;
+        while (prefix[offset] == '\0') {
+            offset++;
+        }
+        TEST_ASSERT_NOT_NULL(strstr((const char*)prefix + offset, "Content-Encoding: gzip\r\n"));
+    }
+
+    // Stream, chunked and positional writers agree
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(out);
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = 1;
+    options.hooks = hooks;
+    TEST_ASSERT_EQUAL_INT(0, pipeline_run(&served, &options, out));
+    size_t expected_len = 0;
+    const char *data = sink_memory_data(out, &expected_len);
+    char *expected = (char*)malloc(expected_len);
+    memcpy(expected, data, expected_len);
+    sink_close(out);
+    for (int run = 0; run < 3; run++) {
+        memset(&options, 0, sizeof(options));
+        options.jobs = 4;
+        options.memory_limit = run == 1 ? pipeline_min_memory(4) : 0;
+        options.hooks = hooks;
+        size_t len = 0;
+        if (run < 2) {
+            out = sink_memory_create();
+            TEST_ASSERT_EQUAL_INT(0, pipeline_run(&served, &options, out));
+            data = sink_memory_data(out, &len);
+            TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+            TEST_ASSERT_EQUAL_MEMORY(expected, data, expected_len);
+            sink_close(out);
+        } else {
+            const char *path = "test_generate_gzip.c";
+            TEST_ASSERT_EQUAL_INT(0, pipeline_write_file(&served, &options, path));
+            unsigned char *written = convert_read_file_contents(path, &len);
+            TEST_ASSERT_NOT_NULL(written);
+            TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+            TEST_ASSERT_EQUAL_MEMORY(expected, written, expected_len);
+            alloc_free(written);
+            remove(path);
+        }
+    }
+    free(expected);
+    file_list_free(&served);
+    generate_destroy(gen);
+
+    // A limit that only just holds the results runs the work one task at a
+    // time, with the same results; one that cannot hold them fails the run
+    size_t kept = page_gz_len + app_gz_len + bundle_gz_len;
+    for (int tight = 0; tight < 2; tight++) {
+        gen = generate_create(&generate_options);
+        TEST_ASSERT_NOT_NULL(gen);
+        file_list_init(&served);
+        compress_options.memory_limit = tight ? kept - 1 : kept;
+        if (tight) {
+            TEST_ASSERT_NOT_EQUAL(0, generate_compress(gen, &files, &compress_options, &served));
+        } else {
+            TEST_ASSERT_EQUAL_INT(0, generate_compress(gen, &files, &compress_options, &served));
+            hooks = generate_hooks(gen);
+            for (size_t i = 0; i < served.count; i++) {
+                size_t size = 0;
+                const unsigned char *held = hooks->contents(hooks->ctx, i, expect_path[i], &size);
+                TEST_ASSERT_EQUAL_INT(expect_data[i] != NULL, held != NULL);
+                if (held) {
+                    TEST_ASSERT_EQUAL_UINT64(expect_size[i], size);
+                    TEST_ASSERT_EQUAL_MEMORY(expect_data[i], held, size);
+                }
+            }
+        }
+        file_list_free(&served);
+        generate_destroy(gen);
+    }
+
+    // A sibling that is not gzip data fails the run
+    add_file(&files, "page.html.gz", page, 100, paths[6], sizeof(paths[6]));
+    gen = generate_create(&generate_options);
+    TEST_ASSERT_NOT_NULL(gen);
+    file_list_init(&served);
+    compress_options.jobs = 1;
+    compress_options.memory_limit = 0;
+    TEST_ASSERT_NOT_EQUAL(0, generate_compress(gen, &files, &compress_options, &served));
+    file_list_free(&served);
+    generate_destroy(gen);
+
+    for (size_t i = 0; i < 7; i++) {
+        remove(paths[i]);
+    }
+    file_list_free(&files);
+    free(bundle);
+    alloc_free(page_gz);
+    alloc_free(app_gz);
+    alloc_free(bundle_gz);
+}
@@ -138,15 +138,23 @@ void tearDown(void) {
 
 // Forward declarations of test functions from test_platform.c
 void test_directory_ops(void);
+void test_directory_lazy_size(void);
 void test_directory_error(void);
 void test_stat_file(void);
 void test_platform_fopen_read(void);
 void test_platform_fread(void);
 void test_platform_fseek_ftell(void);
+void test_platform_large_offsets(void);
 void test_platform_fopen_nonexistent(void);
 void test_platform_fwrite(void);
 void test_unicode_paths(void);
 void test_error_messages(void);
+void test_platform_input_strategies(void);
+void test_platform_input_auto(void);
+void test_platform_output(void);
+#ifdef PLATFORM_LINUX
+void test_platform_prefetch_file(void);
+#endif
 
 // Forward declarations of test functions from test_config.c
 void test_parse_args_valid(void);
@@ -157,18 +165,33 @@ void test_parse_args_output_no_value(void);
 void test_parse_args_unknown_option(void);
 void test_parse_args_help(void);
 void test_parse_args_no_recursion(void);
+void test_parse_args_io(void);
+void test_parse_args_jobs(void);
+void test_parse_args_max_memory(void);
+void test_parse_args_writer(void);
+void test_parse_args_precalc_chksum(void);
+void test_parse_args_gzip(void);
 
 // Forward declarations of test functions from test_file_list.c
 void test_file_list_init(void);
 void test_file_list_append_single(void);
 void test_file_list_append_multiple(void);
 void test_file_list_free(void);
+void test_file_list_arena(void);
+void test_file_list_front_coded(void);
+void test_file_list_append_out_of_memory(void);
 
 // Forward declarations of test functions from test_scan.c
 void test_scan_empty_dir(void);
 void test_scan_single_file(void);
 void test_scan_subdirs_no_recursion(void);
 void test_scan_subdirs_with_recursion(void);
+void test_scan_start_matches_scan(void);
+void test_scan_start_nonexistent(void);
+void test_scan_parallel_sorted(void);
+#ifndef _WIN32
+void test_scan_deep_path(void);
+#endif
 
 // Forward declarations of test functions from test_convert.c
 void test_convert_read_nonempty(void);
@@ -177,24 +200,85 @@ void test_convert_read_nonexistent(void);
 void test_convert_read_large(void);
 void test_convert_write_c_array_basic(void);
 void test_convert_write_c_array_empty(void);
+void test_convert_write_c_array_rows(void);
+void test_convert_stream_matches_write(void);
+void test_convert_stream_nonexistent(void);
+void test_convert_parallel_matches_write(void);
+void test_convert_prefix(void);
+
+// Forward declarations of test functions from test_encode.c
+void test_encode_hex_all_values(void);
+void test_encode_hex_offsets(void);
+void test_encode_kernels_fuzz(void);
+
+// Forward declarations of test functions from test_batch_read.c
+void test_batch_read_io_uring(void);
+void test_batch_read_sync(void);
+
+// Forward declarations of test functions from test_thread_pool.c
+void test_thread_pool_runs_all_tasks(void);
+
+// Forward declarations of test functions from test_alloc.c
+void test_alloc_hooks(void);
+void test_alloc_arena(void);
+void test_alloc_buffer_pool(void);
+
+// Forward declarations of test functions from test_sink.c
+void test_sink_file(void);
+void test_sink_memory_null(void);
+void test_sink_pipe(void);
 
+// Forward declarations of test functions from test_prefetch.c
+void test_prefetch_depth(void);
+
+// Forward declarations of test functions from test_perfect_hash.c
+void test_perfect_hash_build(void);
+
+// Forward declarations of test functions from test_chksum.c
+void test_chksum_kernels_fuzz(void);
+void test_chksum_segments(void);
+
+// Forward declarations of test functions from test_deflate.c
+void test_deflate_crc32(void);
+void test_deflate_gzip(void);
+
+// Forward declarations of test functions from test_generate.c
+void test_generate_prefix(void);
+void test_generate_pipeline(void);
+void test_generate_gzip(void);
+
+// Forward declarations of test functions from test_pipeline.c
+void test_pipeline_parallel_matches_serial(void);
+void test_pipeline_memory_limit_stats(void);
+void test_pipeline_write_error(void);
+void test_pipeline_feed_matches_list(void);
+void test_pipeline_steady_state_allocations(void);
+void test_pipeline_write_file(void);
 
 int main(void) {
     UNITY_BEGIN();
 
     // Run platform tests
     RUN_TEST(test_directory_ops);
+    RUN_TEST(test_directory_lazy_size);
     RUN_TEST(test_directory_error);
     RUN_TEST(test_stat_file);
     RUN_TEST(test_platform_fopen_read);
     RUN_TEST(test_platform_fread);
     RUN_TEST(test_platform_fseek_ftell);
+    RUN_TEST(test_platform_large_offsets);
     RUN_TEST(test_platform_fopen_nonexistent);
     RUN_TEST(test_platform_fwrite);
 #ifdef _WIN32
     RUN_TEST(test_unicode_paths);
 #endif
     RUN_TEST(test_error_messages);
+    RUN_TEST(test_platform_input_strategies);
+    RUN_TEST(test_platform_input_auto);
+    RUN_TEST(test_platform_output);
+#ifdef PLATFORM_LINUX
+    RUN_TEST(test_platform_prefetch_file);
+#endif
 
     // Run config/argument parsing tests
     RUN_TEST(test_parse_args_valid);
@@ -205,18 +289,33 @@ int main(void) {
     RUN_TEST(test_parse_args_unknown_option);
     RUN_TEST(test_parse_args_help);
     RUN_TEST(test_parse_args_no_recursion);
+    RUN_TEST(test_parse_args_io);
+    RUN_TEST(test_parse_args_jobs);
+    RUN_TEST(test_parse_args_max_memory);
+    RUN_TEST(test_parse_args_writer);
+    RUN_TEST(test_parse_args_precalc_chksum);
+    RUN_TEST(test_parse_args_gzip);
 
     // Run file_list tests
     RUN_TEST(test_file_list_init);
     RUN_TEST(test_file_list_append_single);
     RUN_TEST(test_file_list_append_multiple);
     RUN_TEST(test_file_list_free);
+    RUN_TEST(test_file_list_arena);
+    RUN_TEST(test_file_list_front_coded);
+    RUN_TEST(test_file_list_append_out_of_memory);
 
     // Run scan tests
     RUN_TEST(test_scan_empty_dir);
     RUN_TEST(test_scan_single_file);
     RUN_TEST(test_scan_subdirs_no_recursion);
     RUN_TEST(test_scan_subdirs_with_recursion);
+    RUN_TEST(test_scan_start_matches_scan);
+    RUN_TEST(test_scan_start_nonexistent);
+    RUN_TEST(test_scan_parallel_sorted);
+#ifndef _WIN32
+    RUN_TEST(test_scan_deep_path);
+#endif
 
     // Run convert tests
     RUN_TEST(test_convert_read_nonempty);
@@ -225,6 +324,60 @@ int main(void) {
     RUN_TEST(test_convert_read_large);
     RUN_TEST(test_convert_write_c_array_basic);
     RUN_TEST(test_convert_write_c_array_empty);
+    RUN_TEST(test_convert_write_c_array_rows);
+    RUN_TEST(test_convert_stream_matches_write);
+    RUN_TEST(test_convert_stream_nonexistent);
+    RUN_TEST(test_convert_parallel_matches_write);
+    RUN_TEST(test_convert_prefix);
+
+    // Run encode tests
+    RUN_TEST(test_encode_hex_all_values);
+    RUN_TEST(test_encode_hex_offsets);
+    RUN_TEST(test_encode_kernels_fuzz);
+
+    // Run batch read tests
+    RUN_TEST(test_batch_read_io_uring);
+    RUN_TEST(test_batch_read_sync);
+
+    // Run thread pool tests
+    RUN_TEST(test_thread_pool_runs_all_tasks);
+
+    // Run alloc tests
+    RUN_TEST(test_alloc_hooks);
+    RUN_TEST(test_alloc_arena);
+    RUN_TEST(test_alloc_buffer_pool);
+
+    // Run sink tests
+    RUN_TEST(test_sink_file);
+    RUN_TEST(test_sink_memory_null);
+    RUN_TEST(test_sink_pipe);
+
+    // Run prefetch tests
+    RUN_TEST(test_prefetch_depth);
+
+    // Run perfect hash tests
+    RUN_TEST(test_perfect_hash_build);
+
+    // Run checksum tests
+    RUN_TEST(test_chksum_kernels_fuzz);
+    RUN_TEST(test_chksum_segments);
+
+    // Run deflate tests
+    RUN_TEST(test_deflate_crc32);
+    RUN_TEST(test_deflate_gzip);
+
+    // Run generate tests
+    RUN_TEST(test_generate_prefix);
+    RUN_TEST(test_generate_pipeline);
+    RUN_TEST(test_generate_gzip);
+
+    // Run pipeline tests
+    RUN_TEST(test_pipeline_parallel_matches_serial);
+    RUN_TEST(test_pipeline_memory_limit_stats);
+    RUN_TEST(test_pipeline_write_error);
+    RUN_TEST(test_pipeline_feed_matches_list);
+    RUN_TEST(test_pipeline_steady_state_allocations);
+    RUN_TEST(test_pipeline_write_file);
 
     return UNITY_END();
 }
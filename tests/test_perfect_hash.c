@@ -0,0 +1,54 @@
+#include "perfect_hash.h"
+#include "unity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_KEY_COUNT 2000
+
+// Test that every key of a UI-sized set gets its own slot, and that other
+// names are told apart by the one compare
+void test_perfect_hash_build(void) {
+    char **keys = (char**)malloc(TEST_KEY_COUNT * sizeof(char*));
+    TEST_ASSERT_NOT_NULL(keys);
+    for (size_t i = 0; i < TEST_KEY_COUNT; i++) {
+        keys[i] = (char*)malloc(64);
+        snprintf(keys[i], 64, "/assets/d%u/asset_%u.js", (unsigned)(i % 37), (unsigned)i);
+    }
+
+    perfect_hash_t ph;
+    TEST_ASSERT_EQUAL_INT(0, perfect_hash_build(&ph, (const char *const *)keys, TEST_KEY_COUNT));
+    TEST_ASSERT_EQUAL_UINT64(TEST_KEY_COUNT, ph.count);
+    TEST_ASSERT_EQUAL_UINT64(TEST_KEY_COUNT / PERFECT_HASH_KEYS_PER_BUCKET, ph.buckets);
+
+    unsigned char *seen = (unsigned char*)calloc(TEST_KEY_COUNT, 1);
+    for (size_t i = 0; i < TEST_KEY_COUNT; i++) {
+        size_t slot = perfect_hash_slot(&ph, keys[i]);
+        TEST_ASSERT_TRUE(slot < TEST_KEY_COUNT);
+        TEST_ASSERT_EQUAL_UINT64(i, ph.slots[slot]);
+        TEST_ASSERT_EQUAL_UINT8(0, seen[slot]);
+        seen[slot] = 1;
+    }
+    const char *missing[] = { "", "/", "/assets/d0/asset_0.jsx", "/assets/d1/asset_2000.js" };
+    for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+        size_t slot = perfect_hash_slot(&ph, missing[i]);
+        TEST_ASSERT_TRUE(slot < TEST_KEY_COUNT);
+        TEST_ASSERT_NOT_EQUAL(0, strcmp(missing[i], keys[ph.slots[slot]]));
+    }
+    perfect_hash_free(&ph);
+    free(seen);
+
+    // No hash can separate a duplicate
+    const char *dup[] = { "/a", "/b", "/a" };
+    TEST_ASSERT_NOT_EQUAL(0, perfect_hash_build(&ph, dup, 3));
+    TEST_ASSERT_NULL(ph.displace);
+
+    TEST_ASSERT_EQUAL_INT(0, perfect_hash_build(&ph, NULL, 0));
+    TEST_ASSERT_EQUAL_UINT64(0, ph.count);
+    perfect_hash_free(&ph);
+
+    for (size_t i = 0; i < TEST_KEY_COUNT; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+}
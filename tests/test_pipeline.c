@@ -0,0 +1,335 @@
+#include "pipeline.h"
+#include "alloc.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Read back everything written to 'out' and close it
+static char* read_output(platform_file_handle out, size_t *len_out) {
+    platform_off_t len = platform_ftell(out);
+    platform_fseek(out, 0, SEEK_SET);
+    char *text = (char*)malloc((size_t)len + 1);
+    *len_out = platform_fread(text, 1, (size_t)len, out);
+    text[*len_out] = '\0';
+    platform_fclose(out);
+    return text;
+}
+
+// Copy out everything a memory sink collected and close it
+static char* read_sink(output_sink_t *out, size_t *len_out) {
+    const char *data = sink_memory_data(out, len_out);
+    char *text = (char*)malloc(*len_out + 1);
+    memcpy(text, data, *len_out);
+    text[*len_out] = '\0';
+    sink_close(out);
+    return text;
+}
+
+// Run the pipeline over 'list' and return everything it wrote
+static char* run_pipeline_with(const pipeline_options_t *options, size_t *len_out) {
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL_INT(0, pipeline_run(&list, options, out));
+    return read_sink(out, len_out);
+}
+
+static char* run_pipeline(unsigned jobs, platform_input_strategy strategy, size_t *len_out) {
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = jobs;
+    options.input_strategy = strategy;
+    return run_pipeline_with(&options, len_out);
+}
+
+// Fill the shared list with a mix of test files, including one that is missing
+static void add_test_files(void) {
+    const char *paths[] = {
+        test_filename, large_filename, empty_filename, nonexistent_filename, nonempty_filename,
+        large_filename, test_filename, nonempty_filename, empty_filename
+    };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        file_info_t fi;
+        fi.path = paths[i];
+        platform_file_info info;
+        fi.size = platform_stat_file(paths[i], &info) == 0 ? info.size : 0;
+        fi.is_dir = 0;
+        file_list_append(&list, &fi);
+    }
+}
+
+// Test that parallel runs produce exactly the serial output, in list order
+void test_pipeline_parallel_matches_serial(void) {
+    add_test_files();
+
+    size_t serial_len = 0;
+    char *serial = run_pipeline(1, PLATFORM_INPUT_AUTO, &serial_len);
+    TEST_ASSERT_NOT_NULL(strstr(serial, "static const unsigned char file_0[] = {"));
+    TEST_ASSERT_NULL(strstr(serial, "file_3[]")); // nonexistent file is skipped
+    TEST_ASSERT_NOT_NULL(strstr(serial, "static const unsigned char file_8[] = {"));
+
+    unsigned jobs[] = { 2, 3, 8 };
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        size_t parallel_len = 0;
+        char *parallel = run_pipeline(jobs[j], PLATFORM_INPUT_READ, &parallel_len);
+        TEST_ASSERT_EQUAL_UINT64(serial_len, parallel_len);
+        TEST_ASSERT_EQUAL_MEMORY(serial, parallel, serial_len);
+        free(parallel);
+    }
+
+    // Reading ahead does not change the output
+    for (unsigned j = 1; j <= 3; j += 2) {
+        pipeline_options_t options;
+        memset(&options, 0, sizeof(options));
+        options.jobs = j;
+        options.prefetch = 1;
+        size_t prefetched_len = 0;
+        char *prefetched = run_pipeline_with(&options, &prefetched_len);
+        TEST_ASSERT_EQUAL_UINT64(serial_len, prefetched_len);
+        TEST_ASSERT_EQUAL_MEMORY(serial, prefetched, serial_len);
+        free(prefetched);
+    }
+    free(serial);
+}
+
+// Test that a tight memory limit only changes how files are converted, not
+// the output, and that the per-stage counters add up
+void test_pipeline_memory_limit_stats(void) {
+    add_test_files();
+
+    size_t serial_len = 0;
+    char *serial = run_pipeline(1, PLATFORM_INPUT_AUTO, &serial_len);
+
+    pipeline_stats_t stats;
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = 4;
+    options.memory_limit = pipeline_fixed_memory(4, 0) + 1048576;
+    options.stats = &stats;
+
+    size_t limited_len = 0;
+    char *limited = run_pipeline_with(&options, &limited_len);
+    TEST_ASSERT_EQUAL_UINT64(serial_len, limited_len);
+    TEST_ASSERT_EQUAL_MEMORY(serial, limited, serial_len);
+
+    TEST_ASSERT_EQUAL_UINT64(8, stats.files); // One of the nine is missing
+    TEST_ASSERT_EQUAL_UINT64(serial_len, stats.bytes_out);
+    TEST_ASSERT_EQUAL_UINT(4, stats.encode_threads);
+    TEST_ASSERT_TRUE(stats.wall_seconds > 0);
+    TEST_ASSERT_TRUE(stats.encode_busy > 0);
+    // The small files fit in the budget; the two 1 MiB ones and their text
+    // do not, so they are streamed
+    TEST_ASSERT_EQUAL_UINT64(2, stats.streamed_files);
+    TEST_ASSERT_TRUE(stats.peak_memory > pipeline_fixed_memory(4, 0) && stats.peak_memory <= options.memory_limit);
+    TEST_ASSERT_EQUAL_UINT64(options.memory_limit, stats.memory_limit);
+    pipeline_print_stats(&stats, stdout);
+    free(limited);
+
+    // At the smallest limit the fixed buffers shrink to fit, every file is
+    // streamed, and the fixed buffers are all the run holds
+    options.memory_limit = pipeline_min_memory(4);
+    limited = run_pipeline_with(&options, &limited_len);
+    TEST_ASSERT_EQUAL_UINT64(serial_len, limited_len);
+    TEST_ASSERT_EQUAL_MEMORY(serial, limited, serial_len);
+    TEST_ASSERT_EQUAL_UINT64(8, stats.streamed_files);
+    TEST_ASSERT_EQUAL_UINT64(pipeline_fixed_memory(4, options.memory_limit), stats.peak_memory);
+    TEST_ASSERT_TRUE(stats.peak_memory <= options.memory_limit);
+    free(limited);
+
+    // Below it the run is refused before anything is written
+    options.memory_limit = pipeline_min_memory(4) - 1;
+    output_sink_t *out = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_NOT_EQUAL(0, pipeline_run(&list, &options, out));
+    sink_memory_data(out, &limited_len);
+    TEST_ASSERT_EQUAL_UINT64(0, limited_len);
+    sink_close(out);
+
+    free(serial);
+}
+
+// Sink whose writes all fail, counting how often it is tried
+typedef struct {
+    output_sink_t base;
+    int writes;
+} failing_sink_t;
+
+static int failing_sink_write(output_sink_t *sink, const void *data, size_t len) {
+    (void)data;
+    (void)len;
+    ((failing_sink_t*)sink)->writes++;
+    return -1;
+}
+
+static void failing_sink_destroy(output_sink_t *sink) {
+    (void)sink;
+}
+
+// Test that a failed write ends a parallel run with an error instead of
+// converting the rest of the list for nothing
+void test_pipeline_write_error(void) {
+    for (int copies = 0; copies < 20; copies++) {
+        add_test_files();
+    }
+    static const output_sink_ops_t ops = { failing_sink_write, NULL, failing_sink_destroy };
+    failing_sink_t sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.base.ops = &ops;
+
+    pipeline_stats_t stats;
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = 4;
+    options.stats = &stats;
+    TEST_ASSERT_NOT_EQUAL(0, pipeline_run(&list, &options, &sink.base));
+    TEST_ASSERT_EQUAL_INT(1, sink.writes);
+    TEST_ASSERT_EQUAL_UINT64(0, stats.files);
+}
+
+// Appends the entries of 'list' to a feed one at a time, like a slow scan
+static void feed_producer(void *arg) {
+    file_feed_t *feed = (file_feed_t*)arg;
+    for (size_t i = 0; i < list.count; i++) {
+        file_info_t fi;
+        file_list_get(&list, i, &fi);
+        file_feed_append(feed, &fi);
+    }
+    file_feed_finish(feed, 0);
+}
+
+// Test that converting from a feed while it fills gives the output of the
+// finished list
+void test_pipeline_feed_matches_list(void) {
+    add_test_files();
+
+    size_t expected_len = 0;
+    char *expected = run_pipeline(1, PLATFORM_INPUT_AUTO, &expected_len);
+
+    unsigned jobs[] = { 1, 4 };
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        file_list_t fed;
+        file_list_init(&fed);
+        file_feed_t feed;
+        file_feed_init(&feed, &fed);
+
+        pipeline_options_t options;
+        memset(&options, 0, sizeof(options));
+        options.jobs = jobs[j];
+
+        platform_thread_t producer;
+        TEST_ASSERT_EQUAL_INT(0, platform_thread_create(&producer, feed_producer, &feed));
+        output_sink_t *out = sink_memory_create();
+        TEST_ASSERT_NOT_NULL(out);
+        TEST_ASSERT_EQUAL_INT(0, pipeline_run_feed(&feed, &options, out));
+        platform_thread_join(producer);
+
+        size_t len = 0;
+        char *text = read_sink(out, &len);
+        TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, text, expected_len);
+        free(text);
+        file_feed_destroy(&feed);
+        file_list_free(&fed);
+    }
+    free(expected);
+}
+
+// Allocations made by one run over 'copies' rounds of the small test files
+static unsigned long long count_run_allocations(unsigned jobs, size_t copies) {
+    const char *paths[] = { test_filename, nonempty_filename, empty_filename, large_filename };
+    file_list_t files;
+    file_list_init(&files);
+    for (size_t c = 0; c < copies; c++) {
+        for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+            file_info_t fi;
+            fi.path = paths[i];
+            fi.size = PLATFORM_SIZE_UNKNOWN;
+            fi.is_dir = 0;
+            file_list_append(&files, &fi);
+        }
+    }
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = jobs;
+    output_sink_t *out = sink_null_create();
+    TEST_ASSERT_NOT_NULL(out);
+
+    alloc_counters_t before, after;
+    alloc_get_counters(&before);
+    TEST_ASSERT_EQUAL_INT(0, pipeline_run(&files, &options, out));
+    alloc_get_counters(&after);
+
+    sink_close(out);
+    file_list_free(&files);
+    return (after.allocs - before.allocs) + (after.reallocs - before.reallocs);
+}
+
+// Test that once buffers are warm, converting more files allocates nothing more
+void test_pipeline_steady_state_allocations(void) {
+    TEST_ASSERT_EQUAL_UINT64(count_run_allocations(1, 50), count_run_allocations(1, 100));
+
+    // Task queue growth in the thread pool depends on timing, so allow a
+    // little slack, but far less than one allocation per file
+    unsigned long long base = count_run_allocations(4, 50);
+    unsigned long long doubled = count_run_allocations(4, 100);
+    TEST_ASSERT_TRUE(doubled < base + 20);
+}
+
+// Test that the positional writer produces the streamed output, including
+// for missing files and sizes the scan left out
+void test_pipeline_write_file(void) {
+    add_test_files();
+    size_t expected_len = 0;
+    char *expected = run_pipeline(1, PLATFORM_INPUT_AUTO, &expected_len);
+
+    file_list_t unsized;
+    file_list_init(&unsized);
+    for (size_t i = 0; i < list.count; i++) {
+        file_info_t fi;
+        file_list_get(&list, i, &fi);
+        fi.size = PLATFORM_SIZE_UNKNOWN;
+        file_list_append(&unsized, &fi);
+    }
+
+    const char *path = "test_pipeline_positional.txt";
+    unsigned jobs[] = { 1, 4 };
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        pipeline_stats_t stats;
+        pipeline_options_t options;
+        memset(&options, 0, sizeof(options));
+        options.jobs = jobs[j];
+        options.stats = &stats;
+        TEST_ASSERT_EQUAL_INT(0, pipeline_write_file(&unsized, &options, path));
+        TEST_ASSERT_EQUAL_UINT64(8, stats.files);
+        TEST_ASSERT_EQUAL_UINT64(expected_len, stats.bytes_out);
+
+        platform_file_handle fh = platform_fopen(path, "rb");
+        TEST_ASSERT_NOT_NULL(fh);
+        platform_fseek(fh, 0, SEEK_END);
+        size_t len = 0;
+        char *text = read_output(fh, &len);
+        TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, text, expected_len);
+        free(text);
+    }
+
+    // A size that no longer matches the file makes it rewrite in order
+    file_list_set_size(&unsized, 0, 3);
+    pipeline_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.jobs = 4;
+    TEST_ASSERT_EQUAL_INT(0, pipeline_write_file(&unsized, &options, path));
+    platform_file_handle fh = platform_fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(fh);
+    platform_fseek(fh, 0, SEEK_END);
+    size_t len = 0;
+    char *text = read_output(fh, &len);
+    TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, text, expected_len);
+    free(text);
+
+    remove(path);
+    file_list_free(&unsized);
+    free(expected);
+}
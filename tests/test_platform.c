@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef PLATFORM_LINUX
+#include <unistd.h>
+#endif
 
 
 // Test platform_opendir and related functions
@@ -42,6 +45,37 @@ void test_directory_ops(void) {
     printf("[DEBUG] Closed directory: %s\n", temp_dir);
 }
 
+// Test that readdir leaves out sizes only where a size lookup gives them back
+void test_directory_lazy_size(void) {
+    platform_dir_handle *dh = platform_opendir(temp_dir);
+    TEST_ASSERT_NOT_NULL_MESSAGE(dh, platform_get_last_error());
+
+    platform_file_info info;
+    int entries = 0;
+    while (platform_readdir(dh, &info) == 0) {
+        entries++;
+        if (info.is_dir) {
+            TEST_ASSERT_EQUAL_STRING("subdir", info.name);
+            TEST_ASSERT_EQUAL_UINT64(0, info.size);
+            continue;
+        }
+        TEST_ASSERT_EQUAL_STRING("file1.txt", info.name);
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", temp_dir, info.name);
+        size_t size = 0;
+        TEST_ASSERT_EQUAL_INT_MESSAGE(0, platform_stat_size(path, &size), platform_get_last_error());
+        TEST_ASSERT_EQUAL_UINT64(5, size);
+        TEST_ASSERT_TRUE(info.size == PLATFORM_SIZE_UNKNOWN || info.size == size);
+    }
+    TEST_ASSERT_EQUAL_INT(2, entries);
+    // At most one stat per entry, and none where the listing has the type
+    TEST_ASSERT_TRUE(platform_dir_stat_calls(dh) <= 2);
+    TEST_ASSERT_EQUAL_INT(0, platform_closedir(dh));
+
+    size_t size = 0;
+    TEST_ASSERT_NOT_EQUAL(0, platform_stat_size("no_such_file_abc", &size));
+}
+
 void test_directory_error(void) {
     // Nonexistent directory
     platform_dir_handle *dh = platform_opendir("no_such_dir_12345");
@@ -111,9 +145,45 @@ void test_platform_fseek_ftell(void) {
     TEST_ASSERT_EQUAL_INT_MESSAGE(0, platform_fseek(fh, 0, SEEK_SET), "platform_fseek to start failed.");
     TEST_ASSERT_EQUAL_INT_MESSAGE(0, platform_ftell(fh), "Expected file position to be 0 after seeking to start.");
 
+    // The size comes from the file itself and leaves the position alone
+    platform_off_t size = 0;
+    TEST_ASSERT_EQUAL_INT(0, platform_file_size(fh, &size));
+    TEST_ASSERT_EQUAL_INT64(0, platform_ftell(fh));
+    TEST_ASSERT_EQUAL_INT(0, platform_fseek(fh, 0, SEEK_END));
+    TEST_ASSERT_EQUAL_INT64(size, platform_ftell(fh));
+
     platform_fclose(fh);
 }
 
+// Test offsets past 4 GiB, which need 64-bit seeks even where long is 32 bits
+void test_platform_large_offsets(void) {
+#ifdef _WIN32
+    TEST_IGNORE_MESSAGE("Needs a sparse file");
+#else
+    const char *path = "test_large_offset.bin";
+    const platform_off_t offset = (platform_off_t)5 << 30;
+    platform_file_handle fh = platform_fopen(path, "wb+");
+    TEST_ASSERT_NOT_NULL(fh);
+    if (platform_fseek(fh, offset, SEEK_SET) != 0 || platform_fwrite("x", 1, 1, fh) != 1 || fflush(fh) != 0) {
+        platform_fclose(fh);
+        remove(path);
+        TEST_IGNORE_MESSAGE("Filesystem does not allow a 5 GiB sparse file");
+    }
+    TEST_ASSERT_EQUAL_INT64(offset + 1, platform_ftell(fh));
+
+    platform_off_t size = 0;
+    TEST_ASSERT_EQUAL_INT(0, platform_file_size(fh, &size));
+    TEST_ASSERT_EQUAL_INT64(offset + 1, size);
+
+    TEST_ASSERT_EQUAL_INT(0, platform_fseek(fh, offset, SEEK_SET));
+    char c = 0;
+    TEST_ASSERT_EQUAL_UINT64(1, platform_fread(&c, 1, 1, fh));
+    TEST_ASSERT_EQUAL_INT('x', c);
+    platform_fclose(fh);
+    remove(path);
+#endif
+}
+
 // Test opening a non-existent file
 void test_platform_fopen_nonexistent(void) {
     platform_file_handle fh = platform_fopen("nonexistent_file.txt", "rb");
@@ -167,13 +237,165 @@ void test_unicode_paths(void) {
 }
 #endif
 
+// Fails a call on another thread and keeps the message it saw there
+static void error_thread_main(void *arg) {
+    platform_opendir("no_such_dir_for_error_test");
+    snprintf((char*)arg, 256, "%s", platform_get_last_error());
+}
+
 // Test error setting
 void test_error_messages(void) {
     // Call something with invalid args
     int rc = platform_stat_file(NULL, NULL);
     TEST_ASSERT_NOT_EQUAL_INT(0, rc);
     TEST_ASSERT_NOT_EQUAL('\0', platform_get_last_error()[0]);
+
+    // Each thread keeps its own message
+    char before[256];
+    char other[256] = "";
+    snprintf(before, sizeof(before), "%s", platform_get_last_error());
+    platform_thread_t thread;
+    TEST_ASSERT_EQUAL_INT(0, platform_thread_create(&thread, error_thread_main, other));
+    TEST_ASSERT_EQUAL_INT(0, platform_thread_join(thread));
+    TEST_ASSERT_NOT_EQUAL('\0', other[0]);
+    TEST_ASSERT_NOT_EQUAL(0, strcmp(before, other));
+    TEST_ASSERT_EQUAL_STRING(before, platform_get_last_error());
+}
+
+
+
+
+// Read a whole file through an input backend and check its content
+static void check_input_backend(platform_input *in, const char *path, size_t expected_size, char expected_fill) {
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, platform_input_open(in, path), platform_get_last_error());
+    TEST_ASSERT_EQUAL_UINT64(expected_size, platform_input_size(in));
+
+    size_t total = 0;
+    const unsigned char *block;
+    size_t len;
+    while (platform_input_next(in, &block, &len) == 0 && len > 0) {
+        for (size_t i = 0; i < len; i++) {
+            TEST_ASSERT_EQUAL_INT(expected_fill, block[i]);
+        }
+        total += len;
+    }
+    TEST_ASSERT_EQUAL_UINT64(expected_size, total);
 }
 
+#ifdef PLATFORM_LINUX
+// Test the residency probe only advises files missing from the page cache
+void test_platform_prefetch_file(void) {
+    const char *path = "prefetch_probe.bin";
+    FILE *fp = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(fp);
+    static char block[64 * 1024];
+    memset(block, 'p', sizeof(block));
+    for (int i = 0; i < 16; i++) {
+        fwrite(block, 1, sizeof(block), fp);
+    }
+    // Clean pages can be dropped, dirty ones cannot
+    fflush(fp);
+    fsync(fileno(fp));
+    fclose(fp);
+
+    TEST_ASSERT_EQUAL_INT(0, platform_advise_file(path, 0, PLATFORM_ADVISE_DONTNEED));
+    TEST_ASSERT_EQUAL_INT(1, platform_prefetch_file(path, 0));
+
+    // Once it has been read it is cached and left alone
+    platform_input *in = platform_input_create(PLATFORM_INPUT_READ, 0);
+    TEST_ASSERT_NOT_NULL(in);
+    check_input_backend(in, path, sizeof(block) * 16, 'p');
+    platform_input_close(in);
+    platform_input_destroy(in);
+    TEST_ASSERT_EQUAL_INT(0, platform_prefetch_file(path, 0));
+    TEST_ASSERT_EQUAL_INT(0, platform_prefetch_file(path, 4096));
+
+    TEST_ASSERT_EQUAL_INT(-1, platform_prefetch_file(nonexistent_filename, 0));
+    remove(path);
+}
+#endif
+
+// Test every input backend reads the same bytes, reusing one reader per backend
+void test_platform_input_strategies(void) {
+    for (int s = PLATFORM_INPUT_AUTO; s <= PLATFORM_INPUT_MMAP; s++) {
+        platform_input *in = platform_input_create((platform_input_strategy)s, 4096);
+        TEST_ASSERT_NOT_NULL_MESSAGE(in, platform_get_last_error());
+
+        check_input_backend(in, large_filename, 1048576, 'A');
+        check_input_backend(in, large_filename, 1048576, 'A');
+        platform_input_close(in);
+
+        // Reading can continue from any offset
+        TEST_ASSERT_EQUAL_INT(0, platform_input_open(in, large_filename));
+        TEST_ASSERT_EQUAL_INT(0, platform_input_seek(in, 1048576 - 10));
+        size_t rest = 0;
+        const unsigned char *data;
+        size_t n;
+        while (platform_input_next(in, &data, &n) == 0 && n > 0) {
+            rest += n;
+        }
+        TEST_ASSERT_EQUAL_UINT64(10, rest);
+        platform_input_close(in);
+
+        // Empty files end immediately
+        TEST_ASSERT_EQUAL_INT(0, platform_input_open(in, empty_filename));
+        const unsigned char *block;
+        size_t len = 1;
+        TEST_ASSERT_EQUAL_INT(0, platform_input_next(in, &block, &len));
+        TEST_ASSERT_EQUAL_UINT64(0, len);
+
+        TEST_ASSERT_NOT_EQUAL(0, platform_input_open(in, "nonexistent_file.txt"));
+        platform_input_destroy(in);
+    }
+}
 
+// Test auto selection maps large files and reads small ones
+void test_platform_input_auto(void) {
+    platform_input *in = platform_input_create(PLATFORM_INPUT_AUTO, 0);
+    TEST_ASSERT_NOT_NULL(in);
 
+    TEST_ASSERT_EQUAL_INT(0, platform_input_open(in, large_filename));
+#ifdef _WIN32
+    TEST_ASSERT_EQUAL_INT(PLATFORM_INPUT_STDIO, platform_input_active(in));
+#else
+    TEST_ASSERT_EQUAL_INT(PLATFORM_INPUT_MMAP, platform_input_active(in));
+#endif
+
+    TEST_ASSERT_EQUAL_INT(0, platform_input_open(in, test_filename));
+#ifdef _WIN32
+    TEST_ASSERT_EQUAL_INT(PLATFORM_INPUT_STDIO, platform_input_active(in));
+#else
+    TEST_ASSERT_EQUAL_INT(PLATFORM_INPUT_READ, platform_input_active(in));
+#endif
+
+    platform_input_destroy(in);
+}
+
+// Test that parts written at offsets, mapped or not, make up the whole file
+void test_platform_output(void) {
+    const char *path = "test_output_positional.txt";
+    platform_output *out = platform_output_create(path, 10);
+    TEST_ASSERT_NOT_NULL_MESSAGE(out, platform_get_last_error());
+    unsigned char *map = platform_output_map(out);
+    if (map) {
+        memcpy(map + 5, "world", 5);
+    } else {
+        TEST_ASSERT_EQUAL_INT(0, platform_output_write_at(out, "world", 5, 5));
+    }
+    TEST_ASSERT_EQUAL_INT(0, platform_output_write_at(out, "hello", 5, 0));
+    TEST_ASSERT_EQUAL_INT(0, platform_output_close(out));
+
+    char text[16] = { 0 };
+    platform_file_handle fh = platform_fopen(path, "rb");
+    TEST_ASSERT_NOT_NULL(fh);
+    TEST_ASSERT_EQUAL_UINT64(10, platform_fread(text, 1, sizeof(text), fh));
+    platform_fclose(fh);
+    TEST_ASSERT_EQUAL_STRING("helloworld", text);
+
+    // An empty output is created but never mapped
+    out = platform_output_create(path, 0);
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_NULL(platform_output_map(out));
+    TEST_ASSERT_EQUAL_INT(0, platform_output_close(out));
+    remove(path);
+}
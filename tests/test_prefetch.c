@@ -0,0 +1,56 @@
+#include "prefetch.h"
+#include "platform.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <string.h>
+
+// Test the depth grows on slow reads, decays on fast ones, and that files
+// read fast are only dropped from the cache if the prefetcher brought them in
+void test_prefetch_depth(void) {
+    for (int i = 0; i < 4; i++) {
+        file_info_t fi;
+        fi.path = test_filename;
+        fi.size = PLATFORM_SIZE_UNKNOWN;
+        fi.is_dir = 0;
+        file_list_append(&list, &fi);
+    }
+    file_feed_t feed;
+    file_feed_init(&feed, &list);
+    file_feed_finish(&feed, 0);
+
+    prefetcher_t *pf = prefetcher_create(&feed);
+    TEST_ASSERT_NOT_NULL(pf);
+    TEST_ASSERT_EQUAL_UINT(0, prefetcher_depth(pf));
+
+    // Cached reads leave it idle and nothing is dropped
+    for (int i = 0; i < 4; i++) {
+        prefetcher_advance(pf, 0);
+        prefetcher_done(pf, 0, test_filename, 1000, 1000);
+    }
+    TEST_ASSERT_EQUAL_UINT(0, prefetcher_depth(pf));
+
+    // Each cache miss doubles the depth, up to the maximum
+    unsigned expected = 1;
+    for (int i = 0; i < 10; i++) {
+        prefetcher_done(pf, 0, test_filename, PREFETCH_DROP_MIN_BYTES, (PREFETCH_SLOW_NS + PREFETCH_DROP_MIN_BYTES) * 2ULL);
+        TEST_ASSERT_EQUAL_UINT(expected, prefetcher_depth(pf));
+        expected = expected * 2 > PREFETCH_MAX_DEPTH ? PREFETCH_MAX_DEPTH : expected * 2;
+    }
+    prefetcher_advance(pf, 1);
+
+    // Runs of fast reads halve it again. Files read fast that the prefetcher
+    // did not bring in were cached before, so none of them is dropped even
+    // though the depth is up.
+    for (int i = 0; i < PREFETCH_DECAY_READS; i++) {
+        prefetcher_done(pf, 0, test_filename, i == 0 ? 1000 : PREFETCH_DROP_MIN_BYTES, 1000);
+    }
+    TEST_ASSERT_EQUAL_UINT(PREFETCH_MAX_DEPTH / 2, prefetcher_depth(pf));
+
+    prefetch_stats_t stats;
+    prefetcher_destroy(pf, &stats);
+    file_feed_destroy(&feed);
+    TEST_ASSERT_EQUAL_UINT64(10, stats.slow_reads);
+    TEST_ASSERT_EQUAL_UINT(PREFETCH_MAX_DEPTH, stats.max_depth);
+    TEST_ASSERT_EQUAL_UINT64(10, stats.dropped);
+    TEST_ASSERT_TRUE(stats.advised <= 4); // Never past the end of the feed
+}
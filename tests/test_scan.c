@@ -3,7 +3,12 @@
 #include "config.h"
 #include "file_list.h"
 #include "scan.h"
+#include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 // Test scanning an empty directory
@@ -28,9 +33,11 @@ void test_scan_single_file(void) {
     int result = scan_directory(config.input_dir, &config, &list);
     TEST_ASSERT_EQUAL(0, result);
     TEST_ASSERT_EQUAL_UINT64(1, list.count);
-    TEST_ASSERT_EQUAL_STRING(filePath, list.files[0].path);
-    TEST_ASSERT(list.files[0].size > 0); // file1.txt should have content
-    TEST_ASSERT_EQUAL(0, list.files[0].is_dir);
+    TEST_ASSERT_EQUAL_STRING(filePath, file_list_path(&list, 0));
+    file_info_t fi;
+    file_list_get(&list, 0, &fi);
+    TEST_ASSERT(file_info_size(&fi) > 0); // file1.txt should have content
+    TEST_ASSERT_EQUAL(0, file_list_is_dir(&list, 0));
 }
 
 // Test scanning a directory with subdirectories without recursion
@@ -46,7 +53,7 @@ void test_scan_subdirs_no_recursion(void) {
     // The top-level directory has file2.txt and a subdir named "subdir"
     // Without recursion, we should only see file2.txt
     TEST_ASSERT_EQUAL_UINT64(1, list.count);
-    TEST_ASSERT_EQUAL_STRING(file2Path, list.files[0].path);
+    TEST_ASSERT_EQUAL_STRING(file2Path, file_list_path(&list, 0));
 }
 
 // Test scanning a directory with subdirectories with recursion.
@@ -69,12 +76,148 @@ void test_scan_subdirs_with_recursion(void) {
     int found_file2 = 0;
     int found_file3 = 0;
     for (size_t i = 0; i < list.count; i++) {
-        if (strcmp(list.files[i].path, file2Path) == 0) {
+        if (strcmp(file_list_path(&list, i), file2Path) == 0) {
             found_file2 = 1;
-        } else if (strcmp(list.files[i].path, file3Path) == 0) {
+        } else if (strcmp(file_list_path(&list, i), file3Path) == 0) {
             found_file3 = 1;
         }
     }
     TEST_ASSERT_TRUE(found_file2);
     TEST_ASSERT_TRUE(found_file3);
 }
+
+// Test that a background scan feeds the same files, in the same order
+void test_scan_start_matches_scan(void) {
+    const char *root = TEST_RESOURCES_DIR;
+    snprintf(config.input_dir, sizeof(config.input_dir), "%s/subdirs", root);
+    config.recursive = 1;
+
+    TEST_ASSERT_EQUAL(0, scan_directory(config.input_dir, &config, &list));
+
+    file_list_t fed;
+    file_list_init(&fed);
+    file_feed_t feed;
+    file_feed_init(&feed, &fed);
+    scan_job_t *job = scan_start(config.input_dir, &config, &feed);
+    TEST_ASSERT_NOT_NULL(job);
+
+    // Read while the scan may still be running
+    file_info_t fi;
+    size_t count = 0;
+    while (file_feed_get(&feed, count, &fi) == 0) {
+        TEST_ASSERT_TRUE(count < list.count);
+        TEST_ASSERT_EQUAL_STRING(file_list_path(&list, count), fi.path);
+        TEST_ASSERT_EQUAL_UINT64(file_list_size(&list, count), fi.size);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_UINT64(list.count, count);
+    TEST_ASSERT_EQUAL(0, scan_wait(job, NULL));
+    TEST_ASSERT_EQUAL(0, file_feed_error(&feed));
+
+    file_feed_destroy(&feed);
+    file_list_free(&fed);
+}
+
+// Test that a failed background scan finishes its feed with the error
+void test_scan_start_nonexistent(void) {
+    snprintf(config.input_dir, sizeof(config.input_dir), "%s", nonexistent_filename);
+
+    file_feed_t feed;
+    file_feed_init(&feed, &list);
+    scan_job_t *job = scan_start(config.input_dir, &config, &feed);
+    TEST_ASSERT_NOT_NULL(job);
+
+    file_info_t fi;
+    TEST_ASSERT_NOT_EQUAL(0, file_feed_get(&feed, 0, &fi));
+    TEST_ASSERT_NOT_EQUAL(0, scan_wait(job, NULL));
+    TEST_ASSERT_NOT_EQUAL(0, file_feed_error(&feed));
+    file_feed_destroy(&feed);
+}
+
+// Compare paths component by component: '/' sorts before any other character
+static int path_order(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    int ca = *a == '\0' ? 0 : *a == '/' ? 1 : (unsigned char)*a + 1;
+    int cb = *b == '\0' ? 0 : *b == '/' ? 1 : (unsigned char)*b + 1;
+    return ca - cb;
+}
+
+// Test that a parallel scan lists the same files in sorted order, whatever
+// the number of threads
+void test_scan_parallel_sorted(void) {
+    snprintf(config.input_dir, sizeof(config.input_dir), "%s", TEST_RESOURCES_DIR);
+    config.recursive = 1;
+    config.jobs = 1;
+    TEST_ASSERT_EQUAL(0, scan_directory(config.input_dir, &config, &list));
+    TEST_ASSERT_TRUE(list.count > 2);
+    for (size_t i = 1; i < list.count; i++) {
+        TEST_ASSERT_TRUE(path_order(file_list_path(&list, i - 1), file_list_path(&list, i)) < 0);
+    }
+
+    unsigned jobs[] = { 2, 4, 16 };
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        file_list_t parallel;
+        file_list_init(&parallel);
+        config.jobs = jobs[j];
+        TEST_ASSERT_EQUAL(0, scan_directory(config.input_dir, &config, &parallel));
+        TEST_ASSERT_EQUAL_UINT64(list.count, parallel.count);
+        for (size_t i = 0; i < list.count; i++) {
+            TEST_ASSERT_EQUAL_STRING(file_list_path(&list, i), file_list_path(&parallel, i));
+            TEST_ASSERT_EQUAL_UINT64(file_list_size(&list, i), file_list_size(&parallel, i));
+        }
+        file_list_free(&parallel);
+    }
+}
+
+#ifndef _WIN32
+// Test that paths longer than the old 512-byte limit are listed in full
+void test_scan_deep_path(void) {
+    enum { LEVELS = 14 };
+    char name[61];
+    memset(name, 'd', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    char *path = (char*)malloc(4096);
+    TEST_ASSERT_NOT_NULL(path);
+    snprintf(path, 4096, "%s/deep", temp_dir);
+    snprintf(config.input_dir, sizeof(config.input_dir), "%s", path);
+    TEST_ASSERT_EQUAL_INT(0, mkdir(path, 0700));
+    for (int i = 0; i < LEVELS; i++) {
+        strcat(path, "/");
+        strcat(path, name);
+        TEST_ASSERT_EQUAL_INT(0, mkdir(path, 0700));
+    }
+    strcat(path, "/leaf.txt");
+    FILE *fh = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(fh);
+    fputs("leaf", fh);
+    fclose(fh);
+    TEST_ASSERT_TRUE(strlen(path) > 512);
+
+    config.recursive = 1;
+    unsigned jobs[] = { 1, 4 };
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        file_list_t found;
+        file_list_init(&found);
+        config.jobs = jobs[j];
+        TEST_ASSERT_EQUAL(0, scan_directory(config.input_dir, &config, &found));
+        TEST_ASSERT_EQUAL_UINT64(1, found.count);
+        TEST_ASSERT_EQUAL_STRING(path, file_list_path(&found, 0));
+        file_info_t fi;
+        file_list_get(&found, 0, &fi);
+        TEST_ASSERT_EQUAL_UINT64(4, file_info_size(&fi));
+        file_list_free(&found);
+    }
+
+    // Remove the tree again, deepest first
+    unlink(path);
+    for (int i = 0; i <= LEVELS; i++) {
+        *strrchr(path, '/') = '\0';
+        rmdir(path);
+    }
+    free(path);
+}
+#endif
@@ -0,0 +1,146 @@
+#include "sink.h"
+#include "platform.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Write a known pattern in pieces of varying size, some larger than any buffer
+static void write_pattern(output_sink_t *out, char *expected, size_t *expected_len) {
+    static const size_t pieces[] = { 1, 7, 100, 3, 5000, 64, 12000, 9, 4096, 1 };
+    size_t len = 0;
+    for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+        char *p = expected + len;
+        for (size_t k = 0; k < pieces[i]; k++) {
+            p[k] = (char)('a' + (len + k) % 26);
+        }
+        TEST_ASSERT_EQUAL_INT(0, sink_write(out, p, pieces[i]));
+        len += pieces[i];
+    }
+    *expected_len = len;
+}
+
+// Test that buffered and unbuffered file sinks write exactly what was given
+void test_sink_file(void) {
+    const char *path = "test_sink_output.txt";
+    static char expected[32768];
+    static char actual[32768];
+    size_t buffers[] = { 4096, 0 };
+
+    for (size_t b = 0; b < sizeof(buffers) / sizeof(buffers[0]); b++) {
+        output_sink_t *out = sink_file_create(path, buffers[b]);
+        TEST_ASSERT_NOT_NULL(out);
+        size_t expected_len = 0;
+        write_pattern(out, expected, &expected_len);
+        TEST_ASSERT_EQUAL_UINT64(expected_len, out->bytes);
+        TEST_ASSERT_EQUAL_INT(0, sink_close(out));
+
+        platform_file_handle fh = platform_fopen(path, "rb");
+        TEST_ASSERT_NOT_NULL(fh);
+        size_t len = platform_fread(actual, 1, sizeof(actual), fh);
+        platform_fclose(fh);
+        TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+        TEST_ASSERT_EQUAL_MEMORY(expected, actual, len);
+    }
+    remove(path);
+
+    TEST_ASSERT_NULL(sink_file_create("no_such_dir/out.txt", 0));
+}
+
+// Test the memory sink collects everything and the null sink only counts
+void test_sink_memory_null(void) {
+    static char expected[32768];
+    size_t expected_len = 0;
+
+    output_sink_t *mem = sink_memory_create();
+    TEST_ASSERT_NOT_NULL(mem);
+    write_pattern(mem, expected, &expected_len);
+    size_t len = 0;
+    const char *data = sink_memory_data(mem, &len);
+    TEST_ASSERT_EQUAL_UINT64(expected_len, len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, data, len);
+    TEST_ASSERT_EQUAL_INT(0, sink_close(mem));
+
+    output_sink_t *null = sink_null_create();
+    TEST_ASSERT_NOT_NULL(null);
+    write_pattern(null, expected, &expected_len);
+    TEST_ASSERT_EQUAL_UINT64(expected_len, null->bytes);
+    TEST_ASSERT_EQUAL_INT(0, sink_close(null));
+}
+
+#ifndef _WIN32
+#include <stdio.h>
+#include <unistd.h>
+
+typedef struct {
+    int fd;
+    char *data;
+    size_t len;
+    size_t capacity;
+} pipe_reader_t;
+
+static void drain_pipe(void *arg) {
+    pipe_reader_t *r = (pipe_reader_t*)arg;
+    while (r->len < r->capacity) {
+        ssize_t n = read(r->fd, r->data + r->len, r->capacity - r->len);
+        if (n <= 0) {
+            break;
+        }
+        r->len += (size_t)n;
+    }
+}
+#endif
+
+// Test the pipe sink delivers everything through its double buffers, and is
+// refused for descriptors that are not pipes
+void test_sink_pipe(void) {
+#ifdef _WIN32
+    TEST_IGNORE_MESSAGE("Pipe sink is Linux only");
+#else
+    platform_file_handle fh = platform_fopen("test_sink_output.txt", "wb");
+    TEST_ASSERT_NOT_NULL(fh);
+    TEST_ASSERT_NULL(sink_pipe_create(fileno(fh)));
+    platform_fclose(fh);
+    remove("test_sink_output.txt");
+
+    int fds[2];
+    TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+    output_sink_t *out = sink_pipe_create(fds[1]);
+#ifndef PLATFORM_LINUX
+    TEST_ASSERT_NULL(out);
+    close(fds[0]);
+    close(fds[1]);
+#else
+    TEST_ASSERT_NOT_NULL(out);
+
+    // Several times the pipe size, in pieces that straddle buffer ends
+    size_t total = 5 * SINK_BUFFER_SIZE + 12345;
+    char *expected = (char*)malloc(total);
+    pipe_reader_t reader = { fds[0], (char*)malloc(total), 0, total };
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(reader.data);
+    for (size_t i = 0; i < total; i++) {
+        expected[i] = (char)(i * 7 + i / 4096);
+    }
+    platform_thread_t thread;
+    TEST_ASSERT_EQUAL_INT(0, platform_thread_create(&thread, drain_pipe, &reader));
+    for (size_t pos = 0; pos < total; ) {
+        size_t n = 1 + (pos * 31) % 300000;
+        if (n > total - pos) {
+            n = total - pos;
+        }
+        TEST_ASSERT_EQUAL_INT(0, sink_write(out, expected + pos, n));
+        pos += n;
+    }
+    TEST_ASSERT_EQUAL_INT(0, sink_close(out));
+    close(fds[1]);
+    platform_thread_join(thread);
+    close(fds[0]);
+
+    TEST_ASSERT_EQUAL_UINT64(total, reader.len);
+    TEST_ASSERT_EQUAL_MEMORY(expected, reader.data, total);
+    free(expected);
+    free(reader.data);
+#endif
+#endif
+}
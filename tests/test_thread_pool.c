@@ -0,0 +1,55 @@
+#include "thread_pool.h"
+#include "platform.h"
+#include "unity.h"
+#include "test_shared.h"
+#include <string.h>
+
+#define POOL_TEST_TASKS 1000
+
+typedef struct {
+    platform_mutex_t lock;
+    int runs[POOL_TEST_TASKS];
+    unsigned max_worker;
+} pool_test_state;
+
+typedef struct {
+    pool_test_state *state;
+    int id;
+} pool_test_task;
+
+static void pool_test_run(void *arg, unsigned worker) {
+    pool_test_task *task = (pool_test_task*)arg;
+    platform_mutex_lock(&task->state->lock);
+    task->state->runs[task->id]++;
+    if (worker > task->state->max_worker) {
+        task->state->max_worker = worker;
+    }
+    platform_mutex_unlock(&task->state->lock);
+}
+
+// Test every submitted task runs exactly once on a valid worker
+void test_thread_pool_runs_all_tasks(void) {
+    static pool_test_state state;
+    static pool_test_task tasks[POOL_TEST_TASKS];
+    memset(&state, 0, sizeof(state));
+    platform_mutex_init(&state.lock);
+
+    thread_pool_t *pool = thread_pool_create(4);
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT_EQUAL_UINT(4, thread_pool_size(pool));
+
+    for (int i = 0; i < POOL_TEST_TASKS; i++) {
+        tasks[i].state = &state;
+        tasks[i].id = i;
+        TEST_ASSERT_EQUAL_INT(0, thread_pool_submit(pool, pool_test_run, &tasks[i]));
+    }
+    thread_pool_wait(pool);
+
+    for (int i = 0; i < POOL_TEST_TASKS; i++) {
+        TEST_ASSERT_EQUAL_INT(1, state.runs[i]);
+    }
+    TEST_ASSERT_TRUE(state.max_worker < 4);
+
+    thread_pool_destroy(pool);
+    platform_mutex_destroy(&state.lock);
+}